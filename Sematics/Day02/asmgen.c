@@ -0,0 +1,1093 @@
+/* x86-64 code generator
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "asmgen.h"
+#include "regalloc.h"
+#include "vectorize.h"
+#include "vm.h"
+
+/* The generated code keeps the frames of the KPL stack, allocated by the
+   runtime, and the call chain on the machine stack:
+     %rbp  the current frame; r[x] is 4x(%rbp)
+     %r12  the bottom of the KPL stack; addresses are word indexes from it
+     %r13  the limit no frame may reach
+     %r15  the machine stack pointer to restore when the program halts,
+           below which the display is kept
+   Frames keep the layout of the virtual machine, and so does the display:
+   display[d], the word index of the innermost frame of depth d, is at
+   4d(%r15), a call saves the entry of the depth of the callee in the
+   static link word of the new frame and the return puts it back. A
+   non-local variable is one load from the display away. The dynamic link
+   and the return address live on the machine stack. The slots regalloc.c gives a
+   register are read from the frame where the code is entered, and a
+   subprogram using %rbx or %r14 keeps them on the machine stack. */
+
+struct NativeContext_ {
+  X86* x;
+  RegCode* regCode;
+  int* entries;
+  NativeRuntime* runtime;
+  NativeCalls* calls;
+  RegAllocation* allocation;
+  // The loops of the procedure, in the order of their headers
+  VectorLoop* vectorLoops;
+  int vectorLoopCount;
+  int proc;
+  // Label of each instruction of the procedure, or -1
+  int* labels;
+  int overflow;
+  int divisionByZero;
+  int indexOutOfRange;
+};
+
+typedef struct NativeContext_ NativeContext;
+
+// Condition codes of EQ, NE, GT, LT, GE, LE
+enum X86Condition conditions[6] = {CC_E, CC_NE, CC_G, CC_L, CC_GE, CC_LE};
+enum X86Condition negations[6] = {CC_NE, CC_E, CC_LE, CC_GE, CC_L, CC_G};
+
+// Bytes of the display, kept on the machine stack
+#define DISPLAY_BYTES (4 * MAX_DEPTH)
+
+// What the processor can do, in the word above the display: 0 until a
+// vector loop asks, then 1 for SSE2 only or 2 for AVX2 too
+#define CPU_FEATURES x86Mem(X_R15, DISPLAY_BYTES)
+#define CPU_SSE2 1
+#define CPU_AVX2 2
+
+X86Memory slot(WORD x) {
+  return x86Mem(X_RBP, 4 * x);
+}
+
+int labelOf(NativeContext* ctx, int address) {
+  if (ctx->labels[address] < 0)
+    ctx->labels[address] = x86NewLabel(ctx->x);
+  return ctx->labels[address];
+}
+
+int overflowLabel(NativeContext* ctx) {
+  if (ctx->overflow < 0)
+    ctx->overflow = x86NewLabel(ctx->x);
+  return ctx->overflow;
+}
+
+int divisionByZeroLabel(NativeContext* ctx) {
+  if (ctx->divisionByZero < 0)
+    ctx->divisionByZero = x86NewLabel(ctx->x);
+  return ctx->divisionByZero;
+}
+
+int indexOutOfRangeLabel(NativeContext* ctx) {
+  if (ctx->indexOutOfRange < 0)
+    ctx->indexOutOfRange = x86NewLabel(ctx->x);
+  return ctx->indexOutOfRange;
+}
+
+// Runtime functions are named in text and called by address in place
+#define RUNTIME(ctx, f) (((ctx)->runtime == NULL) ? NULL : (ctx)->runtime->f)
+
+X86Memory displayEntry(int depth) {
+  return x86Mem(X_R15, 4 * depth);
+}
+
+// Word offset of the innermost frame of the given depth, through %rcx
+X86Memory genFrameSlot(X86* x, int depth, int current, WORD offset) {
+  if (depth >= current) return slot(offset);
+  x86MovsxdRM(x, X_RCX, displayEntry(depth));
+  return x86MemIndex(X_R12, X_RCX, 4, 4 * offset);
+}
+
+// Turns the pointer in reg into a word index
+void genWordIndex(X86* x, int reg) {
+  x86AluqRR(x, X86_SUB, reg, X_R12);
+  x86SarqRI(x, reg, 2);
+}
+
+// Jumps to label when the frame pointed to by %rax is past the limit
+void genStackCheck(NativeContext* ctx) {
+  x86AluqRR(ctx->x, X86_CMP, X_RAX, X_R13);
+  x86Jcc(ctx->x, CC_AE, overflowLabel(ctx));
+}
+
+void genHalt(X86* x) {
+  x86MovqRR(x, X_RSP, X_R15);
+  x86AluqRI(x, X86_ADD, X_RSP, 8 + DISPLAY_BYTES);
+  x86Pop(x, X_R15);
+  x86Pop(x, X_R14);
+  x86Pop(x, X_R13);
+  x86Pop(x, X_R12);
+  x86Pop(x, X_RBX);
+  x86Pop(x, X_RBP);
+  x86Ret(x);
+}
+
+// Called from C as void kpl_main(int* stack, int* limit)
+void genEntry(X86* x) {
+  x86Push(x, X_RBP);
+  x86Push(x, X_RBX);
+  x86Push(x, X_R12);
+  x86Push(x, X_R13);
+  x86Push(x, X_R14);
+  x86Push(x, X_R15);
+  // Every KPL frame then runs with the machine stack aligned on 16 bytes
+  x86AluqRI(x, X86_SUB, X_RSP, 8 + DISPLAY_BYTES);
+  x86MovqRR(x, X_R15, X_RSP);
+  x86MovqRR(x, X_R12, X_RDI);
+  x86MovqRR(x, X_R13, X_RSI);
+  x86MovqRR(x, X_RBP, X_RDI);
+  x86MovMI(x, displayEntry(0), 0);
+  x86MovMI(x, CPU_FEATURES, 0);
+}
+
+/* Called from C as
+     void enter(int* stack, int* limit, int frame, void* code, int* display)
+   to run code in the frame at stack + frame, as if it had been called
+   there, with the display of the interpreter. It comes back when the
+   code returns or halts. */
+void genNativeEnter(X86* x) {
+  int copy = x86NewLabel(x);
+
+  genEntry(x);
+  x86MovRI(x, X_R9, 0);
+  x86Bind(x, copy);
+  x86MovRM(x, X_RAX, x86MemIndex(X_R8, X_R9, 4, 0));
+  x86MovMR(x, x86MemIndex(X_R15, X_R9, 4, 0), X_RAX);
+  x86AluRI(x, X86_ADD, X_R9, 1);
+  x86AluRI(x, X86_CMP, X_R9, MAX_DEPTH);
+  x86Jcc(x, CC_L, copy);
+  x86LeaqRM(x, X_RBP, x86MemIndex(X_R12, X_RDX, 4, 0));
+  x86Push(x, X_RBP);
+  x86CallRegister(x, X_RCX);
+  genHalt(x);
+}
+
+void genRuntimeError(NativeContext* ctx, int label, int status) {
+  if (label < 0) return;
+  x86Bind(ctx->x, label);
+  x86MovRI(ctx->x, X_RDI, status);
+  x86CallAbsolute(ctx->x, "kpl_error", RUNTIME(ctx, error));
+}
+
+// The register r[x] is kept in, or X_NONE when it is in its slot
+int registerOf(NativeContext* ctx, WORD x) {
+  if ((x < 0) || (x >= ctx->allocation->slotCount)) return X_NONE;
+  return ctx->allocation->registers[x];
+}
+
+// reg := r[x]
+void genLoadSlot(NativeContext* ctx, int reg, WORD x) {
+  int r = registerOf(ctx, x);
+
+  if (r == X_NONE)
+    x86MovRM(ctx->x, reg, slot(x));
+  else if (r != reg)
+    x86MovRR(ctx->x, reg, r);
+}
+
+// r[x] := reg
+void genStoreSlot(NativeContext* ctx, WORD x, int reg) {
+  int r = registerOf(ctx, x);
+
+  if (r == X_NONE)
+    x86MovMR(ctx->x, slot(x), reg);
+  else if (r != reg)
+    x86MovRR(ctx->x, r, reg);
+}
+
+// A register holding r[x], which is scratch when it has to be loaded
+int genSlotOperand(NativeContext* ctx, WORD x, int scratch) {
+  int r = registerOf(ctx, x);
+
+  if (r != X_NONE) return r;
+  x86MovRM(ctx->x, scratch, slot(x));
+  return scratch;
+}
+
+// reg := reg op r[x]
+void genAluSlot(NativeContext* ctx, enum X86Operation op, int reg, WORD x) {
+  int r = registerOf(ctx, x);
+
+  if (r == X_NONE)
+    x86AluRM(ctx->x, op, reg, slot(x));
+  else x86AluRR(ctx->x, op, reg, r);
+}
+
+/* The register to compute r[a] in from r[b] then r[c], where -1 stands
+   for a constant: that of r[a], unless putting r[b] there loses r[c]. */
+int targetOf(NativeContext* ctx, WORD a, WORD b, WORD c) {
+  int reg = registerOf(ctx, a);
+
+  if ((reg == X_NONE) || ((registerOf(ctx, c) == reg) && (registerOf(ctx, b) != reg))) return X_RAX;
+  return reg;
+}
+
+// Compares r[x] with r[y], or with y
+void genCompare(NativeContext* ctx, WORD x, WORD y, int constant) {
+  int reg = genSlotOperand(ctx, x, X_RAX);
+
+  if (constant)
+    x86AluRI(ctx->x, X86_CMP, reg, y);
+  else genAluSlot(ctx, X86_CMP, reg, y);
+}
+
+// r[a] := r[b] op r[c], or r[b] op c
+void genBinary(NativeContext* ctx, enum X86Operation op, RegInstruction* inst, int constant) {
+  int reg = targetOf(ctx, inst->a, inst->b, constant ? -1 : inst->c);
+
+  genLoadSlot(ctx, reg, inst->b);
+  if (constant)
+    x86AluRI(ctx->x, op, reg, inst->c);
+  else genAluSlot(ctx, op, reg, inst->c);
+  genStoreSlot(ctx, inst->a, reg);
+}
+
+// Leaves the word index r[x] in %rax
+void genIndex(NativeContext* ctx, WORD x) {
+  int r = registerOf(ctx, x);
+
+  if (r == X_NONE)
+    x86MovsxdRM(ctx->x, X_RAX, slot(x));
+  else x86MovsxdRR(ctx->x, X_RAX, r);
+}
+
+/* Writes the registers a call may change back to the slots still live
+   after the call at address, or reads them again. */
+void genCallerSaved(NativeContext* ctx, int address, int save) {
+  RegAllocation* allocation = ctx->allocation;
+  WORD x;
+  int r, k;
+
+  for (k = 0; k < allocation->candidateCount; k ++) {
+    x = allocation->candidates[k];
+    r = allocation->registers[x];
+    if ((r == X_NONE) || isCalleeSaved(r) || !isLiveAt(allocation, address + 1, x)) continue;
+    if (save)
+      x86MovMR(ctx->x, slot(x), r);
+    else x86MovRM(ctx->x, r, slot(x));
+  }
+}
+
+// Reads the slots live at address into their registers
+void genLiveSlots(NativeContext* ctx, int address) {
+  RegAllocation* allocation = ctx->allocation;
+  WORD x;
+  int k;
+
+  for (k = 0; k < allocation->candidateCount; k ++) {
+    x = allocation->candidates[k];
+    if ((allocation->registers[x] != X_NONE) && isLiveAt(allocation, address, x))
+      x86MovRM(ctx->x, allocation->registers[x], slot(x));
+  }
+}
+
+// Whether code entered at address has registers to fill or keep
+int needsPrologue(NativeContext* ctx, int address) {
+  RegAllocation* allocation = ctx->allocation;
+  int k;
+
+  if ((ctx->proc > 0) && allocation->usesCalleeSaved) return 1;
+  for (k = 0; k < allocation->candidateCount; k ++)
+    if ((allocation->registers[allocation->candidates[k]] != X_NONE) &&
+        isLiveAt(allocation, address, allocation->candidates[k]))
+      return 1;
+  return 0;
+}
+
+// What a subprogram does before the instruction at address, when entered there
+void genPrologue(NativeContext* ctx, int address) {
+  if ((ctx->proc > 0) && ctx->allocation->usesCalleeSaved) {
+    x86Push(ctx->x, X_RBX);
+    x86Push(ctx->x, X_R14);
+  }
+  genLiveSlots(ctx, address);
+}
+
+void genCall(NativeContext* ctx, RegInstruction* inst, int depth) {
+  X86* x = ctx->x;
+  char name[32];
+  int callee, position;
+  NativeCall* call;
+
+  // The new frame becomes the display entry of the depth of the callee,
+  // whose previous value goes to its static link word
+  x86LeaqRM(x, X_RAX, slot(inst->a));
+  genStackCheck(ctx);
+  x86MovRM(x, X_RCX, displayEntry(inst->b));
+  x86MovMR(x, x86Mem(X_RAX, 4 * STATIC_LINK_OFFSET), X_RCX);
+  x86MovqRR(x, X_RCX, X_RAX);
+  genWordIndex(x, X_RCX);
+  x86MovMR(x, displayEntry(inst->b), X_RCX);
+  x86Push(x, X_RBP);
+  x86MovqRR(x, X_RBP, X_RAX);
+
+  for (callee = 0; ctx->entries[callee] != inst->c; callee ++);
+  sprintf(name, ".Lproc%d", callee);
+  position = x86CallPatchable(x, name);
+  if (position >= 0) {
+    if (ctx->calls->count >= ctx->calls->maxCount) {
+      ctx->calls->maxCount = (ctx->calls->maxCount == 0) ? 16 : 2 * ctx->calls->maxCount;
+      ctx->calls->calls = (NativeCall*) realloc(ctx->calls->calls, ctx->calls->maxCount * sizeof(NativeCall));
+    }
+    call = ctx->calls->calls + ctx->calls->count ++;
+    call->position = position;
+    call->callee = callee;
+  }
+
+  x86Pop(x, X_RBP);
+}
+
+/* idiv traps on the most negative integer divided by -1, which the
+   machine wraps around to itself: a divisor of -1 negates instead. */
+void genDivision(NativeContext* ctx, RegInstruction* inst) {
+  X86* x = ctx->x;
+  int divide, done;
+
+  if (inst->op == R_KDIV)
+    x86MovRI(x, X_RAX, inst->c);
+  else genLoadSlot(ctx, X_RAX, inst->b);
+  if (inst->op == R_DIVK) {
+    if (inst->c == -1) {
+      x86Neg(x, X_RAX);
+      genStoreSlot(ctx, inst->a, X_RAX);
+      return;
+    }
+    x86MovRI(x, X_RCX, inst->c);
+  } else genLoadSlot(ctx, X_RCX, inst->op == R_DIV ? inst->c : inst->b);
+  x86Test(x, X_RCX, X_RCX);
+  x86Jcc(x, CC_E, divisionByZeroLabel(ctx));
+
+  divide = x86NewLabel(x);
+  done = x86NewLabel(x);
+  if (inst->op != R_DIVK) {
+    x86AluRI(x, X86_CMP, X_RCX, -1);
+    x86Jcc(x, CC_NE, divide);
+    x86Neg(x, X_RAX);
+    x86Jmp(x, done);
+  }
+  x86Bind(x, divide);
+  x86Cltd(x);
+  x86Idiv(x, X_RCX);
+  x86Bind(x, done);
+  genStoreSlot(ctx, inst->a, X_RAX);
+}
+
+void genNativeInstruction(NativeContext* ctx, int address) {
+  X86* x = ctx->x;
+  RegInstruction* inst = ctx->regCode->code + address;
+  int depth = ctx->regCode->depths[address];
+  X86Memory mem;
+  int k, reg;
+
+  switch (inst->op) {
+  case R_MOV:
+    reg = registerOf(ctx, inst->a);
+    if (reg != X_NONE)
+      genLoadSlot(ctx, reg, inst->b);
+    else x86MovMR(x, slot(inst->a), genSlotOperand(ctx, inst->b, X_RAX));
+    break;
+  case R_MOVK:
+    reg = registerOf(ctx, inst->a);
+    if (reg != X_NONE)
+      x86MovRI(x, reg, inst->c);
+    else x86MovMI(x, slot(inst->a), inst->c);
+    break;
+  case R_LEA:
+    x86LeaqRM(x, X_RAX, slot(inst->c));
+    genWordIndex(x, X_RAX);
+    genStoreSlot(ctx, inst->a, X_RAX);
+    break;
+  case R_LEAG:
+    if (inst->b >= depth) {
+      x86LeaqRM(x, X_RCX, slot(inst->c));
+      genWordIndex(x, X_RCX);
+    } else {
+      x86MovsxdRM(x, X_RCX, displayEntry(inst->b));
+      x86AluqRI(x, X86_ADD, X_RCX, inst->c);
+    }
+    genStoreSlot(ctx, inst->a, X_RCX);
+    break;
+  case R_LDG:
+    mem = genFrameSlot(x, inst->b, depth, inst->c);
+    reg = targetOf(ctx, inst->a, -1, -1);
+    x86MovRM(x, reg, mem);
+    genStoreSlot(ctx, inst->a, reg);
+    break;
+  case R_STG:
+    mem = genFrameSlot(x, inst->b, depth, inst->c);
+    x86MovMR(x, mem, genSlotOperand(ctx, inst->a, X_RAX));
+    break;
+  case R_STGK:
+    mem = genFrameSlot(x, inst->b, depth, inst->c);
+    x86MovMI(x, mem, inst->a);
+    break;
+  case R_LDI:
+    genIndex(ctx, inst->b);
+    reg = targetOf(ctx, inst->a, -1, -1);
+    x86MovRM(x, reg, x86MemIndex(X_R12, X_RAX, 4, 0));
+    genStoreSlot(ctx, inst->a, reg);
+    break;
+  case R_STI:
+    genIndex(ctx, inst->a);
+    x86MovMR(x, x86MemIndex(X_R12, X_RAX, 4, 0), genSlotOperand(ctx, inst->b, X_RCX));
+    break;
+  case R_STIK:
+    genIndex(ctx, inst->a);
+    x86MovMI(x, x86MemIndex(X_R12, X_RAX, 4, 0), inst->c);
+    break;
+  case R_COPY:
+    // A string move, which the processor does a cache line at a time;
+    // %rsi may hold a slot
+    genIndex(ctx, inst->a);
+    x86LeaqRM(x, X_RDI, x86MemIndex(X_R12, X_RAX, 4, 0));
+    genIndex(ctx, inst->b);
+    x86Push(x, X_RSI);
+    x86LeaqRM(x, X_RSI, x86MemIndex(X_R12, X_RAX, 4, 0));
+    x86MovRI(x, X_RCX, 4 * inst->c);
+    x86RepMovsb(x);
+    x86Pop(x, X_RSI);
+    break;
+
+  case R_ADD:
+    genBinary(ctx, X86_ADD, inst, 0);
+    break;
+  case R_ADDK:
+    genBinary(ctx, X86_ADD, inst, 1);
+    break;
+  case R_SUB:
+    genBinary(ctx, X86_SUB, inst, 0);
+    break;
+  case R_SUBK:
+    genBinary(ctx, X86_SUB, inst, 1);
+    break;
+  case R_MUL:
+    genBinary(ctx, X86_IMUL, inst, 0);
+    break;
+  case R_MULK:
+    genBinary(ctx, X86_IMUL, inst, 1);
+    break;
+  case R_KSUB:
+    reg = targetOf(ctx, inst->a, -1, inst->b);
+    x86MovRI(x, reg, inst->c);
+    genAluSlot(ctx, X86_SUB, reg, inst->b);
+    genStoreSlot(ctx, inst->a, reg);
+    break;
+  case R_DIV:
+  case R_DIVK:
+  case R_KDIV:
+    genDivision(ctx, inst);
+    break;
+  case R_NEG:
+    reg = targetOf(ctx, inst->a, -1, -1);
+    genLoadSlot(ctx, reg, inst->b);
+    x86Neg(x, reg);
+    genStoreSlot(ctx, inst->a, reg);
+    break;
+
+  case R_EQ: case R_EQK: case R_NE: case R_NEK:
+  case R_GT: case R_GTK: case R_LT: case R_LTK:
+  case R_GE: case R_GEK: case R_LE: case R_LEK:
+    k = inst->op - R_EQ;
+    genCompare(ctx, inst->b, inst->c, k % 2);
+    x86Setcc(x, conditions[k / 2], X_RAX);
+    x86Movzbl(x, X_RAX, X_RAX);
+    genStoreSlot(ctx, inst->a, X_RAX);
+    break;
+
+  case R_J:
+    x86Jmp(x, labelOf(ctx, inst->c));
+    break;
+  case R_FJ:
+    reg = registerOf(ctx, inst->a);
+    if (reg != X_NONE)
+      x86Test(x, reg, reg);
+    else x86AluMI(x, X86_CMP, slot(inst->a), 0);
+    x86Jcc(x, CC_E, labelOf(ctx, inst->c));
+    break;
+  case R_FJEQ: case R_FJEQK: case R_FJNE: case R_FJNEK:
+  case R_FJGT: case R_FJGTK: case R_FJLT: case R_FJLTK:
+  case R_FJGE: case R_FJGEK: case R_FJLE: case R_FJLEK:
+    k = inst->op - R_FJEQ;
+    genCompare(ctx, inst->a, inst->b, k % 2);
+    x86Jcc(x, negations[k / 2], labelOf(ctx, inst->c));
+    break;
+
+  case R_CALL:
+    genCallerSaved(ctx, address, 1);
+    genCall(ctx, inst, depth);
+    genCallerSaved(ctx, address, 0);
+    break;
+  case R_RET:
+    x86MovRM(x, X_RCX, slot(STATIC_LINK_OFFSET));
+    x86MovMR(x, displayEntry(inst->a), X_RCX);
+    if ((ctx->proc > 0) && ctx->allocation->usesCalleeSaved) {
+      x86Pop(x, X_R14);
+      x86Pop(x, X_RBX);
+    }
+    x86Ret(x);
+    break;
+  case R_CHK:
+    x86LeaqRM(x, X_RAX, slot(inst->a));
+    genStackCheck(ctx);
+    break;
+  case R_BOUND:
+    // 1 <= r[a] <= c is r[a] - 1 < c, unsigned
+    genLoadSlot(ctx, X_RAX, inst->a);
+    x86AluRI(x, X86_SUB, X_RAX, 1);
+    x86AluRI(x, X86_CMP, X_RAX, inst->c);
+    x86Jcc(x, CC_AE, indexOutOfRangeLabel(ctx));
+    break;
+  case R_HL:
+    genHalt(x);
+    break;
+
+  case R_RC:
+  case R_RI:
+    genCallerSaved(ctx, address, 1);
+    if (inst->op == R_RC)
+      x86CallAbsolute(x, "kpl_readc", RUNTIME(ctx, readc));
+    else x86CallAbsolute(x, "kpl_readi", RUNTIME(ctx, readi));
+    genCallerSaved(ctx, address, 0);
+    genStoreSlot(ctx, inst->a, X_RAX);
+    break;
+  case R_WRC:
+  case R_WRCK:
+    genCallerSaved(ctx, address, 1);
+    if (inst->op == R_WRC)
+      genLoadSlot(ctx, X_RDI, inst->a);
+    else x86MovRI(x, X_RDI, inst->c);
+    x86CallAbsolute(x, "kpl_writec", RUNTIME(ctx, writec));
+    genCallerSaved(ctx, address, 0);
+    break;
+  case R_WRI:
+  case R_WRIK:
+    genCallerSaved(ctx, address, 1);
+    if (inst->op == R_WRI)
+      genLoadSlot(ctx, X_RDI, inst->a);
+    else x86MovRI(x, X_RDI, inst->c);
+    x86CallAbsolute(x, "kpl_writei", RUNTIME(ctx, writei));
+    genCallerSaved(ctx, address, 0);
+    break;
+  case R_WLN:
+    genCallerSaved(ctx, address, 1);
+    x86CallAbsolute(x, "kpl_writeln", RUNTIME(ctx, writeln));
+    genCallerSaved(ctx, address, 0);
+    break;
+  }
+}
+
+/******************* Vector loops ******************************/
+
+/* A loop vectorize.c accepts gets vector code on the way into its header,
+   which runs as many iterations as fill whole vectors, then leaves the
+   rest to the scalar loop. It first writes the registers back to their
+   slots, and reads everything it needs from the frame. The values that do
+   not change in the loop, and the first values of those that grow with
+   it, are computed once into cells on the machine stack; then the
+   iterations left, whether the indexes fit their bounds and whether the
+   arrays written overlap those read closer than a vector, decide whether
+   the vector loop runs at all. It runs on %ymm registers, 8 lanes at a
+   time, where the processor has AVX2, and on %xmm registers otherwise.
+   The cells are taken from the machine stack and given back before the
+   scalar loop. */
+
+// %rcx counts the iterations done, %rdx those the vector loop runs
+int streamRegisters[MAX_VECTOR_STREAMS] = {X_RSI, X_RDI, X_R8, X_R9, X_R10, X_R11};
+
+#define VECTOR_SCRATCH1 14
+#define VECTOR_SCRATCH2 15
+
+// The cells of the nodes, then the iterations of the vector loop, then
+// all the iterations left, then the first values of one vector
+X86Memory vectorCell(int cell) {
+  return x86Mem(X_RSP, 4 * cell);
+}
+
+int vectorCountCell(VectorLoop* loop) {
+  return loop->nodeCount;
+}
+
+int vectorTripCell(VectorLoop* loop) {
+  return loop->nodeCount + 1;
+}
+
+int vectorLanesCell(VectorLoop* loop) {
+  return loop->nodeCount + 2;
+}
+
+int vectorCellBytes(VectorLoop* loop) {
+  return (4 * (loop->nodeCount + 2 + MAX_VECTOR_LANES) + 15) & ~15;
+}
+
+// The value an affine node has in the first iteration, into its cell
+void genFirstValue(NativeContext* ctx, VectorLoop* loop, int n) {
+  X86* x = ctx->x;
+  VectorNode* node = loop->nodes + n;
+
+  switch (node->kind) {
+  case VN_CONST:
+    x86MovRI(x, X_RAX, node->c);
+    break;
+  case VN_INDUCTION:
+    x86MovRM(x, X_RAX, slot(node->x));
+    break;
+  case VN_FRAME:
+    x86LeaqRM(x, X_RAX, slot(node->c));
+    genWordIndex(x, X_RAX);
+    break;
+  case VN_DISPLAY:
+    x86MovsxdRM(x, X_RAX, displayEntry(node->x));
+    x86AluqRI(x, X86_ADD, X_RAX, node->c);
+    break;
+  case VN_LOAD:
+    x86MovsxdRM(x, X_RAX, vectorCell(node->a));
+    x86MovRM(x, X_RAX, x86MemIndex(X_R12, X_RAX, 4, 0));
+    break;
+  case VN_ADD:
+  case VN_SUB:
+  case VN_MUL:
+    x86MovRM(x, X_RAX, vectorCell(node->a));
+    x86AluRM(x, (node->kind == VN_ADD) ? X86_ADD : (node->kind == VN_SUB) ? X86_SUB : X86_IMUL,
+             X_RAX, vectorCell(node->b));
+    break;
+  case VN_NEG:
+    x86MovRM(x, X_RAX, vectorCell(node->a));
+    x86Neg(x, X_RAX);
+    break;
+  default:
+    return;
+  }
+  x86MovMR(x, vectorCell(n), X_RAX);
+}
+
+/* Asks the processor once whether it and the system have AVX2: CPUID
+   leaf 7 must exist, leaf 1 must show AVX and XSAVE enabled by the
+   system, which must keep the %ymm registers, and leaf 7 must show AVX2. */
+void genCpuFeatures(X86* x) {
+  int known = x86NewLabel(x);
+  int done = x86NewLabel(x);
+
+  x86AluMI(x, X86_CMP, CPU_FEATURES, 0);
+  x86Jcc(x, CC_NE, known);
+  x86Push(x, X_RBX);
+  x86MovRI(x, X_RSI, CPU_SSE2);
+  x86MovRI(x, X_RAX, 0);
+  x86Cpuid(x);
+  x86AluRI(x, X86_CMP, X_RAX, 7);
+  x86Jcc(x, CC_B, done);
+  x86MovRI(x, X_RAX, 1);
+  x86Cpuid(x);
+  x86BtRI(x, X_RCX, 27);
+  x86Jcc(x, CC_AE, done);
+  x86BtRI(x, X_RCX, 28);
+  x86Jcc(x, CC_AE, done);
+  x86MovRI(x, X_RCX, 0);
+  x86Xgetbv(x);
+  x86BtRI(x, X_RAX, 1);
+  x86Jcc(x, CC_AE, done);
+  x86BtRI(x, X_RAX, 2);
+  x86Jcc(x, CC_AE, done);
+  x86MovRI(x, X_RAX, 7);
+  x86MovRI(x, X_RCX, 0);
+  x86Cpuid(x);
+  x86BtRI(x, X_RBX, 5);
+  x86Jcc(x, CC_AE, done);
+  x86MovRI(x, X_RSI, CPU_AVX2);
+  x86Bind(x, done);
+  x86Pop(x, X_RBX);
+  x86MovMR(x, CPU_FEATURES, X_RSI);
+  x86Bind(x, known);
+}
+
+// Jumps to scalar unless 1 <= the value in %rax <= limit
+void genVectorCheck(X86* x, WORD limit, int scalar) {
+  x86AluRI(x, X86_SUB, X_RAX, 1);
+  x86AluRI(x, X86_CMP, X_RAX, limit);
+  x86Jcc(x, CC_AE, scalar);
+}
+
+/* Finds how many iterations the vector loop runs, and jumps to scalar
+   when it runs none, or when it cannot run them: an index out of its
+   bounds in any of them, a stream written closer than a vector to
+   another one, or a value read once for the whole loop that a stream
+   writes. */
+void genVectorGuards(NativeContext* ctx, VectorLoop* loop, int lanes, int scalar) {
+  X86* x = ctx->x;
+  VectorNode* node;
+  int count = vectorCountCell(loop);
+  int s, t, n, k, apart;
+
+  x86MovRM(x, X_RAX, vectorCell(vectorTripCell(loop)));
+  x86AluRI(x, X86_CMP, X_RAX, lanes);
+  x86Jcc(x, CC_L, scalar);
+  x86SarqRI(x, X_RAX, (lanes == 8) ? 3 : 2);
+  x86AluRI(x, X86_IMUL, X_RAX, lanes);
+  x86MovMR(x, vectorCell(count), X_RAX);
+
+  // An index grows or shrinks steadily, so that its first and last values
+  // are its extremes
+  for (k = 0; k < loop->checkCount; k ++) {
+    n = loop->checks[k].node;
+    x86MovRM(x, X_RAX, vectorCell(n));
+    genVectorCheck(x, loop->checks[k].limit, scalar);
+    if (loop->nodes[n].step == 0) continue;
+    x86MovRM(x, X_RAX, vectorCell(count));
+    x86AluRI(x, X86_SUB, X_RAX, 1);
+    x86AluRI(x, X86_IMUL, X_RAX, loop->nodes[n].step);
+    x86AluRM(x, X86_ADD, X_RAX, vectorCell(n));
+    genVectorCheck(x, loop->checks[k].limit, scalar);
+  }
+
+  // Streams the same distance apart in every iteration, 0 or at least a
+  // vector, see their elements in the order the scalar loop does
+  for (s = 0; s < loop->streamCount; s ++) {
+    if (!loop->storedStreams[s]) continue;
+    for (t = 0; t < loop->streamCount; t ++) {
+      if ((t == s) || (loop->storedStreams[t] && (t < s))) continue;
+      apart = x86NewLabel(x);
+      x86MovRM(x, X_RAX, vectorCell(loop->streams[t]));
+      x86AluRM(x, X86_SUB, X_RAX, vectorCell(loop->streams[s]));
+      x86Jcc(x, CC_E, apart);
+      x86AluRI(x, X86_ADD, X_RAX, lanes - 1);
+      x86AluRI(x, X86_CMP, X_RAX, 2 * lanes - 2);
+      x86Jcc(x, CC_BE, scalar);
+      x86Bind(x, apart);
+    }
+    for (n = 0; n < loop->nodeCount; n ++) {
+      node = loop->nodes + n;
+      if ((node->kind != VN_LOAD) || !node->affine) continue;
+      x86MovRM(x, X_RAX, vectorCell(node->a));
+      x86AluRM(x, X86_SUB, X_RAX, vectorCell(loop->streams[s]));
+      x86AluRM(x, X86_CMP, X_RAX, vectorCell(count));
+      x86Jcc(x, CC_B, scalar);
+    }
+  }
+}
+
+// dst := a op b in every lane
+void genVectorOperation(X86* x, int wide, enum VectorNodeKind kind, int dst, int a, int b) {
+  enum X86VectorOperation op = (kind == VN_ADD) ? X86_PADDD : X86_PSUBD;
+
+  if (kind == VN_NEG) {
+    x86VecOp(x, wide, X86_PXOR, dst, dst, dst);
+    x86VecOp(x, wide, X86_PSUBD, dst, dst, a);
+  } else if ((kind == VN_MUL) && wide)
+    x86VecOp(x, wide, X86_PMULLD, dst, a, b);
+  else if (kind == VN_MUL) {
+    // SSE2 only multiplies the even lanes, into 64 bits
+    x86VecMov(x, 0, VECTOR_SCRATCH1, a);
+    x86VecOp(x, 0, X86_PMULUDQ, VECTOR_SCRATCH1, VECTOR_SCRATCH1, b);
+    x86VecMov(x, 0, VECTOR_SCRATCH2, a);
+    x86Psrlq(x, VECTOR_SCRATCH2, 32);
+    x86VecMov(x, 0, dst, b);
+    x86Psrlq(x, dst, 32);
+    x86VecOp(x, 0, X86_PMULUDQ, VECTOR_SCRATCH2, VECTOR_SCRATCH2, dst);
+    x86Pshufd(x, dst, VECTOR_SCRATCH1, 8);
+    x86Pshufd(x, VECTOR_SCRATCH2, VECTOR_SCRATCH2, 8);
+    x86VecOp(x, 0, X86_PUNPCKLDQ, dst, dst, VECTOR_SCRATCH2);
+  } else if (wide)
+    x86VecOp(x, wide, op, dst, a, b);
+  else {
+    x86VecMov(x, 0, dst, a);
+    x86VecOp(x, 0, op, dst, dst, b);
+  }
+}
+
+// The loop on vectors of the given number of lanes, after its guards
+void genVectorPath(NativeContext* ctx, VectorLoop* loop, int lanes, int scalar) {
+  X86* x = ctx->x;
+  int wide = (lanes == 8);
+  int registers[MAX_VECTOR_NODES];
+  int steps[MAX_VECTOR_NODES];
+  VectorNode* node;
+  int next = 0;
+  int body, n, s, k;
+
+  genVectorGuards(ctx, loop, lanes, scalar);
+
+  for (n = 0; n < loop->nodeCount; n ++) {
+    node = loop->nodes + n;
+    registers[n] = steps[n] = -1;
+    if ((node->kind == VN_STORE) || (node->affine && !node->inVector)) continue;
+    registers[n] = next ++;
+    if (node->affine && (node->step != 0)) steps[n] = next ++;
+  }
+
+  for (s = 0; s < loop->streamCount; s ++) {
+    x86MovsxdRM(x, X_RAX, vectorCell(loop->streams[s]));
+    x86LeaqRM(x, streamRegisters[s], x86MemIndex(X_R12, X_RAX, 4, 0));
+  }
+
+  // Values that do not change fill every lane; those that grow start
+  // one step apart from lane to lane, and grow by a vector of steps
+  for (n = 0; n < loop->nodeCount; n ++) {
+    node = loop->nodes + n;
+    if ((registers[n] < 0) || !node->affine) continue;
+    x86MovRM(x, X_RAX, vectorCell(n));
+    if (node->step == 0) {
+      x86VecBroadcast(x, wide, registers[n], X_RAX);
+      continue;
+    }
+    for (k = 0; k < lanes; k ++) {
+      x86MovMR(x, vectorCell(vectorLanesCell(loop) + k), X_RAX);
+      x86AluRI(x, X86_ADD, X_RAX, node->step);
+    }
+    x86VecLoad(x, wide, registers[n], vectorCell(vectorLanesCell(loop)));
+    x86MovRI(x, X_RAX, node->step * lanes);
+    x86VecBroadcast(x, wide, steps[n], X_RAX);
+  }
+
+  x86MovRI(x, X_RCX, 0);
+  x86MovsxdRM(x, X_RDX, vectorCell(vectorCountCell(loop)));
+  body = x86NewLabel(x);
+  x86Bind(x, body);
+  for (n = 0; n < loop->nodeCount; n ++) {
+    node = loop->nodes + n;
+    if (node->kind == VN_STORE)
+      x86VecStore(x, wide, x86MemIndex(streamRegisters[node->stream], X_RCX, 4, 0), registers[node->b]);
+    else if (node->kind == VN_LOAD) {
+      if (!node->affine)
+        x86VecLoad(x, wide, registers[n], x86MemIndex(streamRegisters[node->stream], X_RCX, 4, 0));
+    } else if (!node->affine)
+      genVectorOperation(x, wide, node->kind, registers[n], registers[node->a],
+                         (node->b >= 0) ? registers[node->b] : -1);
+  }
+  for (n = 0; n < loop->nodeCount; n ++)
+    if (steps[n] >= 0)
+      x86VecOp(x, wide, X86_PADDD, registers[n], registers[n], steps[n]);
+  x86AluqRI(x, X86_ADD, X_RCX, lanes);
+  x86AluqRR(x, X86_CMP, X_RCX, X_RDX);
+  x86Jcc(x, CC_L, body);
+  if (wide) x86Vzeroupper(x);
+}
+
+void genVectorLoop(NativeContext* ctx, VectorLoop* loop) {
+  X86* x = ctx->x;
+  RegAllocation* allocation = ctx->allocation;
+  int scalar = x86NewLabel(x);
+  int narrow = x86NewLabel(x);
+  int done = x86NewLabel(x);
+  int bytes = vectorCellBytes(loop);
+  char comment[64];
+  WORD y;
+  int n, k, r;
+
+  sprintf(comment, "vectorized loop, line %d", loop->line);
+  x86Comment(x, comment);
+  for (k = 0; k < allocation->candidateCount; k ++) {
+    y = allocation->candidates[k];
+    r = allocation->registers[y];
+    if ((r != X_NONE) && isLiveAt(allocation, loop->header, y))
+      x86MovMR(x, slot(y), r);
+  }
+  x86AluqRI(x, X86_SUB, X_RSP, bytes);
+
+  for (n = 0; n < loop->nodeCount; n ++)
+    if (loop->nodes[n].affine)
+      genFirstValue(ctx, loop, n);
+  x86MovsxdRM(x, X_RAX, vectorCell(loop->bound));
+  x86MovsxdRM(x, X_RCX, vectorCell(loop->counter));
+  x86AluqRR(x, X86_SUB, X_RAX, X_RCX);
+  if (loop->inclusive) x86AluqRI(x, X86_ADD, X_RAX, 1);
+  x86AluqRI(x, X86_CMP, X_RAX, 4);
+  x86Jcc(x, CC_L, scalar);
+  x86AluqRI(x, X86_CMP, X_RAX, 0x7FFFFFFF);
+  x86Jcc(x, CC_G, scalar);
+  x86MovMR(x, vectorCell(vectorTripCell(loop)), X_RAX);
+
+  if (useAvx2) {
+    genCpuFeatures(x);
+    x86AluMI(x, X86_CMP, CPU_FEATURES, CPU_AVX2);
+    x86Jcc(x, CC_NE, narrow);
+    genVectorPath(ctx, loop, 8, scalar);
+    x86Jmp(x, done);
+  }
+  x86Bind(x, narrow);
+  genVectorPath(ctx, loop, 4, scalar);
+
+  // The scalar loop goes on from the first iteration left
+  x86Bind(x, done);
+  for (k = 0; k < loop->inductionCount; k ++) {
+    x86MovRM(x, X_RAX, vectorCell(vectorCountCell(loop)));
+    x86AluRI(x, X86_IMUL, X_RAX, loop->steps[k]);
+    x86AluRM(x, X86_ADD, X_RAX, slot(loop->inductions[k]));
+    x86MovMR(x, slot(loop->inductions[k]), X_RAX);
+  }
+  // and the variables have their values of the last iteration done
+  for (k = 0; k < loop->variableCount; k ++) {
+    n = loop->finalValues[k];
+    x86MovRM(x, X_RAX, vectorCell(vectorCountCell(loop)));
+    x86AluRI(x, X86_SUB, X_RAX, 1);
+    x86AluRI(x, X86_IMUL, X_RAX, loop->nodes[n].step);
+    x86AluRM(x, X86_ADD, X_RAX, vectorCell(n));
+    x86MovMR(x, slot(loop->variables[k]), X_RAX);
+  }
+  x86Bind(x, scalar);
+  x86AluqRI(x, X86_ADD, X_RSP, bytes);
+  genLiveSlots(ctx, loop->header);
+}
+
+/* Generates the instructions owned by one procedure, in their order in
+   the register code. The program itself is entered from C. The position
+   of every instruction in the machine code goes to positions, if any;
+   jump targets get a way in of their own that fills the registers first,
+   for code entered there. Returns how many slots had to stay in memory
+   for want of a register. */
+int genNativeProcedure(X86* x, RegCode* regCode, int* entries, int* owners, int proc,
+                       NativeRuntime* runtime, NativeCalls* calls, int* positions) {
+  NativeContext ctx;
+  char name[64];
+  int entry = entries[proc];
+  int first, last, spilled, i, k;
+
+  ctx.x = x;
+  ctx.regCode = regCode;
+  ctx.entries = entries;
+  ctx.runtime = runtime;
+  ctx.calls = calls;
+  ctx.allocation = allocateRegisters(regCode, entries, owners, proc);
+  ctx.proc = proc;
+  ctx.labels = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  ctx.overflow = -1;
+  ctx.divisionByZero = -1;
+  ctx.indexOutOfRange = -1;
+  first = ctx.allocation->first;
+  last = ctx.allocation->last;
+  for (i = first; i <= last + 1; i ++)
+    ctx.labels[i] = -1;
+  ctx.vectorLoops = NULL;
+  ctx.vectorLoopCount = 0;
+  if (vectorizeLoops) {
+    ctx.vectorLoops = findVectorLoops(regCode, owners, proc, first, last, &ctx.vectorLoopCount);
+    if (reportVectorization)
+      reportVectorLoops(stderr, ctx.vectorLoops, ctx.vectorLoopCount);
+  }
+
+  x->prefix = proc;
+  if (proc == 0) {
+    x86Symbol(x, "kpl_main", 1);
+    genEntry(x);
+  } else {
+    sprintf(name, ".Lproc%d", proc);
+    x86Symbol(x, name, 0);
+  }
+  sprintf(name, "%d slots in registers, %d spilled",
+          ctx.allocation->allocated, ctx.allocation->spilled);
+  x86Comment(x, name);
+  if (positions != NULL)
+    positions[entry] = x->size;
+  genPrologue(&ctx, entry);
+
+  // Jumps only land on instructions of the same procedure
+  for (i = first; i <= last; i ++)
+    if ((owners[i] == proc) && regOpCodeIsJump(regCode->code[i].op))
+      labelOf(&ctx, regCode->code[i].c);
+
+  k = 0;
+  for (i = first; i <= last; i ++)
+    if (owners[i] == proc) {
+      // Only the way in from before the loop goes through the vector loop
+      for (; (k < ctx.vectorLoopCount) && (ctx.vectorLoops[k].header <= i); k ++)
+        if ((ctx.vectorLoops[k].header == i) && (ctx.vectorLoops[k].reason == NULL))
+          genVectorLoop(&ctx, ctx.vectorLoops + k);
+      if (ctx.labels[i] >= 0)
+        x86Bind(x, ctx.labels[i]);
+      if ((positions != NULL) && (i != entry))
+        positions[i] = x->size;
+      genNativeInstruction(&ctx, i);
+    }
+
+  if (positions != NULL)
+    for (i = first; i <= last; i ++)
+      if ((owners[i] == proc) && (i != entry) && (ctx.labels[i] >= 0) && needsPrologue(&ctx, i)) {
+        positions[i] = x->size;
+        genPrologue(&ctx, i);
+        x86Jmp(x, ctx.labels[i]);
+      }
+
+  genRuntimeError(&ctx, ctx.overflow, RT_STACK_OVERFLOW);
+  genRuntimeError(&ctx, ctx.divisionByZero, RT_DIVISION_BY_ZERO);
+  genRuntimeError(&ctx, ctx.indexOutOfRange, RT_INDEX_OUT_OF_RANGE);
+  spilled = ctx.allocation->spilled;
+  freeRegAllocation(ctx.allocation);
+  free(ctx.vectorLoops);
+  free(ctx.labels);
+  return spilled;
+}
+
+/******************* Assembly file ******************************/
+
+// Names the first instruction of every subprogram declared in scope
+void collectNames(Scope* scope, char** names, RegCode* regCode) {
+  ObjectNode* node;
+  Object* obj;
+  int address;
+
+  for (node = scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_FUNCTION) {
+      address = obj->funcAttrs->codeAddress;
+      collectNames(obj->funcAttrs->scope, names, regCode);
+    } else if (obj->kind == OBJ_PROCEDURE) {
+      address = obj->procAttrs->codeAddress;
+      collectNames(obj->procAttrs->scope, names, regCode);
+    } else continue;
+    if ((address >= 0) && (address < regCode->mapSize))
+      names[regCode->addressMap[address]] = obj->name;
+  }
+}
+
+int generateAssembly(CodeBlock* codeBlock, SymTab* symtab, char* fileName) {
+  RegCode* regCode = translateCode(codeBlock);
+  FILE* f;
+  X86* x;
+  char** names;
+  int* entries;
+  int* owners;
+  int count, i;
+  char comment[64];
+
+  if (regCode == NULL) {
+    printf("kplc: %s\n", vmErrorToString(VM_INVALID_CODE));
+    return 0;
+  }
+
+  f = fopen(fileName, "w");
+  if (f == NULL) {
+    printf("Can\'t write output file %s!\n", fileName);
+    freeRegCode(regCode);
+    return 0;
+  }
+
+  names = (char**) calloc(regCode->codeSize + 1, sizeof(char*));
+  collectNames(symtab->program->progAttrs->scope, names, regCode);
+  entries = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  owners = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  count = findProcedures(regCode, entries, owners);
+
+  x = createTextEmitter(f);
+  sprintf(comment, "PROGRAM %s", symtab->program->name);
+  x86Comment(x, comment);
+  fprintf(f, "\t.text\n");
+  for (i = 0; i < count; i ++) {
+    if ((i > 0) && (names[entries[i]] != NULL)) {
+      sprintf(comment, "%.40s", names[entries[i]]);
+      x86Comment(x, comment);
+    }
+    genNativeProcedure(x, regCode, entries, owners, i, NULL, NULL, NULL);
+  }
+  fprintf(f, "\t.size kpl_main, .-kpl_main\n");
+  fprintf(f, "\t.section .note.GNU-stack,\"\",@progbits\n");
+  fclose(f);
+
+  freeEmitter(x);
+  free(names);
+  free(entries);
+  free(owners);
+  freeRegCode(regCode);
+  return 1;
+}
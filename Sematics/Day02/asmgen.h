@@ -0,0 +1,55 @@
+/* x86-64 code generator
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __ASMGEN_H__
+#define __ASMGEN_H__
+
+#include "symtab.h"
+#include "instructions.h"
+#include "regcode.h"
+#include "x86.h"
+
+#define RT_STACK_OVERFLOW 1
+#define RT_DIVISION_BY_ZERO 2
+#define RT_INDEX_OUT_OF_RANGE 4
+
+// Where the runtime functions are, when the code is run in place
+struct NativeRuntime_ {
+  void* readc;
+  void* readi;
+  void* writec;
+  void* writei;
+  void* writeln;
+  void* error;
+};
+
+typedef struct NativeRuntime_ NativeRuntime;
+
+// A call to a subprogram whose code is not placed yet
+struct NativeCall_ {
+  int position;
+  int callee;
+};
+
+typedef struct NativeCall_ NativeCall;
+
+struct NativeCalls_ {
+  NativeCall* calls;
+  int count;
+  int maxCount;
+};
+
+typedef struct NativeCalls_ NativeCalls;
+
+int genNativeProcedure(X86* x, RegCode* regCode, int* entries, int* owners, int proc,
+                       NativeRuntime* runtime, NativeCalls* calls, int* positions);
+void genNativeEnter(X86* x);
+
+void collectNames(Scope* scope, char** names, RegCode* regCode);
+
+int generateAssembly(CodeBlock* codeBlock, SymTab* symtab, char* fileName);
+
+#endif
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Compares switch dispatch with direct threaded dispatch in kplvm on the
+# recursion heavy programs of this directory. Run from Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+RUNS=${RUNS:-3}
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+printf "%-12s %10s %10s %8s\n" program switch threaded speedup
+for src in $DIR/fib.kpl $DIR/hanoi.kpl $DIR/ackermann.kpl; do
+  name=`basename $src .kpl`
+  code=/tmp/$name.$$.kplb
+  $KPLC $src $code > /dev/null || exit 1
+  ts=`best $KPLVM -switch $code`
+  tt=`best $KPLVM $code`
+  awk -v n=$name -v s=$ts -v t=$tt 'BEGIN { printf "%-12s %10.3f %10.3f %7.2fx\n", n, s, t, s / t }'
+  rm -f $code
+done
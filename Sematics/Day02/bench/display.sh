@@ -0,0 +1,42 @@
+#!/bin/sh
+# Times nested.kpl, whose innermost procedure reaches the variables of
+# the four procedures around it in a loop, on every engine: kplvm with
+# each encoding, the code of kplc --run --jit, and the executables of
+# kplc -S and kplc --elf. Best wall time of RUNS runs. Run from
+# Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+RUNS=${RUNS:-3}
+TMP=/tmp/kpldisplay.$$
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null || exit 1
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+mkdir -p $TMP
+src=$DIR/nested.kpl
+$KPLC $src $TMP/nested.kplb > /dev/null &&
+  $KPLC $src $TMP/nested.s -S > /dev/null && gcc -o $TMP/nested $TMP/nested.s kplrt.o &&
+  $KPLC $src $TMP/nested.elf --elf > /dev/null || exit 1
+printf "%-8s %10s %10s %10s %10s %10s\n" program kplvm "kplvm -reg" --jit -S --elf
+awk -v v=`best $KPLVM $TMP/nested.kplb` -v r=`best $KPLVM -reg $TMP/nested.kplb` \
+    -v j=`best $KPLC $src --run --jit` -v s=`best $TMP/nested` -v e=`best $TMP/nested.elf` \
+  'BEGIN { printf "%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", "nested", v, r, j, s, e }'
+rm -rf $TMP
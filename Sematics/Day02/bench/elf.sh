@@ -0,0 +1,76 @@
+#!/bin/sh
+# Compares the time from source to executable of kplc --elf with that of
+# kplc -S followed by gcc, which runs the assembler and the linker, on a
+# generated program of LINES lines and on the programs of this
+# directory. Run from Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+LINES=${LINES:-10000}
+RUNS=${RUNS:-3}
+TMP=/tmp/kplelf.$$
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null || exit 1
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+# Procedures of ten lines each, all called by the program
+generate() {
+  awk -v n=`expr $LINES / 10` 'BEGIN {
+    print "Program Large;"
+    print "Var s : Integer;"
+    for (i = 1; i <= n; i ++) {
+      print "Procedure P" i "(k : Integer);"
+      print "Var j : Integer; t : Integer;"
+      print "Begin"
+      print "  t := 0;"
+      print "  For j := 1 To k Do"
+      print "    If j / 2 * 2 = j Then t := t + j * " i
+      print "    Else t := t - j;"
+      print "  s := s + t / " i ";"
+      print "  Call WriteI(s); Call WriteLn"
+      print "End;"
+    }
+    print "Begin"
+    print "  s := 0;"
+    for (i = 1; i <= n; i ++) print "  Call P" i "(" i % 7 ");"
+    print "  Call WriteI(s)"
+    print "End."
+  }'
+}
+
+# Source to executable with gcc and kplrt.o
+gnu() {
+  $KPLC $1 $2.s -S && gcc -o $2 $2.s kplrt.o
+}
+
+mkdir -p $TMP
+generate > $TMP/large.kpl
+printf "%-12s %8s %10s %10s %8s\n" program lines "-S + gcc" --elf speedup
+for src in $TMP/large.kpl $DIR/*.kpl; do
+  name=`basename $src .kpl`
+  lines=`wc -l < $src`
+  tg=`best gnu $src $TMP/$name.gnu`
+  te=`best $KPLC $src $TMP/$name --elf`
+  $TMP/$name.gnu > $TMP/$name.expected
+  $TMP/$name > $TMP/$name.out
+  cmp -s $TMP/$name.expected $TMP/$name.out || echo "$name: the executables differ"
+  awk -v n=$name -v l=$lines -v g=$tg -v e=$te \
+    'BEGIN { printf "%-12s %8d %10.3f %10.3f %7.2fx\n", n, l, g, e, g / e }'
+done
+rm -rf $TMP
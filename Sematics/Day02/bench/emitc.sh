@@ -0,0 +1,49 @@
+#!/bin/sh
+# Compares kplvm with the C of kplc --emit-c, compiled by gcc -O2, on the
+# programs of test/ and of this directory: the best wall time of each and
+# the speedup. A program reads NAME.in when it exists. Run from
+# Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+CC=${CC:-gcc}
+RUNS=${RUNS:-3}
+TMP=/tmp/kplemitc.$$
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command, reading input
+best() {
+  input=$1
+  shift
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" < $input > /dev/null
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+mkdir -p $TMP
+printf "%-12s %10s %10s %8s\n" program kplvm C speedup
+for src in $DIR/../test/*.kpl $DIR/*.kpl; do
+  name=`basename $src .kpl`
+  input=`dirname $src`/$name.in
+  [ -f $input ] || input=/dev/null
+  $KPLC $src $TMP/$name.kplb > /dev/null || exit 1
+  $KPLC $src $TMP/$name.c --emit-c > /dev/null || exit 1
+  $CC -O2 -o $TMP/$name $TMP/$name.c || exit 1
+  tv=`best $input $KPLVM $TMP/$name.kplb`
+  tc=`best $input $TMP/$name`
+  awk -v n=$name -v v=$tv -v c=$tc \
+    'BEGIN { printf "%-12s %10.3f %10.3f %7.2fx\n", n, v, c, v / c }'
+done
+rm -rf $TMP
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compares the stack encoding with the register encoding of kplvm on the
+# programs of this directory: dispatches per statement, counted by
+# kplvm -count, and the best wall time of threaded dispatch. Run from
+# Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+RUNS=${RUNS:-3}
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+# Dispatches per statement as reported on the last line of kplvm -count
+perStatement() {
+  "$@" 2>&1 > /dev/null | awk '/per statement/ { print $(NF-3) }'
+}
+
+printf "%-12s %12s %12s %10s %10s %8s\n" program "stack d/s" "reg d/s" stack register speedup
+for src in $DIR/fib.kpl $DIR/hanoi.kpl $DIR/ackermann.kpl; do
+  name=`basename $src .kpl`
+  code=/tmp/$name.$$.kplb
+  $KPLC $src $code > /dev/null || exit 1
+  ds=`perStatement $KPLVM -count $code`
+  dr=`perStatement $KPLVM -reg -count $code`
+  ts=`best $KPLVM $code`
+  tr=`best $KPLVM -reg $code`
+  awk -v n=$name -v ds=$ds -v dr=$dr -v s=$ts -v t=$tr \
+    'BEGIN { printf "%-12s %12.2f %12.2f %10.3f %10.3f %7.2fx\n", n, ds, dr, s, t, s / t }'
+  rm -f $code
+done
@@ -0,0 +1,75 @@
+#!/bin/sh
+# Times the input and output of every backend: a program that writes an
+# N by N table with WRITEI, WRITEC and WRITELN, and one that reads it
+# back with READI and writes the sum. Best wall time of RUNS runs, the
+# output going to a file. Run from Sematics/Day02:
+#   make bench
+
+KPLC=./kplc
+KPLVM=./kplvm
+N=${N:-2000}
+RUNS=${RUNS:-3}
+TMP=/tmp/kplio.$$
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command, reading input
+best() {
+  input=$1
+  shift
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" < $input > $TMP/out || exit 1
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+mkdir -p $TMP
+cat > $TMP/write.kpl <<END
+Program Write;
+Var i : Integer; j : Integer;
+Begin
+  For i := 1 To $N Do
+    Begin
+      For j := 1 To $N Do
+        Begin Call WriteI(i * j - 1000); Call WriteC(' ') End;
+      Call WriteLn
+    End
+End.
+END
+cat > $TMP/read.kpl <<END
+Program Read;
+Var i : Integer; s : Integer;
+Begin
+  s := 0;
+  For i := 1 To $N * $N Do s := s + ReadI;
+  Call WriteI(s); Call WriteLn
+End.
+END
+
+printf "%-8s %10s %10s %10s %10s %10s\n" program kplvm "kplvm -reg" "-S" "--emit-c" "--elf"
+for name in write read; do
+  src=$TMP/$name.kpl
+  input=/dev/null
+  [ $name = read ] && input=$TMP/write.txt
+  $KPLC $src $TMP/$name.kplb > /dev/null &&
+    $KPLC $src $TMP/$name.s -S > /dev/null && gcc -o $TMP/$name.native $TMP/$name.s kplrt.o &&
+    $KPLC $src $TMP/$name.c --emit-c > /dev/null && gcc -O2 -o $TMP/$name.c.exe $TMP/$name.c &&
+    $KPLC $src $TMP/$name.elf --elf > /dev/null || exit 1
+  [ $name = write ] && $KPLVM $TMP/write.kplb > $TMP/write.txt
+  tv=`best $input $KPLVM $TMP/$name.kplb`
+  tr=`best $input $KPLVM -reg $TMP/$name.kplb`
+  tn=`best $input $TMP/$name.native`
+  tc=`best $input $TMP/$name.c.exe`
+  te=`best $input $TMP/$name.elf`
+  awk -v n=$name -v v=$tv -v r=$tr -v s=$tn -v c=$tc -v e=$te \
+    'BEGIN { printf "%-8s %10.3f %10.3f %10.3f %10.3f %10.3f\n", n, v, r, s, c, e }'
+done
+rm -rf $TMP
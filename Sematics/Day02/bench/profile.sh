@@ -0,0 +1,20 @@
+#!/bin/sh
+# Prints the profile kplvm -profile takes of the training programs: the
+# examples of the parser, then the programs of test/ and bench/, those
+# that compile. Each reads NAME.in when it exists. Used by
+#   make superops
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+TMP=/tmp/kplprofile.$$
+
+mkdir -p $TMP
+for src in $DIR/../../../Parser/test/example*.kpl $DIR/../test/*.kpl $DIR/*.kpl; do
+  name=`basename $src .kpl`
+  input=`dirname $src`/$name.in
+  [ -f $input ] || input=/dev/null
+  $KPLC $src $TMP/$name.kplb > /dev/null 2>&1 || continue
+  $KPLVM -profile $TMP/$name.kplb < $input 2>&1 > /dev/null | grep '^[0-9]'
+done
+rm -rf $TMP
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Measures how long kplvm takes to start: the mean wall time of LAUNCHES
+# runs of a program that writes one number, and of a generated program
+# of LINES lines whose statements run once each, so that most of its time
+# goes to loading the code. Run from Sematics/Day02:
+#   make bench
+
+KPLC=./kplc
+KPLVM=./kplvm
+LINES=${LINES:-10000}
+LAUNCHES=${LAUNCHES:-200}
+TMP=/tmp/kplstart.$$
+
+now() {
+  date +%s.%N
+}
+
+# Mean wall time in milliseconds of LAUNCHES runs of a code file
+launches() {
+  start=`now`
+  i=0
+  while [ $i -lt $LAUNCHES ]; do
+    $KPLVM $1 > /dev/null || exit 1
+    i=`expr $i + 1`
+  done
+  end=`now`
+  awk -v s=$start -v e=$end -v n=$LAUNCHES 'BEGIN { printf "%.3f", (e - s) * 1000 / n }'
+}
+
+# One assignment and one call per line
+generate() {
+  awk -v n=`expr $LINES / 4` 'BEGIN {
+    print "Program Large;"
+    print "Var s : Integer;"
+    print "Procedure P(k : Integer);"
+    print "Begin s := s + k End;"
+    print "Begin"
+    print "  s := 0;"
+    for (i = 1; i <= n; i ++) {
+      print "  s := s * 3 / 2 + " i ";"
+      print "  Call P(" i ");"
+      print "  If s > 100000 Then"
+      print "    s := s - 100000;"
+    }
+    print "  Call WriteI(s)"
+    print "End."
+  }'
+}
+
+mkdir -p $TMP
+generate > $TMP/large.kpl
+printf "Program Small;\nBegin Call WriteI(1) End.\n" > $TMP/small.kpl
+printf "%-12s %8s %10s %12s\n" program lines "code bytes" "ms per run"
+for name in small large; do
+  $KPLC $TMP/$name.kpl $TMP/$name.kplb > /dev/null || exit 1
+  lines=`wc -l < $TMP/$name.kpl`
+  bytes=`wc -c < $TMP/$name.kplb`
+  awk -v n=$name -v l=$lines -v b=$bytes -v t=`launches $TMP/$name.kplb` \
+    'BEGIN { printf "%-12s %8d %10d %12.3f\n", n, l, b, t }'
+done
+rm -rf $TMP
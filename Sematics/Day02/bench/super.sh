@@ -0,0 +1,47 @@
+#!/bin/sh
+# Compares kplvm with and without the superinstructions of superops.h on
+# the programs of this directory: dispatches, counted by kplvm -count,
+# and the best wall time of threaded dispatch. Run from Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+RUNS=${RUNS:-3}
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+# Dispatches kplvm -count reports
+dispatches() {
+  "$@" 2>&1 > /dev/null | awk '/dispatches/ { print $1 }'
+}
+
+printf "%-12s %12s %12s %10s %10s %8s\n" program dispatches fused plain super speedup
+for src in $DIR/fib.kpl $DIR/hanoi.kpl $DIR/ackermann.kpl; do
+  name=`basename $src .kpl`
+  code=/tmp/$name.$$.kplb
+  $KPLC $src $code > /dev/null || exit 1
+  dp=`dispatches $KPLVM -count -nosuper $code`
+  ds=`dispatches $KPLVM -count $code`
+  tp=`best $KPLVM -nosuper $code`
+  ts=`best $KPLVM $code`
+  awk -v n=$name -v dp=$dp -v ds=$ds -v p=$tp -v s=$ts \
+    'BEGIN { printf "%-12s %12d %12d %10.3f %10.3f %7.2fx\n", n, dp, ds, p, s, p / s }'
+  rm -f $code
+done
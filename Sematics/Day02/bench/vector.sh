@@ -0,0 +1,48 @@
+#!/bin/sh
+# Times vector.kpl, whose loops do arithmetic element by element over
+# whole arrays, in the native code with the loops kept scalar, vectorized
+# with SSE2 only, and vectorized with AVX2 where the processor has it:
+# the code of kplc --run --jit and the executables of kplc -S and
+# kplc --elf. Best wall time of RUNS runs. Run from Sematics/Day02:
+#   make bench
+
+DIR=`dirname $0`
+KPLC=./kplc
+RUNS=${RUNS:-3}
+TMP=/tmp/kplvector.$$
+
+now() {
+  date +%s.%N
+}
+
+# Best wall time in seconds of RUNS runs of a command
+best() {
+  i=0
+  times=""
+  while [ $i -lt $RUNS ]; do
+    start=`now`
+    "$@" > /dev/null || exit 1
+    end=`now`
+    times="$times $start $end"
+    i=`expr $i + 1`
+  done
+  echo $times | awk '{ b = -1; for (i = 1; i < NF; i += 2) { t = $(i+1) - $i; if (b < 0 || t < b) b = t } print b }'
+}
+
+mkdir -p $TMP
+src=$DIR/vector.kpl
+printf "%-8s %10s %10s %10s\n" loops --jit -S --elf
+for mode in scalar sse2 avx2; do
+  if [ $mode = scalar ]; then
+    flags=--no-vectorize
+  elif [ $mode = sse2 ]; then
+    flags=--no-avx2
+  else
+    flags=
+  fi
+  $KPLC $src $TMP/vector.s -S $flags > /dev/null && gcc -o $TMP/vector $TMP/vector.s kplrt.o &&
+    $KPLC $src $TMP/vector.elf --elf $flags > /dev/null || exit 1
+  awk -v j=`best $KPLC $src --run --jit $flags` -v s=`best $TMP/vector` -v e=`best $TMP/vector.elf` -v m=$mode \
+    'BEGIN { printf "%-8s %10.3f %10.3f %10.3f\n", m, j, s, e }'
+done
+rm -rf $TMP
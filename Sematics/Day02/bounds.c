@@ -0,0 +1,269 @@
+/* Bounds check elimination
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "passes.h"
+
+/* A check goes when the range of its index is known to fit the array.
+   The range of a value comes from what computes it, then narrows with
+   every branch on the way from the entry: in the body of
+   FOR i := 1 TO 10, i is at most 10 because the test of the loop said
+   so, and at least 1 because it starts there and only grows. That last
+   part holds only while the increment cannot wrap around, which the
+   test of the loop also has to show. */
+
+#define MAX_RANGE_DEPTH 8
+
+struct Range_ {
+  long long lo;
+  long long hi;
+};
+
+typedef struct Range_ Range;
+
+struct RangeAnalysis_ {
+  IRFunction* f;
+  // Phis being looked at, so that loops do not go round forever
+  char* visiting;
+};
+
+typedef struct RangeAnalysis_ RangeAnalysis;
+
+Range makeRange(long long lo, long long hi) {
+  Range r;
+
+  // Anything the machine would wrap around could be any value
+  if ((lo < INT_MIN) || (hi > INT_MAX)) {
+    lo = INT_MIN;
+    hi = INT_MAX;
+  }
+  r.lo = lo;
+  r.hi = hi;
+  return r;
+}
+
+Range fullRange(void) {
+  return makeRange(INT_MIN, INT_MAX);
+}
+
+long long minimum(long long a, long long b) {
+  return (a < b) ? a : b;
+}
+
+long long maximum(long long a, long long b) {
+  return (a > b) ? a : b;
+}
+
+Range rangeOf(RangeAnalysis* r, int v, int block, int depth);
+
+// The comparison op of v to other still holds, after the swap if v is
+// on the right and the negation if the branch was not taken
+enum IROpCode normalizeComparison(enum IROpCode op, int swap, int negate) {
+  if (swap)
+    switch (op) {
+    case IR_GT: op = IR_LT; break;
+    case IR_LT: op = IR_GT; break;
+    case IR_GE: op = IR_LE; break;
+    case IR_LE: op = IR_GE; break;
+    default: break;
+    }
+  if (negate)
+    switch (op) {
+    case IR_EQ: op = IR_NE; break;
+    case IR_NE: op = IR_EQ; break;
+    case IR_GT: op = IR_LE; break;
+    case IR_LT: op = IR_GE; break;
+    case IR_GE: op = IR_LT; break;
+    case IR_LE: op = IR_GT; break;
+    default: break;
+    }
+  return op;
+}
+
+// Narrows the range of v with the branches every path to block takes
+Range constrain(RangeAnalysis* r, int v, int block, Range range, int depth) {
+  IRFunction* f = r->f;
+  IRBlock* b;
+  IRInst* branch;
+  IRInst* cond;
+  Range other;
+  enum IROpCode op;
+  int c, p, t, swap;
+
+  for (c = block; c != IR_NONE; c = (c == 0) ? IR_NONE : f->blocks[c].idom) {
+    b = f->blocks + c;
+    if (b->predCount != 1) continue;
+    p = b->preds[0];
+    t = terminatorOf(f, p);
+    if ((t == IR_NONE) || (f->insts[t].op != IR_BRANCH)) continue;
+    branch = f->insts + t;
+    if (f->blocks[p].succs[0] == f->blocks[p].succs[1]) continue;
+    cond = f->insts + branch->args[0];
+    if ((cond->op < IR_EQ) || (cond->op > IR_LE)) continue;
+    if (cond->args[0] == v) swap = 0;
+    else if (cond->args[1] == v) swap = 1;
+    else continue;
+
+    op = normalizeComparison(cond->op, swap, f->blocks[p].succs[0] != c);
+    other = rangeOf(r, cond->args[1 - swap], p, depth + 1);
+    switch (op) {
+    case IR_EQ:
+      range.lo = maximum(range.lo, other.lo);
+      range.hi = minimum(range.hi, other.hi);
+      break;
+    case IR_LE:
+      range.hi = minimum(range.hi, other.hi);
+      break;
+    case IR_LT:
+      range.hi = minimum(range.hi, other.hi - 1);
+      break;
+    case IR_GE:
+      range.lo = maximum(range.lo, other.lo);
+      break;
+    case IR_GT:
+      range.lo = maximum(range.lo, other.lo + 1);
+      break;
+    default:
+      break;
+    }
+  }
+  return range;
+}
+
+/* A phi that is its own value plus or minus a constant step on the other edge
+   never goes below where it starts, or above for a negative step, as
+   long as the branches before the step keep it from wrapping around. */
+Range inductionRange(RangeAnalysis* r, int v, int depth) {
+  IRFunction* f = r->f;
+  IRInst* phi = f->insts + v;
+  IRInst* next;
+  Range start, before;
+  long long step;
+  int k;
+
+  if (phi->argCount != 2) return fullRange();
+  for (k = 0; k < 2; k ++) {
+    next = f->insts + phi->args[k];
+    if (((next->op != IR_ADD) && (next->op != IR_SUB)) || (next->args[0] != v) ||
+        (f->insts[next->args[1]].op != IR_CONST))
+      continue;
+    step = f->insts[next->args[1]].value;
+    if (next->op == IR_SUB) step = - (long long) step;
+    if (step == 0) return fullRange();
+    start = rangeOf(r, phi->args[1 - k], f->blocks[phi->block].preds[1 - k], depth + 1);
+    before = constrain(r, v, next->block, fullRange(), depth + 1);
+    if ((step > 0) && (before.hi + step <= INT_MAX))
+      return makeRange(start.lo, INT_MAX);
+    if ((step < 0) && (before.lo + step >= INT_MIN))
+      return makeRange(INT_MIN, start.hi);
+    return fullRange();
+  }
+  return fullRange();
+}
+
+Range phiRange(RangeAnalysis* r, int v, int depth) {
+  IRFunction* f = r->f;
+  IRInst* phi = f->insts + v;
+  Range range, arg;
+  int i;
+
+  r->visiting[v] = 1;
+  range = inductionRange(r, v, depth);
+  if ((range.lo != INT_MIN) || (range.hi != INT_MAX)) {
+    r->visiting[v] = 0;
+    return range;
+  }
+
+  // Otherwise whatever comes in
+  for (i = 0; i < phi->argCount; i ++) {
+    arg = rangeOf(r, phi->args[i], f->blocks[phi->block].preds[i], depth + 1);
+    if (i == 0) range = arg;
+    else range = makeRange(minimum(range.lo, arg.lo), maximum(range.hi, arg.hi));
+  }
+  r->visiting[v] = 0;
+  return range;
+}
+
+// The values v may have when block runs
+Range rangeOf(RangeAnalysis* r, int v, int block, int depth) {
+  IRInst* inst = r->f->insts + v;
+  Range range, x, y;
+  long long a, b, c, d;
+
+  if ((depth > MAX_RANGE_DEPTH) || r->visiting[v]) return fullRange();
+
+  switch (inst->op) {
+  case IR_CONST:
+    return makeRange(inst->value, inst->value);
+  case IR_CHECK:
+    // Past the check it fits the array
+    x = rangeOf(r, inst->args[0], block, depth + 1);
+    range = makeRange(maximum(x.lo, 1), minimum(x.hi, inst->value));
+    break;
+  case IR_ADD:
+  case IR_SUB:
+    x = rangeOf(r, inst->args[0], block, depth + 1);
+    y = rangeOf(r, inst->args[1], block, depth + 1);
+    if (inst->op == IR_ADD) range = makeRange(x.lo + y.lo, x.hi + y.hi);
+    else range = makeRange(x.lo - y.hi, x.hi - y.lo);
+    break;
+  case IR_MUL:
+    x = rangeOf(r, inst->args[0], block, depth + 1);
+    y = rangeOf(r, inst->args[1], block, depth + 1);
+    a = x.lo * y.lo; b = x.lo * y.hi; c = x.hi * y.lo; d = x.hi * y.hi;
+    range = makeRange(minimum(minimum(a, b), minimum(c, d)), maximum(maximum(a, b), maximum(c, d)));
+    break;
+  case IR_NEG:
+    x = rangeOf(r, inst->args[0], block, depth + 1);
+    range = makeRange(- x.hi, - x.lo);
+    break;
+  case IR_EQ: case IR_NE: case IR_GT: case IR_LT: case IR_GE: case IR_LE:
+    range = makeRange(0, 1);
+    break;
+  case IR_PHI:
+    range = phiRange(r, v, depth);
+    break;
+  default:
+    range = fullRange();
+    break;
+  }
+  return constrain(r, v, block, range, depth);
+}
+
+int eliminateBoundsChecks(IRFunction* f) {
+  RangeAnalysis r;
+  int* replacements = (int*) malloc((f->instCount + 1) * sizeof(int));
+  IRInst* inst;
+  Range range;
+  int i, removed = 0;
+
+  computeDominators(f);
+  r.f = f;
+  r.visiting = (char*) calloc(f->instCount + 1, 1);
+  for (i = 0; i < f->instCount; i ++)
+    replacements[i] = IR_NONE;
+
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if ((inst->op != IR_CHECK) || (inst->block == IR_NONE) ||
+        (f->blocks[inst->block].idom == IR_NONE))
+      continue;
+    range = rangeOf(&r, inst->args[0], inst->block, 0);
+    if ((range.lo >= 1) && (range.hi <= inst->value)) {
+      replacements[i] = inst->args[0];
+      removeInstruction(f, i);
+      removed ++;
+    }
+  }
+  replaceUses(f, replacements);
+  compactBlocks(f);
+
+  free(r.visiting);
+  free(replacements);
+  return removed;
+}
@@ -0,0 +1,575 @@
+/* Translation of KPL programs to C
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cgen.h"
+#include "ir.h"
+#include "irbuild.h"
+#include "passes.h"
+#include "asmgen.h"
+#include "vm.h"
+#include "kplio.h"
+
+/* The C comes from the IR after the ssa pass, so that the variables no
+   other subprogram reaches are C locals the C compiler keeps in registers.
+   The others stay in the frame of their subprogram, a struct named
+   fK_NAME_frame: the function value, the parameters, a pointer for a
+   reference parameter or an array, the copy an array passed by value
+   gets, and the variables, an array as a flat C array of its words. The
+   frame of a nested subprogram points up to the frame of the one it is
+   declared in, which is how ADDR and CALL reach the frames levels out.
+   Blocks become labels, and the phi nodes copies on the edges that lead
+   to them.
+
+   The frames of the machine are counted in words, so that a recursion
+   that would overflow its stack stops here too, with the same error. */
+
+// Index of the subprogram whose frame is level scopes out of f's, or IR_NONE
+int cFrameOwner(IRProgram* program, int f, int level) {
+  for (; (level > 0) && (f != IR_NONE); level --)
+    f = program->functions[f]->parent;
+  return f;
+}
+
+// The variable or parameter in slot of the frame of f, and the word of it
+Object* cSlotObject(IRFunction* f, int slot, int* index) {
+  ObjectNode* node;
+  Object* obj;
+  int offset, size;
+
+  for (node = f->scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_VARIABLE) {
+      offset = obj->varAttrs->localOffset;
+      size = sizeOfType(obj->varAttrs->type);
+    } else if (obj->kind == OBJ_PARAMETER) {
+      offset = obj->paramAttrs->localOffset;
+      size = 1;
+      if ((obj->paramAttrs->copyOffset >= 0) && (slot >= obj->paramAttrs->copyOffset) &&
+          (slot < obj->paramAttrs->copyOffset + sizeOfType(obj->paramAttrs->type))) {
+        *index = slot - obj->paramAttrs->copyOffset;
+        return obj;
+      }
+    } else continue;
+    if ((slot >= offset) && (slot < offset + size)) {
+      *index = slot - offset;
+      return obj;
+    }
+  }
+  return NULL;
+}
+
+int cHasField(IRFunction* f, int slot) {
+  int index;
+
+  if ((slot == RETURN_VALUE_OFFSET) && (f->kind == IR_FUNCTION)) return 1;
+  return cSlotObject(f, slot, &index) != NULL;
+}
+
+int cIsArray(Object* obj) {
+  return (obj->kind == OBJ_VARIABLE) && (obj->varAttrs->type->typeClass == TP_ARRAY);
+}
+
+// Whether slot is in the copy of an array parameter rather than the parameter
+int cIsCopy(Object* obj, int slot) {
+  return (obj->kind == OBJ_PARAMETER) && (slot != obj->paramAttrs->localOffset);
+}
+
+// Whether every address and call of f can be written in C
+int cCanTranslate(IRProgram* program, int k) {
+  IRFunction* f = program->functions[k];
+  IRInst* inst;
+  int owner, b, i;
+
+  for (b = 0; b < f->blockCount; b ++)
+    for (i = 0; i < f->blocks[b].instCount; i ++) {
+      inst = f->insts + f->blocks[b].insts[i];
+      if ((inst->op != IR_ADDR) && (inst->op != IR_CALL)) continue;
+      owner = cFrameOwner(program, k, inst->level);
+      if (owner == IR_NONE) return 0;
+      if ((inst->op == IR_ADDR) && !cHasField(program->functions[owner], inst->value))
+        return 0;
+    }
+  return 1;
+}
+
+/******************************************************************/
+
+void cWriteFrameType(FILE* out, IRProgram* program, int k) {
+  fprintf(out, "struct f%d_%s_frame", k, program->functions[k]->name);
+}
+
+void cWriteFunctionName(FILE* out, IRProgram* program, int k) {
+  fprintf(out, "f%d_%s", k, program->functions[k]->name);
+}
+
+void cWriteFrame(FILE* out, IRProgram* program, int k) {
+  IRFunction* f = program->functions[k];
+  ObjectNode* node;
+  Object* obj;
+  int fields = 0;
+
+  cWriteFrameType(out, program, k);
+  fprintf(out, " {\n");
+  if (f->parent != IR_NONE) {
+    fprintf(out, "  ");
+    cWriteFrameType(out, program, f->parent);
+    fprintf(out, "* up;\n");
+    fields ++;
+  }
+  if (f->kind == IR_FUNCTION) {
+    fprintf(out, "  int result;\n");
+    fields ++;
+  }
+  for (node = f->scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_PARAMETER) {
+      fprintf(out, "  int%s v_%s;\n", ((obj->paramAttrs->kind == PARAM_REFERENCE) ||
+                                       (obj->paramAttrs->type->typeClass == TP_ARRAY)) ? "*" : "",
+              obj->name);
+      if (obj->paramAttrs->copyOffset >= 0)
+        fprintf(out, "  int c_%s[%d];\n", obj->name, sizeOfType(obj->paramAttrs->type));
+    } else if (cIsArray(obj))
+      fprintf(out, "  int v_%s[%d];\n", obj->name, sizeOfType(obj->varAttrs->type));
+    else if (obj->kind == OBJ_VARIABLE)
+      fprintf(out, "  int v_%s;\n", obj->name);
+    else continue;
+    fields ++;
+  }
+  // A struct may not be empty
+  if (fields == 0) fprintf(out, "  int unused;\n");
+  fprintf(out, "};\n\n");
+}
+
+void cWriteSignature(FILE* out, IRProgram* program, int k) {
+  IRFunction* f = program->functions[k];
+  int i;
+
+  fprintf(out, "static %s ", (f->kind == IR_FUNCTION) ? "int" : "void");
+  cWriteFunctionName(out, program, k);
+  if (f->parent == IR_NONE) {
+    fprintf(out, "(void)");
+    return;
+  }
+  fprintf(out, "(");
+  cWriteFrameType(out, program, f->parent);
+  fprintf(out, "* up");
+  for (i = 0; i < f->paramCount; i ++)
+    fprintf(out, ", int%s p%d", f->slotIsReference[RESERVED_WORDS + i] ? "*" : "", i);
+  fprintf(out, ")");
+}
+
+// The frame level scopes out, as a pointer
+void cWriteFramePointer(FILE* out, int level) {
+  int i;
+
+  if (level == 0) fprintf(out, "&f");
+  else fprintf(out, "f.up");
+  for (i = 1; i < level; i ++)
+    fprintf(out, "->up");
+}
+
+// The field of slot in the frame level scopes out, checked by cCanTranslate
+void cWriteSlot(FILE* out, IRProgram* program, int k, int level, int slot) {
+  IRFunction* owner = program->functions[cFrameOwner(program, k, level)];
+  Object* obj;
+  int index, i;
+
+  fprintf(out, "f.");
+  for (i = 0; i < level; i ++)
+    fprintf(out, "up->");
+  if ((slot == RETURN_VALUE_OFFSET) && (owner->kind == IR_FUNCTION)) {
+    fprintf(out, "result");
+    return;
+  }
+  obj = cSlotObject(owner, slot, &index);
+  if (cIsCopy(obj, slot))
+    fprintf(out, "c_%s[%d]", obj->name, index);
+  else {
+    fprintf(out, "v_%s", obj->name);
+    if (cIsArray(obj)) fprintf(out, "[%d]", index);
+  }
+}
+
+int cCountPhis(IRFunction* f, int b) {
+  IRBlock* block = f->blocks + b;
+  int phis;
+
+  for (phis = 0; (phis < block->instCount) && (f->insts[block->insts[phis]].op == IR_PHI); phis ++);
+  return phis;
+}
+
+void cWriteDeclarations(FILE* out, IRFunction* f, int addresses) {
+  char* star = addresses ? "*" : "";
+  IRInst* inst;
+  int count = 0;
+  int b, i, v;
+
+  for (b = 0; b < f->blockCount; b ++)
+    for (i = 0; i < f->blocks[b].instCount; i ++) {
+      v = f->blocks[b].insts[i];
+      inst = f->insts + v;
+      if (!irHasValue(inst) || (inst->isAddress != addresses)) continue;
+      fprintf(out, (count % 8 == 0) ? "%s  int " : ", ", (count > 0) ? ";\n" : "");
+      fprintf(out, "%sv%d", star, v);
+      // Phi nodes that change together take their values from temporaries
+      if ((inst->op == IR_PHI) && (cCountPhis(f, b) > 1)) fprintf(out, ", %st%d", star, v);
+      count ++;
+    }
+  if (count > 0) fprintf(out, ";\n");
+}
+
+/* The copies into the phi nodes of to, from the values they have on the
+   edge from from, then the jump. The copies are made at the same time,
+   through temporaries, when a phi node reads another one. */
+void cWriteEdge(FILE* out, IRFunction* f, int from, int to, char* indent) {
+  IRBlock* block = f->blocks + to;
+  int k = predecessorIndex(f, to, from);
+  int phis = cCountPhis(f, to);
+  int i;
+
+  for (i = 0; i < phis; i ++)
+    fprintf(out, "%s%c%d = v%d;\n", indent, (phis > 1) ? 't' : 'v',
+            block->insts[i], f->insts[block->insts[i]].args[k]);
+  if (phis > 1)
+    for (i = 0; i < phis; i ++)
+      fprintf(out, "%sv%d = t%d;\n", indent, block->insts[i], block->insts[i]);
+  fprintf(out, "%sgoto b%d;\n", indent, to);
+}
+
+void cWriteArithmetic(FILE* out, IRFunction* f, IRInst* inst) {
+  IRInst* a = f->insts + inst->args[0];
+  IRInst* b = f->insts + inst->args[1];
+  char* op = (inst->op == IR_ADD) ? "+" : (inst->op == IR_SUB) ? "-" : "*";
+
+  // Moving through an array, or wrapping around like the machine
+  if (a->isAddress || b->isAddress)
+    fprintf(out, "v%d %s v%d;\n", inst->args[0], op, inst->args[1]);
+  else fprintf(out, "(int) ((unsigned) v%d %s (unsigned) v%d);\n", inst->args[0], op, inst->args[1]);
+}
+
+char* cComparison(enum IROpCode op) {
+  switch (op) {
+  case IR_EQ: return "==";
+  case IR_NE: return "!=";
+  case IR_GT: return ">";
+  case IR_LT: return "<";
+  case IR_GE: return ">=";
+  default: return "<=";
+  }
+}
+
+void cWriteInstruction(FILE* out, IRProgram* program, int k, int b, int v) {
+  IRFunction* f = program->functions[k];
+  IRInst* inst = f->insts + v;
+  IRBlock* block = f->blocks + b;
+  int i;
+
+  switch (inst->op) {
+  case IR_PHI:
+    return;
+  case IR_CONST:
+    fprintf(out, "  v%d = %d;\n", v, inst->value);
+    return;
+  case IR_ENTRY:
+    fprintf(out, "  v%d = ", v);
+    if (cHasField(f, inst->value)) {
+      cWriteSlot(out, program, k, 0, inst->value);
+      fprintf(out, ";\n");
+    } else fprintf(out, "0;\n");
+    return;
+  case IR_ADDR:
+    fprintf(out, "  v%d = (int*) &", v);
+    cWriteSlot(out, program, k, inst->level, inst->value);
+    fprintf(out, ";\n");
+    return;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL:
+    fprintf(out, "  v%d = ", v);
+    cWriteArithmetic(out, f, inst);
+    return;
+  case IR_DIV:
+    fprintf(out, "  v%d = kpl_divide(v%d, v%d);\n", v, inst->args[0], inst->args[1]);
+    return;
+  case IR_NEG:
+    fprintf(out, "  v%d = (int) (0u - (unsigned) v%d);\n", v, inst->args[0]);
+    return;
+  case IR_EQ:
+  case IR_NE:
+  case IR_GT:
+  case IR_LT:
+  case IR_GE:
+  case IR_LE:
+    fprintf(out, "  v%d = v%d %s v%d;\n", v, inst->args[0], cComparison(inst->op), inst->args[1]);
+    return;
+  case IR_CHECK:
+    fprintf(out, "  if ((v%d < 1) || (v%d > %d)) kpl_error(RT_INDEX_OUT_OF_RANGE);\n",
+            inst->args[0], inst->args[0], inst->value);
+    fprintf(out, "  v%d = v%d;\n", v, inst->args[0]);
+    return;
+  case IR_LOAD:
+    if (inst->isAddress) fprintf(out, "  v%d = *(int**) v%d;\n", v, inst->args[0]);
+    else fprintf(out, "  v%d = *v%d;\n", v, inst->args[0]);
+    return;
+  case IR_STORE:
+    if (f->insts[inst->args[1]].isAddress)
+      fprintf(out, "  *(int**) v%d = v%d;\n", inst->args[0], inst->args[1]);
+    else fprintf(out, "  *v%d = v%d;\n", inst->args[0], inst->args[1]);
+    return;
+  case IR_COPY:
+    fprintf(out, "  memmove(v%d, v%d, %d * sizeof(int));\n", inst->args[0], inst->args[1], inst->value);
+    return;
+  case IR_CALL:
+    fprintf(out, "  ");
+    if (irHasValue(inst)) fprintf(out, "v%d = ", v);
+    cWriteFunctionName(out, program, inst->callee);
+    fprintf(out, "(");
+    cWriteFramePointer(out, inst->level);
+    for (i = 0; i < inst->argCount; i ++)
+      fprintf(out, ", v%d", inst->args[i]);
+    fprintf(out, ");\n");
+    return;
+  case IR_READC:
+    fprintf(out, "  v%d = kpl_readc();\n", v);
+    return;
+  case IR_READI:
+    fprintf(out, "  v%d = kpl_readi();\n", v);
+    return;
+  case IR_WRITEC:
+    fprintf(out, "  kpl_writec(v%d);\n", inst->args[0]);
+    return;
+  case IR_WRITEI:
+    fprintf(out, "  kpl_writei(v%d);\n", inst->args[0]);
+    return;
+  case IR_WRITELN:
+    fprintf(out, "  kpl_writeln();\n");
+    return;
+  case IR_JUMP:
+    cWriteEdge(out, f, b, block->succs[0], "  ");
+    return;
+  case IR_BRANCH:
+    fprintf(out, "  if (v%d) {\n", inst->args[0]);
+    cWriteEdge(out, f, b, block->succs[0], "    ");
+    fprintf(out, "  }\n");
+    cWriteEdge(out, f, b, block->succs[1], "  ");
+    return;
+  case IR_RETURN:
+  case IR_HALT:
+    fprintf(out, "  kpl_top -= %d;\n", f->frameSize);
+    if (inst->argCount > 0) fprintf(out, "  return v%d;\n", inst->args[0]);
+    else fprintf(out, "  return;\n");
+    return;
+  }
+}
+
+void cWriteFunction(FILE* out, IRProgram* program, int k) {
+  IRFunction* f = program->functions[k];
+  IRBlock* block;
+  ObjectNode* node;
+  Object* obj;
+  int b, i;
+
+  fprintf(out, "/* %s */\n", f->name);
+  cWriteSignature(out, program, k);
+  fprintf(out, " {\n");
+  // The frame of the program is too large for the C stack at times
+  fprintf(out, "  %s", (f->parent == IR_NONE) ? "static " : "");
+  cWriteFrameType(out, program, k);
+  fprintf(out, " f;\n");
+  cWriteDeclarations(out, f, 0);
+  cWriteDeclarations(out, f, 1);
+  fprintf(out, "\n");
+
+  fprintf(out, "  kpl_top += %d;\n", f->frameSize);
+  fprintf(out, "  if (kpl_top >= KPL_STACK_LIMIT) kpl_error(RT_STACK_OVERFLOW);\n");
+  if (f->parent != IR_NONE) fprintf(out, "  f.up = up;\n");
+  for (node = f->scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_PARAMETER)
+      fprintf(out, "  f.v_%s = p%d;\n", obj->name, obj->paramAttrs->localOffset - RESERVED_WORDS);
+  }
+
+  for (b = 0; b < f->blockCount; b ++) {
+    block = f->blocks + b;
+    if (block->predCount > 0) fprintf(out, " b%d:\n", b);
+    for (i = 0; i < block->instCount; i ++)
+      cWriteInstruction(out, program, k, b, block->insts[i]);
+  }
+  fprintf(out, "}\n\n");
+}
+
+/* The buffered output of kplio.c, on top of stdio so that the C stays
+   portable: reads go through getchar, which stdio buffers already, or
+   getchar_unlocked where there is one. */
+char* cRuntimeIO[] = {
+  "#if defined(__unix__) || defined(__APPLE__)",
+  "#define kpl_getchar getchar_unlocked",
+  "#else",
+  "#define kpl_getchar getchar",
+  "#endif",
+  "",
+  "static char kpl_out[KPL_BUFFER_SIZE];",
+  "static int kpl_count = 0;",
+  "static int kpl_interactive = 0;",
+  "",
+  "static void kpl_flush(void) {",
+  "  fwrite(kpl_out, 1, kpl_count, stdout);",
+  "  kpl_count = 0;",
+  "  fflush(stdout);",
+  "}",
+  "",
+  "static int kpl_readc(void) {",
+  "  if (kpl_interactive) kpl_flush();",
+  "  return kpl_getchar();",
+  "}",
+  "",
+  "static int kpl_readi(void) {",
+  "  unsigned int value = 0;",
+  "  int negative = 0;",
+  "  int c;",
+  "",
+  "  if (kpl_interactive) kpl_flush();",
+  "  do c = kpl_getchar(); while ((c == ' ') || ((c >= '\\t') && (c <= '\\r')));",
+  "  if ((c == '-') || (c == '+')) {",
+  "    negative = (c == '-');",
+  "    c = kpl_getchar();",
+  "  }",
+  "  while ((c >= '0') && (c <= '9')) {",
+  "    value = value * 10 + (c - '0');",
+  "    c = kpl_getchar();",
+  "  }",
+  "  if (c != EOF) ungetc(c, stdin);",
+  "  return (int) (negative ? 0u - value : value);",
+  "}",
+  "",
+  "static void kpl_writec(int c) {",
+  "  kpl_out[kpl_count ++] = (char) c;",
+  "  if (kpl_count == KPL_BUFFER_SIZE) kpl_flush();",
+  "}",
+  "",
+  "static void kpl_writei(int i) {",
+  "  char digits[16];",
+  "  char* p = digits + sizeof(digits);",
+  "  unsigned int u = (i < 0) ? 0u - (unsigned int) i : (unsigned int) i;",
+  "",
+  "  do {",
+  "    *--p = (char) ('0' + u % 10);",
+  "    u /= 10;",
+  "  } while (u > 0);",
+  "  if (i < 0) *--p = '-';",
+  "  if (kpl_count + (digits + sizeof(digits) - p) > KPL_BUFFER_SIZE) kpl_flush();",
+  "  while (p < digits + sizeof(digits)) kpl_out[kpl_count ++] = *p ++;",
+  "}",
+  "",
+  "static void kpl_writeln(void) {",
+  "  kpl_writec('\\n');",
+  "  if (kpl_interactive) kpl_flush();",
+  "}",
+  "",
+  NULL
+};
+
+void cWritePrelude(FILE* out, char* name) {
+  int i;
+
+  fprintf(out, "/* PROGRAM %s, translated by kplc --emit-c */\n\n", name);
+  fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n#include <string.h>\n");
+  fprintf(out, "#if defined(__unix__) || defined(__APPLE__)\n");
+  fprintf(out, "#include <sys/resource.h>\n#include <unistd.h>\n#endif\n\n");
+
+  fprintf(out, "#define RT_STACK_OVERFLOW %d\n", RT_STACK_OVERFLOW);
+  fprintf(out, "#define RT_DIVISION_BY_ZERO %d\n", RT_DIVISION_BY_ZERO);
+  fprintf(out, "#define RT_INDEX_OUT_OF_RANGE %d\n\n", RT_INDEX_OUT_OF_RANGE);
+  fprintf(out, "// Words of the frames the program has, at most as many as the machine\n");
+  fprintf(out, "#define KPL_STACK_LIMIT %d\n", STACK_SIZE - STACK_RED_ZONE);
+  fprintf(out, "#define KPL_C_STACK_SIZE %d\n", C_STACK_SIZE);
+  fprintf(out, "#define KPL_BUFFER_SIZE %d\n\n", KPLIO_BUFFER_SIZE);
+  fprintf(out, "static int kpl_top = 0;\n\n");
+  for (i = 0; cRuntimeIO[i] != NULL; i ++)
+    fprintf(out, "%s\n", cRuntimeIO[i]);
+
+  fprintf(out, "static void kpl_error(int status) {\n");
+  fprintf(out, "  kpl_flush();\n");
+  fprintf(out, "  switch (status) {\n");
+  fprintf(out, "  case RT_STACK_OVERFLOW:\n");
+  fprintf(out, "    printf(\"\\nRuntime error: Stack overflow.\\n\");\n    break;\n");
+  fprintf(out, "  case RT_DIVISION_BY_ZERO:\n");
+  fprintf(out, "    printf(\"\\nRuntime error: Division by zero.\\n\");\n    break;\n");
+  fprintf(out, "  case RT_INDEX_OUT_OF_RANGE:\n");
+  fprintf(out, "    printf(\"\\nRuntime error: Index out of range.\\n\");\n    break;\n");
+  fprintf(out, "  }\n  exit(status);\n}\n\n");
+
+  fprintf(out, "// The most negative int divided by -1 wraps around to itself, as in the machine\n");
+  fprintf(out, "static int kpl_divide(int x, int y) {\n");
+  fprintf(out, "  if (y == 0) kpl_error(RT_DIVISION_BY_ZERO);\n");
+  fprintf(out, "  return (y == -1) ? (int) (0u - (unsigned) x) : x / y;\n}\n\n");
+}
+
+void cWriteMain(FILE* out, IRProgram* program) {
+  fprintf(out, "int main(void) {\n");
+  fprintf(out, "#if defined(__unix__) || defined(__APPLE__)\n");
+  fprintf(out, "  struct rlimit limit;\n\n");
+  fprintf(out, "  // C frames are larger than the frames of the machine\n");
+  fprintf(out, "  if ((getrlimit(RLIMIT_STACK, &limit) == 0) && (limit.rlim_cur != RLIM_INFINITY) &&\n");
+  fprintf(out, "      (limit.rlim_cur < KPL_C_STACK_SIZE)) {\n");
+  fprintf(out, "    limit.rlim_cur = KPL_C_STACK_SIZE;\n");
+  fprintf(out, "    if ((limit.rlim_max != RLIM_INFINITY) && (limit.rlim_max < limit.rlim_cur))\n");
+  fprintf(out, "      limit.rlim_cur = limit.rlim_max;\n");
+  fprintf(out, "    setrlimit(RLIMIT_STACK, &limit);\n");
+  fprintf(out, "  }\n");
+  fprintf(out, "  kpl_interactive = isatty(STDOUT_FILENO);\n#endif\n");
+  fprintf(out, "  ");
+  cWriteFunctionName(out, program, 0);
+  fprintf(out, "();\n  kpl_flush();\n  return 0;\n}\n");
+}
+
+int generateC(CodeBlock* codeBlock, SymTab* symtab, char* fileName) {
+  IRProgram* program = buildIR(codeBlock, symtab);
+  PassOptions options;
+  FILE* out;
+  int k;
+
+  if (program == NULL) {
+    printf("kplc: can\'t translate the code to C!\n");
+    return 0;
+  }
+  initPassOptions(&options);
+  options.pipeline = "ssa";
+  if (!runPasses(program, &options)) {
+    freeIRProgram(program);
+    return 0;
+  }
+  for (k = 0; k < program->count; k ++)
+    if (!cCanTranslate(program, k)) {
+      printf("kplc: can\'t translate %s to C!\n", program->functions[k]->name);
+      freeIRProgram(program);
+      return 0;
+    }
+
+  out = fopen(fileName, "w");
+  if (out == NULL) {
+    printf("Can\'t write output file %s!\n", fileName);
+    freeIRProgram(program);
+    return 0;
+  }
+  cWritePrelude(out, symtab->program->name);
+  for (k = 0; k < program->count; k ++)
+    cWriteFrame(out, program, k);
+  for (k = 0; k < program->count; k ++) {
+    cWriteSignature(out, program, k);
+    fprintf(out, ";\n");
+  }
+  fprintf(out, "\n");
+  for (k = 0; k < program->count; k ++)
+    cWriteFunction(out, program, k);
+  cWriteMain(out, program);
+  fclose(out);
+
+  freeIRProgram(program);
+  return 1;
+}
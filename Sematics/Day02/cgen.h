@@ -0,0 +1,23 @@
+/* Translation of KPL programs to C
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __CGEN_H__
+#define __CGEN_H__
+
+#include "symtab.h"
+#include "instructions.h"
+
+// Bytes of C stack the translated program asks for, when it may
+#define C_STACK_SIZE (64 << 20)
+
+/* Writes the program as a single portable C file, to be compiled on its
+   own: gcc -O2 program.c -o program. Every subprogram becomes a function
+   whose frame is a struct, reached by the subprograms nested in it through
+   the chain of up pointers. Returns 0 on code the translation does not
+   cover or when the file can not be written. */
+int generateC(CodeBlock* codeBlock, SymTab* symtab, char* fileName);
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "codegen.h"
+#include "error.h"
+#include "vm.h"
+
+CodeBlock* codeBlock;
+
+extern SymTab* symtab;
+
+// Number of static links to follow from the current scope to reach scope
+int computeNestedLevel(Scope* scope) {
+  int level = 0;
+  Scope* tmp = symtab->currentScope;
+
+  while (tmp != scope) {
+    tmp = tmp->outer;
+    level ++;
+  }
+  return level;
+}
+
+void genVariableAddress(Object* var) {
+  genLA(computeNestedLevel(var->varAttrs->scope), var->varAttrs->localOffset);
+}
+
+void genVariableValue(Object* var) {
+  genLV(computeNestedLevel(var->varAttrs->scope), var->varAttrs->localOffset);
+}
+
+Scope* getParameterScope(Object* param) {
+  Object* owner = param->paramAttrs->function;
+
+  if (owner->kind == OBJ_FUNCTION)
+    return owner->funcAttrs->scope;
+  else return owner->procAttrs->scope;
+}
+
+/* A reference parameter holds the address of its argument, and so does
+   an array passed by value, which is used through its copy. */
+void genParameterAddress(Object* param) {
+  int level = computeNestedLevel(getParameterScope(param));
+
+  if (param->paramAttrs->copyOffset >= 0)
+    genLA(level, param->paramAttrs->copyOffset);
+  else if (param->paramAttrs->kind == PARAM_VALUE)
+    genLA(level, param->paramAttrs->localOffset);
+  else genLV(level, param->paramAttrs->localOffset);
+}
+
+void genParameterValue(Object* param) {
+  int level = computeNestedLevel(getParameterScope(param));
+
+  genLV(level, param->paramAttrs->localOffset);
+  if (param->paramAttrs->kind == PARAM_REFERENCE)
+    genLI();
+}
+
+// The arrays passed by value to the subprogram owner, copied in one go each
+void genParameterCopies(Object* owner) {
+  ObjectNode* node;
+  Object* param;
+
+  if (owner->kind == OBJ_FUNCTION) node = owner->funcAttrs->paramList;
+  else if (owner->kind == OBJ_PROCEDURE) node = owner->procAttrs->paramList;
+  else return;
+
+  for (; node != NULL; node = node->next) {
+    param = node->object;
+    if (param->paramAttrs->copyOffset < 0) continue;
+    genLA(0, param->paramAttrs->copyOffset);
+    genLV(0, param->paramAttrs->localOffset);
+    genCP(sizeOfType(param->paramAttrs->type));
+  }
+}
+
+void genReturnValueAddress(Object* func) {
+  genLA(computeNestedLevel(func->funcAttrs->scope), RETURN_VALUE_OFFSET);
+}
+
+int isPredefinedFunction(Object* func) {
+  return findObject(symtab->globalObjectList, func->name) == func;
+}
+
+int isPredefinedProcedure(Object* proc) {
+  return findObject(symtab->globalObjectList, proc->name) == proc;
+}
+
+void genPredefinedProcedureCall(Object* proc) {
+  if (strcmp(proc->name, "WRITEI") == 0)
+    genWRI();
+  else if (strcmp(proc->name, "WRITEC") == 0)
+    genWRC();
+  else if (strcmp(proc->name, "WRITELN") == 0)
+    genWLN();
+}
+
+void genPredefinedFunctionCall(Object* func) {
+  if (strcmp(func->name, "READI") == 0)
+    genRI();
+  else if (strcmp(func->name, "READC") == 0)
+    genRC();
+}
+
+// The callee's static link is the frame of the scope it is declared in
+void genProcedureCall(Object* proc) {
+  genCALL(computeNestedLevel(proc->procAttrs->scope->outer), proc->procAttrs->codeAddress);
+}
+
+void genFunctionCall(Object* func) {
+  genCALL(computeNestedLevel(func->funcAttrs->scope->outer), func->funcAttrs->codeAddress);
+}
+
+void genLA(int level, int offset) {
+  emitLA(codeBlock, level, offset);
+}
+
+void genLV(int level, int offset) {
+  emitLV(codeBlock, level, offset);
+}
+
+void genLC(WORD constant) {
+  emitLC(codeBlock, constant);
+}
+
+void genLI(void) {
+  emitLI(codeBlock);
+}
+
+void genINT(int delta) {
+  emitINT(codeBlock, delta);
+}
+
+void genDCT(int delta) {
+  emitDCT(codeBlock, delta);
+}
+
+// Jumps are patched through their address since the buffer may move
+CodeAddress genJ(CodeAddress label) {
+  CodeAddress address = codeBlock->codeSize;
+  emitJ(codeBlock, label);
+  return address;
+}
+
+CodeAddress genFJ(CodeAddress label) {
+  CodeAddress address = codeBlock->codeSize;
+  emitFJ(codeBlock, label);
+  return address;
+}
+
+void genHL(void) {
+  emitHL(codeBlock);
+}
+
+void genST(void) {
+  emitST(codeBlock);
+}
+
+void genCALL(int level, CodeAddress label) {
+  emitCALL(codeBlock, level, label);
+}
+
+void genEP(void) {
+  emitEP(codeBlock);
+}
+
+void genEF(void) {
+  emitEF(codeBlock);
+}
+
+void genRC(void) {
+  emitRC(codeBlock);
+}
+
+void genRI(void) {
+  emitRI(codeBlock);
+}
+
+void genWRC(void) {
+  emitWRC(codeBlock);
+}
+
+void genWRI(void) {
+  emitWRI(codeBlock);
+}
+
+void genWLN(void) {
+  emitWLN(codeBlock);
+}
+
+void genAD(void) {
+  emitAD(codeBlock);
+}
+
+void genSB(void) {
+  emitSB(codeBlock);
+}
+
+void genML(void) {
+  emitML(codeBlock);
+}
+
+void genDV(void) {
+  emitDV(codeBlock);
+}
+
+void genNEG(void) {
+  emitNEG(codeBlock);
+}
+
+void genCV(void) {
+  emitCV(codeBlock);
+}
+
+void genEQ(void) {
+  emitEQ(codeBlock);
+}
+
+void genNE(void) {
+  emitNE(codeBlock);
+}
+
+void genGT(void) {
+  emitGT(codeBlock);
+}
+
+void genLT(void) {
+  emitLT(codeBlock);
+}
+
+void genGE(void) {
+  emitGE(codeBlock);
+}
+
+void genLE(void) {
+  emitLE(codeBlock);
+}
+
+void genCK(WORD size) {
+  emitCK(codeBlock, size);
+}
+
+void genCP(WORD size) {
+  emitCP(codeBlock, size);
+}
+
+void updateJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
+}
+
+void updateFJ(CodeAddress jmp, CodeAddress label) {
+  codeBlock->code[jmp].q = label;
+}
+
+CodeAddress getCurrentCodeAddress(void) {
+  return codeBlock->codeSize;
+}
+
+Instruction* getInstruction(CodeAddress address) {
+  return codeBlock->code + address;
+}
+
+// Drops everything emitted from address on: folded constants and
+// statements that can never run
+void discardCode(CodeAddress address) {
+  codeBlock->codeSize = address;
+  discardLines(codeBlock, address);
+}
+
+void markStatement(int lineNo) {
+  emitLine(codeBlock, lineNo);
+}
+
+void initCodeBuffer(void) {
+  codeBlock = createCodeBlock(CODE_SIZE);
+}
+
+void printCodeBuffer(void) {
+  printCodeBlock(codeBlock);
+}
+
+void printCodeBufferSummary(void) {
+  printCodeSummary(codeBlock);
+}
+
+void cleanCodeBuffer(void) {
+  freeCodeBlock(codeBlock);
+}
+
+// Code the machine would reject is saved without frame layouts
+int serialize(char* fileName) {
+  computeFrames(codeBlock);
+  return saveCode(codeBlock, fileName);
+}
@@ -0,0 +1,78 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __CODEGEN_H__
+#define __CODEGEN_H__
+
+#include "symtab.h"
+#include "instructions.h"
+
+#define CODE_SIZE 1024
+
+int computeNestedLevel(Scope* scope);
+
+void genVariableAddress(Object* var);
+void genVariableValue(Object* var);
+void genParameterAddress(Object* param);
+void genParameterValue(Object* param);
+void genReturnValueAddress(Object* func);
+void genParameterCopies(Object* owner);
+
+int isPredefinedFunction(Object* func);
+int isPredefinedProcedure(Object* proc);
+void genPredefinedProcedureCall(Object* proc);
+void genPredefinedFunctionCall(Object* func);
+void genProcedureCall(Object* proc);
+void genFunctionCall(Object* func);
+
+void genLA(int level, int offset);
+void genLV(int level, int offset);
+void genLC(WORD constant);
+void genLI(void);
+void genINT(int delta);
+void genDCT(int delta);
+CodeAddress genJ(CodeAddress label);
+CodeAddress genFJ(CodeAddress label);
+void genHL(void);
+void genST(void);
+void genCALL(int level, CodeAddress label);
+void genEP(void);
+void genEF(void);
+void genRC(void);
+void genRI(void);
+void genWRC(void);
+void genWRI(void);
+void genWLN(void);
+void genAD(void);
+void genSB(void);
+void genML(void);
+void genDV(void);
+void genNEG(void);
+void genCV(void);
+void genEQ(void);
+void genNE(void);
+void genGT(void);
+void genLT(void);
+void genGE(void);
+void genLE(void);
+void genCK(WORD size);
+void genCP(WORD size);
+
+void updateJ(CodeAddress jmp, CodeAddress label);
+void updateFJ(CodeAddress jmp, CodeAddress label);
+
+CodeAddress getCurrentCodeAddress(void);
+Instruction* getInstruction(CodeAddress address);
+void discardCode(CodeAddress address);
+void markStatement(int lineNo);
+
+void initCodeBuffer(void);
+void printCodeBuffer(void);
+void printCodeBufferSummary(void);
+void cleanCodeBuffer(void);
+int serialize(char* fileName);
+
+#endif
@@ -0,0 +1,71 @@
+/* Dead code elimination
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+
+/* An instruction is live when it does something besides computing its
+   value, or when a live instruction uses that value. Everything else
+   goes, including cycles of phis that only feed each other. A division
+   stays unless it is known not to stop the machine. */
+
+int isCritical(IRFunction* f, IRInst* inst) {
+  IRInst* divisor;
+
+  if (!irHasValue(inst)) return 1;
+  switch (inst->op) {
+  case IR_CALL:
+  case IR_CHECK:
+  case IR_READC:
+  case IR_READI:
+    return 1;
+  case IR_DIV:
+    divisor = f->insts + inst->args[1];
+    return (divisor->op != IR_CONST) || (divisor->value == 0) || (divisor->value == -1);
+  default:
+    return 0;
+  }
+}
+
+int eliminateDeadCode(IRFunction* f) {
+  char* live = (char*) calloc(f->instCount + 1, 1);
+  int* work = (int*) malloc((f->instCount + 1) * sizeof(int));
+  IRInst* inst;
+  int count = 0, removed;
+  int i, j, v;
+
+  removed = removeUnreachableBlocks(f);
+
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if ((inst->block != IR_NONE) && isCritical(f, inst)) {
+      live[i] = 1;
+      work[count ++] = i;
+    }
+  }
+  while (count > 0) {
+    inst = f->insts + work[-- count];
+    for (j = 0; j < inst->argCount; j ++) {
+      v = inst->args[j];
+      if (live[v]) continue;
+      live[v] = 1;
+      work[count ++] = v;
+    }
+  }
+
+  for (i = 0; i < f->instCount; i ++)
+    if ((f->insts[i].block != IR_NONE) && !live[i]) {
+      removeInstruction(f, i);
+      removed ++;
+    }
+  compactBlocks(f);
+  removed += simplifyPhis(f);
+
+  free(live);
+  free(work);
+  return removed;
+}
@@ -0,0 +1,513 @@
+/* Writer of static ELF64 executables
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+
+#include "elfgen.h"
+#include "asmgen.h"
+#include "vm.h"
+
+/* The executable has a segment for the headers, the runtime and the code
+   of the program, and one of zeroed data:
+     0    bytes in the output buffer
+     4    next byte to read from the input buffer
+     8    bytes in the input buffer
+     12   1 when the output is a terminal
+     32   end of the digits WRITEI writes backwards
+     64   the output buffer, then the input buffer
+          the KPL stack
+   The runtime keeps the address of the data in %r8. Its functions are
+   called like those of kplrt.c and only change the registers C lets them
+   change. Output is written as kplio.c writes it: when the buffer is
+   full and when the program stops, and when the output is a terminal,
+   at WRITELN and before the program reads. */
+
+#define OUT_COUNT 0
+#define IN_POSITION 4
+#define IN_COUNT 8
+#define INTERACTIVE 12
+#define DIGITS_END 32
+#define OUT_BUFFER 64
+#define IN_BUFFER (OUT_BUFFER + ELF_BUFFER_SIZE)
+#define KPL_STACK (IN_BUFFER + ELF_BUFFER_SIZE)
+#define DATA_SIZE (KPL_STACK + STACK_SIZE * sizeof(WORD))
+
+#define ELF_HEADERS_SIZE (sizeof(Elf64_Ehdr) + 3 * sizeof(Elf64_Phdr))
+#define ELF_PAGE_SIZE 0x1000
+
+#define SYS_READ 0
+#define SYS_WRITE 1
+#define SYS_IOCTL 16
+#define SYS_EXIT_GROUP 231
+
+#define NUM_OF_RUNTIME_ERRORS 3
+
+// Labels of the functions of the runtime
+struct ElfRuntime_ {
+  int flush;
+  int refill;
+  int peek;
+  int readc;
+  int readi;
+  int writec;
+  int writei;
+  int writeln;
+  int error;
+  int start;
+  int main;
+};
+
+typedef struct ElfRuntime_ ElfRuntime;
+
+int runtimeErrors[NUM_OF_RUNTIME_ERRORS] = {RT_STACK_OVERFLOW, RT_DIVISION_BY_ZERO, RT_INDEX_OUT_OF_RANGE};
+
+// Where a bound label is once loaded
+long long elfAddress(X86* x, int label) {
+  return ELF_CODE_ADDRESS + ELF_HEADERS_SIZE + x->labels[label];
+}
+
+X86Memory dataAt(int offset) {
+  return x86Mem(X_R8, offset);
+}
+
+void genElfSyscall(X86* x, int number) {
+  x86MovRI(x, X_RAX, number);
+  x86Syscall(x);
+}
+
+// Writes the output buffer out and empties it
+void genElfFlush(X86* x, ElfRuntime* rt) {
+  int loop = x86NewLabel(x);
+  int done = x86NewLabel(x);
+
+  x86Bind(x, rt->flush);
+  x86MovqRI(x, X_R8, ELF_DATA_ADDRESS);
+  x86MovRM(x, X_RDX, dataAt(OUT_COUNT));
+  x86LeaqRM(x, X_RSI, dataAt(OUT_BUFFER));
+  x86Bind(x, loop);
+  x86Test(x, X_RDX, X_RDX);
+  x86Jcc(x, CC_E, done);
+  x86MovRI(x, X_RDI, 1);
+  genElfSyscall(x, SYS_WRITE);
+  // Nothing more can be done when the output is gone
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_LE, done);
+  x86AluqRR(x, X86_ADD, X_RSI, X_RAX);
+  x86AluRR(x, X86_SUB, X_RDX, X_RAX);
+  x86Jmp(x, loop);
+  x86Bind(x, done);
+  x86MovMI(x, dataAt(OUT_COUNT), 0);
+  x86Ret(x);
+}
+
+// Reads the next bytes of the input, no bytes at its end
+void genElfRefill(X86* x, ElfRuntime* rt) {
+  int quiet = x86NewLabel(x);
+  int read = x86NewLabel(x);
+
+  x86Bind(x, rt->refill);
+  x86AluMI(x, X86_CMP, dataAt(INTERACTIVE), 0);
+  x86Jcc(x, CC_E, quiet);
+  x86CallLabel(x, rt->flush);
+  x86Bind(x, quiet);
+  x86MovRI(x, X_RDI, 0);
+  x86LeaqRM(x, X_RSI, dataAt(IN_BUFFER));
+  x86MovRI(x, X_RDX, ELF_BUFFER_SIZE);
+  genElfSyscall(x, SYS_READ);
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_GE, read);
+  x86MovRI(x, X_RAX, 0);
+  x86Bind(x, read);
+  x86MovMR(x, dataAt(IN_COUNT), X_RAX);
+  x86MovMI(x, dataAt(IN_POSITION), 0);
+  x86Ret(x);
+}
+
+// The next byte of the input in %eax, -1 at its end, without reading it
+void genElfPeek(X86* x, ElfRuntime* rt) {
+  int ready = x86NewLabel(x);
+  int end = x86NewLabel(x);
+
+  x86Bind(x, rt->peek);
+  x86MovqRI(x, X_R8, ELF_DATA_ADDRESS);
+  x86MovRM(x, X_RAX, dataAt(IN_POSITION));
+  x86AluRM(x, X86_CMP, X_RAX, dataAt(IN_COUNT));
+  x86Jcc(x, CC_L, ready);
+  x86CallLabel(x, rt->refill);
+  x86MovRM(x, X_RAX, dataAt(IN_POSITION));
+  x86AluRM(x, X86_CMP, X_RAX, dataAt(IN_COUNT));
+  x86Jcc(x, CC_GE, end);
+  x86Bind(x, ready);
+  x86MovzblRM(x, X_RAX, x86MemIndex(X_R8, X_RAX, 1, IN_BUFFER));
+  x86Ret(x);
+  x86Bind(x, end);
+  x86MovRI(x, X_RAX, -1);
+  x86Ret(x);
+}
+
+// The byte peek saw is read; %r8 still points to the data
+void genElfAdvance(X86* x) {
+  x86AluMI(x, X86_ADD, dataAt(IN_POSITION), 1);
+}
+
+void genElfReadc(X86* x, ElfRuntime* rt) {
+  int end = x86NewLabel(x);
+
+  x86Bind(x, rt->readc);
+  x86CallLabel(x, rt->peek);
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_L, end);
+  genElfAdvance(x);
+  x86Bind(x, end);
+  x86Ret(x);
+}
+
+/* Reads an integer as scanf("%d") would, 0 when there is none: spaces,
+   a sign, then digits. %r9d is the sign and %r10d the value. */
+void genElfReadi(X86* x, ElfRuntime* rt) {
+  int skip = x86NewLabel(x);
+  int space = x86NewLabel(x);
+  int sign = x86NewLabel(x);
+  int plus = x86NewLabel(x);
+  int first = x86NewLabel(x);
+  int digit = x86NewLabel(x);
+  int none = x86NewLabel(x);
+  int done = x86NewLabel(x);
+
+  x86Bind(x, rt->readi);
+  x86Bind(x, skip);
+  x86CallLabel(x, rt->peek);
+  x86AluRI(x, X86_CMP, X_RAX, ' ');
+  x86Jcc(x, CC_E, space);
+  // '\t' to '\r'
+  x86LealRM(x, X_RCX, x86Mem(X_RAX, -'\t'));
+  x86AluRI(x, X86_CMP, X_RCX, '\r' - '\t' + 1);
+  x86Jcc(x, CC_B, space);
+  x86Jmp(x, sign);
+  x86Bind(x, space);
+  genElfAdvance(x);
+  x86Jmp(x, skip);
+
+  x86Bind(x, sign);
+  x86MovRI(x, X_R9, 0);
+  x86AluRI(x, X86_CMP, X_RAX, '-');
+  x86Jcc(x, CC_NE, plus);
+  x86MovRI(x, X_R9, 1);
+  genElfAdvance(x);
+  x86Jmp(x, first);
+  x86Bind(x, plus);
+  x86AluRI(x, X86_CMP, X_RAX, '+');
+  x86Jcc(x, CC_NE, first);
+  genElfAdvance(x);
+
+  x86Bind(x, first);
+  x86CallLabel(x, rt->peek);
+  x86AluRI(x, X86_SUB, X_RAX, '0');
+  x86AluRI(x, X86_CMP, X_RAX, 10);
+  x86Jcc(x, CC_AE, none);
+  x86MovRI(x, X_R10, 0);
+  x86Bind(x, digit);
+  genElfAdvance(x);
+  x86AluRI(x, X86_IMUL, X_R10, 10);
+  x86AluRR(x, X86_ADD, X_R10, X_RAX);
+  x86CallLabel(x, rt->peek);
+  x86AluRI(x, X86_SUB, X_RAX, '0');
+  x86AluRI(x, X86_CMP, X_RAX, 10);
+  x86Jcc(x, CC_B, digit);
+
+  x86MovRR(x, X_RAX, X_R10);
+  x86Test(x, X_R9, X_R9);
+  x86Jcc(x, CC_E, done);
+  x86Neg(x, X_RAX);
+  x86Bind(x, done);
+  x86Ret(x);
+  x86Bind(x, none);
+  x86MovRI(x, X_RAX, 0);
+  x86Ret(x);
+}
+
+void genElfWritec(X86* x, ElfRuntime* rt) {
+  int room = x86NewLabel(x);
+
+  x86Bind(x, rt->writec);
+  x86MovqRI(x, X_R8, ELF_DATA_ADDRESS);
+  x86MovRM(x, X_RAX, dataAt(OUT_COUNT));
+  x86MovRR(x, X_RCX, X_RDI);
+  x86MovbMR(x, x86MemIndex(X_R8, X_RAX, 1, OUT_BUFFER), X_RCX);
+  x86AluRI(x, X86_ADD, X_RAX, 1);
+  x86MovMR(x, dataAt(OUT_COUNT), X_RAX);
+  x86AluRI(x, X86_CMP, X_RAX, ELF_BUFFER_SIZE);
+  x86Jcc(x, CC_L, room);
+  x86Jmp(x, rt->flush);
+  x86Bind(x, room);
+  x86Ret(x);
+}
+
+void genElfWriteln(X86* x, ElfRuntime* rt) {
+  int done = x86NewLabel(x);
+
+  x86Bind(x, rt->writeln);
+  x86MovRI(x, X_RDI, '\n');
+  x86CallLabel(x, rt->writec);
+  x86AluMI(x, X86_CMP, dataAt(INTERACTIVE), 0);
+  x86Jcc(x, CC_E, done);
+  x86Jmp(x, rt->flush);
+  x86Bind(x, done);
+  x86Ret(x);
+}
+
+/* The digits go backwards in front of DIGITS_END, from the magnitude as
+   an unsigned number, then to the output buffer, which has room for
+   them. %r9d keeps the value. */
+void genElfWritei(X86* x, ElfRuntime* rt) {
+  int room = x86NewLabel(x);
+  int positive = x86NewLabel(x);
+  int digit = x86NewLabel(x);
+  int copy = x86NewLabel(x);
+  int loop = x86NewLabel(x);
+
+  x86Bind(x, rt->writei);
+  x86MovRR(x, X_R9, X_RDI);
+  x86MovqRI(x, X_R8, ELF_DATA_ADDRESS);
+  x86MovRM(x, X_RAX, dataAt(OUT_COUNT));
+  x86AluRI(x, X86_CMP, X_RAX, ELF_BUFFER_SIZE - 16);
+  x86Jcc(x, CC_L, room);
+  x86CallLabel(x, rt->flush);
+  x86Bind(x, room);
+
+  x86MovRR(x, X_RAX, X_R9);
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_GE, positive);
+  x86Neg(x, X_RAX);
+  x86Bind(x, positive);
+  x86LeaqRM(x, X_RSI, dataAt(DIGITS_END));
+  x86MovRI(x, X_RCX, 10);
+  x86Bind(x, digit);
+  x86MovRI(x, X_RDX, 0);
+  x86Div(x, X_RCX);
+  x86AluRI(x, X86_ADD, X_RDX, '0');
+  x86AluqRI(x, X86_SUB, X_RSI, 1);
+  x86MovbMR(x, x86Mem(X_RSI, 0), X_RDX);
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_NE, digit);
+  x86Test(x, X_R9, X_R9);
+  x86Jcc(x, CC_GE, copy);
+  x86AluqRI(x, X86_SUB, X_RSI, 1);
+  x86MovRI(x, X_RCX, '-');
+  x86MovbMR(x, x86Mem(X_RSI, 0), X_RCX);
+
+  x86Bind(x, copy);
+  x86MovRM(x, X_RAX, dataAt(OUT_COUNT));
+  x86LeaqRM(x, X_RDX, dataAt(DIGITS_END));
+  x86Bind(x, loop);
+  x86MovzblRM(x, X_RCX, x86Mem(X_RSI, 0));
+  x86MovbMR(x, x86MemIndex(X_R8, X_RAX, 1, OUT_BUFFER), X_RCX);
+  x86AluRI(x, X86_ADD, X_RAX, 1);
+  x86AluqRI(x, X86_ADD, X_RSI, 1);
+  x86AluqRR(x, X86_CMP, X_RSI, X_RDX);
+  x86Jcc(x, CC_NE, loop);
+  x86MovMR(x, dataAt(OUT_COUNT), X_RAX);
+  x86Ret(x);
+}
+
+// Writes the message of kplrt.c and stops with the status in %edi
+void genElfError(X86* x, ElfRuntime* rt, int* messages) {
+  int write = x86NewLabel(x);
+  int stop = x86NewLabel(x);
+  int next, i;
+
+  x86Bind(x, rt->error);
+  x86MovRR(x, X_R9, X_RDI);
+  x86CallLabel(x, rt->flush);
+  for (i = 0; i < NUM_OF_RUNTIME_ERRORS; i ++) {
+    next = x86NewLabel(x);
+    x86AluRI(x, X86_CMP, X_R9, runtimeErrors[i]);
+    x86Jcc(x, CC_NE, next);
+    x86MovqRI(x, X_RSI, elfAddress(x, messages[i]));
+    x86MovRI(x, X_RDX, strlen(vmErrorToString(runtimeErrors[i])) + strlen("\nRuntime error: \n"));
+    x86Jmp(x, write);
+    x86Bind(x, next);
+  }
+  x86Jmp(x, stop);
+  x86Bind(x, write);
+  x86MovRI(x, X_RDI, 1);
+  genElfSyscall(x, SYS_WRITE);
+  x86Bind(x, stop);
+  x86MovRR(x, X_RDI, X_R9);
+  genElfSyscall(x, SYS_EXIT_GROUP);
+}
+
+/* The entry point: finds out whether the output is a terminal, which
+   the TCGETS ioctl only succeeds on, runs kpl_main on the KPL stack,
+   then writes the output. */
+void genElfStart(X86* x, ElfRuntime* rt) {
+  int piped = x86NewLabel(x);
+
+  x86Bind(x, rt->start);
+  x86MovqRI(x, X_R8, ELF_DATA_ADDRESS);
+  x86MovRI(x, X_RDI, 1);
+  x86MovRI(x, X_RSI, TCGETS);
+  // The input buffer is not in use yet
+  x86LeaqRM(x, X_RDX, dataAt(IN_BUFFER));
+  genElfSyscall(x, SYS_IOCTL);
+  x86Test(x, X_RAX, X_RAX);
+  x86Jcc(x, CC_NE, piped);
+  x86MovMI(x, dataAt(INTERACTIVE), 1);
+  x86Bind(x, piped);
+  x86MovqRI(x, X_RDI, ELF_DATA_ADDRESS + KPL_STACK);
+  x86MovqRI(x, X_RSI, ELF_DATA_ADDRESS + KPL_STACK + (STACK_SIZE - STACK_RED_ZONE) * sizeof(WORD));
+  x86CallLabel(x, rt->main);
+  x86CallLabel(x, rt->flush);
+  x86MovRI(x, X_RDI, 0);
+  genElfSyscall(x, SYS_EXIT_GROUP);
+}
+
+void genElfRuntime(X86* x, ElfRuntime* rt) {
+  int messages[NUM_OF_RUNTIME_ERRORS];
+  char message[64];
+  int i;
+
+  // The messages come first, so that the code knows where they are
+  for (i = 0; i < NUM_OF_RUNTIME_ERRORS; i ++) {
+    messages[i] = x86NewLabel(x);
+    x86Bind(x, messages[i]);
+    sprintf(message, "\nRuntime error: %s\n", vmErrorToString(runtimeErrors[i]));
+    x86Data(x, message, strlen(message));
+  }
+
+  rt->flush = x86NewLabel(x);
+  rt->refill = x86NewLabel(x);
+  rt->peek = x86NewLabel(x);
+  rt->readc = x86NewLabel(x);
+  rt->readi = x86NewLabel(x);
+  rt->writec = x86NewLabel(x);
+  rt->writei = x86NewLabel(x);
+  rt->writeln = x86NewLabel(x);
+  rt->error = x86NewLabel(x);
+  rt->start = x86NewLabel(x);
+  rt->main = x86NewLabel(x);
+
+  genElfFlush(x, rt);
+  genElfRefill(x, rt);
+  genElfPeek(x, rt);
+  genElfReadc(x, rt);
+  genElfReadi(x, rt);
+  genElfWritec(x, rt);
+  genElfWriteln(x, rt);
+  genElfWritei(x, rt);
+  genElfError(x, rt, messages);
+  genElfStart(x, rt);
+}
+
+/******************************************************************/
+
+int writeElfFile(char* fileName, X86* x, long long entry) {
+  Elf64_Ehdr header;
+  Elf64_Phdr segments[3];
+  FILE* f;
+  int ok;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  header.e_type = ET_EXEC;
+  header.e_machine = EM_X86_64;
+  header.e_version = EV_CURRENT;
+  header.e_entry = entry;
+  header.e_phoff = sizeof(Elf64_Ehdr);
+  header.e_ehsize = sizeof(Elf64_Ehdr);
+  header.e_phentsize = sizeof(Elf64_Phdr);
+  header.e_phnum = 3;
+
+  memset(segments, 0, sizeof(segments));
+  segments[0].p_type = PT_LOAD;
+  segments[0].p_flags = PF_R | PF_X;
+  segments[0].p_vaddr = segments[0].p_paddr = ELF_CODE_ADDRESS;
+  segments[0].p_filesz = segments[0].p_memsz = ELF_HEADERS_SIZE + x->size;
+  segments[0].p_align = ELF_PAGE_SIZE;
+  segments[1].p_type = PT_LOAD;
+  segments[1].p_flags = PF_R | PF_W;
+  segments[1].p_vaddr = segments[1].p_paddr = ELF_DATA_ADDRESS;
+  segments[1].p_memsz = DATA_SIZE;
+  segments[1].p_align = ELF_PAGE_SIZE;
+  segments[2].p_type = PT_GNU_STACK;
+  segments[2].p_flags = PF_R | PF_W;
+
+  f = fopen(fileName, "wb");
+  if (f == NULL) return 0;
+  ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+       (fwrite(segments, sizeof(segments), 1, f) == 1) &&
+       (fwrite(x->code, 1, x->size, f) == x->size);
+  ok = (fclose(f) == 0) && ok;
+  return ok && (chmod(fileName, 0755) == 0);
+}
+
+int generateElf(CodeBlock* codeBlock, char* fileName) {
+  RegCode* regCode = translateCode(codeBlock);
+  NativeRuntime runtime;
+  NativeCalls calls;
+  NativeCall* call;
+  ElfRuntime rt;
+  X86* x;
+  int* entries;
+  int* owners;
+  int* starts;
+  int count, ok, i;
+
+  if (regCode == NULL) {
+    printf("kplc: %s\n", vmErrorToString(VM_INVALID_CODE));
+    return 0;
+  }
+  entries = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  owners = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  count = findProcedures(regCode, entries, owners);
+  starts = (int*) malloc(count * sizeof(int));
+
+  x = createBinaryEmitter();
+  genElfRuntime(x, &rt);
+  runtime.readc = (void*) elfAddress(x, rt.readc);
+  runtime.readi = (void*) elfAddress(x, rt.readi);
+  runtime.writec = (void*) elfAddress(x, rt.writec);
+  runtime.writei = (void*) elfAddress(x, rt.writei);
+  runtime.writeln = (void*) elfAddress(x, rt.writeln);
+  runtime.error = (void*) elfAddress(x, rt.error);
+
+  calls.calls = NULL;
+  calls.count = 0;
+  calls.maxCount = 0;
+  x86Bind(x, rt.main);
+  for (i = 0; i < count; i ++) {
+    starts[i] = x->size;
+    genNativeProcedure(x, regCode, entries, owners, i, &runtime, &calls, NULL);
+  }
+
+  ok = finishEmitter(x) && (ELF_CODE_ADDRESS + ELF_HEADERS_SIZE + x->size <= ELF_DATA_ADDRESS);
+  if (ok) {
+    for (i = 0; i < calls.count; i ++) {
+      call = calls.calls + i;
+      x86PatchAbsolute(x->code, call->position,
+                       (void*) (ELF_CODE_ADDRESS + ELF_HEADERS_SIZE + (long long) starts[call->callee]));
+    }
+    ok = writeElfFile(fileName, x, elfAddress(x, rt.start));
+    if (!ok) printf("Can\'t write output file %s!\n", fileName);
+  }
+
+  freeEmitter(x);
+  free(calls.calls);
+  free(starts);
+  free(entries);
+  free(owners);
+  freeRegCode(regCode);
+  return ok;
+}
@@ -0,0 +1,27 @@
+/* Writer of static ELF64 executables
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __ELFGEN_H__
+#define __ELFGEN_H__
+
+#include "symtab.h"
+#include "instructions.h"
+
+// Where the code and the zeroed data of the executable are loaded
+#define ELF_CODE_ADDRESS 0x400000
+#define ELF_DATA_ADDRESS 0x10000000
+
+// Bytes of each of the input and output buffers of the runtime
+#define ELF_BUFFER_SIZE (64 << 10)
+
+/* Writes the machine code of the program, with a small runtime of its own
+   in front, as an x86-64 Linux executable that needs neither the C
+   library nor an assembler or a linker: the runtime talks to the kernel
+   directly. Returns 0 on code the native backend can not translate, or
+   when the file can not be written. */
+int generateElf(CodeBlock* codeBlock, char* fileName);
+
+#endif
@@ -8,14 +8,14 @@
 #include <stdlib.h>
 #include "error.h"
 
-#define NUM_OF_ERRORS 29
+#define NUM_OF_ERRORS 35
 
 struct ErrorMessage {
   ErrorCode errorCode;
   char *message;
 };
 
-struct ErrorMessage errors[29] = {
+struct ErrorMessage errors[NUM_OF_ERRORS] = {
   {ERR_END_OF_COMMENT, "End of comment expected."},
   {ERR_IDENT_TOO_LONG, "Identifier too long."},
   {ERR_INVALID_CONSTANT_CHAR, "Invalid char constant."},
@@ -44,7 +44,13 @@ struct ErrorMessage errors[29] = {
   {ERR_UNDECLARED_PROCEDURE, "Undeclared procedure."},
   {ERR_DUPLICATE_IDENT, "Duplicate identifier."},
   {ERR_TYPE_INCONSISTENCY, "Type inconsistency"},
-  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."}
+  {ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, "The number of arguments and the number of parameters are inconsistent."},
+  {ERR_DIVISION_BY_ZERO, "Division by zero in a constant expression."},
+  {ERR_CONSTANT_OVERFLOW, "Integer overflow in a constant expression."},
+  {ERR_INVALID_ARRAY_SIZE, "Array size must be a positive integer constant."},
+  {ERR_INDEX_OUT_OF_RANGE, "Constant index out of range."},
+  {ERR_ARRAY_TOO_LARGE, "Array too large."},
+  {ERR_FRAME_TOO_LARGE, "Frame too large."}
 };
 
 void error(ErrorCode err, int lineNo, int colNo) {
@@ -37,7 +37,13 @@ typedef enum {
   ERR_UNDECLARED_PROCEDURE,
   ERR_DUPLICATE_IDENT,
   ERR_TYPE_INCONSISTENCY,
-  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY
+  ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY,
+  ERR_DIVISION_BY_ZERO,
+  ERR_CONSTANT_OVERFLOW,
+  ERR_INVALID_ARRAY_SIZE,
+  ERR_INDEX_OUT_OF_RANGE,
+  ERR_ARRAY_TOO_LARGE,
+  ERR_FRAME_TOO_LARGE
 } ErrorCode;
 
 void error(ErrorCode err, int lineNo, int colNo);
@@ -0,0 +1,69 @@
+/* Constant folding
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <limits.h>
+#include "fold.h"
+#include "error.h"
+
+/* Folded values are computed in long long and checked against the range
+   of the target's integer so that constant expressions never wrap. */
+static int checkIntRange(long long v, int lineNo, int colNo) {
+  if ((v < INT_MIN) || (v > INT_MAX))
+    error(ERR_CONSTANT_OVERFLOW, lineNo, colNo);
+  return (int) v;
+}
+
+static int constantToInt(ConstantValue* value) {
+  if (value->type == TP_INT)
+    return value->intValue;
+  else return value->charValue;
+}
+
+void foldNegation(ConstantValue* value, int lineNo, int colNo) {
+  value->intValue = checkIntRange(- (long long) value->intValue, lineNo, colNo);
+}
+
+// Folds value1 op value2 into value1
+void foldArithmetic(TokenType op, ConstantValue* value1, ConstantValue* value2, int lineNo, int colNo) {
+  long long v1 = value1->intValue;
+  long long v2 = value2->intValue;
+  long long v = 0;
+
+  switch (op) {
+  case SB_PLUS:
+    v = v1 + v2;
+    break;
+  case SB_MINUS:
+    v = v1 - v2;
+    break;
+  case SB_TIMES:
+    v = v1 * v2;
+    break;
+  case SB_SLASH:
+    if (v2 == 0)
+      error(ERR_DIVISION_BY_ZERO, lineNo, colNo);
+    v = v1 / v2;
+    break;
+  default:
+    break;
+  }
+  value1->intValue = checkIntRange(v, lineNo, colNo);
+}
+
+int foldComparison(TokenType op, ConstantValue* value1, ConstantValue* value2) {
+  int v1 = constantToInt(value1);
+  int v2 = constantToInt(value2);
+
+  switch (op) {
+  case SB_EQ: return v1 == v2;
+  case SB_NEQ: return v1 != v2;
+  case SB_LT: return v1 < v2;
+  case SB_LE: return v1 <= v2;
+  case SB_GT: return v1 > v2;
+  case SB_GE: return v1 >= v2;
+  default: return 0;
+  }
+}
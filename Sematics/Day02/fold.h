@@ -0,0 +1,17 @@
+/* Constant folding
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __FOLD_H__
+#define __FOLD_H__
+
+#include "token.h"
+#include "symtab.h"
+
+void foldNegation(ConstantValue* value, int lineNo, int colNo);
+void foldArithmetic(TokenType op, ConstantValue* value1, ConstantValue* value2, int lineNo, int colNo);
+int foldComparison(TokenType op, ConstantValue* value1, ConstantValue* value2);
+
+#endif
@@ -0,0 +1,175 @@
+/* Global value numbering
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+
+/* Two instructions that do the same thing to the same values compute the
+   same value, so the second can use the result of the first when the
+   first dominates it. The blocks are walked down the dominator tree with
+   a table of the expressions available so far; leaving a block takes its
+   expressions out again. This is what shares the element addresses of
+   arrays: a(.i.)(.j.) read and written in one statement, or a row used
+   twice in a loop, has its address computed once.
+
+   A load is only the same as an earlier one in its block with no store
+   or call in between, since anything else may have changed the memory. */
+
+#define GVN_BUCKETS 256
+
+struct GVN_ {
+  IRFunction* f;
+  int buckets[GVN_BUCKETS];
+  // The next expression in the same bucket, by instruction
+  int* chain;
+  // The buckets expressions went into, undone when their block is left
+  int* pushed;
+  int pushedCount;
+  // The stores and calls seen so far, for the loads
+  int* memory;
+  int memoryCount;
+  int* replacements;
+  // The blocks each block immediately dominates
+  int* childStarts;
+  int* children;
+  int changes;
+};
+
+typedef struct GVN_ GVN;
+
+int isNumbered(IRInst* inst) {
+  switch (inst->op) {
+  case IR_CONST: case IR_ADDR:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_NEG: case IR_CHECK:
+  case IR_EQ: case IR_NE: case IR_GT: case IR_LT: case IR_GE: case IR_LE:
+  case IR_LOAD:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+int isCommutative(enum IROpCode op) {
+  return (op == IR_ADD) || (op == IR_MUL) || (op == IR_EQ) || (op == IR_NE);
+}
+
+unsigned hashExpression(IRInst* inst) {
+  unsigned h = (unsigned) inst->op * 31u + (unsigned) inst->value * 17u + (unsigned) inst->level;
+  int i;
+
+  // The same either way round for the operators that allow it
+  for (i = 0; i < inst->argCount; i ++)
+    h += isCommutative(inst->op) ? (unsigned) inst->args[i] * 7u :
+      (unsigned) inst->args[i] * (7u + 6u * i);
+  return h % GVN_BUCKETS;
+}
+
+int sameExpression(GVN* g, int a, int b) {
+  IRInst* x = g->f->insts + a;
+  IRInst* y = g->f->insts + b;
+  int i;
+
+  if ((x->op != y->op) || (x->value != y->value) || (x->level != y->level) ||
+      (x->argCount != y->argCount) || (x->isAddress != y->isAddress))
+    return 0;
+  if ((x->op == IR_LOAD) && (g->memory[a] != g->memory[b])) return 0;
+  for (i = 0; (i < x->argCount) && (x->args[i] == y->args[i]); i ++);
+  if (i == x->argCount) return 1;
+  return isCommutative(x->op) && (x->args[0] == y->args[1]) && (x->args[1] == y->args[0]);
+}
+
+void numberBlock(GVN* g, int block) {
+  IRFunction* f = g->f;
+  IRBlock* b = f->blocks + block;
+  IRInst* inst;
+  int mark = g->pushedCount;
+  int i, j, v, h, other;
+
+  // Loads never match across blocks
+  g->memoryCount ++;
+  for (i = 0; i < b->instCount; i ++) {
+    v = b->insts[i];
+    inst = f->insts + v;
+    if (inst->op != IR_PHI)
+      for (j = 0; j < inst->argCount; j ++)
+        inst->args[j] = resolveValue(g->replacements, inst->args[j]);
+    if ((inst->op == IR_STORE) || (inst->op == IR_COPY) || (inst->op == IR_CALL)) g->memoryCount ++;
+    if (!isNumbered(inst)) continue;
+    g->memory[v] = g->memoryCount;
+
+    h = hashExpression(inst);
+    for (other = g->buckets[h]; other != IR_NONE; other = g->chain[other])
+      if (sameExpression(g, other, v)) break;
+    if (other != IR_NONE) {
+      g->replacements[v] = other;
+      removeInstruction(f, v);
+      g->changes ++;
+      continue;
+    }
+    g->chain[v] = g->buckets[h];
+    g->buckets[h] = v;
+    g->pushed[g->pushedCount ++] = h;
+  }
+
+  for (i = g->childStarts[block]; i < g->childStarts[block + 1]; i ++)
+    numberBlock(g, g->children[i]);
+
+  while (g->pushedCount > mark) {
+    h = g->pushed[-- g->pushedCount];
+    g->buckets[h] = g->chain[g->buckets[h]];
+  }
+}
+
+void buildDominatorTree(GVN* g) {
+  IRFunction* f = g->f;
+  int* fill;
+  int i, d;
+
+  g->childStarts = (int*) calloc(f->blockCount + 2, sizeof(int));
+  for (i = 1; i < f->blockCount; i ++)
+    if (f->blocks[i].idom != IR_NONE) g->childStarts[f->blocks[i].idom + 1] ++;
+  for (i = 0; i < f->blockCount; i ++)
+    g->childStarts[i + 1] += g->childStarts[i];
+  g->children = (int*) malloc((f->blockCount + 1) * sizeof(int));
+  fill = (int*) calloc(f->blockCount + 1, sizeof(int));
+  for (i = 1; i < f->blockCount; i ++) {
+    d = f->blocks[i].idom;
+    if (d != IR_NONE) g->children[g->childStarts[d] + fill[d] ++] = i;
+  }
+  free(fill);
+}
+
+int numberValues(IRFunction* f) {
+  GVN g;
+  int i;
+
+  computeDominators(f);
+  g.f = f;
+  g.chain = (int*) malloc((f->instCount + 1) * sizeof(int));
+  g.pushed = (int*) malloc((f->instCount + 1) * sizeof(int));
+  g.memory = (int*) calloc(f->instCount + 1, sizeof(int));
+  g.replacements = (int*) malloc((f->instCount + 1) * sizeof(int));
+  for (i = 0; i < GVN_BUCKETS; i ++)
+    g.buckets[i] = IR_NONE;
+  for (i = 0; i < f->instCount; i ++)
+    g.replacements[i] = IR_NONE;
+  g.pushedCount = g.memoryCount = g.changes = 0;
+  buildDominatorTree(&g);
+
+  numberBlock(&g, 0);
+  // The phis take what reaches them last, once every block is done
+  replaceUses(f, g.replacements);
+  compactBlocks(f);
+
+  free(g.chain);
+  free(g.pushed);
+  free(g.memory);
+  free(g.replacements);
+  free(g.childStarts);
+  free(g.children);
+  return g.changes;
+}
@@ -0,0 +1,342 @@
+/* Inlining of small subprograms
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+#include "irbuild.h"
+#include "vm.h"
+
+// Words inlining may add to the frame of a caller, a small part of the
+// stack, and to that of a caller that can have many frames at once
+#define MAX_INLINE_FRAME_GROWTH ((STACK_SIZE - STACK_RED_ZONE) / 256)
+#define MAX_RECURSIVE_INLINE_FRAME_GROWTH 64
+
+/* A call to a subprogram of at most inlineThreshold instructions is
+   replaced by a copy of its body. The frame of the callee becomes slots
+   of its own at the end of the frame of the caller: the arguments are
+   stored in the slots of the parameters, a value as it is and a
+   reference as the address it stands for, and every return jumps to
+   what followed the call. The variables the callee reaches in the
+   scopes around it are the same frames seen from one scope further, or
+   closer, so that only the levels of their addresses change.
+
+   Subprograms that can call themselves, directly or not, stay as they
+   are, and so do those calling a subprogram nested in them, which would
+   need their frame. Every inlined call keeps the slots of its callee for
+   the whole life of the frame of the caller, so a call is kept when the
+   caller would grow by more than MAX_INLINE_FRAME_GROWTH words, or by
+   more than MAX_RECURSIVE_INLINE_FRAME_GROWTH when the caller can call
+   itself and carries the slots in each of its frames on the stack.
+   Callees are done before their callers, so that a helper inlined into a
+   helper goes along with it. Subprograms nobody calls any more are left
+   empty. */
+
+int inlineThreshold = DEFAULT_INLINE_THRESHOLD;
+
+struct Inliner_ {
+  IRProgram* program;
+  int count;
+  // Whether subprogram i calls subprogram j, then whether it leads there
+  char* calls;
+  char* reaches;
+  // Subprograms in the order they are done, callees first
+  int* order;
+  int orderCount;
+  char* visited;
+};
+
+typedef struct Inliner_ Inliner;
+
+void findCalls(Inliner* in, char* calls) {
+  IRFunction* f;
+  IRInst* inst;
+  int i, j;
+
+  for (i = 0; i < in->count * in->count; i ++)
+    calls[i] = 0;
+  for (i = 0; i < in->count; i ++) {
+    f = in->program->functions[i];
+    for (j = 0; j < f->instCount; j ++) {
+      inst = f->insts + j;
+      if ((inst->block != IR_NONE) && (inst->op == IR_CALL) && (inst->callee != IR_NONE))
+        calls[i * in->count + inst->callee] = 1;
+    }
+  }
+}
+
+void visitCallees(Inliner* in, int i) {
+  int j;
+
+  in->visited[i] = 1;
+  for (j = 0; j < in->count; j ++)
+    if (in->calls[i * in->count + j] && !in->visited[j])
+      visitCallees(in, j);
+  in->order[in->orderCount ++] = i;
+}
+
+// Why the call cannot be inlined, or NULL when it can; the caller has
+// grown by growth words already
+char* refuseInlining(Inliner* in, int caller, int callee, int size, int growth) {
+  static char reason[64];
+  IRFunction* g = in->program->functions[callee];
+  int limit = MAX_INLINE_FRAME_GROWTH;
+  int i;
+
+  if ((callee == 0) || in->reaches[callee * in->count + callee])
+    return "recursive";
+  for (i = 0; i < g->instCount; i ++)
+    if ((g->insts[i].block != IR_NONE) && (g->insts[i].op == IR_CALL) && (g->insts[i].level == 0))
+      return "calls a subprogram nested in it";
+  if (size > inlineThreshold) {
+    sprintf(reason, "%d instructions, over %d", size, inlineThreshold);
+    return reason;
+  }
+  if (in->reaches[caller * in->count + caller])
+    limit = MAX_RECURSIVE_INLINE_FRAME_GROWTH;
+  if (growth + g->slotCount > limit) {
+    sprintf(reason, "frame grows by %d words, over %d", growth + g->slotCount, limit);
+    return reason;
+  }
+  return NULL;
+}
+
+// The same address seen from the caller, with the slots of the callee from base on
+void rebaseInstruction(IRInst* inst, int callLevel, int base) {
+  if ((inst->op != IR_ADDR) && (inst->op != IR_CALL)) return;
+  if (inst->level > 0) inst->level += callLevel - 1;
+  else if (inst->op == IR_ADDR) inst->value += base;
+}
+
+int emitSlotAddress(IRFunction* f, int block, int slot, int lineNo) {
+  int address = emitInstruction(f, block, IR_ADDR);
+
+  f->insts[address].value = slot;
+  f->insts[address].isAddress = 1;
+  f->insts[address].type = f->slotTypes[slot];
+  f->insts[address].lineNo = lineNo;
+  return address;
+}
+
+void inlineCall(IRFunction* f, int call, IRFunction* g) {
+  IRInst* site = f->insts + call;
+  int block = site->block;
+  int callLevel = site->level;
+  int lineNo = site->lineNo;
+  int hasValue = irHasValue(site);
+  Type* type = site->type;
+  int* args;
+  int argCount = site->argCount;
+  int* blocks = (int*) malloc((g->blockCount + 1) * sizeof(int));
+  int* values = (int*) malloc((g->instCount + 1) * sizeof(int));
+  int* replacements;
+  int* returns = (int*) malloc((g->blockCount + 1) * sizeof(int));
+  int returnCount = 0;
+  int base = f->slotCount;
+  int rest, position, address, store, result;
+  IRBlock* b;
+  IRBlock* from;
+  IRInst* inst;
+  int i, j, k, v;
+
+  args = (int*) malloc((argCount + 1) * sizeof(int));
+  for (i = 0; i < argCount; i ++)
+    args[i] = site->args[i];
+
+  resizeSlots(f, base + g->slotCount);
+  for (i = 0; i < g->slotCount; i ++) {
+    f->slotTypes[base + i] = g->slotTypes[i];
+    f->slotIsReference[base + i] = g->slotIsReference[i];
+    f->slotIsArray[base + i] = g->slotIsArray[i];
+  }
+
+  // What follows the call goes to a block of its own
+  rest = newBlock(f);
+  b = f->blocks + block;
+  for (position = 0; b->insts[position] != call; position ++);
+  for (i = position + 1; i < b->instCount; i ++)
+    appendInstruction(f, rest, f->blocks[block].insts[i]);
+  b = f->blocks + block;
+  b->instCount = position;
+  removeInstruction(f, call);
+  for (i = 0; i < b->succCount; i ++) {
+    f->blocks[rest].succs[i] = b->succs[i];
+    k = predecessorIndex(f, b->succs[i], block);
+    f->blocks[b->succs[i]].preds[k] = rest;
+  }
+  f->blocks[rest].succCount = f->blocks[block].succCount;
+  f->blocks[block].succCount = 0;
+
+  for (i = 0; i < argCount; i ++) {
+    address = emitSlotAddress(f, block, base + RESERVED_WORDS + i, lineNo);
+    store = emitInstruction(f, block, IR_STORE);
+    f->insts[store].lineNo = lineNo;
+    addArgument(f, store, address);
+    addArgument(f, store, args[i]);
+  }
+
+  // The blocks and instructions of the callee, then their operands
+  for (i = 0; i < g->blockCount; i ++)
+    blocks[i] = newBlock(f);
+  for (i = 0; i < g->instCount; i ++)
+    values[i] = IR_NONE;
+  for (i = 0; i < g->blockCount; i ++)
+    for (j = 0; j < g->blocks[i].instCount; j ++) {
+      v = g->blocks[i].insts[j];
+      inst = g->insts + v;
+      if (inst->op == IR_ENTRY) {
+        // What the slot holds on entry is what the call put there
+        address = emitSlotAddress(f, block, base + inst->value, lineNo);
+        values[v] = emitInstruction(f, block, IR_LOAD);
+        f->insts[values[v]].type = g->insts[v].type;
+        f->insts[values[v]].isAddress = g->insts[v].isAddress;
+        f->insts[values[v]].lineNo = lineNo;
+        addArgument(f, values[v], address);
+        continue;
+      }
+      if (inst->op == IR_RETURN) {
+        values[v] = emitInstruction(f, blocks[i], IR_JUMP);
+        returns[returnCount ++] = i;
+      } else {
+        values[v] = emitInstruction(f, blocks[i], inst->op);
+        inst = g->insts + v;
+        f->insts[values[v]].value = inst->value;
+        f->insts[values[v]].level = inst->level;
+        f->insts[values[v]].callee = inst->callee;
+        f->insts[values[v]].type = inst->type;
+        f->insts[values[v]].isAddress = inst->isAddress;
+        rebaseInstruction(f->insts + values[v], callLevel, base);
+      }
+      f->insts[values[v]].lineNo = lineNo;
+    }
+  for (i = 0; i < g->instCount; i ++)
+    if ((values[i] != IR_NONE) && (g->insts[i].op != IR_ENTRY) && (g->insts[i].op != IR_RETURN))
+      for (j = 0; j < g->insts[i].argCount; j ++)
+        addArgument(f, values[i], values[g->insts[i].args[j]]);
+
+  for (i = 0; i < g->blockCount; i ++) {
+    from = g->blocks + i;
+    b = f->blocks + blocks[i];
+    b->preds = (int*) malloc((from->predCount + 1) * sizeof(int));
+    b->maxPreds = from->predCount + 1;
+    for (j = 0; j < from->predCount; j ++)
+      b->preds[j] = blocks[from->preds[j]];
+    b->predCount = from->predCount;
+    for (j = 0; j < from->succCount; j ++)
+      b->succs[j] = blocks[from->succs[j]];
+    b->succCount = from->succCount;
+  }
+  emitInstruction(f, block, IR_JUMP);
+  f->insts[terminatorOf(f, block)].lineNo = lineNo;
+  addEdge(f, block, blocks[0]);
+  for (i = 0; i < returnCount; i ++)
+    addEdge(f, blocks[returns[i]], rest);
+
+  // The value of a function is what its returns bring to the block after the call
+  if (hasValue) {
+    if (returnCount == 0) {
+      result = newInstruction(f, IR_CONST);
+      insertInstruction(f, block, f->blocks[block].instCount - 1, result);
+    } else if (returnCount == 1)
+      result = values[g->insts[terminatorOf(g, returns[0])].args[0]];
+    else {
+      result = newInstruction(f, IR_PHI);
+      for (i = 0; i < returnCount; i ++)
+        addArgument(f, result, values[g->insts[terminatorOf(g, returns[i])].args[0]]);
+      insertInstruction(f, rest, 0, result);
+    }
+    f->insts[result].type = type;
+    replacements = (int*) malloc((f->instCount + 1) * sizeof(int));
+    for (i = 0; i < f->instCount; i ++)
+      replacements[i] = IR_NONE;
+    replacements[call] = result;
+    replaceUses(f, replacements);
+    free(replacements);
+  }
+
+  free(args);
+  free(blocks);
+  free(values);
+  free(returns);
+}
+
+// A subprogram nobody calls keeps only a halt
+void emptySubprogram(IRFunction* f) {
+  int i, j;
+
+  for (i = 0; i < f->blockCount; i ++) {
+    for (j = 0; j < f->blocks[i].instCount; j ++)
+      removeInstruction(f, f->blocks[i].insts[j]);
+    f->blocks[i].predCount = 0;
+    f->blocks[i].succCount = 0;
+  }
+  compactBlocks(f);
+  emitInstruction(f, 0, IR_HALT);
+}
+
+int inlineSubprograms(IRProgram* program) {
+  Inliner in;
+  IRFunction* f;
+  IRFunction* g;
+  IRInst* site;
+  char* reason;
+  int changes = 0;
+  int i, j, k, n, v, instCount, slotCount, size;
+
+  n = in.count = program->count;
+  in.program = program;
+  in.calls = (char*) malloc(n * n + 1);
+  in.reaches = (char*) malloc(n * n + 1);
+  in.order = (int*) malloc((n + 1) * sizeof(int));
+  in.visited = (char*) calloc(n + 1, 1);
+  in.orderCount = 0;
+  findCalls(&in, in.calls);
+  for (i = 0; i < n * n; i ++)
+    in.reaches[i] = in.calls[i];
+  for (k = 0; k < n; k ++)
+    for (i = 0; i < n; i ++)
+      if (in.reaches[i * n + k])
+        for (j = 0; j < n; j ++)
+          if (in.reaches[k * n + j]) in.reaches[i * n + j] = 1;
+  visitCallees(&in, 0);
+
+  for (i = 0; i < in.orderCount; i ++) {
+    f = program->functions[in.order[i]];
+    instCount = f->instCount;
+    slotCount = f->slotCount;
+    for (v = 0; v < instCount; v ++) {
+      site = f->insts + v;
+      if ((site->block == IR_NONE) || (site->op != IR_CALL) || (site->callee == IR_NONE)) continue;
+      g = program->functions[site->callee];
+      size = countInstructions(g);
+      reason = refuseInlining(&in, in.order[i], site->callee, size, f->slotCount - slotCount);
+      if (reportDecisions) {
+        fprintf(stderr, "inline %s into %s, line %d: ", g->name, f->name, site->lineNo);
+        if (reason == NULL) fprintf(stderr, "inlined, %d instructions\n", size);
+        else fprintf(stderr, "kept, %s\n", reason);
+      }
+      if (reason != NULL) continue;
+      inlineCall(f, v, g);
+      changes ++;
+    }
+  }
+
+  // What is left of the subprograms no call reaches any more
+  findCalls(&in, in.calls);
+  for (i = 0; i < n; i ++)
+    in.visited[i] = 0;
+  in.orderCount = 0;
+  visitCallees(&in, 0);
+  for (i = 1; i < n; i ++)
+    if (!in.visited[i] && (countInstructions(program->functions[i]) > 1))
+      emptySubprogram(program->functions[i]);
+
+  free(in.calls);
+  free(in.reaches);
+  free(in.order);
+  free(in.visited);
+  return changes;
+}
@@ -0,0 +1,326 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "instructions.h"
+
+struct OpCodeInfo {
+  char *name;
+  int operands;  // 0: none, 1: q only, 2: p and q
+};
+
+struct OpCodeInfo opCodes[NUM_OF_OPCODES] = {
+  {"LA", 2}, {"LV", 2}, {"LC", 1}, {"LI", 0},
+  {"INT", 1}, {"DCT", 1}, {"J", 1}, {"FJ", 1},
+  {"HL", 0}, {"ST", 0}, {"CALL", 2}, {"EP", 0},
+  {"EF", 0}, {"RC", 0}, {"RI", 0}, {"WRC", 0},
+  {"WRI", 0}, {"WLN", 0}, {"AD", 0}, {"SB", 0},
+  {"ML", 0}, {"DV", 0}, {"NEG", 0}, {"CV", 0},
+  {"EQ", 0}, {"NE", 0}, {"GT", 0}, {"LT", 0},
+  {"GE", 0}, {"LE", 0}, {"CK", 1}, {"CP", 1},
+  {"BP", 0}
+};
+
+CodeBlock* createCodeBlock(int maxSize) {
+  CodeBlock* codeBlock = (CodeBlock*) malloc(sizeof(CodeBlock));
+
+  codeBlock->code = (Instruction*) malloc(maxSize * sizeof(Instruction));
+  codeBlock->codeSize = 0;
+  codeBlock->maxSize = maxSize;
+  codeBlock->lines = NULL;
+  codeBlock->lineCount = 0;
+  codeBlock->maxLines = 0;
+  codeBlock->frames = NULL;
+  codeBlock->frameCount = 0;
+  codeBlock->image = NULL;
+  codeBlock->imageSize = 0;
+  return codeBlock;
+}
+
+void freeCodeBlock(CodeBlock* codeBlock) {
+  if (codeBlock->image != NULL)
+    munmap(codeBlock->image, codeBlock->imageSize);
+  else {
+    free(codeBlock->code);
+    free(codeBlock->lines);
+    free(codeBlock->frames);
+  }
+  free(codeBlock);
+}
+
+int emitCode(CodeBlock* codeBlock, enum OpCode op, WORD p, WORD q) {
+  Instruction* bottom;
+
+  if (codeBlock->codeSize >= codeBlock->maxSize) {
+    Instruction* code = (Instruction*) realloc(codeBlock->code, 2 * codeBlock->maxSize * sizeof(Instruction));
+    if (code == NULL) return 0;
+    codeBlock->code = code;
+    codeBlock->maxSize *= 2;
+  }
+
+  bottom = codeBlock->code + codeBlock->codeSize;
+  bottom->op = op;
+  bottom->p = p;
+  bottom->q = q;
+  codeBlock->codeSize ++;
+  return 1;
+}
+
+// Marks the start of a statement at the current end of the code
+int emitLine(CodeBlock* codeBlock, int lineNo) {
+  LineEntry* entry;
+
+  if (codeBlock->lineCount >= codeBlock->maxLines) {
+    int maxLines = (codeBlock->maxLines == 0) ? 64 : 2 * codeBlock->maxLines;
+    LineEntry* lines = (LineEntry*) realloc(codeBlock->lines, maxLines * sizeof(LineEntry));
+    if (lines == NULL) return 0;
+    codeBlock->lines = lines;
+    codeBlock->maxLines = maxLines;
+  }
+
+  entry = codeBlock->lines + codeBlock->lineCount;
+  entry->address = codeBlock->codeSize;
+  entry->lineNo = lineNo;
+  codeBlock->lineCount ++;
+  return 1;
+}
+
+// Forgets the statements starting at or after address
+void discardLines(CodeBlock* codeBlock, CodeAddress address) {
+  while ((codeBlock->lineCount > 0) &&
+         (codeBlock->lines[codeBlock->lineCount - 1].address >= address))
+    codeBlock->lineCount --;
+}
+
+int emitLA(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_LA, p, q); }
+int emitLV(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_LV, p, q); }
+int emitLC(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_LC, DC_VALUE, q); }
+int emitLI(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LI, DC_VALUE, DC_VALUE); }
+int emitINT(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_INT, DC_VALUE, q); }
+int emitDCT(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_DCT, DC_VALUE, q); }
+int emitJ(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_J, DC_VALUE, q); }
+int emitFJ(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_FJ, DC_VALUE, q); }
+int emitHL(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_HL, DC_VALUE, DC_VALUE); }
+int emitST(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_ST, DC_VALUE, DC_VALUE); }
+int emitCALL(CodeBlock* codeBlock, WORD p, WORD q) { return emitCode(codeBlock, OP_CALL, p, q); }
+int emitEP(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_EP, DC_VALUE, DC_VALUE); }
+int emitEF(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_EF, DC_VALUE, DC_VALUE); }
+int emitRC(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_RC, DC_VALUE, DC_VALUE); }
+int emitRI(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_RI, DC_VALUE, DC_VALUE); }
+int emitWRC(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_WRC, DC_VALUE, DC_VALUE); }
+int emitWRI(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_WRI, DC_VALUE, DC_VALUE); }
+int emitWLN(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_WLN, DC_VALUE, DC_VALUE); }
+int emitAD(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_AD, DC_VALUE, DC_VALUE); }
+int emitSB(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_SB, DC_VALUE, DC_VALUE); }
+int emitML(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_ML, DC_VALUE, DC_VALUE); }
+int emitDV(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_DV, DC_VALUE, DC_VALUE); }
+int emitNEG(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_NEG, DC_VALUE, DC_VALUE); }
+int emitCV(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_CV, DC_VALUE, DC_VALUE); }
+int emitEQ(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_EQ, DC_VALUE, DC_VALUE); }
+int emitNE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_NE, DC_VALUE, DC_VALUE); }
+int emitGT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GT, DC_VALUE, DC_VALUE); }
+int emitLT(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LT, DC_VALUE, DC_VALUE); }
+int emitGE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_GE, DC_VALUE, DC_VALUE); }
+int emitLE(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_LE, DC_VALUE, DC_VALUE); }
+int emitCK(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_CK, DC_VALUE, q); }
+int emitCP(CodeBlock* codeBlock, WORD q) { return emitCode(codeBlock, OP_CP, DC_VALUE, q); }
+int emitBP(CodeBlock* codeBlock) { return emitCode(codeBlock, OP_BP, DC_VALUE, DC_VALUE); }
+
+int opCodeOperands(enum OpCode op) {
+  return opCodes[op].operands;
+}
+
+char* opCodeToString(enum OpCode op) {
+  return opCodes[op].name;
+}
+
+void printInstruction(Instruction* inst) {
+  switch (opCodes[inst->op].operands) {
+  case 2:
+    printf("%s %d,%d", opCodes[inst->op].name, inst->p, inst->q);
+    break;
+  case 1:
+    printf("%s %d", opCodes[inst->op].name, inst->q);
+    break;
+  default:
+    printf("%s", opCodes[inst->op].name);
+    break;
+  }
+}
+
+void printCodeBlock(CodeBlock* codeBlock) {
+  Instruction* pc = codeBlock->code;
+  int i;
+
+  for (i = 0 ; i < codeBlock->codeSize; i ++) {
+    printf("%d:  ",i);
+    printInstruction(pc);
+    printf("\n");
+    pc ++;
+  }
+}
+
+void printCodeSummary(CodeBlock* codeBlock) {
+  int counts[NUM_OF_OPCODES];
+  int i;
+
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    counts[codeBlock->code[i].op] ++;
+
+  printf("%d instructions\n", codeBlock->codeSize);
+  for (i = 0; i < NUM_OF_OPCODES; i ++)
+    if (counts[i] > 0)
+      printf("  %-5s %d\n", opCodes[i].name, counts[i]);
+}
+
+/******************* Binary code file ******************************/
+
+/* A .kplb file is an image of the code block, laid out as described in
+   instructions.h: the instructions, the frame layouts and the line table
+   are the arrays the machine works on, so loading maps the file and
+   points the block into it, with no decoding and no relocation. */
+
+// Bytes of padding that bring offset to an 8-byte boundary
+int imagePadding(int offset) {
+  return (8 - offset % 8) % 8;
+}
+
+int saveCode(CodeBlock* codeBlock, char* fileName) {
+  FILE* f = fopen(fileName, "wb");
+  ImageHeader header;
+  ImageSection sections[KPLB_SECTIONS];
+  void* data[KPLB_SECTIONS];
+  char zeros[8];
+  int offset, i, ok;
+
+  if (f == NULL) return 0;
+
+  sections[0].kind = KPLB_CODE;
+  sections[0].count = codeBlock->codeSize;
+  sections[0].entrySize = sizeof(Instruction);
+  data[0] = codeBlock->code;
+  sections[1].kind = KPLB_FRAMES;
+  sections[1].count = codeBlock->frameCount;
+  sections[1].entrySize = sizeof(FrameLayout);
+  data[1] = codeBlock->frames;
+  sections[2].kind = KPLB_LINES;
+  sections[2].count = codeBlock->lineCount;
+  sections[2].entrySize = sizeof(LineEntry);
+  data[2] = codeBlock->lines;
+
+  offset = sizeof(ImageHeader) + sizeof(sections);
+  for (i = 0; i < KPLB_SECTIONS; i ++) {
+    offset += imagePadding(offset);
+    sections[i].offset = offset;
+    offset += sections[i].count * sections[i].entrySize;
+  }
+
+  memcpy(header.magic, KPLB_MAGIC, 4);
+  header.version = KPLB_VERSION;
+  header.sectionCount = KPLB_SECTIONS;
+  header.imageSize = offset;
+
+  memset(zeros, 0, sizeof(zeros));
+  ok = (fwrite(&header, sizeof(header), 1, f) == 1) &&
+       (fwrite(sections, sizeof(sections), 1, f) == 1);
+  offset = sizeof(ImageHeader) + sizeof(sections);
+  for (i = 0; ok && (i < KPLB_SECTIONS); i ++) {
+    ok = fwrite(zeros, 1, sections[i].offset - offset, f) == sections[i].offset - offset;
+    if (ok && (sections[i].count > 0))
+      ok = fwrite(data[i], sections[i].entrySize, sections[i].count, f) == sections[i].count;
+    offset = sections[i].offset + sections[i].count * sections[i].entrySize;
+  }
+  return (fclose(f) == 0) && ok;
+}
+
+// The entries of the section of kind in the image, or NULL when it is missing
+void* findSection(char* image, int kind, int entrySize, int* count) {
+  ImageHeader* header = (ImageHeader*) image;
+  ImageSection* section = (ImageSection*) (image + sizeof(ImageHeader));
+  int i;
+
+  *count = 0;
+  for (i = 0; i < header->sectionCount; i ++, section ++)
+    if (section->kind == kind) {
+      if ((section->entrySize != entrySize) || (section->count < 0) ||
+          (section->offset < 0) || (section->offset % 8 != 0) ||
+          (section->offset > header->imageSize) ||
+          (section->count > (header->imageSize - section->offset) / entrySize))
+        return NULL;
+      *count = section->count;
+      return image + section->offset;
+    }
+  return NULL;
+}
+
+int loadCode(CodeBlock* codeBlock, char* fileName) {
+  int fd = open(fileName, O_RDONLY);
+  struct stat st;
+  ImageHeader* header;
+  char* image;
+  int i;
+
+  if (fd < 0) return 0;
+  if ((fstat(fd, &st) != 0) || (st.st_size < sizeof(ImageHeader))) {
+    close(fd);
+    return 0;
+  }
+  image = (char*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) return 0;
+
+  // The header, the section table and the kinds of instructions are all
+  // that is checked: createVM checks the operands of the instructions, and
+  // translateCode those and the operands it relies on
+  header = (ImageHeader*) image;
+  if ((memcmp(header->magic, KPLB_MAGIC, 4) != 0) || (header->version != KPLB_VERSION) ||
+      (header->imageSize > st.st_size) || (header->sectionCount < 0) ||
+      (header->sectionCount > (header->imageSize - (int) sizeof(ImageHeader)) / (int) sizeof(ImageSection))) {
+    munmap(image, st.st_size);
+    return 0;
+  }
+
+  if (codeBlock->image != NULL)
+    munmap(codeBlock->image, codeBlock->imageSize);
+  else {
+    free(codeBlock->code);
+    free(codeBlock->lines);
+    free(codeBlock->frames);
+  }
+  codeBlock->image = image;
+  codeBlock->imageSize = st.st_size;
+  codeBlock->code = (Instruction*) findSection(image, KPLB_CODE, sizeof(Instruction), &(codeBlock->codeSize));
+  codeBlock->maxSize = codeBlock->codeSize;
+  codeBlock->frames = (FrameLayout*) findSection(image, KPLB_FRAMES, sizeof(FrameLayout), &(codeBlock->frameCount));
+  codeBlock->lines = (LineEntry*) findSection(image, KPLB_LINES, sizeof(LineEntry), &(codeBlock->lineCount));
+  codeBlock->maxLines = codeBlock->lineCount;
+
+  if (codeBlock->code == NULL) return 0;
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    if (((int) codeBlock->code[i].op < 0) || (codeBlock->code[i].op >= NUM_OF_OPCODES))
+      return 0;
+  return 1;
+}
+
+// The sections of a loaded image and its frame layouts
+void printImage(CodeBlock* codeBlock) {
+  int i;
+
+  printf("KPLB version %d, %d bytes\n", KPLB_VERSION, codeBlock->imageSize);
+  printf("  code   %d instructions\n", codeBlock->codeSize);
+  printf("  frames %d\n", codeBlock->frameCount);
+  for (i = 0; i < codeBlock->frameCount; i ++)
+    printf("    entry %d, depth %d, %d words\n", codeBlock->frames[i].entry,
+           codeBlock->frames[i].depth, codeBlock->frames[i].size);
+  printf("  lines  %d\n", codeBlock->lineCount);
+}
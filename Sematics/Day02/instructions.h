@@ -0,0 +1,185 @@
+/*
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __INSTRUCTIONS_H__
+#define __INSTRUCTIONS_H__
+
+#define DC_VALUE 0
+
+#define KPLB_MAGIC "KPLB"
+#define KPLB_VERSION 3
+
+// Sections of a .kplb image
+#define KPLB_CODE 1
+#define KPLB_FRAMES 2
+#define KPLB_LINES 3
+#define KPLB_SECTIONS 3
+
+enum OpCode {
+  OP_LA,   // Load Address:    t := t + 1; s[t] := base(p) + q;
+  OP_LV,   // Load Value:      t := t + 1; s[t] := s[base(p) + q];
+  OP_LC,   // Load Constant:   t := t + 1; s[t] := q;
+  OP_LI,   // Load Indirect:   s[t] := s[s[t]];
+  OP_INT,  // Increment T:     t := t + q;
+  OP_DCT,  // Decrement T:     t := t - q;
+  OP_J,    // Jump:            pc := q;
+  OP_FJ,   // False Jump:      if s[t] = 0 then pc := q; t := t - 1;
+  OP_HL,   // Halt
+  OP_ST,   // Store:           s[s[t-1]] := s[t]; t := t - 2;
+  OP_CALL, // Call:            s[t+2] := b; s[t+3] := pc; s[t+4] := base(p); b := t + 1; pc := q;
+  OP_EP,   // Exit Procedure:  t := b - 1; pc := s[b+2]; b := s[b+1];
+  OP_EF,   // Exit Function:   t := b; pc := s[b+2]; b := s[b+1];
+  OP_RC,   // Read Char:       t := t + 1; s[t] := getch;
+  OP_RI,   // Read Integer:    t := t + 1; s[t] := integer;
+  OP_WRC,  // Write Char:      write s[t]; t := t - 1;
+  OP_WRI,  // Write Integer:   write s[t]; t := t - 1;
+  OP_WLN,  // New Line
+  OP_AD,   // Add:             t := t - 1; s[t] := s[t] + s[t+1];
+  OP_SB,   // Subtract:        t := t - 1; s[t] := s[t] - s[t+1];
+  OP_ML,   // Multiply:        t := t - 1; s[t] := s[t] * s[t+1];
+  OP_DV,   // Divide:          t := t - 1; s[t] := s[t] / s[t+1];
+  OP_NEG,  // Negative:        s[t] := - s[t];
+  OP_CV,   // Copy Top:        s[t+1] := s[t]; t := t + 1;
+  OP_EQ,   // Equal:           t := t - 1; s[t] := (s[t] = s[t+1]);
+  OP_NE,   // Not Equal:       t := t - 1; s[t] := (s[t] != s[t+1]);
+  OP_GT,   // Greater:         t := t - 1; s[t] := (s[t] > s[t+1]);
+  OP_LT,   // Less:            t := t - 1; s[t] := (s[t] < s[t+1]);
+  OP_GE,   // Greater or Equal: t := t - 1; s[t] := (s[t] >= s[t+1]);
+  OP_LE,   // Less or Equal:   t := t - 1; s[t] := (s[t] <= s[t+1]);
+  OP_CK,   // Check Index:     if (s[t] < 1) or (s[t] > q) then stop;
+  OP_CP,   // Copy:            s[s[t-1]..s[t-1]+q-1] := s[s[t]..s[t]+q-1]; t := t - 2;
+
+  OP_BP    // Break point. Just for debugging
+};
+
+#define NUM_OF_OPCODES (OP_BP + 1)
+
+typedef int WORD;
+
+/* x / y for a y that is not 0. Dividing the most negative WORD by -1
+   wraps around to itself, as adding and multiplying wrap. */
+#define DIVIDE_WORDS(x, y) (((y) == -1) ? (WORD) (0u - (unsigned) (x)) : (x) / (y))
+typedef int CodeAddress;
+
+struct Instruction_ {
+  enum OpCode op;
+  WORD p;
+  WORD q;
+};
+
+typedef struct Instruction_ Instruction;
+
+// The first instruction of a statement and the source line it comes from
+struct LineEntry_ {
+  CodeAddress address;
+  int lineNo;
+};
+
+typedef struct LineEntry_ LineEntry;
+
+// The frame of a subprogram, or of the program at address 0
+struct FrameLayout_ {
+  CodeAddress entry;
+  int depth;
+  int size;
+};
+
+typedef struct FrameLayout_ FrameLayout;
+
+/* The image starts with this header, followed by sectionCount sections,
+   each one an array of count entries of entrySize bytes at offset from
+   the start of the image, on an 8-byte boundary. Everything in it is a
+   little endian word, and an address is the index of an instruction, so
+   that the image is used in place wherever it is mapped. */
+struct ImageSection_ {
+  int kind;
+  int offset;
+  int count;
+  int entrySize;
+};
+
+typedef struct ImageSection_ ImageSection;
+
+struct ImageHeader_ {
+  char magic[4];
+  int version;
+  int sectionCount;
+  int imageSize;
+};
+
+typedef struct ImageHeader_ ImageHeader;
+
+struct CodeBlock_ {
+  Instruction* code;
+  int codeSize;
+  int maxSize;
+  LineEntry* lines;
+  int lineCount;
+  int maxLines;
+  FrameLayout* frames;
+  int frameCount;
+  // The mapped image that code, lines and frames point into, read only,
+  // when the block was loaded
+  char* image;
+  int imageSize;
+};
+
+typedef struct CodeBlock_ CodeBlock;
+
+CodeBlock* createCodeBlock(int maxSize);
+void freeCodeBlock(CodeBlock* codeBlock);
+
+int emitCode(CodeBlock* codeBlock, enum OpCode op, WORD p, WORD q);
+
+int emitLine(CodeBlock* codeBlock, int lineNo);
+void discardLines(CodeBlock* codeBlock, CodeAddress address);
+
+int emitLA(CodeBlock* codeBlock, WORD p, WORD q);
+int emitLV(CodeBlock* codeBlock, WORD p, WORD q);
+int emitLC(CodeBlock* codeBlock, WORD q);
+int emitLI(CodeBlock* codeBlock);
+int emitINT(CodeBlock* codeBlock, WORD q);
+int emitDCT(CodeBlock* codeBlock, WORD q);
+int emitJ(CodeBlock* codeBlock, WORD q);
+int emitFJ(CodeBlock* codeBlock, WORD q);
+int emitHL(CodeBlock* codeBlock);
+int emitST(CodeBlock* codeBlock);
+int emitCALL(CodeBlock* codeBlock, WORD p, WORD q);
+int emitEP(CodeBlock* codeBlock);
+int emitEF(CodeBlock* codeBlock);
+int emitRC(CodeBlock* codeBlock);
+int emitRI(CodeBlock* codeBlock);
+int emitWRC(CodeBlock* codeBlock);
+int emitWRI(CodeBlock* codeBlock);
+int emitWLN(CodeBlock* codeBlock);
+int emitAD(CodeBlock* codeBlock);
+int emitSB(CodeBlock* codeBlock);
+int emitML(CodeBlock* codeBlock);
+int emitDV(CodeBlock* codeBlock);
+int emitNEG(CodeBlock* codeBlock);
+int emitCV(CodeBlock* codeBlock);
+int emitEQ(CodeBlock* codeBlock);
+int emitNE(CodeBlock* codeBlock);
+int emitGT(CodeBlock* codeBlock);
+int emitLT(CodeBlock* codeBlock);
+int emitGE(CodeBlock* codeBlock);
+int emitLE(CodeBlock* codeBlock);
+int emitCK(CodeBlock* codeBlock, WORD q);
+int emitCP(CodeBlock* codeBlock, WORD q);
+int emitBP(CodeBlock* codeBlock);
+
+int opCodeOperands(enum OpCode op);
+char* opCodeToString(enum OpCode op);
+
+void printInstruction(Instruction* inst);
+void printCodeBlock(CodeBlock* codeBlock);
+void printCodeSummary(CodeBlock* codeBlock);
+
+int saveCode(CodeBlock* codeBlock, char* fileName);
+int loadCode(CodeBlock* codeBlock, char* fileName);
+void printImage(CodeBlock* codeBlock);
+
+#endif
@@ -0,0 +1,686 @@
+/* Intermediate representation of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir.h"
+
+Type irIntType = { TP_INT, 0, NULL };
+Type irCharType = { TP_CHAR, 0, NULL };
+
+IRFunction* createIRFunction(char* name, int kind) {
+  IRFunction* f = (IRFunction*) malloc(sizeof(IRFunction));
+
+  f->name = name;
+  f->kind = kind;
+  f->object = NULL;
+  f->scope = NULL;
+  f->parent = IR_NONE;
+  f->depth = 0;
+  f->address = 0;
+  f->frameSize = RESERVED_WORDS;
+  f->paramCount = 0;
+  f->returnType = NULL;
+  f->slotTypes = NULL;
+  f->slotIsReference = NULL;
+  f->slotIsArray = NULL;
+  f->slotCount = 0;
+  f->insts = NULL;
+  f->instCount = 0;
+  f->maxInsts = 0;
+  f->blocks = NULL;
+  f->blockCount = 0;
+  f->maxBlocks = 0;
+  return f;
+}
+
+void freeIRFunction(IRFunction* f) {
+  int i;
+
+  for (i = 0; i < f->instCount; i ++)
+    free(f->insts[i].args);
+  for (i = 0; i < f->blockCount; i ++) {
+    free(f->blocks[i].insts);
+    free(f->blocks[i].preds);
+  }
+  free(f->insts);
+  free(f->blocks);
+  free(f->slotTypes);
+  free(f->slotIsReference);
+  free(f->slotIsArray);
+  free(f);
+}
+
+IRProgram* createIRProgram(void) {
+  IRProgram* program = (IRProgram*) malloc(sizeof(IRProgram));
+
+  program->functions = NULL;
+  program->count = 0;
+  return program;
+}
+
+void addIRFunction(IRProgram* program, IRFunction* f) {
+  program->functions = (IRFunction**) realloc(program->functions, (program->count + 1) * sizeof(IRFunction*));
+  program->functions[program->count ++] = f;
+}
+
+void freeIRProgram(IRProgram* program) {
+  int i;
+
+  for (i = 0; i < program->count; i ++)
+    freeIRFunction(program->functions[i]);
+  free(program->functions);
+  free(program);
+}
+
+/******************* Building ******************************/
+
+int newBlock(IRFunction* f) {
+  IRBlock* block;
+
+  if (f->blockCount >= f->maxBlocks) {
+    f->maxBlocks = (f->maxBlocks == 0) ? 16 : 2 * f->maxBlocks;
+    f->blocks = (IRBlock*) realloc(f->blocks, f->maxBlocks * sizeof(IRBlock));
+  }
+  block = f->blocks + f->blockCount;
+  block->insts = NULL;
+  block->instCount = 0;
+  block->maxInsts = 0;
+  block->preds = NULL;
+  block->predCount = 0;
+  block->maxPreds = 0;
+  block->succCount = 0;
+  block->idom = IR_NONE;
+  block->order = IR_NONE;
+  return f->blockCount ++;
+}
+
+void addEdge(IRFunction* f, int from, int to) {
+  IRBlock* block = f->blocks + to;
+
+  f->blocks[from].succs[f->blocks[from].succCount ++] = to;
+  if (block->predCount >= block->maxPreds) {
+    block->maxPreds = (block->maxPreds == 0) ? 4 : 2 * block->maxPreds;
+    block->preds = (int*) realloc(block->preds, block->maxPreds * sizeof(int));
+  }
+  block->preds[block->predCount ++] = from;
+}
+
+int newInstruction(IRFunction* f, enum IROpCode op) {
+  IRInst* inst;
+
+  if (f->instCount >= f->maxInsts) {
+    f->maxInsts = (f->maxInsts == 0) ? 64 : 2 * f->maxInsts;
+    f->insts = (IRInst*) realloc(f->insts, f->maxInsts * sizeof(IRInst));
+  }
+  inst = f->insts + f->instCount;
+  inst->op = op;
+  inst->block = IR_NONE;
+  inst->value = 0;
+  inst->level = 0;
+  inst->callee = IR_NONE;
+  inst->args = NULL;
+  inst->argCount = 0;
+  inst->maxArgs = 0;
+  inst->type = NULL;
+  inst->isAddress = 0;
+  inst->lineNo = 0;
+  return f->instCount ++;
+}
+
+void addArgument(IRFunction* f, int inst, int arg) {
+  IRInst* i = f->insts + inst;
+
+  if (i->argCount >= i->maxArgs) {
+    i->maxArgs = (i->maxArgs == 0) ? 2 : 2 * i->maxArgs;
+    i->args = (int*) realloc(i->args, i->maxArgs * sizeof(int));
+  }
+  i->args[i->argCount ++] = arg;
+}
+
+void insertInstruction(IRFunction* f, int block, int position, int inst) {
+  IRBlock* b = f->blocks + block;
+
+  if (b->instCount >= b->maxInsts) {
+    b->maxInsts = (b->maxInsts == 0) ? 16 : 2 * b->maxInsts;
+    b->insts = (int*) realloc(b->insts, b->maxInsts * sizeof(int));
+  }
+  memmove(b->insts + position + 1, b->insts + position, (b->instCount - position) * sizeof(int));
+  b->insts[position] = inst;
+  b->instCount ++;
+  f->insts[inst].block = block;
+}
+
+void appendInstruction(IRFunction* f, int block, int inst) {
+  insertInstruction(f, block, f->blocks[block].instCount, inst);
+}
+
+int emitInstruction(IRFunction* f, int block, enum IROpCode op) {
+  int inst = newInstruction(f, op);
+
+  appendInstruction(f, block, inst);
+  return inst;
+}
+
+int terminatorOf(IRFunction* f, int block) {
+  IRBlock* b = f->blocks + block;
+
+  if (b->instCount == 0) return IR_NONE;
+  return irOpCodeIsTerminator(f->insts[b->insts[b->instCount - 1]].op) ?
+    b->insts[b->instCount - 1] : IR_NONE;
+}
+
+// Takes an instruction out of its block; compactBlocks drops it for good
+void removeInstruction(IRFunction* f, int inst) {
+  f->insts[inst].block = IR_NONE;
+}
+
+void compactBlocks(IRFunction* f) {
+  IRBlock* b;
+  int i, j, k;
+
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    for (j = k = 0; j < b->instCount; j ++)
+      if (f->insts[b->insts[j]].block == i)
+        b->insts[k ++] = b->insts[j];
+    b->instCount = k;
+  }
+}
+
+// What a value stands for once the replacements are made
+int resolveValue(int* replacements, int value) {
+  while ((value >= 0) && (replacements[value] != IR_NONE) && (replacements[value] != value))
+    value = replacements[value];
+  return value;
+}
+
+// Rewrites every operand v into replacements[v], following chains
+void replaceUses(IRFunction* f, int* replacements) {
+  IRInst* inst;
+  int i, j;
+
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    for (j = 0; j < inst->argCount; j ++)
+      inst->args[j] = resolveValue(replacements, inst->args[j]);
+  }
+}
+
+int* countUses(IRFunction* f) {
+  int* uses = (int*) calloc(f->instCount + 1, sizeof(int));
+  IRInst* inst;
+  int i, j;
+
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    for (j = 0; j < inst->argCount; j ++)
+      if (inst->args[j] != IR_NONE)
+        uses[inst->args[j]] ++;
+  }
+  return uses;
+}
+
+int predecessorIndex(IRFunction* f, int block, int pred) {
+  int i;
+
+  for (i = 0; i < f->blocks[block].predCount; i ++)
+    if (f->blocks[block].preds[i] == pred) return i;
+  return IR_NONE;
+}
+
+/* Puts a block that only jumps on the edge to successor k of from, in
+   the place of from among the predecessors of the target. Returns the
+   new block. */
+int splitEdge(IRFunction* f, int from, int k) {
+  int to = f->blocks[from].succs[k];
+  int block = newBlock(f);
+  int index = predecessorIndex(f, to, from);
+
+  emitInstruction(f, block, IR_JUMP);
+  f->blocks[to].preds[index] = block;
+  f->blocks[block].succs[0] = to;
+  f->blocks[block].succCount = 1;
+  f->blocks[from].succs[k] = block;
+  f->blocks[block].preds = (int*) malloc(sizeof(int));
+  f->blocks[block].preds[0] = from;
+  f->blocks[block].predCount = f->blocks[block].maxPreds = 1;
+  return block;
+}
+
+// Takes away the edge and the operands the phis of its target had for it
+void removeEdge(IRFunction* f, int from, int to) {
+  IRBlock* b = f->blocks + from;
+  IRInst* phi;
+  int i, j, k;
+
+  for (i = 0; (i < b->succCount) && (b->succs[i] != to); i ++);
+  if (i == b->succCount) return;
+  for (; i + 1 < b->succCount; i ++)
+    b->succs[i] = b->succs[i + 1];
+  b->succCount --;
+
+  b = f->blocks + to;
+  k = predecessorIndex(f, to, from);
+  for (i = k; i + 1 < b->predCount; i ++)
+    b->preds[i] = b->preds[i + 1];
+  b->predCount --;
+  for (i = 0; i < b->instCount; i ++) {
+    phi = f->insts + b->insts[i];
+    if (phi->op != IR_PHI) continue;
+    for (j = k; j + 1 < phi->argCount; j ++)
+      phi->args[j] = phi->args[j + 1];
+    phi->argCount --;
+  }
+}
+
+// Empties the blocks that cannot be reached; returns the instructions removed
+int removeUnreachableBlocks(IRFunction* f) {
+  char* reachable = (char*) calloc(f->blockCount + 1, 1);
+  int* order;
+  int count, i, j, removed = 0;
+
+  order = reversePostorder(f, &count);
+  for (i = 0; i < count; i ++)
+    reachable[order[i]] = 1;
+
+  for (i = 0; i < f->blockCount; i ++) {
+    if (reachable[i]) continue;
+    for (j = 0; j < f->blocks[i].instCount; j ++)
+      if (f->insts[f->blocks[i].insts[j]].block == i) {
+        removeInstruction(f, f->blocks[i].insts[j]);
+        removed ++;
+      }
+    while (f->blocks[i].succCount > 0)
+      removeEdge(f, i, f->blocks[i].succs[0]);
+  }
+  compactBlocks(f);
+
+  free(reachable);
+  free(order);
+  return removed;
+}
+
+// Phis left with a single value are that value; returns how many went
+int simplifyPhis(IRFunction* f) {
+  int* replacements = (int*) malloc((f->instCount + 1) * sizeof(int));
+  IRInst* phi;
+  int removed = 0, changed = 1;
+  int i, j, same, value;
+
+  for (i = 0; i < f->instCount; i ++)
+    replacements[i] = IR_NONE;
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < f->instCount; i ++) {
+      phi = f->insts + i;
+      if ((phi->op != IR_PHI) || (phi->block == IR_NONE)) continue;
+      same = IR_NONE;
+      for (j = 0; j < phi->argCount; j ++) {
+        value = resolveValue(replacements, phi->args[j]);
+        if ((value == i) || (value == same)) continue;
+        if (same != IR_NONE) break;
+        same = value;
+      }
+      if ((j == phi->argCount) && (same != IR_NONE)) {
+        replacements[i] = same;
+        removeInstruction(f, i);
+        removed ++;
+        changed = 1;
+      }
+    }
+  }
+  if (removed > 0) {
+    replaceUses(f, replacements);
+    compactBlocks(f);
+  }
+  free(replacements);
+  return removed;
+}
+
+int countInstructions(IRFunction* f) {
+  int count = 0;
+  int i;
+
+  for (i = 0; i < f->blockCount; i ++)
+    count += f->blocks[i].instCount;
+  return count;
+}
+
+/******************* Properties ******************************/
+
+// Instructions that can be dropped when nobody uses their value
+int irOpCodeIsPure(enum IROpCode op) {
+  switch (op) {
+  case IR_CONST: case IR_ENTRY: case IR_PHI: case IR_ADDR:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG:
+  case IR_EQ: case IR_NE: case IR_GT: case IR_LT: case IR_GE: case IR_LE:
+  case IR_LOAD:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+int irOpCodeIsTerminator(enum IROpCode op) {
+  return (op == IR_JUMP) || (op == IR_BRANCH) || (op == IR_RETURN) || (op == IR_HALT);
+}
+
+int irHasValue(IRInst* inst) {
+  switch (inst->op) {
+  case IR_STORE: case IR_COPY: case IR_WRITEC: case IR_WRITEI: case IR_WRITELN:
+  case IR_JUMP: case IR_BRANCH: case IR_RETURN: case IR_HALT:
+    return 0;
+  case IR_CALL:
+    return inst->type != NULL;
+  default:
+    return 1;
+  }
+}
+
+/******************* Dominators ******************************/
+
+void visitBlock(IRFunction* f, int block, char* visited, int* postorder, int* count) {
+  int i;
+
+  // The first successor is visited last, so that it comes right after
+  visited[block] = 1;
+  for (i = f->blocks[block].succCount - 1; i >= 0; i --)
+    if (!visited[f->blocks[block].succs[i]])
+      visitBlock(f, f->blocks[block].succs[i], visited, postorder, count);
+  postorder[(*count) ++] = block;
+}
+
+// The blocks reachable from the entry, in reverse postorder
+int* reversePostorder(IRFunction* f, int* count) {
+  char* visited = (char*) calloc(f->blockCount + 1, 1);
+  int* postorder = (int*) malloc((f->blockCount + 1) * sizeof(int));
+  int* order = (int*) malloc((f->blockCount + 1) * sizeof(int));
+  int i;
+
+  *count = 0;
+  if (f->blockCount > 0)
+    visitBlock(f, 0, visited, postorder, count);
+  for (i = 0; i < *count; i ++)
+    order[i] = postorder[*count - 1 - i];
+
+  free(visited);
+  free(postorder);
+  return order;
+}
+
+int intersect(IRFunction* f, int a, int b) {
+  while (a != b) {
+    while (f->blocks[a].order > f->blocks[b].order) a = f->blocks[a].idom;
+    while (f->blocks[b].order > f->blocks[a].order) b = f->blocks[b].idom;
+  }
+  return a;
+}
+
+/* Cooper, Harvey and Kennedy's iteration over reverse postorder. Blocks
+   that cannot be reached keep IR_NONE. */
+void computeDominators(IRFunction* f) {
+  int* order;
+  int count, i, j, b, p, idom, changed;
+
+  order = reversePostorder(f, &count);
+  for (i = 0; i < f->blockCount; i ++) {
+    f->blocks[i].idom = IR_NONE;
+    f->blocks[i].order = IR_NONE;
+  }
+  for (i = 0; i < count; i ++)
+    f->blocks[order[i]].order = i;
+  if (count == 0) {
+    free(order);
+    return;
+  }
+
+  f->blocks[0].idom = 0;
+  do {
+    changed = 0;
+    for (i = 1; i < count; i ++) {
+      b = order[i];
+      idom = IR_NONE;
+      for (j = 0; j < f->blocks[b].predCount; j ++) {
+        p = f->blocks[b].preds[j];
+        if (f->blocks[p].idom == IR_NONE) continue;
+        idom = (idom == IR_NONE) ? p : intersect(f, p, idom);
+      }
+      if (idom != f->blocks[b].idom) {
+        f->blocks[b].idom = idom;
+        changed = 1;
+      }
+    }
+  } while (changed);
+  free(order);
+}
+
+int dominates(IRFunction* f, int a, int b) {
+  if (f->blocks[b].idom == IR_NONE) return 0;
+  while (b != a) {
+    if (b == 0) return a == 0;
+    b = f->blocks[b].idom;
+  }
+  return 1;
+}
+
+/******************* Checking ******************************/
+
+int verifyError(IRFunction* f, FILE* out, char* message, int block, int inst) {
+  fprintf(out, "IR error in %s, block b%d", f->name, block);
+  if (inst != IR_NONE) fprintf(out, ", v%d", inst);
+  fprintf(out, ": %s\n", message);
+  return 0;
+}
+
+/* Checks the shape of the graph and that every operand is a live value
+   defined where it dominates its use. */
+int verifyIRFunction(IRFunction* f, FILE* out) {
+  IRBlock* b;
+  IRInst* inst;
+  IRInst* arg;
+  int i, j, k, v, position, phis;
+  int* positions = (int*) malloc((f->instCount + 1) * sizeof(int));
+  int ok = 1;
+
+  computeDominators(f);
+  for (i = 0; i < f->instCount; i ++)
+    positions[i] = IR_NONE;
+  for (i = 0; i < f->blockCount; i ++)
+    for (j = 0; j < f->blocks[i].instCount; j ++) {
+      v = f->blocks[i].insts[j];
+      if (f->insts[v].block != i)
+        ok = verifyError(f, out, "instruction listed in the wrong block", i, v);
+      positions[v] = j;
+    }
+
+  for (i = 0; (i < f->blockCount) && ok; i ++) {
+    b = f->blocks + i;
+    if (b->idom == IR_NONE) continue;
+    if (terminatorOf(f, i) == IR_NONE)
+      ok = verifyError(f, out, "no terminator", i, IR_NONE);
+    for (j = 0; j < b->succCount; j ++)
+      if (predecessorIndex(f, b->succs[j], i) == IR_NONE)
+        ok = verifyError(f, out, "successor does not list the block", i, IR_NONE);
+
+    phis = 1;
+    for (j = 0; (j < b->instCount) && ok; j ++) {
+      v = b->insts[j];
+      inst = f->insts + v;
+      if (inst->op == IR_PHI) {
+        if (!phis) ok = verifyError(f, out, "phi after other instructions", i, v);
+        if (inst->argCount != b->predCount) ok = verifyError(f, out, "phi arity", i, v);
+      } else phis = 0;
+      if (irOpCodeIsTerminator(inst->op) && (j != b->instCount - 1))
+        ok = verifyError(f, out, "terminator in the middle", i, v);
+      if ((inst->op == IR_BRANCH) && (b->succCount != 2))
+        ok = verifyError(f, out, "branch without two successors", i, v);
+      if ((inst->op == IR_JUMP) && (b->succCount != 1))
+        ok = verifyError(f, out, "jump without one successor", i, v);
+
+      for (k = 0; (k < inst->argCount) && ok; k ++) {
+        if (inst->args[k] == IR_NONE) {
+          ok = verifyError(f, out, "missing operand", i, v);
+          break;
+        }
+        arg = f->insts + inst->args[k];
+        if (arg->block == IR_NONE) {
+          ok = verifyError(f, out, "operand was removed", i, v);
+          break;
+        }
+        if (!irHasValue(arg)) {
+          ok = verifyError(f, out, "operand has no value", i, v);
+          break;
+        }
+        if (inst->op == IR_PHI) {
+          // The value must be available at the end of the predecessor
+          if (!dominates(f, arg->block, b->preds[k]))
+            ok = verifyError(f, out, "phi operand does not dominate its edge", i, v);
+          continue;
+        }
+        position = positions[inst->args[k]];
+        if ((arg->block == i) ? (position >= j) : !dominates(f, arg->block, i))
+          ok = verifyError(f, out, "operand does not dominate its use", i, v);
+      }
+    }
+  }
+
+  free(positions);
+  return ok;
+}
+
+/******************* Printing ******************************/
+
+char* irOpCodeToString(enum IROpCode op) {
+  switch (op) {
+  case IR_CONST: return "const";
+  case IR_ENTRY: return "entry";
+  case IR_PHI: return "phi";
+  case IR_ADDR: return "addr";
+  case IR_ADD: return "add";
+  case IR_SUB: return "sub";
+  case IR_MUL: return "mul";
+  case IR_DIV: return "div";
+  case IR_NEG: return "neg";
+  case IR_EQ: return "eq";
+  case IR_NE: return "ne";
+  case IR_GT: return "gt";
+  case IR_LT: return "lt";
+  case IR_GE: return "ge";
+  case IR_LE: return "le";
+  case IR_CHECK: return "check";
+  case IR_LOAD: return "load";
+  case IR_STORE: return "store";
+  case IR_COPY: return "copy";
+  case IR_CALL: return "call";
+  case IR_READC: return "readc";
+  case IR_READI: return "readi";
+  case IR_WRITEC: return "writec";
+  case IR_WRITEI: return "writei";
+  case IR_WRITELN: return "writeln";
+  case IR_JUMP: return "jump";
+  case IR_BRANCH: return "branch";
+  case IR_RETURN: return "return";
+  case IR_HALT: return "halt";
+  default: return "?";
+  }
+}
+
+void printIRType(Type* type, FILE* out) {
+  switch (type->typeClass) {
+  case TP_INT:
+    fprintf(out, "Int");
+    break;
+  case TP_CHAR:
+    fprintf(out, "Char");
+    break;
+  case TP_ARRAY:
+    fprintf(out, "Arr(%d,", type->arraySize);
+    printIRType(type->elementType, out);
+    fprintf(out, ")");
+    break;
+  }
+}
+
+void printIRInstruction(IRFunction* f, int v, FILE* out) {
+  IRInst* inst = f->insts + v;
+  int i;
+
+  fprintf(out, "  ");
+  if (irHasValue(inst)) fprintf(out, "v%d = ", v);
+  fprintf(out, "%s", irOpCodeToString(inst->op));
+
+  switch (inst->op) {
+  case IR_CONST:
+  case IR_ENTRY:
+  case IR_COPY:
+    fprintf(out, " %d", inst->value);
+    break;
+  case IR_CHECK:
+    fprintf(out, " 1..%d", inst->value);
+    break;
+  case IR_ADDR:
+    fprintf(out, " %d,%d", inst->level, inst->value);
+    break;
+  case IR_CALL:
+    fprintf(out, " f%d,%d", inst->callee, inst->level);
+    break;
+  default:
+    break;
+  }
+
+  for (i = 0; i < inst->argCount; i ++) {
+    fprintf(out, (i == 0) ? " " : ", ");
+    if (inst->op == IR_PHI)
+      fprintf(out, "[b%d] ", f->blocks[inst->block].preds[i]);
+    fprintf(out, "v%d", inst->args[i]);
+  }
+
+  if (inst->op == IR_JUMP)
+    fprintf(out, " b%d", f->blocks[inst->block].succs[0]);
+  else if (inst->op == IR_BRANCH)
+    fprintf(out, ", b%d, b%d", f->blocks[inst->block].succs[0], f->blocks[inst->block].succs[1]);
+
+  if ((inst->type != NULL) && irHasValue(inst)) {
+    fprintf(out, " : ");
+    if (inst->isAddress) fprintf(out, "&");
+    printIRType(inst->type, out);
+  }
+  fprintf(out, "\n");
+}
+
+void printIRFunction(IRFunction* f, FILE* out) {
+  IRBlock* b;
+  int i, j;
+
+  fprintf(out, "%s %s (depth %d, frame %d)\n",
+          (f->kind == IR_PROGRAM) ? "program" : (f->kind == IR_FUNCTION) ? "function" : "procedure",
+          f->name, f->depth, f->frameSize);
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    fprintf(out, " b%d:", i);
+    if (b->predCount > 0) {
+      fprintf(out, "  <-");
+      for (j = 0; j < b->predCount; j ++)
+        fprintf(out, " b%d", b->preds[j]);
+    }
+    fprintf(out, "\n");
+    for (j = 0; j < b->instCount; j ++)
+      printIRInstruction(f, b->insts[j], out);
+  }
+}
+
+void printIRProgram(IRProgram* program, FILE* out) {
+  int i;
+
+  for (i = 0; i < program->count; i ++) {
+    fprintf(out, "f%d: ", i);
+    printIRFunction(program->functions[i], out);
+  }
+}
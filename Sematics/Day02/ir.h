@@ -0,0 +1,184 @@
+/* Intermediate representation of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __IR_H__
+#define __IR_H__
+
+#include <stdio.h>
+#include "symtab.h"
+#include "instructions.h"
+
+/* Every subprogram becomes a control flow graph of basic blocks. An
+   instruction is also the value it computes, named by its index in the
+   instruction table of the function. Blocks list their instructions in
+   order: phi nodes first, a single terminator last.
+
+   Variables start out as memory: a load or a store through the address
+   of their slot. The ssa pass then turns the slots nobody else can reach
+   into values, with phi nodes where control flow joins. */
+
+#define IR_NONE -1
+
+enum IROpCode {
+  IR_CONST,     // value
+  IR_ENTRY,     // the content of slot value when the subprogram starts
+  IR_PHI,       // one operand per predecessor, in order
+  IR_ADDR,      // address of slot value in the frame level scopes out
+
+  IR_ADD,       // args[0] + args[1]
+  IR_SUB,
+  IR_MUL,
+  IR_DIV,
+  IR_NEG,       // - args[0]
+
+  IR_EQ,        // args[0] = args[1]
+  IR_NE,
+  IR_GT,
+  IR_LT,
+  IR_GE,
+  IR_LE,
+
+  IR_CHECK,     // args[0], stopping unless 1 <= args[0] <= value
+
+  IR_LOAD,      // s[args[0]]
+  IR_STORE,     // s[args[0]] := args[1]
+  IR_COPY,      // the value words from s[args[1]] on to s[args[0]] on
+  IR_CALL,      // callee with the arguments, static link level scopes out
+  IR_READC,
+  IR_READI,
+  IR_WRITEC,    // write args[0]
+  IR_WRITEI,
+  IR_WRITELN,
+
+  IR_JUMP,      // to succs[0]
+  IR_BRANCH,    // to succs[0] if args[0] is true, else succs[1]
+  IR_RETURN,    // with the function value args[0], if any
+  IR_HALT
+};
+
+#define NUM_OF_IR_OPCODES (IR_HALT + 1)
+
+struct IRInst_ {
+  enum IROpCode op;
+  // The block the instruction is in, or IR_NONE once removed
+  int block;
+  WORD value;
+  int level;
+  int callee;
+  int* args;
+  int argCount;
+  int maxArgs;
+  // What the value is, or what it points to when isAddress is set
+  Type* type;
+  int isAddress;
+  // Source line of the statement the instruction comes from
+  int lineNo;
+};
+
+typedef struct IRInst_ IRInst;
+
+struct IRBlock_ {
+  int* insts;
+  int instCount;
+  int maxInsts;
+  int* preds;
+  int predCount;
+  int maxPreds;
+  int succs[2];
+  int succCount;
+  // Immediate dominator, and the position in reverse postorder
+  int idom;
+  int order;
+};
+
+typedef struct IRBlock_ IRBlock;
+
+#define IR_PROGRAM 0
+#define IR_PROCEDURE 1
+#define IR_FUNCTION 2
+
+struct IRFunction_ {
+  char* name;
+  int kind;
+  Object* object;
+  Scope* scope;
+  // Index of the subprogram it is declared in, or IR_NONE
+  int parent;
+  int depth;
+  // First instruction in the stack code
+  CodeAddress address;
+  int frameSize;
+  int paramCount;
+  Type* returnType;
+  // Type of the variable in each slot of the frame, or NULL
+  Type** slotTypes;
+  // Slots that hold the address of a reference parameter
+  char* slotIsReference;
+  // Slots that belong to an array
+  char* slotIsArray;
+  int slotCount;
+
+  IRInst* insts;
+  int instCount;
+  int maxInsts;
+  IRBlock* blocks;
+  int blockCount;
+  int maxBlocks;
+};
+
+typedef struct IRFunction_ IRFunction;
+
+struct IRProgram_ {
+  IRFunction** functions;
+  int count;
+};
+
+typedef struct IRProgram_ IRProgram;
+
+// The types of values that do not come from a variable
+extern Type irIntType;
+extern Type irCharType;
+
+IRFunction* createIRFunction(char* name, int kind);
+void freeIRFunction(IRFunction* f);
+IRProgram* createIRProgram(void);
+void addIRFunction(IRProgram* program, IRFunction* f);
+void freeIRProgram(IRProgram* program);
+
+int newBlock(IRFunction* f);
+void addEdge(IRFunction* f, int from, int to);
+int newInstruction(IRFunction* f, enum IROpCode op);
+void addArgument(IRFunction* f, int inst, int arg);
+void appendInstruction(IRFunction* f, int block, int inst);
+void insertInstruction(IRFunction* f, int block, int position, int inst);
+int emitInstruction(IRFunction* f, int block, enum IROpCode op);
+int terminatorOf(IRFunction* f, int block);
+void removeInstruction(IRFunction* f, int inst);
+void compactBlocks(IRFunction* f);
+void replaceUses(IRFunction* f, int* replacements);
+int* countUses(IRFunction* f);
+int predecessorIndex(IRFunction* f, int block, int pred);
+int splitEdge(IRFunction* f, int from, int k);
+void removeEdge(IRFunction* f, int from, int to);
+int removeUnreachableBlocks(IRFunction* f);
+int simplifyPhis(IRFunction* f);
+int countInstructions(IRFunction* f);
+int resolveValue(int* replacements, int value);
+
+int irOpCodeIsPure(enum IROpCode op);
+int irOpCodeIsTerminator(enum IROpCode op);
+int irHasValue(IRInst* inst);
+
+void computeDominators(IRFunction* f);
+int dominates(IRFunction* f, int a, int b);
+int* reversePostorder(IRFunction* f, int* count);
+
+int verifyIRFunction(IRFunction* f, FILE* out);
+char* irOpCodeToString(enum IROpCode op);
+void printIRFunction(IRFunction* f, FILE* out);
+void printIRProgram(IRProgram* program, FILE* out);
+
+#endif
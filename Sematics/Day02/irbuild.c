@@ -0,0 +1,575 @@
+/* Lowering of stack code to the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "irbuild.h"
+
+/* The stack of the code is simulated with the values it holds. The words
+   an INT reserves for a call are placeholders, which the DCT before the
+   CALL takes off again. Whatever is still on the stack at the end of a
+   block goes to the slot it occupies in the frame, and is read back by
+   the next block. */
+#define PLACEHOLDER -2
+
+struct Builder_ {
+  CodeBlock* codeBlock;
+  IRProgram* program;
+  IRFunction* f;
+  char* isLeader;
+  int* lineNos;
+  // The block starting at each leader of the current function
+  int* blockOf;
+  // Address and stack height on entry of each block
+  int* starts;
+  int* heights;
+  int maxBlocks;
+  int* work;
+  int top;
+  int* stack;
+  int height;
+  int maxStack;
+  // The most temporaries kept across blocks
+  int maxHeight;
+  int lineNo;
+  int failed;
+};
+
+typedef struct Builder_ Builder;
+
+/******************* Functions ******************************/
+
+void setSlot(IRFunction* f, int slot, Type* type, int isReference) {
+  int size, i;
+
+  if ((slot < 0) || (slot >= f->slotCount) || (type == NULL)) return;
+  size = (isReference) ? 1 : sizeOfType(type);
+  for (i = 0; (i < size) && (slot + i < f->slotCount); i ++) {
+    f->slotTypes[slot + i] = type;
+    f->slotIsArray[slot + i] = (type->typeClass == TP_ARRAY);
+  }
+  f->slotIsReference[slot] = isReference;
+}
+
+void resizeSlots(IRFunction* f, int slotCount) {
+  int i;
+
+  f->slotTypes = (Type**) realloc(f->slotTypes, slotCount * sizeof(Type*));
+  f->slotIsReference = (char*) realloc(f->slotIsReference, slotCount);
+  f->slotIsArray = (char*) realloc(f->slotIsArray, slotCount);
+  for (i = f->slotCount; i < slotCount; i ++) {
+    f->slotTypes[i] = NULL;
+    f->slotIsReference[i] = 0;
+    f->slotIsArray[i] = 0;
+  }
+  f->slotCount = slotCount;
+}
+
+IRFunction* createFunctionOf(Object* obj, Scope* scope, int kind, CodeAddress address) {
+  IRFunction* f = createIRFunction(obj->name, kind);
+  ObjectNode* node;
+  Object* var;
+
+  f->object = obj;
+  f->scope = scope;
+  f->address = address;
+  f->frameSize = scope->frameSize;
+  resizeSlots(f, scope->frameSize);
+
+  if (kind == IR_FUNCTION) {
+    f->returnType = obj->funcAttrs->returnType;
+    f->paramCount = obj->funcAttrs->paramCount;
+    setSlot(f, RETURN_VALUE_OFFSET, f->returnType, 0);
+  } else if (kind == IR_PROCEDURE)
+    f->paramCount = obj->procAttrs->paramCount;
+
+  for (node = scope->objList; node != NULL; node = node->next) {
+    var = node->object;
+    if (var->kind == OBJ_VARIABLE)
+      setSlot(f, var->varAttrs->localOffset, var->varAttrs->type, 0);
+    else if (var->kind == OBJ_PARAMETER) {
+      // An array comes as its address, and a value one is copied on entry
+      setSlot(f, var->paramAttrs->localOffset, var->paramAttrs->type,
+              (var->paramAttrs->kind == PARAM_REFERENCE) ||
+              (var->paramAttrs->type->typeClass == TP_ARRAY));
+      if (var->paramAttrs->copyOffset >= 0)
+        setSlot(f, var->paramAttrs->copyOffset, var->paramAttrs->type, 0);
+    }
+  }
+  return f;
+}
+
+// Subprograms in the order they are declared, each after its parent
+void collectFunctions(IRProgram* program, Scope* scope, int parent, int depth) {
+  ObjectNode* node;
+  Object* obj;
+  IRFunction* f;
+
+  for (node = scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_FUNCTION)
+      f = createFunctionOf(obj, obj->funcAttrs->scope, IR_FUNCTION, obj->funcAttrs->codeAddress);
+    else if (obj->kind == OBJ_PROCEDURE)
+      f = createFunctionOf(obj, obj->procAttrs->scope, IR_PROCEDURE, obj->procAttrs->codeAddress);
+    else continue;
+    // Predefined subprograms have no code
+    if (f->address < 0) {
+      freeIRFunction(f);
+      continue;
+    }
+    f->parent = parent;
+    f->depth = depth;
+    addIRFunction(program, f);
+    collectFunctions(program, f->scope, program->count - 1, depth + 1);
+  }
+}
+
+int functionAt(IRProgram* program, CodeAddress address) {
+  int i;
+
+  for (i = 0; i < program->count; i ++)
+    if (program->functions[i]->address == address) return i;
+  return IR_NONE;
+}
+
+/******************* Values ******************************/
+
+int emitValue(Builder* b, int block, enum IROpCode op) {
+  int inst = emitInstruction(b->f, block, op);
+
+  b->f->insts[inst].lineNo = b->lineNo;
+  b->f->insts[inst].type = &irIntType;
+  return inst;
+}
+
+void pushEntry(Builder* b, int value) {
+  if (b->height >= b->maxStack) {
+    b->maxStack *= 2;
+    b->stack = (int*) realloc(b->stack, b->maxStack * sizeof(int));
+  }
+  b->stack[b->height ++] = value;
+}
+
+int popEntry(Builder* b) {
+  if (b->height <= 0) {
+    b->failed = 1;
+    return PLACEHOLDER;
+  }
+  return b->stack[-- b->height];
+}
+
+int popValue(Builder* b) {
+  int value = popEntry(b);
+
+  if (value == PLACEHOLDER) b->failed = 1;
+  return value;
+}
+
+int emitAddress(Builder* b, int block, int level, int offset) {
+  IRFunction* g = b->f;
+  int inst = emitValue(b, block, IR_ADDR);
+  int i;
+
+  b->f->insts[inst].level = level;
+  b->f->insts[inst].value = offset;
+  b->f->insts[inst].isAddress = 1;
+  b->f->insts[inst].type = NULL;
+  for (i = 0; (i < level) && (g->parent != IR_NONE); i ++)
+    g = b->program->functions[g->parent];
+  if ((i == level) && (offset >= 0) && (offset < g->slotCount))
+    b->f->insts[inst].type = g->slotTypes[offset];
+  return inst;
+}
+
+int emitLoad(Builder* b, int block, int address) {
+  IRInst* a = b->f->insts + address;
+  int reference = 0;
+  int inst;
+  IRFunction* g = b->f;
+  int i;
+
+  if (a->op == IR_ADDR) {
+    for (i = 0; (i < a->level) && (g->parent != IR_NONE); i ++)
+      g = b->program->functions[g->parent];
+    if ((a->value >= 0) && (a->value < g->slotCount))
+      reference = g->slotIsReference[a->value];
+  }
+
+  inst = emitValue(b, block, IR_LOAD);
+  addArgument(b->f, inst, address);
+  a = b->f->insts + address;
+  b->f->insts[inst].type = (a->type != NULL) ? a->type : &irIntType;
+  b->f->insts[inst].isAddress = reference;
+  return inst;
+}
+
+int emitBinary(Builder* b, int block, enum IROpCode op) {
+  int right = popValue(b);
+  int left = popValue(b);
+  int inst;
+  IRInst* l;
+  IRInst* r;
+
+  if (b->failed) return IR_NONE;
+  inst = emitValue(b, block, op);
+  addArgument(b->f, inst, left);
+  addArgument(b->f, inst, right);
+
+  // Address arithmetic steps into the elements of an array
+  l = b->f->insts + left;
+  r = b->f->insts + right;
+  if ((op == IR_ADD) && (l->isAddress || r->isAddress)) {
+    if (!l->isAddress) l = r;
+    b->f->insts[inst].isAddress = 1;
+    b->f->insts[inst].type = ((l->type != NULL) && (l->type->typeClass == TP_ARRAY)) ?
+      l->type->elementType : l->type;
+  }
+  return inst;
+}
+
+/******************* Blocks ******************************/
+
+int blockAt(Builder* b, CodeAddress address, int height) {
+  int block = b->blockOf[address];
+
+  if (block == IR_NONE) {
+    block = newBlock(b->f);
+    b->blockOf[address] = block;
+    if (block >= b->maxBlocks) {
+      b->maxBlocks = 2 * block + 2;
+      b->starts = (int*) realloc(b->starts, b->maxBlocks * sizeof(int));
+      b->heights = (int*) realloc(b->heights, b->maxBlocks * sizeof(int));
+      b->work = (int*) realloc(b->work, b->maxBlocks * sizeof(int));
+    }
+    b->starts[block] = address;
+    b->heights[block] = height;
+    b->work[b->top ++] = block;
+  } else if (b->heights[block] != height)
+    b->failed = 1;
+  return block;
+}
+
+// The temporaries that live on go to their place in the frame
+void saveStack(Builder* b, int block) {
+  int i, address, store;
+
+  for (i = 0; i < b->height; i ++) {
+    if (b->stack[i] == PLACEHOLDER) {
+      b->failed = 1;
+      return;
+    }
+    address = emitAddress(b, block, 0, b->f->frameSize + i);
+    store = emitValue(b, block, IR_STORE);
+    addArgument(b->f, store, address);
+    addArgument(b->f, store, b->stack[i]);
+  }
+}
+
+void restoreStack(Builder* b, int block) {
+  int i;
+
+  b->height = 0;
+  for (i = 0; i < b->heights[block]; i ++)
+    pushEntry(b, emitLoad(b, block, emitAddress(b, block, 0, b->f->frameSize + i)));
+}
+
+void jumpTo(Builder* b, int block, CodeAddress target) {
+  int succ;
+
+  saveStack(b, block);
+  emitValue(b, block, IR_JUMP);
+  succ = blockAt(b, target, b->height);
+  addEdge(b->f, block, succ);
+}
+
+void translateCall(Builder* b, int block, int argCount, Instruction* inst) {
+  int callee = functionAt(b->program, inst->q);
+  int* args = (int*) malloc((argCount + 1) * sizeof(int));
+  int call, i;
+
+  for (i = argCount - 1; i >= 0; i --)
+    args[i] = popValue(b);
+  for (i = 0; i < RESERVED_WORDS; i ++)
+    if (popEntry(b) != PLACEHOLDER) b->failed = 1;
+
+  if ((callee == IR_NONE) || b->failed) {
+    b->failed = 1;
+    free(args);
+    return;
+  }
+
+  call = emitValue(b, block, IR_CALL);
+  b->f->insts[call].callee = callee;
+  b->f->insts[call].level = inst->p;
+  b->f->insts[call].type = b->program->functions[callee]->returnType;
+  for (i = 0; i < argCount; i ++)
+    addArgument(b->f, call, args[i]);
+  if (b->program->functions[callee]->kind == IR_FUNCTION)
+    pushEntry(b, call);
+  free(args);
+}
+
+void translateBlock(Builder* b, int block, CodeAddress body) {
+  CodeBlock* codeBlock = b->codeBlock;
+  IRFunction* f = b->f;
+  CodeAddress address = b->starts[block];
+  Instruction* inst;
+  int value, address2, inst2, i;
+
+  restoreStack(b, block);
+  while (!b->failed) {
+    if ((address >= codeBlock->codeSize) || (address < 0)) {
+      b->failed = 1;
+      return;
+    }
+    if ((address != b->starts[block]) && b->isLeader[address]) {
+      jumpTo(b, block, address);
+      return;
+    }
+
+    inst = codeBlock->code + address;
+    b->lineNo = b->lineNos[address];
+    switch (inst->op) {
+    case OP_LA:
+      pushEntry(b, emitAddress(b, block, inst->p, inst->q));
+      break;
+    case OP_LV:
+      pushEntry(b, emitLoad(b, block, emitAddress(b, block, inst->p, inst->q)));
+      break;
+    case OP_LC:
+      value = emitValue(b, block, IR_CONST);
+      f->insts[value].value = inst->q;
+      pushEntry(b, value);
+      break;
+    case OP_LI:
+      pushEntry(b, emitLoad(b, block, popValue(b)));
+      break;
+    case OP_INT:
+      // The frame of the subprogram itself
+      if (address == body) break;
+      for (i = 0; i < inst->q; i ++)
+        pushEntry(b, PLACEHOLDER);
+      break;
+    case OP_DCT:
+      if ((address + 1 < codeBlock->codeSize) && (codeBlock->code[address + 1].op == OP_CALL)
+          && !b->isLeader[address + 1]) {
+        address ++;
+        translateCall(b, block, inst->q - RESERVED_WORDS, codeBlock->code + address);
+      } else
+        for (i = 0; i < inst->q; i ++) popEntry(b);
+      break;
+    case OP_J:
+      jumpTo(b, block, inst->q);
+      return;
+    case OP_FJ:
+      value = popValue(b);
+      if (inst->q == address + 1) {
+        jumpTo(b, block, inst->q);
+        return;
+      }
+      saveStack(b, block);
+      inst2 = emitValue(b, block, IR_BRANCH);
+      addArgument(f, inst2, value);
+      addEdge(f, block, blockAt(b, address + 1, b->height));
+      addEdge(f, block, blockAt(b, inst->q, b->height));
+      return;
+    case OP_HL:
+      emitValue(b, block, IR_HALT);
+      return;
+    case OP_ST:
+      value = popValue(b);
+      address2 = popValue(b);
+      if (b->failed) return;
+      inst2 = emitValue(b, block, IR_STORE);
+      addArgument(f, inst2, address2);
+      addArgument(f, inst2, value);
+      break;
+    case OP_CP:
+      value = popValue(b);
+      address2 = popValue(b);
+      if (b->failed) return;
+      inst2 = emitValue(b, block, IR_COPY);
+      f->insts[inst2].value = inst->q;
+      addArgument(f, inst2, address2);
+      addArgument(f, inst2, value);
+      break;
+    case OP_CALL:
+      // Calls always come right after the DCT of their arguments
+      b->failed = 1;
+      return;
+    case OP_EP:
+      emitValue(b, block, IR_RETURN);
+      return;
+    case OP_EF:
+      value = emitLoad(b, block, emitAddress(b, block, 0, RETURN_VALUE_OFFSET));
+      inst2 = emitValue(b, block, IR_RETURN);
+      addArgument(f, inst2, value);
+      return;
+    case OP_RC:
+      value = emitValue(b, block, IR_READC);
+      f->insts[value].type = &irCharType;
+      pushEntry(b, value);
+      break;
+    case OP_RI:
+      pushEntry(b, emitValue(b, block, IR_READI));
+      break;
+    case OP_WRC:
+    case OP_WRI:
+      value = popValue(b);
+      if (b->failed) return;
+      inst2 = emitValue(b, block, (inst->op == OP_WRC) ? IR_WRITEC : IR_WRITEI);
+      addArgument(f, inst2, value);
+      break;
+    case OP_WLN:
+      emitValue(b, block, IR_WRITELN);
+      break;
+    case OP_AD: pushEntry(b, emitBinary(b, block, IR_ADD)); break;
+    case OP_SB: pushEntry(b, emitBinary(b, block, IR_SUB)); break;
+    case OP_ML: pushEntry(b, emitBinary(b, block, IR_MUL)); break;
+    case OP_DV: pushEntry(b, emitBinary(b, block, IR_DIV)); break;
+    case OP_EQ: pushEntry(b, emitBinary(b, block, IR_EQ)); break;
+    case OP_NE: pushEntry(b, emitBinary(b, block, IR_NE)); break;
+    case OP_GT: pushEntry(b, emitBinary(b, block, IR_GT)); break;
+    case OP_LT: pushEntry(b, emitBinary(b, block, IR_LT)); break;
+    case OP_GE: pushEntry(b, emitBinary(b, block, IR_GE)); break;
+    case OP_LE: pushEntry(b, emitBinary(b, block, IR_LE)); break;
+    case OP_NEG:
+      value = popValue(b);
+      if (b->failed) return;
+      inst2 = emitValue(b, block, IR_NEG);
+      addArgument(f, inst2, value);
+      pushEntry(b, inst2);
+      break;
+    case OP_CV:
+      value = popValue(b);
+      pushEntry(b, value);
+      pushEntry(b, value);
+      break;
+    case OP_CK:
+      value = popValue(b);
+      if (b->failed) return;
+      inst2 = emitValue(b, block, IR_CHECK);
+      f->insts[inst2].value = inst->q;
+      addArgument(f, inst2, value);
+      pushEntry(b, inst2);
+      break;
+    default:
+      break;
+    }
+    address ++;
+  }
+}
+
+int buildFunction(Builder* b, IRFunction* f) {
+  CodeBlock* codeBlock = b->codeBlock;
+  CodeAddress body = f->address;
+  int entry, first, block, i;
+
+  if ((body < 0) || (body >= codeBlock->codeSize)) return 0;
+  if (codeBlock->code[body].op == OP_J) body = codeBlock->code[body].q;
+  if ((body < 0) || (body >= codeBlock->codeSize) || (codeBlock->code[body].op != OP_INT))
+    return 0;
+
+  b->f = f;
+  b->top = 0;
+  b->maxHeight = 0;
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    b->blockOf[i] = IR_NONE;
+
+  // The entry block has no predecessors, even when the body is a loop
+  entry = newBlock(f);
+  b->lineNo = b->lineNos[body];
+  emitValue(b, entry, IR_JUMP);
+  first = blockAt(b, body, 0);
+  addEdge(f, entry, first);
+
+  while ((b->top > 0) && !b->failed) {
+    block = b->work[-- b->top];
+    b->height = 0;
+    translateBlock(b, block, body);
+    if (b->heights[block] > b->maxHeight) b->maxHeight = b->heights[block];
+  }
+
+  if (b->failed) return 0;
+  // The temporaries kept in the frame across blocks get slots of their own
+  if (f->slotCount < f->frameSize + b->maxHeight)
+    resizeSlots(f, f->frameSize + b->maxHeight);
+  return 1;
+}
+
+void findLeaders(Builder* b) {
+  CodeBlock* codeBlock = b->codeBlock;
+  Instruction* inst;
+  int i, j;
+
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    switch (inst->op) {
+    case OP_J:
+    case OP_FJ:
+      if ((inst->q >= 0) && (inst->q < codeBlock->codeSize))
+        b->isLeader[inst->q] = 1;
+      // Fall through
+    case OP_EP:
+    case OP_EF:
+    case OP_HL:
+      b->isLeader[i + 1] = 1;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // The line of each instruction is the one of the last statement starting at or before it
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    b->lineNos[i] = 0;
+  for (i = 0; i < codeBlock->lineCount; i ++)
+    for (j = codeBlock->lines[i].address; (j >= 0) && (j < codeBlock->codeSize); j ++)
+      if ((i + 1 < codeBlock->lineCount) && (j >= codeBlock->lines[i + 1].address)) break;
+      else b->lineNos[j] = codeBlock->lines[i].lineNo;
+}
+
+IRProgram* buildIR(CodeBlock* codeBlock, SymTab* symtab) {
+  IRProgram* program = createIRProgram();
+  Object* obj = symtab->program;
+  Builder b;
+  int i, ok = 1;
+
+  addIRFunction(program, createFunctionOf(obj, obj->progAttrs->scope, IR_PROGRAM, obj->progAttrs->codeAddress));
+  collectFunctions(program, obj->progAttrs->scope, 0, 1);
+
+  b.codeBlock = codeBlock;
+  b.program = program;
+  b.isLeader = (char*) calloc(codeBlock->codeSize + 1, 1);
+  b.lineNos = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  b.blockOf = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  b.maxBlocks = 16;
+  b.starts = (int*) malloc(b.maxBlocks * sizeof(int));
+  b.heights = (int*) malloc(b.maxBlocks * sizeof(int));
+  b.work = (int*) malloc(b.maxBlocks * sizeof(int));
+  b.maxStack = 16;
+  b.stack = (int*) malloc(b.maxStack * sizeof(int));
+  b.failed = 0;
+  findLeaders(&b);
+
+  for (i = 0; (i < program->count) && ok; i ++)
+    ok = buildFunction(&b, program->functions[i]);
+
+  free(b.isLeader);
+  free(b.lineNos);
+  free(b.blockOf);
+  free(b.starts);
+  free(b.heights);
+  free(b.work);
+  free(b.stack);
+
+  if (!ok) {
+    freeIRProgram(program);
+    return NULL;
+  }
+  return program;
+}
@@ -0,0 +1,23 @@
+/* Lowering of stack code to the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __IRBUILD_H__
+#define __IRBUILD_H__
+
+#include "symtab.h"
+#include "instructions.h"
+#include "ir.h"
+
+/* Rebuilds the statements of every subprogram from the code the parser
+   emitted for them, with the symbol table for the frame layout and the
+   types. Function 0 is the program. Returns NULL on code the parser
+   does not produce. */
+IRProgram* buildIR(CodeBlock* codeBlock, SymTab* symtab);
+
+// Grows or shrinks the slots of the frame, the new ones holding nothing known
+void resizeSlots(IRFunction* f, int slotCount);
+
+#endif
@@ -0,0 +1,687 @@
+/* Stack code from the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "irgen.h"
+
+/* Every instruction that does something is the root of an expression
+   tree, evaluated on the stack where it stands. A value used once, later
+   in the same block, is evaluated as part of the tree of its user when
+   nothing in between can tell the difference. Constants and addresses
+   are loaded again wherever they are needed. Everything else is stored
+   in a home slot of the frame: slots are shared by values that are never
+   live at the same time, and phis are copied into theirs at the end of
+   each predecessor. */
+
+#define KIND_ROOT 0     // no value: evaluated where it stands
+#define KIND_HOME 1     // evaluated where it stands, then kept in a slot
+#define KIND_INLINE 2   // evaluated by its user
+#define KIND_REMAT 3    // loaded again by each user
+#define KIND_DROP 4     // evaluated for its effect, the value thrown away
+
+struct Fixup_ {
+  CodeAddress address;
+  int target;
+};
+
+typedef struct Fixup_ Fixup;
+
+struct Generator_ {
+  IRProgram* program;
+  CodeBlock* out;
+  IRFunction* f;
+  int* kinds;
+  int* homes;
+  int* positions;
+  int* blockStarts;
+  Fixup* jumps;
+  int jumpCount;
+  int maxJumps;
+  Fixup* calls;
+  int callCount;
+  int maxCalls;
+  int lastLine;
+};
+
+typedef struct Generator_ Generator;
+
+/******************* Preparation ******************************/
+
+// Pure instructions whose values nobody uses are left out
+void removeDeadValues(IRFunction* f) {
+  int* uses;
+  int i, removed;
+
+  do {
+    removed = 0;
+    uses = countUses(f);
+    for (i = 0; i < f->instCount; i ++)
+      if ((f->insts[i].block != IR_NONE) && (uses[i] == 0) &&
+          irHasValue(f->insts + i) && irOpCodeIsPure(f->insts[i].op)) {
+        removeInstruction(f, i);
+        removed ++;
+      }
+    free(uses);
+  } while (removed > 0);
+  compactBlocks(f);
+}
+
+int hasPhis(IRFunction* f, int block) {
+  IRBlock* b = f->blocks + block;
+
+  return (b->instCount > 0) && (f->insts[b->insts[0]].op == IR_PHI);
+}
+
+// The copies into the phis of a block need an edge of their own
+void splitCriticalEdges(IRFunction* f) {
+  int count = f->blockCount;
+  int i, k;
+
+  for (i = 0; i < count; i ++) {
+    if (f->blocks[i].succCount != 2) continue;
+    for (k = 0; k < 2; k ++)
+      if (hasPhis(f, f->blocks[i].succs[k])) splitEdge(f, i, k);
+  }
+}
+
+int readsMemory(enum IROpCode op) {
+  return (op == IR_LOAD) || (op == IR_COPY);
+}
+
+int writesMemory(enum IROpCode op) {
+  return (op == IR_STORE) || (op == IR_COPY) || (op == IR_CALL);
+}
+
+int hasEffect(enum IROpCode op) {
+  switch (op) {
+  case IR_DIV: case IR_CHECK: case IR_CALL: case IR_READC: case IR_READI:
+  case IR_WRITEC: case IR_WRITEI: case IR_WRITELN:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// Whether two instructions may not swap places
+int conflicts(enum IROpCode a, enum IROpCode b) {
+  if (writesMemory(a) && (readsMemory(b) || writesMemory(b))) return 1;
+  if (writesMemory(b) && (readsMemory(a) || writesMemory(a))) return 1;
+  return hasEffect(a) && hasEffect(b);
+}
+
+void classifyValues(Generator* g, int* uses, int* users) {
+  IRFunction* f = g->f;
+  IRBlock* b;
+  IRInst* inst;
+  int* finals = (int*) malloc((f->instCount + 1) * sizeof(int));
+  int i, j, k, v, u, w, c, movable;
+
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    for (j = 0; j < b->instCount; j ++)
+      g->positions[b->insts[j]] = j;
+  }
+
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    for (j = b->instCount - 1; j >= 0; j --) {
+      v = b->insts[j];
+      inst = f->insts + v;
+      finals[v] = j;
+      if (!irHasValue(inst)) {
+        g->kinds[v] = KIND_ROOT;
+        continue;
+      }
+      switch (inst->op) {
+      case IR_CONST:
+      case IR_ADDR:
+        g->kinds[v] = KIND_REMAT;
+        continue;
+      case IR_PHI:
+      case IR_ENTRY:
+        g->kinds[v] = KIND_HOME;
+        continue;
+      default:
+        break;
+      }
+      if (uses[v] == 0) {
+        g->kinds[v] = KIND_DROP;
+        continue;
+      }
+
+      g->kinds[v] = KIND_HOME;
+      u = users[v];
+      if ((uses[v] != 1) || (f->insts[u].block != i) || (g->positions[u] <= j) ||
+          (f->insts[u].op == IR_PHI))
+        continue;
+      // Evaluated later, where the tree of its user is
+      movable = 1;
+      for (k = j + 1; (k < finals[u]) && movable; k ++) {
+        w = b->insts[k];
+        // The users of v on the way to its root come after it anyway
+        for (c = u; (c != w) && (g->kinds[c] == KIND_INLINE); c = users[c]);
+        if ((c != w) && conflicts(inst->op, f->insts[w].op)) movable = 0;
+      }
+      if (movable) {
+        g->kinds[v] = KIND_INLINE;
+        finals[v] = finals[u];
+      }
+    }
+  }
+  free(finals);
+}
+
+/******************* Home slots ******************************/
+
+#define BITS 32
+#define SET_BIT(set, i) ((set)[(i) / BITS] |= (1u << ((i) % BITS)))
+#define CLEAR_BIT(set, i) ((set)[(i) / BITS] &= ~(1u << ((i) % BITS)))
+#define TEST_BIT(set, i) (((set)[(i) / BITS] >> ((i) % BITS)) & 1u)
+
+struct Homes_ {
+  int count;
+  int words;
+  int* values;
+  // The index of each value kept in a home
+  int* indexes;
+  unsigned* liveIn;
+  unsigned* interference;
+};
+
+typedef struct Homes_ Homes;
+
+// The values kept in homes that the tree of v reads
+void addTreeUses(Generator* g, Homes* h, int v, unsigned* live) {
+  IRInst* inst = g->f->insts + v;
+  int i, arg;
+
+  for (i = 0; i < inst->argCount; i ++) {
+    arg = inst->args[i];
+    if (g->kinds[arg] == KIND_HOME)
+      SET_BIT(live, h->indexes[arg]);
+    else if (g->kinds[arg] == KIND_INLINE)
+      addTreeUses(g, h, arg, live);
+  }
+}
+
+void interfere(Homes* h, int a, int b) {
+  if (a == b) return;
+  SET_BIT(h->interference + a * h->words, b);
+  SET_BIT(h->interference + b * h->words, a);
+}
+
+// Walks a block backwards from what is live at its end
+void scanBlock(Generator* g, Homes* h, int block, unsigned* live, int record) {
+  IRFunction* f = g->f;
+  IRBlock* b = f->blocks + block;
+  IRBlock* s;
+  IRInst* inst;
+  int i, j, k, v, index, arg;
+
+  memset(live, 0, h->words * sizeof(unsigned));
+  for (i = 0; i < b->succCount; i ++) {
+    s = f->blocks + b->succs[i];
+    for (k = 0; k < h->words; k ++)
+      live[k] |= h->liveIn[b->succs[i] * h->words + k];
+    index = predecessorIndex(f, b->succs[i], block);
+    for (j = 0; (j < s->instCount) && (f->insts[s->insts[j]].op == IR_PHI); j ++) {
+      arg = f->insts[s->insts[j]].args[index];
+      if (g->kinds[arg] == KIND_HOME) SET_BIT(live, h->indexes[arg]);
+    }
+  }
+
+  for (j = b->instCount - 1; j >= 0; j --) {
+    v = b->insts[j];
+    inst = f->insts + v;
+    if ((inst->op == IR_PHI) || (inst->op == IR_ENTRY)) break;
+    if ((g->kinds[v] == KIND_INLINE) || (g->kinds[v] == KIND_REMAT)) continue;
+    if (g->kinds[v] == KIND_HOME) {
+      index = h->indexes[v];
+      if (record)
+        for (k = 0; k < h->count; k ++)
+          if (TEST_BIT(live, k)) interfere(h, index, k);
+      CLEAR_BIT(live, index);
+    }
+    addTreeUses(g, h, v, live);
+  }
+
+  // Phis and entry values are all defined together on entry
+  for (; j >= 0; j --) {
+    v = b->insts[j];
+    SET_BIT(live, h->indexes[v]);
+  }
+  for (j = 0; (j < b->instCount) && ((f->insts[b->insts[j]].op == IR_PHI) ||
+                                      (f->insts[b->insts[j]].op == IR_ENTRY)); j ++) {
+    index = h->indexes[b->insts[j]];
+    if (record)
+      for (k = 0; k < h->count; k ++)
+        if (TEST_BIT(live, k)) interfere(h, index, k);
+  }
+  for (j = 0; (j < b->instCount) && ((f->insts[b->insts[j]].op == IR_PHI) ||
+                                      (f->insts[b->insts[j]].op == IR_ENTRY)); j ++)
+    CLEAR_BIT(live, h->indexes[b->insts[j]]);
+}
+
+// Slots that are still read or written as memory, by anyone
+char* findMemorySlots(IRProgram* program, int index) {
+  IRFunction* f = program->functions[index];
+  char* memory = (char*) calloc(f->slotCount + 1, 1);
+  IRFunction* g;
+  IRInst* inst;
+  int i, j, k, o;
+
+  for (i = 0; i < f->slotCount; i ++)
+    memory[i] = f->slotIsArray[i] || (i < RESERVED_WORDS);
+  for (i = 0; i < program->count; i ++) {
+    g = program->functions[i];
+    for (j = 0; j < g->instCount; j ++) {
+      inst = g->insts + j;
+      if ((inst->block == IR_NONE) || (inst->op != IR_ADDR)) continue;
+      o = i;
+      for (k = 0; (k < inst->level) && (o != IR_NONE); k ++)
+        o = program->functions[o]->parent;
+      if ((o == index) && (inst->value >= 0) && (inst->value < f->slotCount))
+        memory[inst->value] = 1;
+    }
+  }
+  return memory;
+}
+
+// Returns the size of the frame with the homes in it
+int assignHomes(Generator* g, int functionIndex, int* order, int orderCount) {
+  IRFunction* f = g->f;
+  char* memory = findMemorySlots(g->program, functionIndex);
+  unsigned* live;
+  int* taken;
+  int* nextFree;
+  Homes h;
+  int frameSize = RESERVED_WORDS + f->paramCount;
+  int i, j, k, v, slot, changed, maxSlot;
+
+  for (i = 0; i < f->slotCount; i ++)
+    if (memory[i] && (i + 1 > frameSize)) frameSize = i + 1;
+
+  h.count = 0;
+  h.values = (int*) malloc((f->instCount + 1) * sizeof(int));
+  h.indexes = (int*) malloc((f->instCount + 1) * sizeof(int));
+  for (i = 0; i < orderCount; i ++)
+    for (j = 0; j < f->blocks[order[i]].instCount; j ++) {
+      v = f->blocks[order[i]].insts[j];
+      h.indexes[v] = IR_NONE;
+      if (g->kinds[v] == KIND_HOME) {
+        h.indexes[v] = h.count;
+        h.values[h.count ++] = v;
+      }
+    }
+  if (h.count == 0) {
+    free(h.values);
+    free(h.indexes);
+    free(memory);
+    return frameSize;
+  }
+
+  h.words = (h.count + BITS - 1) / BITS;
+  h.liveIn = (unsigned*) calloc(f->blockCount * h.words, sizeof(unsigned));
+  h.interference = (unsigned*) calloc(h.count * h.words, sizeof(unsigned));
+  live = (unsigned*) malloc(h.words * sizeof(unsigned));
+
+  // Live values on entry of every block, by iterating in postorder
+  do {
+    changed = 0;
+    for (i = orderCount - 1; i >= 0; i --) {
+      scanBlock(g, &h, order[i], live, 0);
+      if (memcmp(live, h.liveIn + order[i] * h.words, h.words * sizeof(unsigned)) != 0) {
+        memcpy(h.liveIn + order[i] * h.words, live, h.words * sizeof(unsigned));
+        changed = 1;
+      }
+    }
+  } while (changed);
+  for (i = 0; i < orderCount; i ++)
+    scanBlock(g, &h, order[i], live, 1);
+
+  // Entry values stay in the slot the caller put them in; the rest take
+  // the lowest free slot, in the order they are defined
+  taken = (int*) malloc((h.count + 1) * sizeof(int));
+  // The first slot from each one on that is not memory, so that the
+  // search skips the words of the arrays at once
+  nextFree = (int*) malloc((f->slotCount + 1) * sizeof(int));
+  nextFree[f->slotCount] = f->slotCount;
+  for (slot = f->slotCount - 1; slot >= 0; slot --)
+    nextFree[slot] = memory[slot] ? nextFree[slot + 1] : slot;
+  maxSlot = 0;
+  for (i = 0; i < h.count; i ++) {
+    v = h.values[i];
+    g->homes[v] = (f->insts[v].op == IR_ENTRY) ? f->insts[v].value : IR_NONE;
+  }
+  for (i = 0; i < h.count; i ++) {
+    v = h.values[i];
+    if (g->homes[v] != IR_NONE) continue;
+    k = 0;
+    for (j = 0; j < h.count; j ++)
+      if (TEST_BIT(h.interference + i * h.words, j) && (g->homes[h.values[j]] != IR_NONE))
+        taken[k ++] = g->homes[h.values[j]];
+    for (slot = RESERVED_WORDS; ; slot ++) {
+      if (slot < f->slotCount) slot = nextFree[slot];
+      for (j = 0; (j < k) && (taken[j] != slot); j ++);
+      if (j == k) break;
+    }
+    g->homes[v] = slot;
+  }
+  for (i = 0; i < h.count; i ++)
+    if (g->homes[h.values[i]] > maxSlot) maxSlot = g->homes[h.values[i]];
+  if (maxSlot + 1 > frameSize) frameSize = maxSlot + 1;
+
+  free(taken);
+  free(nextFree);
+  free(live);
+  free(h.liveIn);
+  free(h.interference);
+  free(h.values);
+  free(h.indexes);
+  free(memory);
+  return frameSize;
+}
+
+/******************* Emission ******************************/
+
+void addFixup(Fixup** fixups, int* count, int* max, CodeAddress address, int target) {
+  if (*count >= *max) {
+    *max = 2 * (*max) + 16;
+    *fixups = (Fixup*) realloc(*fixups, (*max) * sizeof(Fixup));
+  }
+  (*fixups)[*count].address = address;
+  (*fixups)[*count].target = target;
+  (*count) ++;
+}
+
+void emitJump(Generator* g, enum OpCode op, int block) {
+  addFixup(&g->jumps, &g->jumpCount, &g->maxJumps, g->out->codeSize, block);
+  emitCode(g->out, op, DC_VALUE, DC_VALUE);
+}
+
+void emitTree(Generator* g, int v);
+
+void emitOperation(Generator* g, int v) {
+  IRInst* inst = g->f->insts + v;
+  IRInst* arg;
+  int i;
+
+  switch (inst->op) {
+  case IR_CONST:
+    emitLC(g->out, inst->value);
+    return;
+  case IR_ADDR:
+    emitLA(g->out, inst->level, inst->value);
+    return;
+  case IR_LOAD:
+    arg = g->f->insts + inst->args[0];
+    if ((arg->op == IR_ADDR) && (g->kinds[inst->args[0]] == KIND_REMAT))
+      emitLV(g->out, arg->level, arg->value);
+    else {
+      emitTree(g, inst->args[0]);
+      emitLI(g->out);
+    }
+    return;
+  case IR_CALL:
+    emitINT(g->out, RESERVED_WORDS);
+    for (i = 0; i < inst->argCount; i ++)
+      emitTree(g, inst->args[i]);
+    emitDCT(g->out, RESERVED_WORDS + inst->argCount);
+    addFixup(&g->calls, &g->callCount, &g->maxCalls, g->out->codeSize, inst->callee);
+    emitCALL(g->out, inst->level, DC_VALUE);
+    return;
+  case IR_READC:
+    emitRC(g->out);
+    return;
+  case IR_READI:
+    emitRI(g->out);
+    return;
+  case IR_WRITELN:
+    emitWLN(g->out);
+    return;
+  default:
+    break;
+  }
+
+  for (i = 0; i < inst->argCount; i ++)
+    emitTree(g, inst->args[i]);
+  switch (inst->op) {
+  case IR_ADD: emitAD(g->out); break;
+  case IR_SUB: emitSB(g->out); break;
+  case IR_MUL: emitML(g->out); break;
+  case IR_DIV: emitDV(g->out); break;
+  case IR_NEG: emitNEG(g->out); break;
+  case IR_CHECK: emitCK(g->out, inst->value); break;
+  case IR_EQ: emitEQ(g->out); break;
+  case IR_NE: emitNE(g->out); break;
+  case IR_GT: emitGT(g->out); break;
+  case IR_LT: emitLT(g->out); break;
+  case IR_GE: emitGE(g->out); break;
+  case IR_LE: emitLE(g->out); break;
+  case IR_STORE: emitST(g->out); break;
+  case IR_COPY: emitCP(g->out, inst->value); break;
+  case IR_WRITEC: emitWRC(g->out); break;
+  case IR_WRITEI: emitWRI(g->out); break;
+  default: break;
+  }
+}
+
+// Leaves the value of v on top of the stack
+void emitTree(Generator* g, int v) {
+  switch (g->kinds[v]) {
+  case KIND_HOME:
+    emitLV(g->out, 0, g->homes[v]);
+    break;
+  default:
+    emitOperation(g, v);
+    break;
+  }
+}
+
+// The values of the phis of succ coming from block, all read before any is written
+void emitPhiCopies(Generator* g, int block, int succ) {
+  IRFunction* f = g->f;
+  IRBlock* s = f->blocks + succ;
+  int index = predecessorIndex(f, succ, block);
+  int count = 0;
+  int i, phi, arg;
+
+  for (i = 0; (i < s->instCount) && (f->insts[s->insts[i]].op == IR_PHI); i ++) {
+    phi = s->insts[i];
+    arg = f->insts[phi].args[index];
+    if ((g->kinds[arg] == KIND_HOME) && (g->homes[arg] == g->homes[phi])) continue;
+    emitLA(g->out, 0, g->homes[phi]);
+    emitTree(g, arg);
+    count ++;
+  }
+  for (i = 0; i < count; i ++)
+    emitST(g->out);
+}
+
+// A block with nothing to do but go to a block without phis
+int isForwarding(IRFunction* f, int block) {
+  IRBlock* b = f->blocks + block;
+
+  return (block != 0) && (b->instCount == 1) && (f->insts[b->insts[0]].op == IR_JUMP) &&
+    (b->succs[0] != block) && !hasPhis(f, b->succs[0]);
+}
+
+// Where a jump to block ends up
+int finalTarget(IRFunction* f, int block) {
+  int steps = 0;
+
+  while (isForwarding(f, block) && (steps ++ < f->blockCount))
+    block = f->blocks[block].succs[0];
+  return block;
+}
+
+void emitRoot(Generator* g, int v, int next) {
+  IRFunction* f = g->f;
+  IRInst* inst = f->insts + v;
+  IRBlock* b = f->blocks + inst->block;
+  int target;
+
+  switch (inst->op) {
+  case IR_JUMP:
+    if (hasPhis(f, b->succs[0]))
+      emitPhiCopies(g, inst->block, b->succs[0]);
+    target = finalTarget(f, b->succs[0]);
+    if (target != next)
+      emitJump(g, OP_J, target);
+    return;
+  case IR_BRANCH:
+    emitTree(g, inst->args[0]);
+    emitJump(g, OP_FJ, finalTarget(f, b->succs[1]));
+    target = finalTarget(f, b->succs[0]);
+    if (target != next)
+      emitJump(g, OP_J, target);
+    return;
+  case IR_RETURN:
+    if (inst->argCount > 0) {
+      emitLA(g->out, 0, RETURN_VALUE_OFFSET);
+      emitTree(g, inst->args[0]);
+      emitST(g->out);
+      emitEF(g->out);
+    } else emitEP(g->out);
+    return;
+  case IR_HALT:
+    emitHL(g->out);
+    return;
+  default:
+    break;
+  }
+
+  switch (g->kinds[v]) {
+  case KIND_ROOT:
+    emitOperation(g, v);
+    break;
+  case KIND_HOME:
+    emitLA(g->out, 0, g->homes[v]);
+    emitOperation(g, v);
+    emitST(g->out);
+    break;
+  case KIND_DROP:
+    emitOperation(g, v);
+    emitDCT(g->out, 1);
+    break;
+  default:
+    break;
+  }
+}
+
+void setCodeAddress(IRFunction* f, CodeAddress address) {
+  f->address = address;
+  switch (f->kind) {
+  case IR_PROGRAM:
+    f->object->progAttrs->codeAddress = address;
+    break;
+  case IR_FUNCTION:
+    f->object->funcAttrs->codeAddress = address;
+    break;
+  default:
+    f->object->procAttrs->codeAddress = address;
+    break;
+  }
+}
+
+void generateFunction(Generator* g, int index) {
+  IRFunction* f = g->program->functions[index];
+  IRInst* inst;
+  int* uses;
+  int* users;
+  int* order;
+  char* skipped;
+  int orderCount, i, j, k, v, next;
+
+  g->f = f;
+  removeDeadValues(f);
+  splitCriticalEdges(f);
+  order = reversePostorder(f, &orderCount);
+
+  uses = (int*) calloc(f->instCount + 1, sizeof(int));
+  users = (int*) malloc((f->instCount + 1) * sizeof(int));
+  for (i = 0; i < orderCount; i ++)
+    for (j = 0; j < f->blocks[order[i]].instCount; j ++) {
+      inst = f->insts + f->blocks[order[i]].insts[j];
+      for (k = 0; k < inst->argCount; k ++) {
+        uses[inst->args[k]] ++;
+        users[inst->args[k]] = f->blocks[order[i]].insts[j];
+      }
+    }
+
+  g->kinds = (int*) malloc((f->instCount + 1) * sizeof(int));
+  g->homes = (int*) malloc((f->instCount + 1) * sizeof(int));
+  g->positions = (int*) malloc((f->instCount + 1) * sizeof(int));
+  g->blockStarts = (int*) malloc((f->blockCount + 1) * sizeof(int));
+  for (i = 0; i < f->instCount; i ++) {
+    g->kinds[i] = KIND_ROOT;
+    g->homes[i] = IR_NONE;
+  }
+  classifyValues(g, uses, users);
+  f->frameSize = assignHomes(g, index, order, orderCount);
+
+  setCodeAddress(f, g->out->codeSize);
+  g->jumpCount = 0;
+  g->lastLine = 0;
+  emitINT(g->out, f->frameSize);
+  // Blocks that only forward are jumped over, unless they sit in a loop of their own
+  skipped = (char*) calloc(f->blockCount + 1, 1);
+  for (i = 0; i < orderCount; i ++)
+    skipped[order[i]] = isForwarding(f, order[i]) && !isForwarding(f, finalTarget(f, order[i]));
+  for (i = 0; i < orderCount; i ++) {
+    if (skipped[order[i]]) continue;
+    g->blockStarts[order[i]] = g->out->codeSize;
+    for (k = i + 1; (k < orderCount) && skipped[order[k]]; k ++);
+    next = (k < orderCount) ? order[k] : IR_NONE;
+    for (j = 0; j < f->blocks[order[i]].instCount; j ++) {
+      v = f->blocks[order[i]].insts[j];
+      inst = f->insts + v;
+      if ((g->kinds[v] == KIND_INLINE) || (g->kinds[v] == KIND_REMAT) ||
+          (inst->op == IR_PHI) || (inst->op == IR_ENTRY))
+        continue;
+      if ((inst->lineNo > 0) && (inst->lineNo != g->lastLine)) {
+        emitLine(g->out, inst->lineNo);
+        g->lastLine = inst->lineNo;
+      }
+      emitRoot(g, v, next);
+    }
+  }
+  for (i = 0; i < g->jumpCount; i ++)
+    g->out->code[g->jumps[i].address].q = g->blockStarts[g->jumps[i].target];
+
+  free(skipped);
+  free(uses);
+  free(users);
+  free(order);
+  free(g->kinds);
+  free(g->homes);
+  free(g->positions);
+  free(g->blockStarts);
+}
+
+CodeBlock* generateStackCode(IRProgram* program) {
+  Generator g;
+  int i;
+
+  g.program = program;
+  g.out = createCodeBlock(1024);
+  g.jumps = NULL;
+  g.jumpCount = g.maxJumps = 0;
+  g.calls = NULL;
+  g.callCount = g.maxCalls = 0;
+
+  for (i = 0; i < program->count; i ++)
+    generateFunction(&g, i);
+  for (i = 0; i < g.callCount; i ++)
+    g.out->code[g.calls[i].address].q = program->functions[g.calls[i].target]->address;
+
+  free(g.jumps);
+  free(g.calls);
+  return g.out;
+}
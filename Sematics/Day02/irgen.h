@@ -0,0 +1,18 @@
+/* Stack code from the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __IRGEN_H__
+#define __IRGEN_H__
+
+#include "instructions.h"
+#include "ir.h"
+
+/* Lays the program out again: the program block first, then every
+   subprogram, with the code addresses of the symbol table updated. The
+   IR is changed on the way, so it can only be generated once. */
+CodeBlock* generateStackCode(IRProgram* program);
+
+#endif
@@ -0,0 +1,219 @@
+/* In-process compiler to machine code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+#include "kplio.h"
+#include "asmgen.h"
+#include "vm.h"
+
+// Where a runtime error leaves the generated code
+static jmp_buf errorExit;
+
+// The status codes of the native runtime are those of the VM
+static void jitError(int status) {
+  longjmp(errorExit, status);
+}
+
+static NativeRuntime runtime = {
+  (void*) kplReadc,
+  (void*) kplReadi,
+  (void*) kplWritec,
+  (void*) kplWritei,
+  (void*) kplWriteln,
+  (void*) jitError
+};
+
+/******************************************************************/
+
+// Copies code into fresh pages; they become executable once patched
+unsigned char* allocateBuffer(X86* x) {
+  unsigned char* buffer;
+
+  buffer = (unsigned char*) mmap(NULL, x->size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) return NULL;
+  memcpy(buffer, x->code, x->size);
+  return buffer;
+}
+
+int protectBuffer(unsigned char* buffer, int size) {
+  return mprotect(buffer, size, PROT_READ | PROT_EXEC) == 0;
+}
+
+NativeProgram* createNativeProgram(RegCode* regCode) {
+  NativeProgram* program = (NativeProgram*) malloc(sizeof(NativeProgram));
+  X86* x;
+  int i;
+
+  program->regCode = regCode;
+  program->entries = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  program->owners = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  program->count = findProcedures(regCode, program->entries, program->owners);
+  program->buffers = (unsigned char**) calloc(program->count, sizeof(unsigned char*));
+  program->sizes = (int*) calloc(program->count, sizeof(int));
+  program->spills = (int*) calloc(program->count, sizeof(int));
+  program->positions = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  for (i = 0; i <= regCode->codeSize; i ++)
+    program->positions[i] = -1;
+
+  x = createBinaryEmitter();
+  genNativeEnter(x);
+  program->enter = finishEmitter(x) ? allocateBuffer(x) : NULL;
+  program->enterSize = x->size;
+  freeEmitter(x);
+  if ((program->enter == NULL) || !protectBuffer(program->enter, program->enterSize)) {
+    freeNativeProgram(program);
+    return NULL;
+  }
+  return program;
+}
+
+void freeNativeProgram(NativeProgram* program) {
+  int i;
+
+  for (i = 0; i < program->count; i ++)
+    if (program->buffers[i] != NULL)
+      munmap(program->buffers[i], program->sizes[i]);
+  if (program->enter != NULL)
+    munmap(program->enter, program->enterSize);
+  free(program->entries);
+  free(program->owners);
+  free(program->buffers);
+  free(program->sizes);
+  free(program->spills);
+  free(program->positions);
+  free(program);
+}
+
+/* Compiles a procedure and every procedure it may call that has no code
+   yet, so that compiled code only ever calls compiled code. */
+int compileProcedure(NativeProgram* program, int proc) {
+  NativeCalls* calls;
+  NativeCall* call;
+  int* round;
+  X86* x;
+  int count = 0, next = 0, ok = 1, i, j;
+
+  if (program->buffers[proc] != NULL) return 1;
+
+  calls = (NativeCalls*) calloc(program->count, sizeof(NativeCalls));
+  round = (int*) malloc(program->count * sizeof(int));
+  round[count ++] = proc;
+  // The entry stub stands for the procedures waiting to be compiled
+  program->buffers[proc] = program->enter;
+
+  while ((next < count) && ok) {
+    i = round[next ++];
+    x = createBinaryEmitter();
+    program->spills[i] = genNativeProcedure(x, program->regCode, program->entries, program->owners, i,
+                                            &runtime, calls + i, program->positions);
+    program->buffers[i] = NULL;
+    if (finishEmitter(x)) {
+      program->buffers[i] = allocateBuffer(x);
+      program->sizes[i] = x->size;
+    }
+    ok = (program->buffers[i] != NULL);
+    freeEmitter(x);
+
+    for (j = 0; ok && (j < calls[i].count); j ++)
+      if (program->buffers[calls[i].calls[j].callee] == NULL) {
+        program->buffers[calls[i].calls[j].callee] = program->enter;
+        round[count ++] = calls[i].calls[j].callee;
+      }
+  }
+
+  // Calls between buffers can only be linked once every buffer is placed
+  for (i = 0; ok && (i < count); i ++) {
+    for (j = 0; j < calls[round[i]].count; j ++) {
+      call = calls[round[i]].calls + j;
+      x86PatchAbsolute(program->buffers[round[i]], call->position, program->buffers[call->callee]);
+    }
+    ok = protectBuffer(program->buffers[round[i]], program->sizes[round[i]]);
+  }
+
+  for (i = 0; i < count; i ++) {
+    if (!ok) {
+      if ((program->buffers[round[i]] != NULL) && (program->buffers[round[i]] != program->enter))
+        munmap(program->buffers[round[i]], program->sizes[round[i]]);
+      program->buffers[round[i]] = NULL;
+    }
+    free(calls[round[i]].calls);
+  }
+  free(calls);
+  free(round);
+  return ok;
+}
+
+NativeProgram* compileNative(RegCode* regCode) {
+  NativeProgram* program = createNativeProgram(regCode);
+  int i;
+
+  if (program == NULL) return NULL;
+  for (i = 0; i < program->count; i ++)
+    if (!compileProcedure(program, i)) {
+      freeNativeProgram(program);
+      return NULL;
+    }
+  return program;
+}
+
+int runNative(NativeProgram* program, WORD* stack, int stackSize) {
+  void (*entry)(WORD*, WORD*);
+  int status;
+
+  status = setjmp(errorExit);
+  if (status == 0) {
+    entry = (void (*)(WORD*, WORD*)) program->buffers[0];
+    entry(stack, stack + stackSize - STACK_RED_ZONE);
+  }
+  kplFlush();
+  return status;
+}
+
+/* Runs the compiled code of the register instruction at address in the
+   frame that starts at stack[frame], with the frames of the display of the
+   interpreter around it, until its procedure returns or the program
+   halts. */
+int enterNative(NativeProgram* program, WORD* stack, int stackSize, WORD* display, WORD frame, int address) {
+  void (*enter)(WORD*, WORD*, WORD, unsigned char*, WORD*);
+  unsigned char* code;
+  int status;
+
+  code = program->buffers[program->owners[address]] + program->positions[address];
+  status = setjmp(errorExit);
+  if (status == 0) {
+    enter = (void (*)(WORD*, WORD*, WORD, unsigned char*, WORD*)) program->enter;
+    enter(stack, stack + stackSize - STACK_RED_ZONE, frame, code, display);
+  }
+  return status;
+}
+
+int runJit(CodeBlock* codeBlock, int stackSize) {
+  RegCode* regCode = translateCode(codeBlock);
+  NativeProgram* program;
+  WORD* stack;
+  int status;
+
+  if (regCode == NULL) return VM_INVALID_CODE;
+  program = compileNative(regCode);
+  if (program == NULL) {
+    freeRegCode(regCode);
+    return VM_INVALID_CODE;
+  }
+
+  stack = (WORD*) calloc(stackSize, sizeof(WORD));
+  status = runNative(program, stack, stackSize);
+  free(stack);
+  freeNativeProgram(program);
+  freeRegCode(regCode);
+  return status;
+}
@@ -0,0 +1,45 @@
+/* In-process compiler to machine code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "instructions.h"
+#include "regcode.h"
+
+/* Each subprogram and the program block get their own executable
+   buffer, compiled when first asked for. Procedure 0 is the program,
+   entered as kpl_main would be. */
+struct NativeProgram_ {
+  RegCode* regCode;
+  // First instruction of each procedure, and the owner of each instruction
+  int* entries;
+  int* owners;
+  int count;
+  unsigned char** buffers;
+  int* sizes;
+  // Slots of each compiled procedure the registers could not hold
+  int* spills;
+  // Offset of each register instruction in the buffer of its procedure
+  int* positions;
+  // Runs code in a given frame
+  unsigned char* enter;
+  int enterSize;
+};
+
+typedef struct NativeProgram_ NativeProgram;
+
+NativeProgram* createNativeProgram(RegCode* regCode);
+void freeNativeProgram(NativeProgram* program);
+int compileProcedure(NativeProgram* program, int proc);
+NativeProgram* compileNative(RegCode* regCode);
+
+int runNative(NativeProgram* program, WORD* stack, int stackSize);
+int enterNative(NativeProgram* program, WORD* stack, int stackSize, WORD* display, WORD frame, int address);
+
+int runJit(CodeBlock* codeBlock, int stackSize);
+
+#endif
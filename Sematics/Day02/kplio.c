@@ -0,0 +1,105 @@
+/* Buffered input and output of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "kplio.h"
+
+char outBuffer[KPLIO_BUFFER_SIZE];
+int outCount = 0;
+
+char inBuffer[KPLIO_BUFFER_SIZE];
+int inPosition = 0;
+int inCount = 0;
+
+// Whether the output is a terminal, -1 until known
+int interactive = -1;
+
+int isInteractive(void) {
+  if (interactive < 0) interactive = isatty(STDOUT_FILENO);
+  return interactive;
+}
+
+/* The bytes go to stdout, which the messages of the machines are printed
+   on as well, and stdout is flushed at once, so that both come out in
+   the order they were written. */
+void kplFlush(void) {
+  if (outCount > 0) fwrite(outBuffer, 1, outCount, stdout);
+  outCount = 0;
+  fflush(stdout);
+}
+
+// The next byte of the input, -1 at its end, without reading it
+int kplPeek(void) {
+  int n;
+
+  if (inPosition < inCount) return (unsigned char) inBuffer[inPosition];
+  if (isInteractive()) kplFlush();
+  n = read(STDIN_FILENO, inBuffer, KPLIO_BUFFER_SIZE);
+  inPosition = 0;
+  inCount = (n > 0) ? n : 0;
+  return (inCount > 0) ? (unsigned char) inBuffer[0] : -1;
+}
+
+int kplReadc(void) {
+  int c = kplPeek();
+
+  if (c >= 0) inPosition ++;
+  return c;
+}
+
+// Reads an integer as scanf("%d") would, 0 when there is none
+int kplReadi(void) {
+  unsigned int value = 0;
+  int negative = 0;
+  int c = kplPeek();
+
+  while ((c == ' ') || ((c >= '\t') && (c <= '\r'))) {
+    inPosition ++;
+    c = kplPeek();
+  }
+  if ((c == '-') || (c == '+')) {
+    negative = (c == '-');
+    inPosition ++;
+    c = kplPeek();
+  }
+  if ((c < '0') || (c > '9')) return 0;
+  do {
+    value = value * 10 + (c - '0');
+    inPosition ++;
+    c = kplPeek();
+  } while ((c >= '0') && (c <= '9'));
+  return (int) (negative ? 0u - value : value);
+}
+
+void kplWritec(int c) {
+  outBuffer[outCount ++] = (char) c;
+  if (outCount == KPLIO_BUFFER_SIZE) kplFlush();
+}
+
+// The digits go backwards into a small buffer, from the magnitude as an
+// unsigned number, so that the most negative integer has one
+void kplWritei(int i) {
+  char digits[16];
+  char* p = digits + sizeof(digits);
+  unsigned int u = (i < 0) ? 0u - (unsigned int) i : (unsigned int) i;
+
+  do {
+    *--p = (char) ('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (i < 0) *--p = '-';
+
+  if (outCount + (digits + sizeof(digits) - p) > KPLIO_BUFFER_SIZE) kplFlush();
+  while (p < digits + sizeof(digits))
+    outBuffer[outCount ++] = *p ++;
+}
+
+void kplWriteln(void) {
+  kplWritec('\n');
+  if (isInteractive()) kplFlush();
+}
@@ -0,0 +1,25 @@
+/* Buffered input and output of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __KPLIO_H__
+#define __KPLIO_H__
+
+// Bytes of each of the input and output buffers
+#define KPLIO_BUFFER_SIZE (64 << 10)
+
+/* The input and output of READC, READI, WRITEC, WRITEI and WRITELN go
+   through buffers of their own instead of stdio. Output is written when
+   the buffer is full and by kplFlush, which the machines call when the
+   program stops. When the output is a terminal, WRITELN and every read
+   write it out as well, so that a line or a prompt shows up at once. */
+int kplReadc(void);
+int kplReadi(void);
+void kplWritec(int c);
+void kplWritei(int i);
+void kplWriteln(void);
+void kplFlush(void);
+
+#endif
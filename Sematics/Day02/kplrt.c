@@ -0,0 +1,71 @@
+/* Runtime of native KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ *
+ * Link with the output of kplc -S:
+ *   gcc program.s kplrt.c -o program
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The buffers of the machines, compiled in, so that kplrt.o stays the
+   only object a program is linked with */
+#include "kplio.c"
+
+#define STACK_SIZE (1 << 20)
+#define STACK_RED_ZONE 1024
+
+#define RT_STACK_OVERFLOW 1
+#define RT_DIVISION_BY_ZERO 2
+#define RT_INDEX_OUT_OF_RANGE 4
+
+// The compiled program: stack is the bottom of the KPL stack, no frame
+// may start at or above limit
+void kpl_main(int* stack, int* limit);
+
+int kpl_readc(void) {
+  return kplReadc();
+}
+
+int kpl_readi(void) {
+  return kplReadi();
+}
+
+void kpl_writec(int c) {
+  kplWritec(c);
+}
+
+void kpl_writei(int i) {
+  kplWritei(i);
+}
+
+void kpl_writeln(void) {
+  kplWriteln();
+}
+
+void kpl_error(int status) {
+  kplFlush();
+  switch (status) {
+  case RT_STACK_OVERFLOW:
+    printf("\nRuntime error: Stack overflow.\n");
+    break;
+  case RT_DIVISION_BY_ZERO:
+    printf("\nRuntime error: Division by zero.\n");
+    break;
+  case RT_INDEX_OUT_OF_RANGE:
+    printf("\nRuntime error: Index out of range.\n");
+    break;
+  }
+  exit(status);
+}
+
+int main(void) {
+  int* stack = (int*) calloc(STACK_SIZE, sizeof(int));
+
+  kpl_main(stack, stack + STACK_SIZE - STACK_RED_ZONE);
+  kplFlush();
+  free(stack);
+  return 0;
+}
@@ -0,0 +1,133 @@
+/* KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "vm.h"
+#include "regvm.h"
+
+/******************************************************************/
+
+void printCounts(long long dispatches, long long statements) {
+  fprintf(stderr, "%lld dispatches, %lld statements", dispatches, statements);
+  if (statements > 0)
+    fprintf(stderr, ", %.2f dispatches per statement", (double) dispatches / statements);
+  fprintf(stderr, "\n");
+}
+
+// Runs the program on the register machine
+int runRegister(CodeBlock* codeBlock, int stackSize, int dispatch, int dump) {
+  RegCode* regCode = translateCode(codeBlock);
+  RegVM* vm;
+  int status;
+
+  if (regCode == NULL) {
+    printf("kplvm: %s\n", vmErrorToString(VM_INVALID_CODE));
+    return -1;
+  }
+  if (dump) {
+    printRegCode(regCode);
+    freeRegCode(regCode);
+    return 0;
+  }
+
+  vm = createRegVM(regCode, stackSize);
+  freeRegCode(regCode);
+
+  status = runRegVM(vm, dispatch);
+  if (status != VM_OK)
+    printf("\nRuntime error: %s\n", vmErrorToString(status));
+  if (dispatch == DISPATCH_COUNT)
+    printCounts(vm->dispatchCount, vm->statementCount);
+
+  freeRegVM(vm);
+  return status;
+}
+
+int main(int argc, char *argv[]) {
+  char* fileName = NULL;
+  int dispatch = DISPATCH_THREADED;
+  int stackSize = STACK_SIZE;
+  int registers = 0;
+  int dump = 0;
+  int info = 0;
+  int fuse = 1;
+  CodeBlock* codeBlock;
+  VM* vm;
+  int i, status;
+
+  for (i = 1; i < argc; i ++) {
+    if (strcmp(argv[i], "-switch") == 0)
+      dispatch = DISPATCH_SWITCH;
+    else if (strcmp(argv[i], "-count") == 0)
+      dispatch = DISPATCH_COUNT;
+    else if (strcmp(argv[i], "-profile") == 0)
+      dispatch = DISPATCH_PROFILE;
+    else if (strcmp(argv[i], "-nosuper") == 0)
+      fuse = 0;
+    else if (strcmp(argv[i], "-reg") == 0)
+      registers = 1;
+    else if (strcmp(argv[i], "-dump") == 0)
+      dump = 1;
+    else if (strcmp(argv[i], "-info") == 0)
+      info = 1;
+    else if ((strcmp(argv[i], "-stack") == 0) && (i + 1 < argc))
+      stackSize = atoi(argv[++i]);
+    else fileName = argv[i];
+  }
+
+  if (fileName == NULL) {
+    printf("kplvm: no input file.\n");
+    printf("usage: kplvm [-switch | -count | -profile] [-nosuper] [-reg [-dump]] [-info] [-stack words] program.kplb\n");
+    return -1;
+  }
+
+  if (stackSize <= 2 * STACK_RED_ZONE) {
+    printf("kplvm: stack too small.\n");
+    return -1;
+  }
+
+  codeBlock = createCodeBlock(1);
+  if (!loadCode(codeBlock, fileName)) {
+    printf("Can\'t read code file %s!\n", fileName);
+    freeCodeBlock(codeBlock);
+    return -1;
+  }
+
+  if (info) {
+    printImage(codeBlock);
+    freeCodeBlock(codeBlock);
+    return 0;
+  }
+
+  if (registers) {
+    status = runRegister(codeBlock, stackSize, dispatch, dump);
+    freeCodeBlock(codeBlock);
+    return status;
+  }
+
+  vm = createVM(codeBlock, stackSize);
+  freeCodeBlock(codeBlock);
+  if (vm == NULL) {
+    printf("kplvm: %s\n", vmErrorToString(VM_INVALID_CODE));
+    return -1;
+  }
+
+  vm->fuse = fuse;
+  status = runVM(vm, dispatch);
+  if (status != VM_OK)
+    printf("\nRuntime error: %s\n", vmErrorToString(status));
+  if (dispatch == DISPATCH_COUNT)
+    printCounts(vm->dispatchCount, vm->statementCount);
+  if (dispatch == DISPATCH_PROFILE)
+    printProfile(vm, stderr);
+
+  freeVM(vm);
+  return status;
+}
@@ -0,0 +1,424 @@
+/* Loop optimizations
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+
+/* A loop is the set of blocks that reach a back edge, an edge to a block
+   that dominates its source, without passing through that header. The
+   code put before a loop goes in its preheader, the one block outside
+   that leads to the header; an edge is split to make one when needed.
+   Loops entered from more than one place are left alone.
+
+   licm moves the instructions whose operands do not change in a loop to
+   its preheader, so that they run once. Only what cannot stop the
+   machine moves, since the loop may not run at all: no division, and a
+   load only of a variable in a loop that stores and calls nothing.
+
+   ivsr works on the induction variables: a phi of the header that grows
+   by a constant on every trip around the loop. A multiplication of one
+   by a constant, as in the address of a(.i.), becomes a variable of its
+   own that grows by the product, and adding an invariant address to one
+   of these makes a pointer that moves by the same step. */
+
+struct Loop_ {
+  int header;
+  int preheader;
+  // The source of the back edge, or IR_NONE when there are several
+  int latch;
+  // Which blocks are in the loop
+  char* body;
+};
+
+typedef struct Loop_ Loop;
+
+// A block outside the loop that only leads to the header
+int findPreheader(IRFunction* f, int header, char* body) {
+  IRBlock* h = f->blocks + header;
+  IRBlock* p;
+  int pred = IR_NONE;
+  int i, k;
+
+  for (i = 0; i < h->predCount; i ++) {
+    if (body[h->preds[i]]) continue;
+    if (pred != IR_NONE) return IR_NONE;
+    pred = h->preds[i];
+  }
+  if (pred == IR_NONE) return IR_NONE;
+  p = f->blocks + pred;
+  if (p->succCount == 1) return pred;
+  for (k = 0; p->succs[k] != header; k ++);
+  return splitEdge(f, pred, k);
+}
+
+/* The loops of the function, one per header, in reverse postorder of
+   their headers: outer loops before the loops nested in them. */
+Loop* findLoops(IRFunction* f, int* count) {
+  Loop* loops;
+  Loop* loop;
+  IRBlock* h;
+  int* order;
+  int* work;
+  int orderCount, workCount, i, j, b, p, preheader;
+
+  // Making the preheaders first keeps the dominators right afterwards
+  computeDominators(f);
+  order = reversePostorder(f, &orderCount);
+  loops = (Loop*) malloc((orderCount + 1) * sizeof(Loop));
+  work = (int*) malloc((f->blockCount + 1) * sizeof(int));
+  *count = 0;
+  for (i = 0; i < orderCount; i ++) {
+    h = f->blocks + order[i];
+    loop = loops + *count;
+    loop->header = order[i];
+    loop->latch = IR_NONE;
+    loop->body = NULL;
+    workCount = 0;
+    for (j = 0; j < h->predCount; j ++) {
+      p = h->preds[j];
+      if ((f->blocks[p].order == IR_NONE) || !dominates(f, order[i], p)) continue;
+      loop->latch = (loop->body == NULL) ? p : IR_NONE;
+      if (loop->body == NULL) {
+        loop->body = (char*) calloc(f->blockCount + orderCount + 1, 1);
+        loop->body[order[i]] = 1;
+      }
+      if (!loop->body[p]) {
+        loop->body[p] = 1;
+        work[workCount ++] = p;
+      }
+    }
+    if (loop->body == NULL) continue;
+
+    while (workCount > 0) {
+      b = work[-- workCount];
+      for (j = 0; j < f->blocks[b].predCount; j ++) {
+        p = f->blocks[b].preds[j];
+        if ((f->blocks[p].order == IR_NONE) || loop->body[p]) continue;
+        loop->body[p] = 1;
+        work[workCount ++] = p;
+      }
+    }
+    (*count) ++;
+  }
+  free(work);
+
+  for (i = 0; i < *count; i ++) {
+    preheader = findPreheader(f, loops[i].header, loops[i].body);
+    loops[i].preheader = preheader;
+  }
+  computeDominators(f);
+  free(order);
+  return loops;
+}
+
+void freeLoops(Loop* loops, int count) {
+  int i;
+
+  for (i = 0; i < count; i ++)
+    free(loops[i].body);
+  free(loops);
+}
+
+// The blocks of the loop in reverse postorder
+int* loopBlocks(IRFunction* f, Loop* loop, int* count) {
+  int* order = reversePostorder(f, count);
+  int i, n = 0;
+
+  for (i = 0; i < *count; i ++)
+    if (loop->body[order[i]]) order[n ++] = order[i];
+  *count = n;
+  return order;
+}
+
+int definedOutside(IRFunction* f, Loop* loop, int value) {
+  return !loop->body[f->insts[value].block];
+}
+
+void moveBeforeTerminator(IRFunction* f, int block, int inst) {
+  f->insts[inst].block = IR_NONE;
+  insertInstruction(f, block, f->blocks[block].instCount - 1, inst);
+}
+
+/******************* Invariant code motion ******************************/
+
+int canHoist(IRFunction* f, Loop* loop, IRInst* inst, int storesMemory) {
+  int i;
+
+  switch (inst->op) {
+  case IR_CONST: case IR_ADDR:
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_NEG:
+  case IR_EQ: case IR_NE: case IR_GT: case IR_LT: case IR_GE: case IR_LE:
+    break;
+  case IR_LOAD:
+    if (storesMemory || (f->insts[inst->args[0]].op != IR_ADDR)) return 0;
+    break;
+  default:
+    return 0;
+  }
+  for (i = 0; i < inst->argCount; i ++)
+    if (!definedOutside(f, loop, inst->args[i])) return 0;
+  return 1;
+}
+
+int hoistInvariants(IRFunction* f, Loop* loop) {
+  IRBlock* b;
+  IRInst* inst;
+  int* blocks;
+  int blockCount, i, j, v;
+  int storesMemory = 0, moved = 0, changed = 1;
+
+  blocks = loopBlocks(f, loop, &blockCount);
+  for (i = 0; i < blockCount; i ++) {
+    b = f->blocks + blocks[i];
+    for (j = 0; j < b->instCount; j ++) {
+      inst = f->insts + b->insts[j];
+      if ((inst->op == IR_STORE) || (inst->op == IR_COPY) || (inst->op == IR_CALL)) storesMemory = 1;
+    }
+  }
+
+  // Moving an instruction out can make the ones using it invariant
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < blockCount; i ++) {
+      b = f->blocks + blocks[i];
+      for (j = 0; j < b->instCount; j ++) {
+        v = b->insts[j];
+        inst = f->insts + v;
+        if ((inst->block != blocks[i]) || !canHoist(f, loop, inst, storesMemory)) continue;
+        moveBeforeTerminator(f, loop->preheader, v);
+        moved ++;
+        changed = 1;
+      }
+    }
+    compactBlocks(f);
+  }
+  free(blocks);
+  return moved;
+}
+
+int hoistLoopInvariants(IRFunction* f) {
+  Loop* loops;
+  int count, i, moved = 0;
+
+  loops = findLoops(f, &count);
+  // Inner loops first, so that what they move out can move further
+  for (i = count - 1; i >= 0; i --)
+    if (loops[i].preheader != IR_NONE)
+      moved += hoistInvariants(f, loops + i);
+  freeLoops(loops, count);
+  return moved;
+}
+
+/******************* Strength reduction ******************************/
+
+struct Induction_ {
+  // Per value: how much it grows on every trip, and where it starts
+  char* isInduction;
+  WORD* steps;
+  int* starts;
+  int* replacements;
+  int size;
+  // Phis made for the header, put in once the loop is done
+  int* phis;
+  int phiCount;
+};
+
+typedef struct Induction_ Induction;
+
+void growInduction(Induction* ind, int size) {
+  int i;
+
+  if (size <= ind->size) return;
+  ind->isInduction = (char*) realloc(ind->isInduction, size);
+  ind->steps = (WORD*) realloc(ind->steps, size * sizeof(WORD));
+  ind->starts = (int*) realloc(ind->starts, size * sizeof(int));
+  ind->replacements = (int*) realloc(ind->replacements, size * sizeof(int));
+  for (i = ind->size; i < size; i ++) {
+    ind->isInduction[i] = 0;
+    ind->replacements[i] = IR_NONE;
+  }
+  ind->size = size;
+}
+
+int makeValue(IRFunction* f, int block, enum IROpCode op, Type* type, int isAddress, int a, int b) {
+  int inst = newInstruction(f, op);
+
+  f->insts[inst].type = type;
+  f->insts[inst].isAddress = isAddress;
+  if (a != IR_NONE) addArgument(f, inst, a);
+  if (b != IR_NONE) addArgument(f, inst, b);
+  moveBeforeTerminator(f, block, inst);
+  return inst;
+}
+
+int makeConstant(IRFunction* f, int block, WORD value) {
+  int inst = makeValue(f, block, IR_CONST, &irIntType, 0, IR_NONE, IR_NONE);
+
+  f->insts[inst].value = value;
+  return inst;
+}
+
+/* A new induction variable for x, which starts at start, computed in the
+   preheader, and grows by step. Uses of x in the loop take it instead. */
+int newInduction(IRFunction* f, Loop* loop, Induction* ind, int x, int start, WORD step) {
+  int entry = predecessorIndex(f, loop->header, loop->preheader);
+  int phi, next;
+
+  phi = newInstruction(f, IR_PHI);
+  f->insts[phi].type = f->insts[x].type;
+  f->insts[phi].isAddress = f->insts[x].isAddress;
+  f->insts[phi].lineNo = f->insts[x].lineNo;
+  f->insts[phi].block = loop->header;
+  next = makeValue(f, loop->latch, IR_ADD, f->insts[x].type, f->insts[x].isAddress,
+                   phi, makeConstant(f, loop->latch, step));
+  if (entry == 0) {
+    addArgument(f, phi, start);
+    addArgument(f, phi, next);
+  } else {
+    addArgument(f, phi, next);
+    addArgument(f, phi, start);
+  }
+
+  growInduction(ind, f->instCount);
+  ind->isInduction[phi] = 1;
+  ind->steps[phi] = step;
+  ind->starts[phi] = start;
+  ind->replacements[x] = phi;
+  ind->phis = (int*) realloc(ind->phis, (ind->phiCount + 1) * sizeof(int));
+  ind->phis[ind->phiCount ++] = phi;
+  return phi;
+}
+
+// The basic induction variables: phi = phi(start, phi + constant)
+void findBasicInductions(IRFunction* f, Loop* loop, Induction* ind) {
+  IRBlock* h = f->blocks + loop->header;
+  int entry = predecessorIndex(f, loop->header, loop->preheader);
+  IRInst* phi;
+  IRInst* next;
+  IRInst* c;
+  int i, v;
+
+  for (i = 0; i < h->instCount; i ++) {
+    v = h->insts[i];
+    phi = f->insts + v;
+    if (phi->op != IR_PHI) break;
+    next = f->insts + phi->args[1 - entry];
+    if (((next->op != IR_ADD) && (next->op != IR_SUB)) || (next->argCount != 2)) continue;
+    if ((next->args[0] == v) && (f->insts[next->args[1]].op == IR_CONST)) {
+      c = f->insts + next->args[1];
+      ind->steps[v] = (next->op == IR_ADD) ? c->value : (WORD) (0u - (unsigned) c->value);
+    } else if ((next->op == IR_ADD) && (next->args[1] == v) &&
+               (f->insts[next->args[0]].op == IR_CONST))
+      ind->steps[v] = f->insts[next->args[0]].value;
+    else continue;
+    ind->isInduction[v] = 1;
+    ind->starts[v] = phi->args[entry];
+  }
+}
+
+int reduceStrength(IRFunction* f, Loop* loop, Induction* ind) {
+  IRBlock* b;
+  IRInst* inst;
+  int* blocks;
+  int blockCount, i, j, k, v, iv, other, start;
+  int reduced = 0;
+
+  if ((loop->preheader == IR_NONE) || (loop->latch == IR_NONE) ||
+      (f->blocks[loop->header].predCount != 2))
+    return 0;
+  growInduction(ind, f->instCount);
+  for (i = 0; i < ind->size; i ++) {
+    ind->isInduction[i] = 0;
+    ind->replacements[i] = IR_NONE;
+  }
+  ind->phiCount = 0;
+  findBasicInductions(f, loop, ind);
+
+  blocks = loopBlocks(f, loop, &blockCount);
+  for (i = 0; i < blockCount; i ++) {
+    b = f->blocks + blocks[i];
+    for (j = 0; j < b->instCount; j ++) {
+      v = b->insts[j];
+      inst = f->insts + v;
+      if (inst->op == IR_PHI) continue;
+      for (k = 0; k < inst->argCount; k ++)
+        inst->args[k] = resolveValue(ind->replacements, inst->args[k]);
+      // A checked index is the same value
+      if ((inst->op == IR_CHECK) && (v < ind->size) && ind->isInduction[inst->args[0]]) {
+        ind->isInduction[v] = 1;
+        ind->steps[v] = ind->steps[inst->args[0]];
+        ind->starts[v] = ind->starts[inst->args[0]];
+        continue;
+      }
+      if ((inst->argCount != 2) || (v >= ind->size)) continue;
+
+      iv = ind->isInduction[inst->args[0]] ? 0 : (ind->isInduction[inst->args[1]] ? 1 : IR_NONE);
+      if (iv == IR_NONE) continue;
+      other = inst->args[1 - iv];
+      if ((inst->op == IR_MUL) && (f->insts[other].op == IR_CONST)) {
+        // iv * c starts at start * c and grows by step * c
+        start = makeValue(f, loop->preheader, IR_MUL, inst->type, 0,
+                          ind->starts[inst->args[iv]], other);
+        newInduction(f, loop, ind, v, start,
+                     (WORD) ((unsigned) ind->steps[inst->args[iv]] * (unsigned) f->insts[other].value));
+        reduced ++;
+      } else if ((inst->op == IR_ADD) && inst->isAddress && definedOutside(f, loop, other) &&
+                 (f->insts[other].op != IR_CONST)) {
+        // An invariant address plus iv is a pointer moving with it
+        start = (iv == 1) ?
+          makeValue(f, loop->preheader, IR_ADD, inst->type, 1, other, ind->starts[inst->args[iv]]) :
+          makeValue(f, loop->preheader, IR_ADD, inst->type, 1, ind->starts[inst->args[iv]], other);
+        newInduction(f, loop, ind, v, start, ind->steps[inst->args[iv]]);
+        reduced ++;
+      }
+      b = f->blocks + blocks[i];
+    }
+  }
+  for (i = 0; i < ind->phiCount; i ++)
+    insertInstruction(f, loop->header, 0, ind->phis[i]);
+
+  // The phis of the loop, and what uses a value the header computes
+  for (i = 0; i < blockCount; i ++) {
+    b = f->blocks + blocks[i];
+    for (j = 0; j < b->instCount; j ++) {
+      inst = f->insts + b->insts[j];
+      for (k = 0; (inst->op == IR_PHI) && (k < inst->argCount); k ++)
+        inst->args[k] = resolveValue(ind->replacements, inst->args[k]);
+    }
+  }
+  for (i = 0; i < ind->size; i ++)
+    if ((ind->replacements[i] != IR_NONE) && (f->insts[i].block != loop->header))
+      ind->replacements[i] = IR_NONE;
+  replaceUses(f, ind->replacements);
+  free(blocks);
+  return reduced;
+}
+
+int reduceInductionVariables(IRFunction* f) {
+  Induction ind;
+  Loop* loops;
+  int count, i, reduced = 0;
+
+  ind.isInduction = NULL;
+  ind.steps = NULL;
+  ind.starts = NULL;
+  ind.replacements = NULL;
+  ind.size = 0;
+  ind.phis = NULL;
+  loops = findLoops(f, &count);
+  // Outer loops first: the rows they reduce become pointers inside
+  for (i = 0; i < count; i ++)
+    reduced += reduceStrength(f, loops + i, &ind);
+  freeLoops(loops, count);
+
+  free(ind.isInduction);
+  free(ind.steps);
+  free(ind.starts);
+  free(ind.replacements);
+  free(ind.phis);
+  return reduced;
+}
@@ -1,4 +1,4 @@
-/* 
+/*
  * @copyright (c) 2008, Hedspi, Hanoi University of Technology
  * @author Huu-Duc Nguyen
  * @version 1.1
@@ -6,22 +6,214 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "reader.h"
 #include "parser.h"
+#include "codegen.h"
+#include "asmgen.h"
+#include "cgen.h"
+#include "elfgen.h"
+#include "vm.h"
+#include "jit.h"
+#include "tier.h"
+#include "passes.h"
+#include "peephole.h"
+#include "vectorize.h"
+#include "debug.h"
+
+extern SymTab* symtab;
+extern CodeBlock* codeBlock;
+
+int dumpCode = 0;
+int emitAssembly = 0;
+int emitC = 0;
+int emitElf = 0;
+int runProgram = 0;
+int runNativeCode = 0;
+int runInTiers = 0;
+int tierThreshold = DEFAULT_TIER_THRESHOLD;
+int tierStats = 0;
+int optimize = 0;
+int peephole = 0;
+int peepholeStats = 0;
+PassOptions passOptions;
 
 /******************************************************************/
 
+// Runs the compiled program without writing it out
+int run(void) {
+  VM* vm;
+  int status;
+
+  if (runNativeCode)
+    status = runJit(codeBlock, STACK_SIZE);
+  else if (runInTiers)
+    status = runTieredProgram(codeBlock, symtab, STACK_SIZE, tierThreshold, tierStats);
+  else {
+    vm = createVM(codeBlock, STACK_SIZE);
+    if (vm == NULL) status = VM_INVALID_CODE;
+    else {
+      status = runVM(vm, DISPATCH_THREADED);
+      freeVM(vm);
+    }
+  }
+
+  if (status == VM_INVALID_CODE)
+    printf("kplc: %s\n", vmErrorToString(status));
+  else if (status != VM_OK)
+    printf("\nRuntime error: %s\n", vmErrorToString(status));
+  return status;
+}
+
+// input.kpl -> input.kplb, input.s, input.c or the executable input
+char* makeOutputFileName(char* inputFileName, char* extension) {
+  int len = strlen(inputFileName);
+  char* outputFileName = (char*) malloc(len + strlen(extension) + 1);
+
+  strcpy(outputFileName, inputFileName);
+  if ((len > 4) && (strcmp(inputFileName + len - 4, ".kpl") == 0))
+    outputFileName[len - 4] = '\0';
+  strcat(outputFileName, extension);
+  return outputFileName;
+}
+
 int main(int argc, char *argv[]) {
-  if (argc <= 1) {
-    printf("parser: no input file.\n");
+  char* inputFileName = NULL;
+  char* outputFileName = NULL;
+  int i, ok;
+
+  initPassOptions(&passOptions);
+  for (i = 1; i < argc; i ++) {
+    if (strcmp(argv[i], "-dump") == 0)
+      dumpCode = 1;
+    else if (strcmp(argv[i], "-S") == 0)
+      emitAssembly = 1;
+    else if (strcmp(argv[i], "--emit-c") == 0)
+      emitC = 1;
+    else if (strcmp(argv[i], "--elf") == 0)
+      emitElf = 1;
+    else if (strcmp(argv[i], "--run") == 0)
+      runProgram = 1;
+    else if (strcmp(argv[i], "--jit") == 0)
+      runNativeCode = 1;
+    else if (strcmp(argv[i], "--tiered") == 0)
+      runInTiers = 1;
+    else if (strcmp(argv[i], "--tier-stats") == 0)
+      runInTiers = tierStats = 1;
+    else if ((strcmp(argv[i], "--threshold") == 0) && (i + 1 < argc))
+      tierThreshold = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-O") == 0)
+      optimize = 1;
+    else if (strncmp(argv[i], "--passes=", 9) == 0) {
+      optimize = 1;
+      passOptions.pipeline = argv[i] + 9;
+    } else if (strcmp(argv[i], "--time-passes") == 0)
+      passOptions.timePasses = 1;
+    else if (strncmp(argv[i], "--dump-after=", 13) == 0)
+      passOptions.dumpAfter = argv[i] + 13;
+    else if (strcmp(argv[i], "--verify-ir") == 0)
+      passOptions.verify = 1;
+    else if (strcmp(argv[i], "--opt-report") == 0)
+      passOptions.report = reportVectorization = 1;
+    else if (strcmp(argv[i], "--memoize") == 0)
+      optimize = passOptions.memoize = 1;
+    else if (strcmp(argv[i], "--peephole") == 0)
+      peephole = 1;
+    else if (strcmp(argv[i], "--peephole-stats") == 0)
+      peephole = peepholeStats = 1;
+    else if (strcmp(argv[i], "--no-vectorize") == 0)
+      vectorizeLoops = 0;
+    else if (strcmp(argv[i], "--no-avx2") == 0)
+      useAvx2 = 0;
+    else if (strncmp(argv[i], "--inline-threshold=", 19) == 0)
+      passOptions.inlineThreshold = atoi(argv[i] + 19);
+    else if (strcmp(argv[i], "--list-passes") == 0) {
+      printPasses(stdout);
+      return 0;
+    } else if (inputFileName == NULL)
+      inputFileName = argv[i];
+    else if (outputFileName == NULL)
+      outputFileName = argv[i];
+  }
+
+  if (inputFileName == NULL) {
+    printf("kplc: no input file.\n");
+    printf("usage: kplc input [output] [-dump] [-S | --elf | --emit-c | --run [--jit | --tiered [--threshold n] [--tier-stats]]]\n");
+    printf("            [-O | --passes=p1,p2,...] [--time-passes] [--dump-after=pass|all] [--verify-ir]\n");
+    printf("            [--opt-report] [--inline-threshold=n] [--memoize]\n");
+    printf("            [--peephole] [--peephole-stats] [--no-vectorize] [--no-avx2]\n");
+    printf("       kplc --list-passes\n");
     return -1;
   }
 
-  if (compile(argv[1]) == IO_ERROR) {
+  if (compile(inputFileName) == IO_ERROR) {
     printf("Can\'t read input file!\n");
     return -1;
   }
-    
-  return 0;
+
+  // The C compiler optimizes the C, which comes from the parser's code
+  if (emitC) {
+    if (outputFileName == NULL)
+      outputFileName = makeOutputFileName(inputFileName, ".c");
+    ok = generateC(codeBlock, symtab, outputFileName);
+    cleanSymTab();
+    cleanCodeBuffer();
+    return ok ? 0 : -1;
+  }
+
+  if (optimize && !optimizeCode(&codeBlock, symtab, &passOptions)) {
+    cleanSymTab();
+    cleanCodeBuffer();
+    return -1;
+  }
+
+  if (optimize || peephole)
+    runPeephole(codeBlock, symtab, peepholeStats ? stderr : NULL);
+
+  if (dumpCode) {
+    printObject(symtab->program, 0);
+    printf("\n");
+    printCodeBuffer();
+  }
+
+  if (runProgram) {
+    ok = run();
+    cleanSymTab();
+    cleanCodeBuffer();
+    return ok;
+  }
+
+  if (emitAssembly) {
+    if (outputFileName == NULL)
+      outputFileName = makeOutputFileName(inputFileName, ".s");
+    ok = generateAssembly(codeBlock, symtab, outputFileName);
+    cleanSymTab();
+    cleanCodeBuffer();
+    return ok ? 0 : -1;
+  }
+
+  if (emitElf) {
+    if (outputFileName == NULL) {
+      outputFileName = makeOutputFileName(inputFileName, "");
+      if (strcmp(outputFileName, inputFileName) == 0)
+        outputFileName = makeOutputFileName(inputFileName, ".out");
+    }
+    ok = generateElf(codeBlock, outputFileName);
+    cleanSymTab();
+    cleanCodeBuffer();
+    return ok ? 0 : -1;
+  }
+
+  if (outputFileName == NULL)
+    outputFileName = makeOutputFileName(inputFileName, ".kplb");
+  ok = serialize(outputFileName);
+  if (ok) {
+    printf("%s: ", outputFileName);
+    printCodeBufferSummary();
+  } else printf("Can\'t write output file %s!\n", outputFileName);
+
+  cleanSymTab();
+  cleanCodeBuffer();
+  return ok ? 0 : -1;
 }
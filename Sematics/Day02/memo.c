@@ -0,0 +1,311 @@
+/* Memoization of pure recursive functions
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+#include "irbuild.h"
+
+/* A function is pure when its value depends on its parameters alone: it
+   takes no reference or array parameter, reads and writes no variable
+   outside its own frame, does no input or output and calls only pure
+   functions.
+   Those that call themselves remember what they returned in a table of
+   the frame of the program. On entry the parameters hash to an entry,
+   and when it holds the same parameters the function returns the value
+   kept there at once; every return fills the entry in.
+
+   An entry is a flag, then the parameters, then the value. The hash is
+   the remainder of a division, which goes from -(MEMO_MODULUS - 1) to
+   MEMO_MODULUS - 1 with the sign of the dividend, so that every one of
+   these has an entry. The program clears the tables before it starts. */
+
+#define MEMO_MODULUS 128
+#define MEMO_ENTRIES (2 * MEMO_MODULUS - 1)
+#define MEMO_HASH_FACTOR 31
+
+int emitMemoOp(IRFunction* f, int block, enum IROpCode op, int a, int b) {
+  int inst = emitInstruction(f, block, op);
+
+  f->insts[inst].type = &irIntType;
+  addArgument(f, inst, a);
+  if (b != IR_NONE) addArgument(f, inst, b);
+  if ((op == IR_ADD) && f->insts[a].isAddress) f->insts[inst].isAddress = 1;
+  return inst;
+}
+
+int emitMemoConstant(IRFunction* f, int block, WORD value) {
+  int inst = emitInstruction(f, block, IR_CONST);
+
+  f->insts[inst].type = &irIntType;
+  f->insts[inst].value = value;
+  return inst;
+}
+
+int emitMemoAddress(IRFunction* f, int block, int level, int slot) {
+  int inst = emitInstruction(f, block, IR_ADDR);
+
+  f->insts[inst].level = level;
+  f->insts[inst].value = slot;
+  f->insts[inst].isAddress = 1;
+  f->insts[inst].type = &irIntType;
+  return inst;
+}
+
+// The word at offset words from the entry
+int emitMemoWord(IRFunction* f, int block, int entry, int offset) {
+  if (offset == 0) return entry;
+  return emitMemoOp(f, block, IR_ADD, entry, emitMemoConstant(f, block, offset));
+}
+
+void emitMemoStore(IRFunction* f, int block, int address, int value) {
+  int inst = emitInstruction(f, block, IR_STORE);
+
+  addArgument(f, inst, address);
+  addArgument(f, inst, value);
+}
+
+// Whether the address is in the frame of the function itself
+int isLocalAddress(IRFunction* f, int v) {
+  IRInst* inst = f->insts + v;
+
+  while ((inst->op == IR_ADD) && inst->isAddress)
+    inst = f->insts + (f->insts[inst->args[0]].isAddress ? inst->args[0] : inst->args[1]);
+  return (inst->op == IR_ADDR) && (inst->level == 0);
+}
+
+// Whether the functions call each other, directly or not
+int inCallCycle(IRProgram* program, char* reaches, int i, int j) {
+  int n = program->count;
+
+  return (i == j) || (reaches[i * n + j] && reaches[j * n + i]);
+}
+
+/* The impure function the function calls, preferring one out of its call
+   cycle, and then one a member of the cycle calls, since those of the
+   cycle are only impure through the others. -1 when it calls none. */
+int findImpureCallee(IRProgram* program, int index, char* pure, char* reaches) {
+  IRFunction* f;
+  int cycle = -1;
+  int i, j, callee;
+
+  for (j = 0; j < program->count; j ++) {
+    if ((j != index) && ((reaches == NULL) || !inCallCycle(program, reaches, index, j))) continue;
+    f = program->functions[j];
+    for (i = 0; i < f->instCount; i ++) {
+      if ((f->insts[i].block == IR_NONE) || (f->insts[i].op != IR_CALL)) continue;
+      callee = f->insts[i].callee;
+      if (pure[callee]) continue;
+      if ((reaches == NULL) || !inCallCycle(program, reaches, index, callee)) return callee;
+      if (cycle < 0) cycle = callee;
+    }
+  }
+  return cycle;
+}
+
+/* Why the function is not pure, or NULL when it is as far as the rest
+   goes. reaches, when not NULL, tells which functions call which, so
+   that a call is blamed on a function out of the call cycle. */
+char* findImpurity(IRProgram* program, int index, char* pure, char* reaches) {
+  static char reason[64];
+  IRFunction* f = program->functions[index];
+  IRInst* inst;
+  int calls = 0;
+  int i;
+
+  if (f->kind != IR_FUNCTION) return "not a function";
+  if (f->paramCount == 0) return "no parameters";
+  // An array parameter comes as its address too, even when passed by value
+  for (i = 0; i < f->paramCount; i ++)
+    if (f->slotIsReference[RESERVED_WORDS + i])
+      return f->slotIsArray[RESERVED_WORDS + i] ? "an array parameter" : "a reference parameter";
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    switch (inst->op) {
+    case IR_READC: case IR_READI: case IR_WRITEC: case IR_WRITEI: case IR_WRITELN:
+      return "input or output";
+    case IR_ADDR:
+      if (inst->level > 0) return "uses a variable outside it";
+      break;
+    case IR_LOAD: case IR_STORE:
+      if (!isLocalAddress(f, inst->args[0])) return "uses memory outside its frame";
+      break;
+    case IR_COPY:
+      if (!isLocalAddress(f, inst->args[0]) || !isLocalAddress(f, inst->args[1]))
+        return "uses memory outside its frame";
+      break;
+    case IR_CALL:
+      if (!pure[inst->callee]) calls = 1;
+      break;
+    default:
+      break;
+    }
+  }
+  if (calls) {
+    sprintf(reason, "calls %.40s", program->functions[findImpureCallee(program, index, pure, reaches)]->name);
+    return reason;
+  }
+  return NULL;
+}
+
+// Looks the parameters up on entry and fills the entry in on every return
+void memoizeFunction(IRFunction* f, int table) {
+  int words = f->paramCount + 2;
+  int* keys = (int*) malloc(f->paramCount * sizeof(int));
+  int lookup, first, hit, found, entry, hash, value, t;
+  int i, k;
+
+  lookup = splitEdge(f, 0, 0);
+  first = f->blocks[lookup].succs[0];
+  removeInstruction(f, terminatorOf(f, lookup));
+  compactBlocks(f);
+
+  for (i = 0; i < f->paramCount; i ++) {
+    keys[i] = emitMemoOp(f, lookup, IR_LOAD,
+                         emitMemoAddress(f, lookup, 0, RESERVED_WORDS + i), IR_NONE);
+    f->insts[keys[i]].type = f->slotTypes[RESERVED_WORDS + i];
+  }
+  hash = keys[0];
+  for (i = 1; i < f->paramCount; i ++)
+    hash = emitMemoOp(f, lookup, IR_ADD,
+                      emitMemoOp(f, lookup, IR_MUL, hash, emitMemoConstant(f, lookup, MEMO_HASH_FACTOR)),
+                      keys[i]);
+  t = emitMemoConstant(f, lookup, MEMO_MODULUS);
+  hash = emitMemoOp(f, lookup, IR_SUB, hash,
+                    emitMemoOp(f, lookup, IR_MUL, emitMemoOp(f, lookup, IR_DIV, hash, t), t));
+  hash = emitMemoOp(f, lookup, IR_ADD, hash, emitMemoConstant(f, lookup, MEMO_MODULUS - 1));
+  entry = emitMemoOp(f, lookup, IR_ADD, emitMemoAddress(f, lookup, f->depth, table),
+                     emitMemoOp(f, lookup, IR_MUL, hash, emitMemoConstant(f, lookup, words)));
+
+  found = emitMemoOp(f, lookup, IR_EQ, emitMemoOp(f, lookup, IR_LOAD, entry, IR_NONE),
+                     emitMemoConstant(f, lookup, 1));
+  for (i = 0; i < f->paramCount; i ++)
+    found = emitMemoOp(f, lookup, IR_MUL, found,
+                       emitMemoOp(f, lookup, IR_EQ,
+                                  emitMemoOp(f, lookup, IR_LOAD, emitMemoWord(f, lookup, entry, i + 1), IR_NONE),
+                                  keys[i]));
+  addArgument(f, emitInstruction(f, lookup, IR_BRANCH), found);
+
+  hit = newBlock(f);
+  value = emitMemoOp(f, hit, IR_LOAD, emitMemoWord(f, hit, entry, words - 1), IR_NONE);
+  f->insts[value].type = f->returnType;
+  addArgument(f, emitInstruction(f, hit, IR_RETURN), value);
+  f->blocks[lookup].succCount = 0;
+  addEdge(f, lookup, hit);
+  f->blocks[lookup].succs[f->blocks[lookup].succCount ++] = first;
+
+  // The terminator of each return is taken off while the stores go in
+  for (i = 0; i < f->blockCount; i ++) {
+    t = terminatorOf(f, i);
+    if ((i == hit) || (t == IR_NONE) || (f->insts[t].op != IR_RETURN)) continue;
+    f->blocks[i].instCount --;
+    emitMemoStore(f, i, emitMemoWord(f, i, entry, words - 1), f->insts[t].args[0]);
+    for (k = 0; k < f->paramCount; k ++)
+      emitMemoStore(f, i, emitMemoWord(f, i, entry, k + 1), keys[k]);
+    emitMemoStore(f, i, entry, emitMemoConstant(f, i, 1));
+    appendInstruction(f, i, t);
+  }
+  free(keys);
+}
+
+/* The program clears the words of the tables, from slot table on, in a
+   loop before its first statement. */
+void clearMemoTables(IRFunction* f, int table, int words) {
+  int start, loop, body, first, i, next, zero, k;
+
+  start = splitEdge(f, 0, 0);
+  first = f->blocks[start].succs[0];
+  loop = newBlock(f);
+  body = newBlock(f);
+  zero = newInstruction(f, IR_CONST);
+  f->insts[zero].type = &irIntType;
+  insertInstruction(f, 0, f->blocks[0].instCount - 1, zero);
+  f->blocks[start].succCount = 0;
+  addEdge(f, start, loop);
+
+  i = newInstruction(f, IR_PHI);
+  f->insts[i].type = &irIntType;
+  appendInstruction(f, loop, i);
+  addArgument(f, i, zero);
+  addArgument(f, emitInstruction(f, loop, IR_BRANCH),
+              emitMemoOp(f, loop, IR_LT, i, emitMemoConstant(f, loop, words)));
+  addEdge(f, loop, body);
+  f->blocks[loop].succs[f->blocks[loop].succCount ++] = first;
+  k = predecessorIndex(f, first, start);
+  f->blocks[first].preds[k] = loop;
+
+  emitMemoStore(f, body, emitMemoOp(f, body, IR_ADD, emitMemoAddress(f, body, 0, table), i), zero);
+  next = emitMemoOp(f, body, IR_ADD, i, emitMemoConstant(f, body, 1));
+  addArgument(f, i, next);
+  emitInstruction(f, body, IR_JUMP);
+  addEdge(f, body, loop);
+}
+
+int memoizeFunctions(IRProgram* program) {
+  IRFunction* main = program->functions[0];
+  IRFunction* f;
+  int n = program->count;
+  char* pure = (char*) malloc(n + 1);
+  char* reaches = (char*) calloc(n * n + 1, 1);
+  char* reason;
+  int base = main->slotCount;
+  int table = base;
+  int changed = 1;
+  int count = 0;
+  int i, j, k;
+
+  for (i = 0; i < n; i ++)
+    pure[i] = 1;
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < n; i ++)
+      if (pure[i] && (findImpurity(program, i, pure, NULL) != NULL)) {
+        pure[i] = 0;
+        changed = 1;
+      }
+  }
+
+  // Which functions call themselves, directly or not
+  for (i = 0; i < n; i ++) {
+    f = program->functions[i];
+    for (j = 0; j < f->instCount; j ++)
+      if ((f->insts[j].block != IR_NONE) && (f->insts[j].op == IR_CALL))
+        reaches[i * n + f->insts[j].callee] = 1;
+  }
+  for (k = 0; k < n; k ++)
+    for (i = 0; i < n; i ++)
+      if (reaches[i * n + k])
+        for (j = 0; j < n; j ++)
+          if (reaches[k * n + j]) reaches[i * n + j] = 1;
+
+  for (i = 1; i < n; i ++) {
+    f = program->functions[i];
+    if (f->kind != IR_FUNCTION) continue;
+    reason = pure[i] ? NULL : findImpurity(program, i, pure, reaches);
+    if ((reason == NULL) && !reaches[i * n + i]) reason = "not recursive";
+    if (reportDecisions) {
+      if (reason == NULL)
+        fprintf(stderr, "memoize %s: %d entries of %d words\n", f->name, MEMO_ENTRIES, f->paramCount + 2);
+      else fprintf(stderr, "memoize %s: kept, %s\n", f->name, reason);
+    }
+    if (reason != NULL) continue;
+
+    resizeSlots(main, table + MEMO_ENTRIES * (f->paramCount + 2));
+    for (j = table; j < main->slotCount; j ++) {
+      main->slotTypes[j] = &irIntType;
+      main->slotIsArray[j] = 1;
+    }
+    memoizeFunction(f, table);
+    table = main->slotCount;
+    count ++;
+  }
+  if (count > 0) clearMemoTables(main, base, table - base);
+
+  free(pure);
+  free(reaches);
+  return count;
+}
@@ -11,6 +11,13 @@
 #include "parser.h"
 #include "error.h"
 #include "debug.h"
+#include "semantics.h"
+#include "fold.h"
+#include "codegen.h"
+#include "vm.h"
+
+// Words of the largest frame, which must fit on the stack of the machine
+#define MAX_FRAME_SIZE (STACK_SIZE - RESERVED_WORDS)
 
 Token *currentToken;
 Token *lookAhead;
@@ -32,16 +39,24 @@ void eat(TokenType tokenType) {
   } else missingToken(tokenType, lookAhead->lineNo, lookAhead->colNo);
 }
 
+// A frame past the stack gives up at the declaration that made it so
+void checkFrameSize(void) {
+  if (symtab->currentScope->frameSize > MAX_FRAME_SIZE)
+    error(ERR_FRAME_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
+}
+
 void compileProgram(void) {
   // TODO: create, enter, and exit program block
   eat(KW_PROGRAM);
   eat(TK_IDENT);
   	//Create a program object 
     Object* Obj = createProgramObject(currentToken->string);
+    Obj->progAttrs->codeAddress = getCurrentCodeAddress();
   	//enter program block
     enterBlock(Obj->progAttrs->scope);
   eat(SB_SEMICOLON);
   compileBlock();
+  genHL();
   eat(SB_PERIOD);
   	//exit program block
     exitBlock();
@@ -119,6 +134,7 @@ void compileBlock3(void) {
       varObj->varAttrs->type = varType;
       //Add Variable object to Curent object list
       declareObject(varObj);
+      checkFrameSize();
       eat(SB_SEMICOLON);
     } while (lookAhead->tokenType == TK_IDENT);
     compileBlock4();
@@ -127,7 +143,16 @@ void compileBlock3(void) {
 }
 
 void compileBlock4(void) {
+  // Code of nested subprograms is laid out before the block's own body
+  CodeAddress jmp = genJ(DC_VALUE);
+
   compileSubDecls();
+  if (getCurrentCodeAddress() == jmp + 1)
+    discardCode(jmp);
+  else updateJ(jmp, getCurrentCodeAddress());
+
+  genINT(symtab->currentScope->frameSize);
+  genParameterCopies(symtab->currentScope->owner);
   compileBlock5();
 }
 
@@ -165,7 +190,9 @@ void compileFuncDecl(void) {
     funcObj->funcAttrs->returnType = returnType;
   eat(SB_SEMICOLON);
   
+  funcObj->funcAttrs->codeAddress = getCurrentCodeAddress();
   compileBlock();
+  genEF();
   eat(SB_SEMICOLON);
   	//Exit Function scope
     exitBlock();
@@ -181,101 +208,23 @@ void compileProcDecl(void) {
   enterBlock(procObj->procAttrs->scope);
   compileParams();
   eat(SB_SEMICOLON);
+  procObj->procAttrs->codeAddress = getCurrentCodeAddress();
   compileBlock();
+  genEP();
   eat(SB_SEMICOLON);
   exitBlock();
 }
 
-ConstantValue* compileUnsignedConstant(void) {
-  // TODO: create and return an unsigned constant value
-  
-  ConstantValue* constValue;
-
-  switch (lookAhead->tokenType) {
-  case TK_NUMBER:
-    eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
-    break;
-  case TK_IDENT:
-    eat(TK_IDENT);
-    Object* obj = lookupObject(currentToken->string);
-    if (obj == NULL)
-      error(ERR_UNDECLARED_IDENT,
-            currentToken->lineNo,
-            currentToken->colNo);
-    if (obj->kind != OBJ_CONSTANT)
-      error(ERR_INVALID_CONSTANT,
-            currentToken->lineNo,
-            currentToken->colNo);
-
-    constValue = duplicateConstantValue(obj->constAttrs->value);
-    break;
-  case TK_CHAR:
-    eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->value);
-    break;
-  default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
-    break;
-  }
-  return constValue;
-}
-
 ConstantValue* compileConstant(void) {
-  // TODO: create and return a constant
-  
-  ConstantValue* constValue;
-
-  switch (lookAhead->tokenType) {
-  case SB_PLUS:
-    eat(SB_PLUS);
-    constValue = compileConstant2();
-    break;
-  case SB_MINUS:
-    eat(SB_MINUS);
-    constValue = compileConstant2();
-    break;
-  case TK_CHAR:
-    eat(TK_CHAR);
-    constValue = makeCharConstant(currentToken->value);
-    break;
-  default:
-    constValue = compileConstant2();
-    break;
-  }
-  return constValue;
-}
-
-ConstantValue* compileConstant2(void) {
-  // TODO: create and return a constant value
-  
-  ConstantValue* constValue;
-
-  switch (lookAhead->tokenType) {
-  case TK_NUMBER:
-    eat(TK_NUMBER);
-    constValue = makeIntConstant(currentToken->value);
-    break;
-  case TK_IDENT:
-    eat(TK_IDENT);
-    Object* obj = lookupObject(currentToken->string);
-    if (obj == NULL)
-      error(ERR_UNDECLARED_IDENT,
-            currentToken->lineNo,
-            currentToken->colNo);
-
-    if (obj->kind != OBJ_CONSTANT)
-      error(ERR_INVALID_CONSTANT,
-            currentToken->lineNo,
-            currentToken->colNo);
-
-    constValue = duplicateConstantValue(obj->constAttrs->value);
-    break;
-  default:
-    error(ERR_INVALID_CONSTANT, lookAhead->lineNo, lookAhead->colNo);
-    break;
-  }
-  return constValue;
+  // A constant is any expression that folds at compile time. It leaves
+  // no code behind: the value lives in the symbol table
+  CodeAddress mark = getCurrentCodeAddress();
+  ExprInfo info = compileExpression();
+
+  if (!info.isConstant)
+    error(ERR_INVALID_CONSTANT, currentToken->lineNo, currentToken->colNo);
+  discardCode(mark);
+  return duplicateConstantValue(&(info.value));
 }
 
 Type* compileType(void) {
@@ -293,11 +242,16 @@ Type* compileType(void) {
   case KW_ARRAY:
     eat(KW_ARRAY);
     eat(SB_LSEL);
-    eat(TK_NUMBER);
-    int size = currentToken->value;
+    ConstantValue* sizeValue = compileConstant();
+    if ((sizeValue->type != TP_INT) || (sizeValue->intValue <= 0))
+      error(ERR_INVALID_ARRAY_SIZE, currentToken->lineNo, currentToken->colNo);
+    int size = sizeValue->intValue;
+    free(sizeValue);
     eat(SB_RSEL);
     eat(KW_OF);
     Type* elementType = compileType();
+    if ((long long) size * sizeOfType(elementType) > MAX_FRAME_SIZE)
+      error(ERR_ARRAY_TOO_LARGE, currentToken->lineNo, currentToken->colNo);
     type = makeArrayType(size, elementType);
     break;
   case TK_IDENT:
@@ -349,6 +303,8 @@ void compileParams(void) {
       compileParam();
     }
     eat(SB_RPAR);
+    declareParameterCopies(symtab->currentScope->owner);
+    checkFrameSize();
   }
 }
 
@@ -364,7 +320,7 @@ void compileParam(void) {
         symtab->currentScope->owner
     );
     eat(SB_COLON);
-    paramObj->paramAttrs->type = compileBasicType();
+    paramObj->paramAttrs->type = compileType();
     declareObject(paramObj);
     break;
   case KW_VAR:
@@ -372,11 +328,11 @@ void compileParam(void) {
     eat(TK_IDENT);
     paramObj = createParameterObject(
         currentToken->string,
-        PARAM_VALUE,
+        PARAM_REFERENCE,
         symtab->currentScope->owner
     );
     eat(SB_COLON);
-    paramObj->paramAttrs->type = compileBasicType();
+    paramObj->paramAttrs->type = compileType();
     declareObject(paramObj);
     break;
   default:
@@ -394,6 +350,18 @@ void compileStatements(void) {
 }
 
 void compileStatement(void) {
+  switch (lookAhead->tokenType) {
+  case TK_IDENT:
+  case KW_CALL:
+  case KW_IF:
+  case KW_WHILE:
+  case KW_FOR:
+    markStatement(lookAhead->lineNo);
+    break;
+  default:
+    break;
+  }
+
   switch (lookAhead->tokenType) {
   case TK_IDENT:
     compileAssignSt();
@@ -425,21 +393,78 @@ void compileStatement(void) {
   }
 }
 
-void compileLValue(void) {
+// Leaves the address of the lvalue on top of the stack
+Type* compileLValue(void) {
+  Object* var;
+  Type* varType;
+
   eat(TK_IDENT);
-  compileIndexes();
+  var = checkDeclaredLValueIdent(currentToken->string);
+
+  switch (var->kind) {
+  case OBJ_VARIABLE:
+    genVariableAddress(var);
+    varType = compileIndexes(var->varAttrs->type);
+    break;
+  case OBJ_PARAMETER:
+    genParameterAddress(var);
+    varType = compileIndexes(var->paramAttrs->type);
+    break;
+  case OBJ_FUNCTION:
+    genReturnValueAddress(var);
+    varType = var->funcAttrs->returnType;
+    break;
+  default:
+    varType = NULL;
+    break;
+  }
+  return varType;
 }
 
 void compileAssignSt(void) {
-  compileLValue();
+  Type* varType;
+  ExprInfo info;
+
+  varType = compileLValue();
   eat(SB_ASSIGN);
-  compileExpression();
+  info = compileExpression();
+  checkTypeEquality(varType, info.type);
+  // An array is assigned as a whole, from the address of the other one
+  if (varType->typeClass == TP_ARRAY)
+    genCP(sizeOfType(varType));
+  else genST();
 }
 
 void compileCallSt(void) {
+  Object* proc;
+  Type* varType;
+
   eat(KW_CALL);
   eat(TK_IDENT);
-  compileArguments();
+
+  proc = lookupObject(currentToken->string);
+  if ((proc != NULL) && (proc->kind == OBJ_FUNCTION) && isPredefinedFunction(proc)
+      && (lookAhead->tokenType == SB_LPAR)) {
+    // CALL READI(v) and CALL READC(v) read straight into a variable
+    eat(SB_LPAR);
+    varType = compileLValue();
+    checkTypeEquality(varType, proc->funcAttrs->returnType);
+    genPredefinedFunctionCall(proc);
+    genST();
+    eat(SB_RPAR);
+    return;
+  }
+
+  proc = checkDeclaredProcedure(currentToken->string);
+  if (isPredefinedProcedure(proc)) {
+    compileArguments(proc->procAttrs->paramList);
+    genPredefinedProcedureCall(proc);
+  } else {
+    genINT(RESERVED_WORDS);
+    compileArguments(proc->procAttrs->paramList);
+    genDCT(RESERVED_WORDS + proc->procAttrs->paramCount);
+    genProcedureCall(proc);
+  }
 }
 
 void compileGroupSt(void) {
@@ -449,12 +474,40 @@ void compileGroupSt(void) {
 }
 
 void compileIfSt(void) {
+  CodeAddress fjInstruction, jInstruction, mark;
+  int cond;
+
   eat(KW_IF);
-  compileCondition();
+  cond = compileCondition();
   eat(KW_THEN);
-  compileStatement();
-  if (lookAhead->tokenType == KW_ELSE) 
-    compileElseSt();
+
+  switch (cond) {
+  case COND_TRUE:
+    compileStatement();
+    if (lookAhead->tokenType == KW_ELSE) {
+      mark = getCurrentCodeAddress();
+      compileElseSt();
+      discardCode(mark);
+    }
+    break;
+  case COND_FALSE:
+    mark = getCurrentCodeAddress();
+    compileStatement();
+    discardCode(mark);
+    if (lookAhead->tokenType == KW_ELSE)
+      compileElseSt();
+    break;
+  default:
+    fjInstruction = genFJ(DC_VALUE);
+    compileStatement();
+    if (lookAhead->tokenType == KW_ELSE) {
+      jInstruction = genJ(DC_VALUE);
+      updateFJ(fjInstruction, getCurrentCodeAddress());
+      compileElseSt();
+      updateJ(jInstruction, getCurrentCodeAddress());
+    } else updateFJ(fjInstruction, getCurrentCodeAddress());
+    break;
+  }
 }
 
 void compileElseSt(void) {
@@ -463,41 +516,135 @@ void compileElseSt(void) {
 }
 
 void compileWhileSt(void) {
+  CodeAddress beginWhile, fjInstruction;
+  int cond;
+
+  beginWhile = getCurrentCodeAddress();
   eat(KW_WHILE);
-  compileCondition();
+  cond = compileCondition();
   eat(KW_DO);
-  compileStatement();
+
+  switch (cond) {
+  case COND_TRUE:
+    compileStatement();
+    genJ(beginWhile);
+    break;
+  case COND_FALSE:
+    compileStatement();
+    discardCode(beginWhile);
+    break;
+  default:
+    fjInstruction = genFJ(DC_VALUE);
+    compileStatement();
+    genJ(beginWhile);
+    updateFJ(fjInstruction, getCurrentCodeAddress());
+    break;
+  }
 }
 
+/* The address of the loop variable stays on the stack for the whole loop:
+ *   var := e1
+ *   L1: if var > e2 goto L2
+ *       stmt
+ *       var := var + 1
+ *       goto L1
+ *   L2:
+ */
 void compileForSt(void) {
+  CodeAddress beginLoop, fjInstruction;
+  Object* var;
+  Type* varType;
+  ExprInfo info;
+
   eat(KW_FOR);
   eat(TK_IDENT);
+
+  var = checkDeclaredLValueIdent(currentToken->string);
+  switch (var->kind) {
+  case OBJ_VARIABLE:
+    genVariableAddress(var);
+    varType = var->varAttrs->type;
+    break;
+  case OBJ_PARAMETER:
+    genParameterAddress(var);
+    varType = var->paramAttrs->type;
+    break;
+  default:
+    error(ERR_INVALID_VARIABLE, currentToken->lineNo, currentToken->colNo);
+    varType = NULL;
+    break;
+  }
+  checkIntType(varType);
+
+  genCV();
   eat(SB_ASSIGN);
-  compileExpression();
+  info = compileExpression();
+  checkIntType(info.type);
+  genST();
+
+  beginLoop = getCurrentCodeAddress();
+  genCV();
+  genLI();
   eat(KW_TO);
-  compileExpression();
+  info = compileExpression();
+  checkIntType(info.type);
+  genLE();
+  fjInstruction = genFJ(DC_VALUE);
+
   eat(KW_DO);
   compileStatement();
+
+  genCV();
+  genCV();
+  genLI();
+  genLC(1);
+  genAD();
+  genST();
+  genJ(beginLoop);
+  updateFJ(fjInstruction, getCurrentCodeAddress());
+  genDCT(1);
 }
 
-void compileArgument(void) {
-  compileExpression();
+void compileArgument(Object* param) {
+  Type* type;
+  ExprInfo info;
+
+  if (param->paramAttrs->kind == PARAM_VALUE) {
+    info = compileExpression();
+    checkTypeEquality(param->paramAttrs->type, info.type);
+  } else {
+    // A reference parameter gets the address of an lvalue
+    if (lookAhead->tokenType != TK_IDENT)
+      error(ERR_INVALID_LVALUE, lookAhead->lineNo, lookAhead->colNo);
+    type = compileLValue();
+    checkTypeEquality(param->paramAttrs->type, type);
+  }
 }
 
-void compileArguments(void) {
+void compileArguments(ObjectNode* paramList) {
+  ObjectNode* node = paramList;
+
   switch (lookAhead->tokenType) {
   case SB_LPAR:
     eat(SB_LPAR);
-    compileArgument();
+    if (node == NULL)
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+    compileArgument(node->object);
+    node = node->next;
 
     while (lookAhead->tokenType == SB_COMMA) {
       eat(SB_COMMA);
-      compileArgument();
+      if (node == NULL)
+        error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+      compileArgument(node->object);
+      node = node->next;
     }
 
+    if (node != NULL)
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
     eat(SB_RPAR);
     break;
-    // Check FOLLOW set 
+    // Check FOLLOW set
   case SB_TIMES:
   case SB_SLASH:
   case SB_PLUS:
@@ -517,15 +664,25 @@ void compileArguments(void) {
   case KW_END:
   case KW_ELSE:
   case KW_THEN:
+    if (node != NULL)
+      error(ERR_PARAMETERS_ARGUMENTS_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
     break;
   default:
     error(ERR_INVALID_ARGUMENTS, lookAhead->lineNo, lookAhead->colNo);
   }
 }
 
-void compileCondition(void) {
-  compileExpression();
-  switch (lookAhead->tokenType) {
+// Leaves the truth value on top of the stack, or no code at all when the
+// condition folds to a constant
+int compileCondition(void) {
+  ExprInfo info1, info2;
+  TokenType op;
+
+  info1 = compileExpression();
+  checkBasicType(info1.type);
+
+  op = lookAhead->tokenType;
+  switch (op) {
   case SB_EQ:
     eat(SB_EQ);
     break;
@@ -548,42 +705,86 @@ void compileCondition(void) {
     error(ERR_INVALID_COMPARATOR, lookAhead->lineNo, lookAhead->colNo);
   }
 
-  compileExpression();
+  info2 = compileExpression();
+  checkTypeEquality(info1.type, info2.type);
+
+  if (info1.isConstant && info2.isConstant) {
+    discardCode(getCurrentCodeAddress() - 2);
+    return foldComparison(op, &(info1.value), &(info2.value)) ? COND_TRUE : COND_FALSE;
+  }
+
+  switch (op) {
+  case SB_EQ:
+    genEQ();
+    break;
+  case SB_NEQ:
+    genNE();
+    break;
+  case SB_LE:
+    genLE();
+    break;
+  case SB_LT:
+    genLT();
+    break;
+  case SB_GE:
+    genGE();
+    break;
+  case SB_GT:
+    genGT();
+    break;
+  default:
+    break;
+  }
+  return COND_UNKNOWN;
 }
 
-void compileExpression(void) {
+ExprInfo compileExpression(void) {
+  ExprInfo info;
+  int lineNo, colNo;
+
   switch (lookAhead->tokenType) {
   case SB_PLUS:
     eat(SB_PLUS);
-    compileExpression2();
+    info = compileTerm();
+    checkIntType(info.type);
     break;
   case SB_MINUS:
     eat(SB_MINUS);
-    compileExpression2();
+    lineNo = currentToken->lineNo;
+    colNo = currentToken->colNo;
+    info = compileTerm();
+    checkIntType(info.type);
+    if (info.isConstant) {
+      discardCode(getCurrentCodeAddress() - 1);
+      foldNegation(&(info.value), lineNo, colNo);
+      genLC(info.value.intValue);
+    } else genNEG();
     break;
   default:
-    compileExpression2();
+    info = compileTerm();
   }
+  return compileExpression3(info);
 }
 
-void compileExpression2(void) {
-  compileTerm();
-  compileExpression3();
+ExprInfo compileExpression2(void) {
+  return compileExpression3(compileTerm());
 }
 
 
-void compileExpression3(void) {
-  switch (lookAhead->tokenType) {
+ExprInfo compileExpression3(ExprInfo info1) {
+  ExprInfo info2;
+  TokenType op = lookAhead->tokenType;
+  int lineNo = lookAhead->lineNo;
+  int colNo = lookAhead->colNo;
+
+  switch (op) {
   case SB_PLUS:
-    eat(SB_PLUS);
-    compileTerm();
-    compileExpression3();
-    break;
   case SB_MINUS:
-    eat(SB_MINUS);
-    compileTerm();
-    compileExpression3();
-    break;
+    eat(op);
+    checkIntType(info1.type);
+    info2 = compileTerm();
+    checkIntType(info2.type);
+    return compileExpression3(foldBinaryOp(op, info1, info2, lineNo, colNo));
     // check the FOLLOW set
   case KW_TO:
   case KW_DO:
@@ -604,25 +805,27 @@ void compileExpression3(void) {
   default:
     error(ERR_INVALID_EXPRESSION, lookAhead->lineNo, lookAhead->colNo);
   }
+  return info1;
 }
 
-void compileTerm(void) {
-  compileFactor();
-  compileTerm2();
+ExprInfo compileTerm(void) {
+  return compileTerm2(compileFactor());
 }
 
-void compileTerm2(void) {
-  switch (lookAhead->tokenType) {
+ExprInfo compileTerm2(ExprInfo info1) {
+  ExprInfo info2;
+  TokenType op = lookAhead->tokenType;
+  int lineNo = lookAhead->lineNo;
+  int colNo = lookAhead->colNo;
+
+  switch (op) {
   case SB_TIMES:
-    eat(SB_TIMES);
-    compileFactor();
-    compileTerm2();
-    break;
   case SB_SLASH:
-    eat(SB_SLASH);
-    compileFactor();
-    compileTerm2();
-    break;
+    eat(op);
+    checkIntType(info1.type);
+    info2 = compileFactor();
+    checkIntType(info2.type);
+    return compileTerm2(foldBinaryOp(op, info1, info2, lineNo, colNo));
     // check the FOLLOW set
   case SB_PLUS:
   case SB_MINUS:
@@ -645,40 +848,171 @@ void compileTerm2(void) {
   default:
     error(ERR_INVALID_TERM, lookAhead->lineNo, lookAhead->colNo);
   }
+  return info1;
 }
 
-void compileFactor(void) {
+ExprInfo compileFactor(void) {
+  ExprInfo info;
+  Object* obj;
+
+  info.isConstant = 0;
+
   switch (lookAhead->tokenType) {
   case TK_NUMBER:
     eat(TK_NUMBER);
+    info.type = intType;
+    info.isConstant = 1;
+    info.value.type = TP_INT;
+    info.value.intValue = currentToken->value;
+    genLC(info.value.intValue);
     break;
   case TK_CHAR:
     eat(TK_CHAR);
+    info.type = charType;
+    info.isConstant = 1;
+    info.value.type = TP_CHAR;
+    info.value.charValue = currentToken->value;
+    genLC(info.value.charValue);
     break;
   case TK_IDENT:
     eat(TK_IDENT);
-    switch (lookAhead->tokenType) {
-    case SB_LPAR:
-      compileArguments();
+    obj = checkDeclaredIdent(currentToken->string);
+
+    switch (obj->kind) {
+    case OBJ_CONSTANT:
+      info.isConstant = 1;
+      info.value = *(obj->constAttrs->value);
+      if (info.value.type == TP_INT) {
+        info.type = intType;
+        genLC(info.value.intValue);
+      } else {
+        info.type = charType;
+        genLC(info.value.charValue);
+      }
       break;
-    case SB_LSEL:
-      compileIndexes();
+    case OBJ_VARIABLE:
+      // An array, or a row of one, stands for its address
+      if ((lookAhead->tokenType == SB_LSEL) || (obj->varAttrs->type->typeClass == TP_ARRAY)) {
+        genVariableAddress(obj);
+        info.type = compileIndexes(obj->varAttrs->type);
+        if (info.type->typeClass != TP_ARRAY)
+          genLI();
+      } else {
+        genVariableValue(obj);
+        info.type = obj->varAttrs->type;
+      }
+      break;
+    case OBJ_PARAMETER:
+      if ((lookAhead->tokenType == SB_LSEL) || (obj->paramAttrs->type->typeClass == TP_ARRAY)) {
+        genParameterAddress(obj);
+        info.type = compileIndexes(obj->paramAttrs->type);
+        if (info.type->typeClass != TP_ARRAY)
+          genLI();
+      } else {
+        genParameterValue(obj);
+        info.type = obj->paramAttrs->type;
+      }
+      break;
+    case OBJ_FUNCTION:
+      if (isPredefinedFunction(obj)) {
+        compileArguments(obj->funcAttrs->paramList);
+        genPredefinedFunctionCall(obj);
+      } else {
+        genINT(RESERVED_WORDS);
+        compileArguments(obj->funcAttrs->paramList);
+        genDCT(RESERVED_WORDS + obj->funcAttrs->paramCount);
+        genFunctionCall(obj);
+      }
+      info.type = obj->funcAttrs->returnType;
       break;
     default:
+      error(ERR_INVALID_FACTOR, currentToken->lineNo, currentToken->colNo);
       break;
     }
     break;
   default:
     error(ERR_INVALID_FACTOR, lookAhead->lineNo, lookAhead->colNo);
   }
+  return info;
 }
 
-void compileIndexes(void) {
+// Turns the array address on top of the stack into the address of the
+// selected element. Indexes start from 1; constant indexes and the -1
+// adjustments are gathered into a single offset added at the end
+// Every index is checked against the size of its array: a constant one
+// here, any other one when the program runs
+Type* compileIndexes(Type* arrayType) {
+  ExprInfo info;
+  int elementSize;
+  int offset = 0;
+  int lineNo, colNo;
+
   while (lookAhead->tokenType == SB_LSEL) {
     eat(SB_LSEL);
-    compileExpression();
+    checkArrayType(arrayType);
+    lineNo = lookAhead->lineNo;
+    colNo = lookAhead->colNo;
+    info = compileExpression();
+    checkIntType(info.type);
+
+    elementSize = sizeOfType(arrayType->elementType);
+    if (info.isConstant) {
+      if ((info.value.intValue < 1) || (info.value.intValue > arrayType->arraySize))
+        error(ERR_INDEX_OUT_OF_RANGE, lineNo, colNo);
+      discardCode(getCurrentCodeAddress() - 1);
+      offset += (info.value.intValue - 1) * elementSize;
+    } else {
+      genCK(arrayType->arraySize);
+      if (elementSize != 1) {
+        genLC(elementSize);
+        genML();
+      }
+      genAD();
+      offset -= elementSize;
+    }
+
     eat(SB_RSEL);
+    arrayType = arrayType->elementType;
+  }
+
+  if (offset != 0) {
+    genLC(offset);
+    genAD();
+  }
+  return arrayType;
+}
+
+// Combines two operands of an arithmetic operator, folding the result
+// when both of them are known at compile time. A constant operand is
+// always a single LC at the end of the code, so folding replaces the
+// two of them with one
+ExprInfo foldBinaryOp(TokenType op, ExprInfo info1, ExprInfo info2, int lineNo, int colNo) {
+  if (info1.isConstant && info2.isConstant) {
+    discardCode(getCurrentCodeAddress() - 2);
+    foldArithmetic(op, &(info1.value), &(info2.value), lineNo, colNo);
+    genLC(info1.value.intValue);
+    return info1;
+  }
+
+  switch (op) {
+  case SB_PLUS:
+    genAD();
+    break;
+  case SB_MINUS:
+    genSB();
+    break;
+  case SB_TIMES:
+    genML();
+    break;
+  case SB_SLASH:
+    genDV();
+    break;
+  default:
+    break;
   }
+  info1.isConstant = 0;
+  info1.type = intType;
+  return info1;
 }
 
 int compile(char *fileName) {
@@ -689,13 +1023,9 @@ int compile(char *fileName) {
   lookAhead = getValidToken();
 
   initSymTab();
+  initCodeBuffer();
   compileProgram();
 
-  printObject(symtab->program,0);
-  printf("Finished printing object!\n");
-
-  cleanSymTab();
-
   free(currentToken);
   free(lookAhead);
   closeInputStream();
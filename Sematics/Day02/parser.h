@@ -8,6 +8,21 @@
 #include "token.h"
 #include "symtab.h"
 
+// Truth value of a condition as far as it is known at compile time
+#define COND_FALSE 0
+#define COND_TRUE 1
+#define COND_UNKNOWN 2
+
+/* What the parser learns from compiling an expression: its type and,
+   when every operand is a constant, its folded value */
+struct ExprInfo_ {
+  Type* type;
+  int isConstant;
+  ConstantValue value;
+};
+
+typedef struct ExprInfo_ ExprInfo;
+
 void scan(void);
 void eat(TokenType tokenType);
 
@@ -26,16 +41,14 @@ void compileVarDecl(void);
 void compileSubDecls(void);
 void compileFuncDecl(void);
 void compileProcDecl(void);
-ConstantValue* compileUnsignedConstant(void);
 ConstantValue* compileConstant(void);
-ConstantValue* compileConstant2(void);
 Type* compileType(void);
 Type* compileBasicType(void);
 void compileParams(void);
 void compileParam(void);
 void compileStatements(void);
 void compileStatement(void);
-void compileLValue(void);
+Type* compileLValue(void);
 void compileAssignSt(void);
 void compileCallSt(void);
 void compileGroupSt(void);
@@ -43,16 +56,17 @@ void compileIfSt(void);
 void compileElseSt(void);
 void compileWhileSt(void);
 void compileForSt(void);
-void compileArgument(void);
-void compileArguments(void);
-void compileCondition(void);
-void compileExpression(void);
-void compileExpression2(void);
-void compileExpression3(void);
-void compileTerm(void);
-void compileTerm2(void);
-void compileFactor(void);
-void compileIndexes(void);
+void compileArgument(Object* param);
+void compileArguments(ObjectNode* paramList);
+int compileCondition(void);
+ExprInfo compileExpression(void);
+ExprInfo compileExpression2(void);
+ExprInfo compileExpression3(ExprInfo info1);
+ExprInfo compileTerm(void);
+ExprInfo compileTerm2(ExprInfo info1);
+ExprInfo compileFactor(void);
+Type* compileIndexes(Type* arrayType);
+ExprInfo foldBinaryOp(TokenType op, ExprInfo info1, ExprInfo info2, int lineNo, int colNo);
 
 int compile(char *fileName);
 
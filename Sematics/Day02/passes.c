@@ -0,0 +1,208 @@
+/* Optimization passes over the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "passes.h"
+#include "irbuild.h"
+#include "irgen.h"
+
+IRPass passes[] = {
+  {MEMO_PASS, "remember the values of pure recursive functions", NULL, memoizeFunctions},
+  {"inline", "replace calls to small subprograms with their body", NULL, inlineSubprograms},
+  {"ssa", "promote scalar slots to SSA values", NULL, promoteSlots},
+  {"tailcall", "turn calls of a subprogram to itself before it returns into jumps", NULL, eliminateTailCalls},
+  {"accumulate", "also loop in functions returning x + F(...) or x * F(...)", NULL, introduceAccumulators},
+  {"sccp", "sparse conditional constant propagation", propagateConstants, NULL},
+  {"gvn", "share the values computed twice, such as element addresses", numberValues, NULL},
+  {"licm", "move loop invariant instructions to the preheader", hoistLoopInvariants, NULL},
+  {"bce", "remove the index checks range analysis proves needless", eliminateBoundsChecks, NULL},
+  {"ivsr", "turn multiplied induction variables into additions", reduceInductionVariables, NULL},
+  {"dce", "remove instructions whose values are never used", eliminateDeadCode, NULL},
+  {NULL, NULL, NULL, NULL}
+};
+
+// Whether the passes say what they did to each subprogram, and why
+int reportDecisions = 0;
+
+void initPassOptions(PassOptions* options) {
+  options->pipeline = DEFAULT_PIPELINE;
+  options->timePasses = 0;
+  options->dumpAfter = NULL;
+  options->verify = 0;
+  options->report = 0;
+  options->inlineThreshold = DEFAULT_INLINE_THRESHOLD;
+  options->memoize = 0;
+}
+
+IRPass* findPass(char* name) {
+  int i;
+
+  for (i = 0; passes[i].name != NULL; i ++)
+    if (strcmp(passes[i].name, name) == 0) return passes + i;
+  return NULL;
+}
+
+void printPasses(FILE* out) {
+  int i;
+
+  for (i = 0; passes[i].name != NULL; i ++)
+    fprintf(out, "  %-10s %s\n", passes[i].name, passes[i].description);
+}
+
+int verifyIRProgram(IRProgram* program, char* after) {
+  int i, ok = 1;
+
+  for (i = 0; i < program->count; i ++)
+    if (!verifyIRFunction(program->functions[i], stderr)) ok = 0;
+  if (!ok) fprintf(stderr, "kplc: broken IR after %s\n", after);
+  return ok;
+}
+
+int runPass(IRProgram* program, IRPass* pass) {
+  int changes = 0;
+  int i;
+
+  if (pass->runProgram != NULL)
+    return pass->runProgram(program);
+  for (i = 0; i < program->count; i ++)
+    changes += pass->runFunction(program->functions[i]);
+  return changes;
+}
+
+void countProgram(IRProgram* program, int* counts) {
+  int i;
+
+  for (i = 0; i < program->count; i ++)
+    counts[i] = countInstructions(program->functions[i]);
+}
+
+// Index checks left in the whole program
+int countChecks(IRProgram* program) {
+  IRFunction* f;
+  int i, j, count = 0;
+
+  for (i = 0; i < program->count; i ++) {
+    f = program->functions[i];
+    for (j = 0; j < f->instCount; j ++)
+      if ((f->insts[j].op == IR_CHECK) && (f->insts[j].block != IR_NONE)) count ++;
+  }
+  return count;
+}
+
+/* One row per subprogram: the instructions it had after lowering, how
+   many each pass took out (or put in, when negative) and what is left. */
+void printReport(IRProgram* program, char** names, int** counts, int passCount) {
+  int i, j;
+
+  fprintf(stderr, "%-12s %8s", "subprogram", "lowered");
+  for (j = 0; j < passCount; j ++)
+    fprintf(stderr, " %8s", names[j]);
+  fprintf(stderr, " %8s %8s\n", "final", "removed");
+  for (i = 0; i < program->count; i ++) {
+    fprintf(stderr, "%-12s %8d", program->functions[i]->name, counts[0][i]);
+    for (j = 0; j < passCount; j ++)
+      fprintf(stderr, " %8d", counts[j][i] - counts[j + 1][i]);
+    fprintf(stderr, " %8d %8d\n", counts[passCount][i], counts[0][i] - counts[passCount][i]);
+  }
+}
+
+/* Runs the pipeline in order. The IR is checked before the first pass
+   and after each one when asked, and dumped to stderr after the passes
+   named. Returns 0 on an unknown pass or a broken IR. */
+int runPasses(IRProgram* program, PassOptions* options) {
+  // Memoization goes first, while the calls are all there
+  char* pipeline = (char*) malloc(strlen(options->pipeline) + strlen(MEMO_PASS) + 2);
+  // Instruction counts of every subprogram before the first pass and after each
+  int** counts = (int**) malloc((strlen(options->pipeline) + 4) * sizeof(int*));
+  char** names = (char**) malloc((strlen(options->pipeline) + 3) * sizeof(char*));
+  int passCount = 0;
+  int checks;
+  int i;
+  char* name;
+  IRPass* pass;
+  clock_t start;
+  double total = 0, elapsed;
+  int changes, ok = 1;
+
+  inlineThreshold = options->inlineThreshold;
+  reportDecisions = options->report;
+  if (options->verify) ok = verifyIRProgram(program, "lowering");
+  if (ok && (options->dumpAfter != NULL) && (strcmp(options->dumpAfter, "all") == 0)) {
+    fprintf(stderr, "*** IR after lowering\n");
+    printIRProgram(program, stderr);
+  }
+  if (ok && options->timePasses)
+    fprintf(stderr, "%-10s %10s %8s\n", "pass", "time (ms)", "changes");
+
+  counts[0] = (int*) malloc((program->count + 1) * sizeof(int));
+  countProgram(program, counts[0]);
+  checks = countChecks(program);
+
+  pipeline[0] = '\0';
+  if (options->memoize) strcat(strcpy(pipeline, MEMO_PASS), ",");
+  strcat(pipeline, options->pipeline);
+  for (name = strtok(pipeline, ","); (name != NULL) && ok; name = strtok(NULL, ",")) {
+    pass = findPass(name);
+    if (pass == NULL) {
+      fprintf(stderr, "kplc: unknown pass %s\n", name);
+      ok = 0;
+      break;
+    }
+
+    start = clock();
+    changes = runPass(program, pass);
+    elapsed = 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+    total += elapsed;
+    if (options->timePasses)
+      fprintf(stderr, "%-10s %10.3f %8d\n", pass->name, elapsed, changes);
+    names[passCount ++] = pass->name;
+    counts[passCount] = (int*) malloc((program->count + 1) * sizeof(int));
+    countProgram(program, counts[passCount]);
+
+    if ((options->dumpAfter != NULL) &&
+        ((strcmp(options->dumpAfter, "all") == 0) || (strcmp(options->dumpAfter, name) == 0))) {
+      fprintf(stderr, "*** IR after %s\n", name);
+      printIRProgram(program, stderr);
+    }
+    if (options->verify) ok = verifyIRProgram(program, name);
+  }
+  if (ok && options->timePasses)
+    fprintf(stderr, "%-10s %10.3f\n", "total", total);
+  if (ok && options->report) {
+    printReport(program, names, counts, passCount);
+    fprintf(stderr, "index checks: %d removed, %d kept\n",
+            checks - countChecks(program), countChecks(program));
+  }
+
+  for (i = 0; i <= passCount; i ++)
+    free(counts[i]);
+  free(counts);
+  free(names);
+  free(pipeline);
+  return ok;
+}
+
+int optimizeCode(CodeBlock** codeBlock, SymTab* symtab, PassOptions* options) {
+  IRProgram* program = buildIR(*codeBlock, symtab);
+  CodeBlock* optimized;
+
+  // Code the IR cannot express is run as the parser left it
+  if (program == NULL) return 1;
+
+  if (!runPasses(program, options)) {
+    freeIRProgram(program);
+    return 0;
+  }
+
+  optimized = generateStackCode(program);
+  freeIRProgram(program);
+  freeCodeBlock(*codeBlock);
+  *codeBlock = optimized;
+  return 1;
+}
@@ -0,0 +1,78 @@
+/* Optimization passes over the intermediate representation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PASSES_H__
+#define __PASSES_H__
+
+#include <stdio.h>
+#include "symtab.h"
+#include "instructions.h"
+#include "ir.h"
+
+/* A pass works on one subprogram at a time, or on the whole program when
+   it needs to see the calls between them. Either way it returns how many
+   changes it made. */
+struct IRPass_ {
+  char* name;
+  char* description;
+  int (*runFunction)(IRFunction* f);
+  int (*runProgram)(IRProgram* program);
+};
+
+typedef struct IRPass_ IRPass;
+
+#define MEMO_PASS "memo"
+
+// Largest subprogram, in instructions, inlined at its calls
+#define DEFAULT_INLINE_THRESHOLD 40
+
+#define DEFAULT_PIPELINE "inline,ssa,tailcall,sccp,gvn,licm,bce,ivsr,sccp,dce"
+
+struct PassOptions_ {
+  // Comma separated names of the passes to run, in order
+  char* pipeline;
+  // Print how long each pass took
+  int timePasses;
+  // Print the IR after the pass of this name, or after every pass for "all"
+  char* dumpAfter;
+  // Check the IR after every pass
+  int verify;
+  // Print how many instructions each pass took out of every subprogram,
+  // and what became of every call the inliner looked at
+  int report;
+  int inlineThreshold;
+  // Run the memo pass before the others
+  int memoize;
+};
+
+typedef struct PassOptions_ PassOptions;
+
+void initPassOptions(PassOptions* options);
+IRPass* findPass(char* name);
+void printPasses(FILE* out);
+int runPasses(IRProgram* program, PassOptions* options);
+
+/* Rebuilds the program in the IR, runs the passes and replaces the code
+   with what they leave. Returns 0 when a pass is unknown or breaks the IR,
+   in which case the code is left as it was. */
+int optimizeCode(CodeBlock** codeBlock, SymTab* symtab, PassOptions* options);
+
+extern int reportDecisions;
+extern int inlineThreshold;
+
+int memoizeFunctions(IRProgram* program);
+int inlineSubprograms(IRProgram* program);
+int promoteSlots(IRProgram* program);
+int eliminateTailCalls(IRProgram* program);
+int introduceAccumulators(IRProgram* program);
+int propagateConstants(IRFunction* f);
+int numberValues(IRFunction* f);
+int hoistLoopInvariants(IRFunction* f);
+int eliminateBoundsChecks(IRFunction* f);
+int reduceInductionVariables(IRFunction* f);
+int eliminateDeadCode(IRFunction* f);
+
+#endif
@@ -0,0 +1,580 @@
+/* Peephole optimization of the stack code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "peephole.h"
+
+/* Every rule is tried at every address, the first one that matches wins
+   and the scan goes on after the sequence it replaced. A sequence may
+   start where a jump or a call lands, but not go on past such a place,
+   so whatever comes to it runs it from its first instruction. The rounds
+   go on until one changes nothing. */
+PeepholeRule peepholeRules[] = {
+  // Arithmetic that changes nothing
+  {"add-zero", "LC 0; AD", ""},
+  {"sub-zero", "LC 0; SB", ""},
+  {"mul-one", "LC 1; ML", ""},
+  {"div-one", "LC 1; DV", ""},
+  {"neg-neg", "NEG; NEG", ""},
+  {"add-neg", "NEG; AD", "SB"},
+
+  // Constants worked out at once
+  {"fold-add", "LC $a; LC $b; AD", "LC $a+$b"},
+  {"fold-sub", "LC $a; LC $b; SB", "LC $a-$b"},
+  {"fold-mul", "LC $a; LC $b; ML", "LC $a*$b"},
+  {"fold-neg", "LC $a; NEG", "LC -$a"},
+  {"add-add", "LC $a; AD; LC $b; AD", "LC $a+$b; AD"},
+
+  // Loads of a value that is already known
+  {"load-load", "LV $p $q; LV $p $q", "LV $p $q; CV"},
+  {"store-load", "LA $p $q; LC $c; ST; LV $p $q", "LA $p $q; LC $c; ST; LC $c"},
+
+  // Values pushed only to be dropped
+  {"push-drop", "LC _; DCT 1", ""},
+  {"load-drop", "LV _ _; DCT 1", ""},
+  {"copy-drop", "CV; DCT 1", ""},
+  {"drop-drop", "DCT $a; DCT $b", "DCT $a+$b"},
+  {"drop-none", "DCT 0", ""},
+
+  // Conditions known at once, or tested through a boolean
+  {"branch-true", "LC $a; FJ _ | $a != 0", ""},
+  {"branch-false", "LC 0; FJ $l", "J $l"},
+  {"not-eq", "EQ; LC 0; EQ", "NE"},
+  {"not-ne", "NE; LC 0; EQ", "EQ"},
+  {"not-gt", "GT; LC 0; EQ", "LE"},
+  {"not-lt", "LT; LC 0; EQ", "GE"},
+  {"not-ge", "GE; LC 0; EQ", "LT"},
+  {"not-le", "LE; LC 0; EQ", "GT"},
+
+  // Jumps
+  {"jump-to-next", "J $next", ""},
+  {"branch-to-next", "FJ $next", "DCT 1"},
+  {"jump-to-jump", "J $l | $l: J $m", "J $m"},
+  {"branch-to-jump", "FJ $l | $l: J $m", "FJ $m"},
+  {"call-to-jump", "CALL $p $l | $l: J $m", "CALL $p $m"},
+  {"jump-to-ep", "J $l | $l: EP", "EP"},
+  {"jump-to-ef", "J $l | $l: EF", "EF"},
+  {"jump-to-hl", "J $l | $l: HL", "HL"},
+
+  // Code that nothing reaches
+  {"dead-after-j", "J $l; *", "J $l"},
+  {"dead-after-ep", "EP; *", "EP"},
+  {"dead-after-ef", "EF; *", "EF"},
+  {"dead-after-hl", "HL; *", "HL"},
+
+  {NULL, NULL, NULL}
+};
+
+/******************************************************************/
+
+#define MAX_RULE_LENGTH 4
+#define MAX_RULE_CONDITIONS 2
+#define MAX_RULE_VARIABLES 8
+#define MAX_VARIABLE_NAME 8
+
+// Any opcode, in a pattern
+#define ANY_OPCODE -1
+
+// The variable every rule starts with
+#define NEXT_VARIABLE 0
+
+enum PeepholeOperandKind {
+  OPERAND_ANY,
+  OPERAND_TERM,
+  OPERAND_NEGATION,
+  OPERAND_BINARY
+};
+
+enum PeepholeConditionKind {
+  CONDITION_AT,
+  CONDITION_EQ,
+  CONDITION_NE
+};
+
+// A number, or a variable when var is not negative
+struct PeepholeTerm_ {
+  int var;
+  WORD value;
+};
+
+typedef struct PeepholeTerm_ PeepholeTerm;
+
+struct PeepholeOperand_ {
+  enum PeepholeOperandKind kind;
+  PeepholeTerm left;
+  char op;
+  PeepholeTerm right;
+};
+
+typedef struct PeepholeOperand_ PeepholeOperand;
+
+struct PeepholeItem_ {
+  int op;
+  PeepholeOperand p;
+  PeepholeOperand q;
+};
+
+typedef struct PeepholeItem_ PeepholeItem;
+
+struct PeepholeCondition_ {
+  enum PeepholeConditionKind kind;
+  int var;
+  // The instruction at the address, or what the variable is compared with
+  PeepholeItem item;
+  PeepholeOperand operand;
+};
+
+typedef struct PeepholeCondition_ PeepholeCondition;
+
+struct CompiledRule_ {
+  PeepholeItem items[MAX_RULE_LENGTH];
+  int itemCount;
+  PeepholeCondition conditions[MAX_RULE_CONDITIONS];
+  int conditionCount;
+  PeepholeItem replacement[MAX_RULE_LENGTH];
+  int replacementCount;
+  char variables[MAX_RULE_VARIABLES][MAX_VARIABLE_NAME];
+  int variableCount;
+};
+
+typedef struct CompiledRule_ CompiledRule;
+
+CompiledRule* compiledRules = NULL;
+int ruleCount = 0;
+
+/******************************************************************/
+
+// Where the text of the rule being compiled stands, and which rule it is
+char* ruleText;
+char* ruleName;
+
+void badRule(char* message) {
+  fprintf(stderr, "kplc: peephole rule %s: %s at \"%s\"\n", ruleName, message, ruleText);
+  exit(-1);
+}
+
+void skipRuleSpaces(void) {
+  while (isspace((unsigned char) *ruleText)) ruleText ++;
+}
+
+int findRuleVariable(CompiledRule* rule, char* name) {
+  int i;
+
+  for (i = 0; i < rule->variableCount; i ++)
+    if (strcmp(rule->variables[i], name) == 0) return i;
+  if (rule->variableCount == MAX_RULE_VARIABLES) badRule("too many variables");
+  strcpy(rule->variables[rule->variableCount], name);
+  return rule->variableCount ++;
+}
+
+void compileRuleTerm(CompiledRule* rule, PeepholeTerm* term) {
+  char name[MAX_VARIABLE_NAME];
+  int n = 0;
+
+  if (*ruleText == '$') {
+    ruleText ++;
+    while (isalnum((unsigned char) *ruleText)) {
+      if (n == MAX_VARIABLE_NAME - 1) badRule("variable name too long");
+      name[n ++] = *ruleText ++;
+    }
+    if (n == 0) badRule("variable without a name");
+    name[n] = '\0';
+    term->var = findRuleVariable(rule, name);
+    term->value = 0;
+  } else if (isdigit((unsigned char) *ruleText)) {
+    term->var = -1;
+    term->value = strtol(ruleText, &ruleText, 10);
+  } else badRule("operand expected");
+}
+
+// Operands of a pattern are terms or '_'; those of a replacement compute
+void compileRuleOperand(CompiledRule* rule, PeepholeOperand* operand, int computes) {
+  skipRuleSpaces();
+  operand->op = 0;
+  if (*ruleText == '_') {
+    if (computes) badRule("'_' in a replacement");
+    ruleText ++;
+    operand->kind = OPERAND_ANY;
+    return;
+  }
+  if (computes && (*ruleText == '-')) {
+    ruleText ++;
+    operand->kind = OPERAND_NEGATION;
+    compileRuleTerm(rule, &operand->left);
+    return;
+  }
+  operand->kind = OPERAND_TERM;
+  compileRuleTerm(rule, &operand->left);
+  if (computes && ((*ruleText == '+') || (*ruleText == '-') || (*ruleText == '*'))) {
+    operand->kind = OPERAND_BINARY;
+    operand->op = *ruleText ++;
+    compileRuleTerm(rule, &operand->right);
+  }
+}
+
+int atItemEnd(void) {
+  skipRuleSpaces();
+  return (*ruleText == '\0') || (*ruleText == ';') || (*ruleText == '|') || (*ruleText == ',');
+}
+
+void compileRuleItem(CompiledRule* rule, PeepholeItem* item, int computes) {
+  char mnemonic[8];
+  int n = 0, op;
+
+  item->p.kind = item->q.kind = OPERAND_ANY;
+  skipRuleSpaces();
+  if (*ruleText == '*') {
+    if (computes) badRule("'*' in a replacement");
+    ruleText ++;
+    item->op = ANY_OPCODE;
+    return;
+  }
+  while (isupper((unsigned char) *ruleText) && (n < 7))
+    mnemonic[n ++] = *ruleText ++;
+  mnemonic[n] = '\0';
+  for (op = 0; op < NUM_OF_OPCODES; op ++)
+    if (strcmp(opCodeToString((enum OpCode) op), mnemonic) == 0) break;
+  if (op == NUM_OF_OPCODES) badRule("unknown instruction");
+  item->op = op;
+
+  if (atItemEnd()) return;
+  if (opCodeOperands((enum OpCode) op) == 2) {
+    compileRuleOperand(rule, &item->p, computes);
+    if (atItemEnd()) badRule("second operand expected");
+  }
+  if (opCodeOperands((enum OpCode) op) > 0)
+    compileRuleOperand(rule, &item->q, computes);
+  if (!atItemEnd()) badRule("too many operands");
+}
+
+// Instructions separated by ';', up to one of stops
+int compileRuleSequence(CompiledRule* rule, PeepholeItem* items, int computes) {
+  int count = 0;
+
+  skipRuleSpaces();
+  if ((*ruleText == '\0') || (*ruleText == '|')) return 0;
+  while (1) {
+    if (count == MAX_RULE_LENGTH) badRule("sequence too long");
+    compileRuleItem(rule, items + count ++, computes);
+    if (*ruleText != ';') return count;
+    ruleText ++;
+  }
+}
+
+void compileRuleCondition(CompiledRule* rule, PeepholeCondition* condition) {
+  PeepholeTerm term;
+
+  skipRuleSpaces();
+  if (*ruleText != '$') badRule("variable expected");
+  compileRuleTerm(rule, &term);
+  condition->var = term.var;
+  skipRuleSpaces();
+  if (*ruleText == ':') {
+    ruleText ++;
+    condition->kind = CONDITION_AT;
+    compileRuleItem(rule, &condition->item, 0);
+  } else if (*ruleText == '=') {
+    ruleText ++;
+    condition->kind = CONDITION_EQ;
+    compileRuleOperand(rule, &condition->operand, 1);
+  } else if ((ruleText[0] == '!') && (ruleText[1] == '=')) {
+    ruleText += 2;
+    condition->kind = CONDITION_NE;
+    compileRuleOperand(rule, &condition->operand, 1);
+  } else badRule("':', '=' or '!=' expected");
+}
+
+void compileRule(PeepholeRule* source, CompiledRule* rule) {
+  ruleName = source->name;
+  rule->variableCount = 0;
+  rule->conditionCount = 0;
+  findRuleVariable(rule, "next");
+
+  ruleText = source->pattern;
+  rule->itemCount = compileRuleSequence(rule, rule->items, 0);
+  if (rule->itemCount == 0) badRule("empty pattern");
+  skipRuleSpaces();
+  if (*ruleText == '|') {
+    do {
+      ruleText ++;
+      if (rule->conditionCount == MAX_RULE_CONDITIONS) badRule("too many conditions");
+      compileRuleCondition(rule, rule->conditions + rule->conditionCount ++);
+      skipRuleSpaces();
+    } while (*ruleText == ',');
+  }
+  if (*ruleText != '\0') badRule("end of pattern expected");
+
+  ruleText = source->replacement;
+  rule->replacementCount = compileRuleSequence(rule, rule->replacement, 1);
+  skipRuleSpaces();
+  if (*ruleText != '\0') badRule("end of replacement expected");
+  if (rule->replacementCount > rule->itemCount) badRule("replacement longer than the pattern");
+}
+
+void compilePeepholeRules(void) {
+  int i;
+
+  if (compiledRules != NULL) return;
+  for (ruleCount = 0; peepholeRules[ruleCount].name != NULL; ruleCount ++);
+  compiledRules = (CompiledRule*) malloc(ruleCount * sizeof(CompiledRule));
+  for (i = 0; i < ruleCount; i ++)
+    compileRule(peepholeRules + i, compiledRules + i);
+}
+
+/******************************************************************/
+
+// Values of the variables of the rule being matched, and which have one
+WORD ruleValues[MAX_RULE_VARIABLES];
+char ruleBound[MAX_RULE_VARIABLES];
+
+WORD evaluateTerm(PeepholeTerm* term) {
+  return (term->var < 0) ? term->value : ruleValues[term->var];
+}
+
+WORD evaluateOperand(PeepholeOperand* operand) {
+  unsigned int a, b;
+
+  switch (operand->kind) {
+  case OPERAND_ANY:
+    return DC_VALUE;
+  case OPERAND_TERM:
+    return evaluateTerm(&operand->left);
+  case OPERAND_NEGATION:
+    return (WORD) (0u - (unsigned int) evaluateTerm(&operand->left));
+  default:
+    a = (unsigned int) evaluateTerm(&operand->left);
+    b = (unsigned int) evaluateTerm(&operand->right);
+    if (operand->op == '+') return (WORD) (a + b);
+    if (operand->op == '-') return (WORD) (a - b);
+    return (WORD) (a * b);
+  }
+}
+
+int matchOperand(PeepholeOperand* operand, WORD value) {
+  int var;
+
+  if (operand->kind == OPERAND_ANY) return 1;
+  var = operand->left.var;
+  if ((var >= 0) && !ruleBound[var]) {
+    ruleValues[var] = value;
+    ruleBound[var] = 1;
+    return 1;
+  }
+  return evaluateTerm(&operand->left) == value;
+}
+
+int matchItem(PeepholeItem* item, Instruction* inst) {
+  if (item->op == ANY_OPCODE) return 1;
+  return (inst->op == item->op) && matchOperand(&item->p, inst->p) && matchOperand(&item->q, inst->q);
+}
+
+int matchRule(CompiledRule* rule, CodeBlock* codeBlock, int address, char* leaders) {
+  PeepholeCondition* condition;
+  WORD value;
+  int i;
+
+  if (address + rule->itemCount > codeBlock->codeSize) return 0;
+  memset(ruleBound, 0, sizeof(ruleBound));
+  ruleValues[NEXT_VARIABLE] = address + rule->itemCount;
+  ruleBound[NEXT_VARIABLE] = 1;
+
+  for (i = 0; i < rule->itemCount; i ++) {
+    if ((i > 0) && leaders[address + i]) return 0;
+    if (!matchItem(rule->items + i, codeBlock->code + address + i)) return 0;
+  }
+
+  for (i = 0; i < rule->conditionCount; i ++) {
+    condition = rule->conditions + i;
+    if (!ruleBound[condition->var]) return 0;
+    value = ruleValues[condition->var];
+    switch (condition->kind) {
+    case CONDITION_AT:
+      if ((value < 0) || (value >= codeBlock->codeSize) ||
+          !matchItem(&condition->item, codeBlock->code + value))
+        return 0;
+      break;
+    case CONDITION_EQ:
+      if (value != evaluateOperand(&condition->operand)) return 0;
+      break;
+    default:
+      if (value == evaluateOperand(&condition->operand)) return 0;
+      break;
+    }
+  }
+  return 1;
+}
+
+// Fills code with the replacement, returning 0 when it is what was there
+int buildReplacement(CompiledRule* rule, CodeBlock* codeBlock, int address, Instruction* code) {
+  Instruction* old = codeBlock->code + address;
+  int i, same;
+
+  for (i = 0; i < rule->replacementCount; i ++) {
+    code[i].op = (enum OpCode) rule->replacement[i].op;
+    code[i].p = evaluateOperand(&rule->replacement[i].p);
+    code[i].q = evaluateOperand(&rule->replacement[i].q);
+  }
+  if (rule->replacementCount != rule->itemCount) return 1;
+  same = 1;
+  for (i = 0; i < rule->replacementCount; i ++)
+    if ((code[i].op != old[i].op) ||
+        ((opCodeOperands(code[i].op) == 2) && (code[i].p != old[i].p)) ||
+        ((opCodeOperands(code[i].op) > 0) && (code[i].q != old[i].q)))
+      same = 0;
+  return !same;
+}
+
+/******************************************************************/
+
+// The addresses of the subprograms declared in scope, deepest first
+int collectEntries(Scope* scope, CodeAddress** entries, int count) {
+  ObjectNode* node;
+  Object* obj;
+
+  for (node = scope->objList; node != NULL; node = node->next) {
+    obj = node->object;
+    if (obj->kind == OBJ_FUNCTION) {
+      count = collectEntries(obj->funcAttrs->scope, entries, count);
+      entries[count ++] = &obj->funcAttrs->codeAddress;
+    } else if (obj->kind == OBJ_PROCEDURE) {
+      count = collectEntries(obj->procAttrs->scope, entries, count);
+      entries[count ++] = &obj->procAttrs->codeAddress;
+    }
+  }
+  return count;
+}
+
+int countEntries(Scope* scope) {
+  ObjectNode* node;
+  int count = 0;
+
+  for (node = scope->objList; node != NULL; node = node->next)
+    if (node->object->kind == OBJ_FUNCTION)
+      count += 1 + countEntries(node->object->funcAttrs->scope);
+    else if (node->object->kind == OBJ_PROCEDURE)
+      count += 1 + countEntries(node->object->procAttrs->scope);
+  return count;
+}
+
+int isCodeJump(Instruction* inst) {
+  return (inst->op == OP_J) || (inst->op == OP_FJ) || (inst->op == OP_CALL);
+}
+
+/* A subprogram that starts with a jump, over those declared in it,
+   starts where the jump goes. */
+void skipEntryJumps(CodeBlock* codeBlock, CodeAddress** entries, int entryCount) {
+  int i, steps;
+
+  for (i = 0; i < entryCount; i ++)
+    for (steps = 0; (steps < codeBlock->codeSize) && (*entries[i] >= 0) &&
+           (*entries[i] < codeBlock->codeSize) && (codeBlock->code[*entries[i]].op == OP_J); steps ++)
+      *entries[i] = codeBlock->code[*entries[i]].q;
+}
+
+void findJumpTargets(CodeBlock* codeBlock, CodeAddress** entries, int entryCount, char* leaders) {
+  Instruction* inst;
+  int i;
+
+  memset(leaders, 0, codeBlock->codeSize + 1);
+  leaders[0] = 1;
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    if (isCodeJump(inst) && (inst->q >= 0) && (inst->q <= codeBlock->codeSize))
+      leaders[inst->q] = 1;
+  }
+  for (i = 0; i < entryCount; i ++)
+    if ((*entries[i] >= 0) && (*entries[i] <= codeBlock->codeSize))
+      leaders[*entries[i]] = 1;
+}
+
+CodeAddress relocate(int* map, int size, CodeAddress address) {
+  return ((address >= 0) && (address <= size)) ? map[address] : address;
+}
+
+// One pass of the rules over the code; returns how many matched
+int runPeepholeRound(CodeBlock* codeBlock, CodeAddress** entries, int entryCount,
+                     CodeAddress* programEntry, int* hits) {
+  int size = codeBlock->codeSize;
+  Instruction* code = (Instruction*) malloc((size + 1) * sizeof(Instruction));
+  int* map = (int*) malloc((size + 1) * sizeof(int));
+  char* leaders = (char*) malloc(size + 1);
+  int count = 0, changes = 0;
+  int i, k, r;
+
+  skipEntryJumps(codeBlock, entries, entryCount);
+  findJumpTargets(codeBlock, entries, entryCount, leaders);
+  i = 0;
+  while (i < size) {
+    for (r = 0; r < ruleCount; r ++)
+      if (matchRule(compiledRules + r, codeBlock, i, leaders) &&
+          buildReplacement(compiledRules + r, codeBlock, i, code + count))
+        break;
+    if (r == ruleCount) {
+      map[i] = count;
+      code[count ++] = codeBlock->code[i ++];
+      continue;
+    }
+    for (k = 0; k < compiledRules[r].itemCount; k ++)
+      map[i + k] = count;
+    count += compiledRules[r].replacementCount;
+    i += compiledRules[r].itemCount;
+    hits[r] ++;
+    changes ++;
+  }
+  map[size] = count;
+
+  if (changes > 0) {
+    for (i = 0; i < count; i ++)
+      if (isCodeJump(code + i))
+        code[i].q = relocate(map, size, code[i].q);
+    for (i = 0; i < codeBlock->lineCount; i ++)
+      codeBlock->lines[i].address = relocate(map, size, codeBlock->lines[i].address);
+    for (i = 0; i < entryCount; i ++)
+      *entries[i] = relocate(map, size, *entries[i]);
+    *programEntry = relocate(map, size, *programEntry);
+    memcpy(codeBlock->code, code, count * sizeof(Instruction));
+    codeBlock->codeSize = count;
+  }
+
+  free(code);
+  free(map);
+  free(leaders);
+  return changes;
+}
+
+int runPeephole(CodeBlock* codeBlock, SymTab* symtab, FILE* stats) {
+  Scope* scope = symtab->program->progAttrs->scope;
+  int entryCount = countEntries(scope);
+  CodeAddress** entries = (CodeAddress**) malloc((entryCount + 1) * sizeof(CodeAddress*));
+  int* hits;
+  int before = codeBlock->codeSize;
+  int rounds = 0;
+  int i;
+
+  compilePeepholeRules();
+  hits = (int*) calloc(ruleCount, sizeof(int));
+  collectEntries(scope, entries, 0);
+  while (rounds < MAX_PEEPHOLE_ROUNDS) {
+    rounds ++;
+    if (runPeepholeRound(codeBlock, entries, entryCount, &symtab->program->progAttrs->codeAddress, hits) == 0)
+      break;
+  }
+
+  if (stats != NULL) {
+    fprintf(stats, "%-16s %8s\n", "rule", "hits");
+    for (i = 0; i < ruleCount; i ++)
+      fprintf(stats, "%-16s %8d\n", peepholeRules[i].name, hits[i]);
+    fprintf(stats, "%d of %d instructions removed in %d rounds\n",
+            before - codeBlock->codeSize, before, rounds);
+  }
+
+  free(entries);
+  free(hits);
+  return before - codeBlock->codeSize;
+}
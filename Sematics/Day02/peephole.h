@@ -0,0 +1,46 @@
+/* Peephole optimization of the stack code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __PEEPHOLE_H__
+#define __PEEPHOLE_H__
+
+#include <stdio.h>
+#include "symtab.h"
+#include "instructions.h"
+
+// Rounds after which the pass gives up on a fixed point
+#define MAX_PEEPHOLE_ROUNDS 64
+
+/* A rule replaces a short sequence of instructions with a shorter or a
+   cheaper one. Both are written as instructions separated by ';', an
+   instruction being a mnemonic and its operands; the replacement is empty
+   when the sequence simply goes.
+
+   An operand of the pattern is a number, '_' for any value, or a variable
+   $x that takes the value it first meets and must meet the same one again.
+   $next is the address after the sequence. '*' matches any instruction.
+   After a '|' come conditions, separated by ',': "$x: INSTRUCTION" for the
+   instruction at the address $x, "$x = operand" and "$x != operand".
+
+   An operand of the replacement is a number, a variable, -$x, or two of
+   these joined by '+', '-' or '*', which wrap around like the machine. */
+struct PeepholeRule_ {
+  char* name;
+  char* pattern;
+  char* replacement;
+};
+
+typedef struct PeepholeRule_ PeepholeRule;
+
+extern PeepholeRule peepholeRules[];
+
+/* Applies the rules until none matches any more, moving the jumps, the
+   line table and the addresses of the subprograms in symtab with the code.
+   When stats is not NULL, prints how many times each rule matched there.
+   Returns how many instructions went. */
+int runPeephole(CodeBlock* codeBlock, SymTab* symtab, FILE* stats);
+
+#endif
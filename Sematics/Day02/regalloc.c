@@ -0,0 +1,355 @@
+/* Register allocation for the native code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "regalloc.h"
+
+/* The slots of a frame that no one else may see are kept in machine
+   registers by linear scan: the live range of a slot goes from the first
+   instruction it is live at, or written by, to the last one, in the order
+   of the register code, and the ranges get registers in the order they
+   start. When none is left, the range that ends last stays in memory.
+
+   Others see a slot when a nested subprogram reaches it through a static
+   link, and from the frame of the first call on, where callees put their
+   own frames. An address taken in the frame may reach any of its
+   variables once something is added to it, so that they all stay in
+   memory then, and only the temporaries above them may have registers.
+   The reserved words are always in memory too.
+
+   %rbx and %r14 are kept by the runtime functions and by every compiled
+   subprogram that uses them, so that the ranges live across a call get
+   them first. The other registers are written back to their slots before
+   a call and read again after it. Either way a call costs a register
+   something, which only a loop around it pays back: out of loops, the
+   ranges across calls stay in memory. */
+
+int allocatableRegisters[ALLOCATABLE_REGISTERS] = {
+  X_RBX, X_R14, X_RSI, X_R8, X_R9, X_R10, X_R11
+};
+
+int isCalleeSaved(int reg) {
+  return (reg == X_RBX) || (reg == X_R14);
+}
+
+// Fills uses with the slots the instruction reads and returns how many
+int findUses(RegInstruction* inst, WORD* uses) {
+  switch (inst->op) {
+  case R_MOV: case R_LDI: case R_KSUB: case R_KDIV: case R_NEG:
+  case R_ADDK: case R_SUBK: case R_MULK: case R_DIVK:
+  case R_EQK: case R_NEK: case R_GTK: case R_LTK: case R_GEK: case R_LEK:
+    uses[0] = inst->b;
+    return 1;
+  case R_ADD: case R_SUB: case R_MUL: case R_DIV:
+  case R_EQ: case R_NE: case R_GT: case R_LT: case R_GE: case R_LE:
+    uses[0] = inst->b;
+    uses[1] = inst->c;
+    return 2;
+  case R_STG: case R_STIK: case R_FJ: case R_BOUND: case R_WRC: case R_WRI:
+  case R_FJEQK: case R_FJNEK: case R_FJGTK: case R_FJLTK: case R_FJGEK: case R_FJLEK:
+    uses[0] = inst->a;
+    return 1;
+  case R_STI: case R_COPY:
+  case R_FJEQ: case R_FJNE: case R_FJGT: case R_FJLT: case R_FJGE: case R_FJLE:
+    uses[0] = inst->a;
+    uses[1] = inst->b;
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+// The slot the instruction writes, or -1
+WORD findDefinition(RegInstruction* inst) {
+  switch (inst->op) {
+  case R_MOV: case R_MOVK: case R_LEA: case R_LEAG: case R_LDG: case R_LDI:
+  case R_ADD: case R_ADDK: case R_SUB: case R_SUBK: case R_MUL: case R_MULK:
+  case R_DIV: case R_DIVK: case R_KSUB: case R_KDIV: case R_NEG:
+  case R_EQ: case R_EQK: case R_NE: case R_NEK: case R_GT: case R_GTK:
+  case R_LT: case R_LTK: case R_GE: case R_GEK: case R_LE: case R_LEK:
+  case R_RC: case R_RI:
+    return inst->a;
+  default:
+    return -1;
+  }
+}
+
+// Whether the instruction calls a subprogram or the runtime and comes back
+int isCallInstruction(enum RegOpCode op) {
+  switch (op) {
+  case R_CALL: case R_RC: case R_RI: case R_WRC: case R_WRCK:
+  case R_WRI: case R_WRIK: case R_WLN:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+void pinRange(char* pinned, int slotCount, WORD from, WORD to) {
+  WORD x;
+
+  for (x = (from < 0) ? 0 : from; (x < to) && (x < slotCount); x ++)
+    pinned[x] = 1;
+}
+
+/* Which slots must stay in memory, out of the first slotCount. The code
+   of the subprograms nested in the procedure is not always inside its
+   own, once the peephole pass has moved its entry. */
+char* findPinnedSlots(RegAllocation* allocation, RegCode* regCode, int* entries, int* owners, int proc) {
+  int slotCount = allocation->slotCount;
+  char* pinned = (char*) calloc(slotCount + 1, 1);
+  int depth = regCode->depths[entries[proc]];
+  WORD frameSize = slotCount;
+  RegInstruction* inst;
+  int i;
+
+  for (i = allocation->first; i <= allocation->last; i ++)
+    if ((owners[i] == proc) && (regCode->code[i].op == R_CHK)) {
+      frameSize = regCode->code[i].a;
+      break;
+    }
+
+  pinRange(pinned, slotCount, 0, RESERVED_WORDS);
+  for (i = 0; i < regCode->codeSize; i ++) {
+    inst = regCode->code + i;
+    // Any scope of this depth may be the frame they reach
+    if (((inst->op == R_LDG) || (inst->op == R_STG) || (inst->op == R_STGK)) && (inst->b == depth))
+      pinRange(pinned, slotCount, inst->c, inst->c + 1);
+    // Arithmetic on an address may go anywhere in the frame
+    if (((inst->op == R_LEA) && (owners[i] == proc)) || ((inst->op == R_LEAG) && (inst->b == depth)))
+      pinRange(pinned, slotCount, RESERVED_WORDS, frameSize);
+  }
+  return pinned;
+}
+
+void findCandidates(RegAllocation* allocation, RegCode* regCode, int* owners, int proc, char* pinned) {
+  RegInstruction* inst;
+  WORD uses[3];
+  WORD x;
+  int i, j, n;
+
+  allocation->candidateOf = (int*) malloc((allocation->slotCount + 1) * sizeof(int));
+  allocation->candidates = (WORD*) malloc((allocation->slotCount + 1) * sizeof(WORD));
+  allocation->candidateCount = 0;
+  for (x = 0; x < allocation->slotCount; x ++)
+    allocation->candidateOf[x] = -1;
+
+  for (i = allocation->first; i <= allocation->last; i ++) {
+    if (owners[i] != proc) continue;
+    inst = regCode->code + i;
+    n = findUses(inst, uses);
+    uses[n ++] = findDefinition(inst);
+    for (j = 0; j < n; j ++) {
+      x = uses[j];
+      if ((x < 0) || (x >= allocation->slotCount) || pinned[x] || (allocation->candidateOf[x] >= 0))
+        continue;
+      allocation->candidateOf[x] = allocation->candidateCount;
+      allocation->candidates[allocation->candidateCount ++] = x;
+    }
+  }
+}
+
+int isLiveAt(RegAllocation* allocation, int address, WORD x) {
+  if ((x < 0) || (x >= allocation->slotCount) || (allocation->candidateOf[x] < 0)) return 0;
+  if ((address < allocation->first) || (address > allocation->last)) return 0;
+  return allocation->liveIn[(address - allocation->first) * allocation->candidateCount +
+                            allocation->candidateOf[x]];
+}
+
+// What is live before each instruction, until nothing changes
+void computeLiveness(RegAllocation* allocation, RegCode* regCode, int* owners, int proc) {
+  int n = allocation->candidateCount;
+  char* row = (char*) malloc(n + 1);
+  char* liveIn;
+  RegInstruction* inst;
+  WORD uses[3];
+  WORD def;
+  int succs[2];
+  int changed = 1;
+  int i, j, k, count;
+
+  allocation->liveIn = (char*) calloc((allocation->last - allocation->first + 2) * n + 1, 1);
+  // Rows by address
+  liveIn = allocation->liveIn - allocation->first * n;
+  while (changed) {
+    changed = 0;
+    for (i = allocation->last; i >= allocation->first; i --) {
+      if (owners[i] != proc) continue;
+      inst = regCode->code + i;
+      count = 0;
+      if ((inst->op != R_J) && (inst->op != R_RET) && (inst->op != R_HL) && (i + 1 < regCode->codeSize))
+        succs[count ++] = i + 1;
+      if (regOpCodeIsJump(inst->op))
+        succs[count ++] = inst->c;
+
+      memset(row, 0, n);
+      for (j = 0; j < count; j ++)
+        if ((succs[j] >= 0) && (succs[j] < regCode->codeSize) && (owners[succs[j]] == proc))
+          for (k = 0; k < n; k ++)
+            row[k] |= liveIn[succs[j] * n + k];
+      def = findDefinition(inst);
+      if ((def >= 0) && (def < allocation->slotCount) && (allocation->candidateOf[def] >= 0))
+        row[allocation->candidateOf[def]] = 0;
+      count = findUses(inst, uses);
+      for (j = 0; j < count; j ++)
+        if ((uses[j] >= 0) && (uses[j] < allocation->slotCount) && (allocation->candidateOf[uses[j]] >= 0))
+          row[allocation->candidateOf[uses[j]]] = 1;
+
+      if (memcmp(row, liveIn + i * n, n) != 0) {
+        memcpy(liveIn + i * n, row, n);
+        changed = 1;
+      }
+    }
+  }
+  free(row);
+}
+
+// Gives registers to the live ranges, in the order they start
+void scanRanges(RegAllocation* allocation, RegCode* regCode, int* owners, int proc) {
+  int n = allocation->candidateCount;
+  int* start = (int*) malloc((n + 1) * sizeof(int));
+  int* end = (int*) malloc((n + 1) * sizeof(int));
+  char* crossesCall = (char*) calloc(n + 1, 1);
+  char* inLoop = (char*) calloc(n + 1, 1);
+  int* order = (int*) malloc((n + 1) * sizeof(int));
+  int* active = (int*) malloc((n + 1) * sizeof(int));
+  int* assigned = (int*) malloc((n + 1) * sizeof(int));
+  char* liveIn = allocation->liveIn - allocation->first * n;
+  int busy[ALLOCATABLE_REGISTERS];
+  int activeCount = 0;
+  int i, j, k, r, pick, last;
+  WORD def;
+
+  for (k = 0; k < n; k ++) {
+    start[k] = end[k] = -1;
+    assigned[k] = -1;
+  }
+  for (i = allocation->first; i <= allocation->last; i ++) {
+    if (owners[i] != proc) continue;
+    def = findDefinition(regCode->code + i);
+    for (k = 0; k < n; k ++)
+      if (liveIn[i * n + k] || (def == allocation->candidates[k])) {
+        if (start[k] < 0) start[k] = i;
+        end[k] = i;
+      }
+    if (isCallInstruction(regCode->code[i].op) && (i + 1 <= allocation->last))
+      for (k = 0; k < n; k ++)
+        if (liveIn[(i + 1) * n + k]) crossesCall[k] = 1;
+  }
+
+  // Ranges a backward jump goes over
+  for (i = allocation->first; i <= allocation->last; i ++)
+    if ((owners[i] == proc) && regOpCodeIsJump(regCode->code[i].op) && (regCode->code[i].c <= i))
+      for (k = 0; k < n; k ++)
+        if ((start[k] <= i) && (end[k] >= regCode->code[i].c)) inLoop[k] = 1;
+
+  for (k = 0; k < n; k ++) {
+    for (j = k; (j > 0) && (start[order[j - 1]] > start[k]); j --)
+      order[j] = order[j - 1];
+    order[j] = k;
+  }
+  for (r = 0; r < ALLOCATABLE_REGISTERS; r ++)
+    busy[r] = 0;
+
+  for (i = 0; i < n; i ++) {
+    k = order[i];
+    // Keeping a register across a call costs more than it saves, but in a loop
+    if ((start[k] < 0) || (crossesCall[k] && !inLoop[k])) continue;
+    for (j = 0; j < activeCount; j ++)
+      if (end[active[j]] < start[k]) {
+        busy[assigned[active[j]]] = 0;
+        active[j --] = active[-- activeCount];
+      }
+
+    // A range across a call would rather have a register the call keeps
+    pick = -1;
+    for (r = 0; r < ALLOCATABLE_REGISTERS; r ++)
+      if (!busy[r] && ((pick < 0) ||
+                       (crossesCall[k] && (r < CALLEE_SAVED_REGISTERS) && (pick >= CALLEE_SAVED_REGISTERS)) ||
+                       (!crossesCall[k] && (pick < CALLEE_SAVED_REGISTERS) && (r >= CALLEE_SAVED_REGISTERS))))
+        pick = r;
+
+    if (pick < 0) {
+      last = 0;
+      for (j = 1; j < activeCount; j ++)
+        if (end[active[j]] > end[active[last]]) last = j;
+      allocation->spilled ++;
+      if (end[active[last]] <= end[k]) continue;
+      pick = assigned[active[last]];
+      assigned[active[last]] = -1;
+      active[last] = active[-- activeCount];
+    }
+    busy[pick] = 1;
+    assigned[k] = pick;
+    active[activeCount ++] = k;
+  }
+
+  for (k = 0; k < n; k ++) {
+    if (assigned[k] < 0) continue;
+    r = allocatableRegisters[assigned[k]];
+    allocation->registers[allocation->candidates[k]] = r;
+    allocation->allocated ++;
+    if (isCalleeSaved(r)) allocation->usesCalleeSaved = 1;
+  }
+
+  free(start);
+  free(end);
+  free(crossesCall);
+  free(inLoop);
+  free(order);
+  free(active);
+  free(assigned);
+}
+
+RegAllocation* allocateRegisters(RegCode* regCode, int* entries, int* owners, int proc) {
+  RegAllocation* allocation = (RegAllocation*) malloc(sizeof(RegAllocation));
+  RegInstruction* inst;
+  char* pinned;
+  WORD uses[3];
+  WORD limit = -1, top = 0;
+  int i, j, n;
+
+  // Code is never entered above a procedure's entry
+  allocation->first = entries[proc];
+  for (allocation->last = regCode->codeSize - 1;
+       (allocation->last > allocation->first) && (owners[allocation->last] != proc); allocation->last --);
+
+  // Below the first frame a call makes, or past every slot the procedure names
+  for (i = allocation->first; i <= allocation->last; i ++) {
+    if (owners[i] != proc) continue;
+    inst = regCode->code + i;
+    if ((inst->op == R_CALL) && ((limit < 0) || (inst->a < limit))) limit = inst->a;
+    n = findUses(inst, uses);
+    uses[n ++] = findDefinition(inst);
+    for (j = 0; j < n; j ++)
+      if (uses[j] >= top) top = uses[j] + 1;
+  }
+  allocation->slotCount = ((limit >= 0) && (limit < top)) ? limit : top;
+  allocation->registers = (int*) malloc((allocation->slotCount + 1) * sizeof(int));
+  for (i = 0; i < allocation->slotCount; i ++)
+    allocation->registers[i] = X_NONE;
+  allocation->allocated = 0;
+  allocation->spilled = 0;
+  allocation->usesCalleeSaved = 0;
+
+  pinned = findPinnedSlots(allocation, regCode, entries, owners, proc);
+  findCandidates(allocation, regCode, owners, proc, pinned);
+  computeLiveness(allocation, regCode, owners, proc);
+  scanRanges(allocation, regCode, owners, proc);
+  free(pinned);
+  return allocation;
+}
+
+void freeRegAllocation(RegAllocation* allocation) {
+  free(allocation->registers);
+  free(allocation->candidates);
+  free(allocation->candidateOf);
+  free(allocation->liveIn);
+  free(allocation);
+}
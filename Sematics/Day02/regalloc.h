@@ -0,0 +1,51 @@
+/* Register allocation for the native code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __REGALLOC_H__
+#define __REGALLOC_H__
+
+#include "regcode.h"
+#include "x86.h"
+
+// %rbx and %r14, then registers the runtime functions may change
+#define ALLOCATABLE_REGISTERS 7
+#define CALLEE_SAVED_REGISTERS 2
+
+struct RegAllocation_ {
+  // The instructions of the procedure, and of those nested in it, lie in
+  // first..last
+  int first;
+  int last;
+  // Only r[0] to r[slotCount - 1] may get a register
+  int slotCount;
+  // Register of each of them, or X_NONE when it stays in its slot
+  int* registers;
+  // Slots with a live range, and the index of each slot among them or -1
+  WORD* candidates;
+  int candidateCount;
+  int* candidateOf;
+  // Candidates live before each instruction from first on, candidateCount
+  // to a row
+  char* liveIn;
+  int allocated;
+  int spilled;
+  // Whether %rbx or %r14 is used, to be kept for the caller
+  int usesCalleeSaved;
+};
+
+typedef struct RegAllocation_ RegAllocation;
+
+extern int allocatableRegisters[ALLOCATABLE_REGISTERS];
+
+RegAllocation* allocateRegisters(RegCode* regCode, int* entries, int* owners, int proc);
+void freeRegAllocation(RegAllocation* allocation);
+
+int isCalleeSaved(int reg);
+int findUses(RegInstruction* inst, WORD* uses);
+WORD findDefinition(RegInstruction* inst);
+int isLiveAt(RegAllocation* allocation, int address, WORD x);
+
+#endif
@@ -0,0 +1,901 @@
+/* Register code of the KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "vm.h"
+#include "regcode.h"
+
+struct RegOpCodeInfo {
+  char* name;
+  int operands;  // 1: a, 2: a and b, 3: a, b and c, 4: c, 5: a and c
+};
+
+struct RegOpCodeInfo regOpCodes[NUM_OF_REG_OPCODES] = {
+  {"MOV", 2}, {"MOVK", 5}, {"LEA", 5}, {"LEAG", 3}, {"LDG", 3},
+  {"STG", 3}, {"STGK", 3}, {"LDI", 2}, {"STI", 2}, {"STIK", 5},
+  {"COPY", 3},
+  {"ADD", 3}, {"ADDK", 3}, {"SUB", 3}, {"SUBK", 3}, {"MUL", 3},
+  {"MULK", 3}, {"DIV", 3}, {"DIVK", 3}, {"KSUB", 3}, {"KDIV", 3},
+  {"NEG", 2},
+  {"EQ", 3}, {"EQK", 3}, {"NE", 3}, {"NEK", 3}, {"GT", 3},
+  {"GTK", 3}, {"LT", 3}, {"LTK", 3}, {"GE", 3}, {"GEK", 3},
+  {"LE", 3}, {"LEK", 3},
+  {"J", 4}, {"FJ", 5},
+  {"FJEQ", 3}, {"FJEQK", 3}, {"FJNE", 3}, {"FJNEK", 3}, {"FJGT", 3},
+  {"FJGTK", 3}, {"FJLT", 3}, {"FJLTK", 3}, {"FJGE", 3}, {"FJGEK", 3},
+  {"FJLE", 3}, {"FJLEK", 3},
+  {"CALL", 3}, {"RET", 1}, {"CHK", 1}, {"BOUND", 5}, {"HL", 0},
+  {"RC", 1}, {"RI", 1}, {"WRC", 1}, {"WRCK", 4}, {"WRI", 1},
+  {"WRIK", 4}, {"WLN", 0}
+};
+
+/******************* Symbolic stack ******************************/
+
+/* While translating, every word of the stack above fp is described by an
+   entry. Loads are delayed until an instruction consumes their value, so
+   that it can read the variable or the constant directly. */
+
+#define E_CONST 0   // the constant v
+#define E_SLOT 1    // the value of r[v]; a temporary when v is its own index
+#define E_GSLOT 2   // the value at display[v] + w
+#define E_ADDR 3    // the address fp + v
+#define E_GADDR 4   // the address display[v] + w
+
+struct Entry_ {
+  int kind;
+  WORD v;
+  WORD w;
+};
+
+typedef struct Entry_ Entry;
+
+// The entries a jump target expects besides temporaries
+struct LeaderState_ {
+  int height;
+  int count;
+  int* indexes;
+  Entry* entries;
+};
+
+typedef struct LeaderState_ LeaderState;
+
+struct Translator_ {
+  CodeBlock* codeBlock;
+  RegCode* regCode;
+  int* depths;
+  char* isLeader;
+  char* isEntry;
+  char* isFunction;
+  LeaderState** states;
+  int* lineCounts;
+
+  Entry* stack;
+  int height;
+  int maxHeight;
+  // Every entry below floor is a temporary
+  int floor;
+  // Whether the instruction being translated can be reached
+  int reachable;
+  // The instruction that computed the top temporary, or -1
+  int lastDef;
+  int pendingStatements;
+  // The stack code instruction being translated
+  CodeAddress address;
+  int failed;
+};
+
+typedef struct Translator_ Translator;
+
+int isTemporary(Entry* e, int index) {
+  return (e->kind == E_SLOT) && (e->v == index);
+}
+
+// A delayed load, which a store or a call may invalidate
+int isLazy(Entry* e, int index) {
+  return ((e->kind == E_SLOT) && (e->v != index)) || (e->kind == E_GSLOT);
+}
+
+int emitReg(Translator* tr, enum RegOpCode op, WORD a, WORD b, WORD c) {
+  RegCode* regCode = tr->regCode;
+  RegInstruction* inst;
+
+  if (regCode->codeSize >= regCode->maxSize) {
+    regCode->maxSize *= 2;
+    regCode->code = (RegInstruction*) realloc(regCode->code, regCode->maxSize * sizeof(RegInstruction));
+    regCode->statements = (int*) realloc(regCode->statements, regCode->maxSize * sizeof(int));
+    regCode->depths = (int*) realloc(regCode->depths, regCode->maxSize * sizeof(int));
+  }
+
+  inst = regCode->code + regCode->codeSize;
+  inst->op = op;
+  inst->a = a;
+  inst->b = b;
+  inst->c = c;
+  regCode->statements[regCode->codeSize] = tr->pendingStatements;
+  regCode->depths[regCode->codeSize] = (tr->address < tr->codeBlock->codeSize) ? tr->depths[tr->address] : 0;
+  tr->pendingStatements = 0;
+  tr->lastDef = -1;
+  return regCode->codeSize ++;
+}
+
+// Emits an instruction computing the temporary at index
+void emitDef(Translator* tr, enum RegOpCode op, int index, WORD b, WORD c) {
+  tr->lastDef = emitReg(tr, op, index, b, c);
+  tr->stack[index].kind = E_SLOT;
+  tr->stack[index].v = index;
+}
+
+void push(Translator* tr, int kind, WORD v, WORD w) {
+  Entry* e;
+
+  if (tr->height >= tr->maxHeight) {
+    tr->maxHeight *= 2;
+    tr->stack = (Entry*) realloc(tr->stack, tr->maxHeight * sizeof(Entry));
+  }
+  e = tr->stack + tr->height;
+  e->kind = kind;
+  e->v = v;
+  e->w = w;
+  if (!isTemporary(e, tr->height) && (tr->height < tr->floor))
+    tr->floor = tr->height;
+  tr->height ++;
+}
+
+void pop(Translator* tr, int count) {
+  tr->height -= count;
+  if (tr->floor > tr->height)
+    tr->floor = tr->height;
+}
+
+// Moves the value of an entry into its own slot
+void materialize(Translator* tr, int index) {
+  Entry* e = tr->stack + index;
+
+  switch (e->kind) {
+  case E_CONST:
+    emitDef(tr, R_MOVK, index, DC_VALUE, e->v);
+    break;
+  case E_SLOT:
+    if (e->v != index)
+      emitDef(tr, R_MOV, index, e->v, DC_VALUE);
+    break;
+  case E_GSLOT:
+    emitDef(tr, R_LDG, index, e->v, e->w);
+    break;
+  case E_ADDR:
+    emitDef(tr, R_LEA, index, DC_VALUE, e->v);
+    break;
+  case E_GADDR:
+    emitDef(tr, R_LEAG, index, e->v, e->w);
+    break;
+  }
+}
+
+// Returns a register holding the value of an entry
+WORD toRegister(Translator* tr, int index) {
+  if (tr->stack[index].kind == E_SLOT)
+    return tr->stack[index].v;
+  materialize(tr, index);
+  return index;
+}
+
+int hasLazy(Translator* tr, int top) {
+  int i;
+
+  for (i = tr->floor; i < top; i ++)
+    if (isLazy(tr->stack + i, i))
+      return 1;
+  return 0;
+}
+
+// Performs the delayed loads below top
+void flushLazy(Translator* tr, int top) {
+  int i, floor = top;
+
+  for (i = tr->floor; i < top; i ++) {
+    if (isLazy(tr->stack + i, i))
+      materialize(tr, i);
+    if (!isTemporary(tr->stack + i, i) && (i < floor))
+      floor = i;
+  }
+  if (top >= tr->height)
+    tr->floor = floor;
+}
+
+/******************* Jump targets ******************************/
+
+LeaderState* saveState(Translator* tr) {
+  LeaderState* state = (LeaderState*) malloc(sizeof(LeaderState));
+  int i, n = 0;
+
+  state->height = tr->height;
+  state->indexes = (int*) malloc((tr->height - tr->floor + 1) * sizeof(int));
+  state->entries = (Entry*) malloc((tr->height - tr->floor + 1) * sizeof(Entry));
+  for (i = tr->floor; i < tr->height; i ++)
+    if (!isTemporary(tr->stack + i, i)) {
+      state->indexes[n] = i;
+      state->entries[n] = tr->stack[i];
+      n ++;
+    }
+  state->count = n;
+  return state;
+}
+
+void freeState(LeaderState* state) {
+  free(state->indexes);
+  free(state->entries);
+  free(state);
+}
+
+int sameState(Translator* tr, LeaderState* state) {
+  LeaderState* current = saveState(tr);
+  int same = (current->height == state->height) && (current->count == state->count);
+  int i;
+
+  for (i = 0; same && (i < state->count); i ++)
+    same = (current->indexes[i] == state->indexes[i]) &&
+      (current->entries[i].kind == state->entries[i].kind) &&
+      (current->entries[i].v == state->entries[i].v) &&
+      (current->entries[i].w == state->entries[i].w);
+  freeState(current);
+  return same;
+}
+
+void loadState(Translator* tr, LeaderState* state) {
+  int i;
+
+  tr->height = 0;
+  tr->floor = 0;
+  for (i = 0; i < state->height; i ++)
+    push(tr, E_SLOT, i, DC_VALUE);
+  tr->floor = state->height;
+  for (i = 0; i < state->count; i ++) {
+    tr->stack[state->indexes[i]] = state->entries[i];
+    if (state->indexes[i] < tr->floor)
+      tr->floor = state->indexes[i];
+  }
+}
+
+// The current state flows to a jump target; delayed loads must be done
+void joinState(Translator* tr, CodeAddress target) {
+  if (tr->states[target] == NULL)
+    tr->states[target] = saveState(tr);
+  else if (!sameState(tr, tr->states[target]))
+    tr->failed = 1;
+}
+
+/******************* Translation ******************************/
+
+int isConstant(Entry* e) {
+  return e->kind == E_CONST;
+}
+
+int isAddress(Entry* e) {
+  return (e->kind == E_ADDR) || (e->kind == E_GADDR);
+}
+
+int foldOperation(enum OpCode op, WORD x, WORD y, WORD* result) {
+  unsigned int ux = (unsigned int) x, uy = (unsigned int) y;
+
+  switch (op) {
+  case OP_AD: *result = (WORD) (ux + uy); return 1;
+  case OP_SB: *result = (WORD) (ux - uy); return 1;
+  case OP_ML: *result = (WORD) (ux * uy); return 1;
+  case OP_DV:
+    if (y == 0) return 0;
+    *result = DIVIDE_WORDS(x, y);
+    return 1;
+  case OP_EQ: *result = (x == y); return 1;
+  case OP_NE: *result = (x != y); return 1;
+  case OP_GT: *result = (x > y); return 1;
+  case OP_LT: *result = (x < y); return 1;
+  case OP_GE: *result = (x >= y); return 1;
+  case OP_LE: *result = (x <= y); return 1;
+  default: return 0;
+  }
+}
+
+int isComparison(enum OpCode op) {
+  return (op >= OP_EQ) && (op <= OP_LE);
+}
+
+// The register form of a binary operation; the constant form follows it
+enum RegOpCode regOperation(enum OpCode op) {
+  switch (op) {
+  case OP_AD: return R_ADD;
+  case OP_SB: return R_SUB;
+  case OP_ML: return R_MUL;
+  case OP_DV: return R_DIV;
+  default: return R_EQ + 2 * (op - OP_EQ);
+  }
+}
+
+// k op x is x op' k
+enum OpCode swapComparison(enum OpCode op) {
+  switch (op) {
+  case OP_GT: return OP_LT;
+  case OP_LT: return OP_GT;
+  case OP_GE: return OP_LE;
+  case OP_LE: return OP_GE;
+  default: return op;
+  }
+}
+
+void translateBinary(Translator* tr, enum OpCode op) {
+  int i = tr->height - 2;
+  Entry* x = tr->stack + i;
+  Entry* y = tr->stack + i + 1;
+  WORD result, rx, ry;
+
+  if (isConstant(x) && isConstant(y) && foldOperation(op, x->v, y->v, &result)) {
+    pop(tr, 1);
+    x->v = result;
+    return;
+  }
+
+  // Constant offsets are kept in the address
+  if ((op == OP_AD) && isAddress(x) && isConstant(y)) {
+    if (x->kind == E_ADDR) x->v += y->v;
+    else x->w += y->v;
+    pop(tr, 1);
+    return;
+  }
+  if ((op == OP_AD) && isConstant(x) && isAddress(y)) {
+    if (y->kind == E_ADDR) y->v += x->v;
+    else y->w += x->v;
+    *x = *y;
+    pop(tr, 1);
+    return;
+  }
+
+  if (isConstant(y) && !((op == OP_DV) && (y->v == 0))) {
+    ry = y->v;
+    rx = toRegister(tr, i);
+    pop(tr, 1);
+    emitDef(tr, regOperation(op) + 1, i, rx, ry);
+  } else if (isConstant(x) && ((op == OP_AD) || (op == OP_ML) || isComparison(op))) {
+    rx = x->v;
+    ry = toRegister(tr, i + 1);
+    pop(tr, 1);
+    emitDef(tr, regOperation(swapComparison(op)) + 1, i, ry, rx);
+  } else if (isConstant(x) && ((op == OP_SB) || (op == OP_DV))) {
+    rx = x->v;
+    ry = toRegister(tr, i + 1);
+    pop(tr, 1);
+    emitDef(tr, (op == OP_SB) ? R_KSUB : R_KDIV, i, ry, rx);
+  } else {
+    rx = toRegister(tr, i);
+    ry = toRegister(tr, i + 1);
+    pop(tr, 1);
+    emitDef(tr, regOperation(op), i, rx, ry);
+  }
+}
+
+void translateStore(Translator* tr) {
+  int i = tr->height - 2;
+  Entry* address = tr->stack + i;
+  Entry* value = tr->stack + i + 1;
+  RegInstruction* def;
+  WORD ra, rv;
+
+  flushLazy(tr, i);
+
+  switch (address->kind) {
+  case E_ADDR:
+    if ((tr->lastDef >= 0) && isTemporary(value, i + 1)) {
+      // Computes the value straight into the variable
+      def = tr->regCode->code + tr->lastDef;
+      if (def->a == i + 1) {
+        def->a = address->v;
+        break;
+      }
+    }
+    switch (value->kind) {
+    case E_CONST:
+      emitReg(tr, R_MOVK, address->v, DC_VALUE, value->v);
+      break;
+    case E_SLOT:
+      emitReg(tr, R_MOV, address->v, value->v, DC_VALUE);
+      break;
+    case E_GSLOT:
+      emitReg(tr, R_LDG, address->v, value->v, value->w);
+      break;
+    case E_ADDR:
+      emitReg(tr, R_LEA, address->v, DC_VALUE, value->v);
+      break;
+    case E_GADDR:
+      emitReg(tr, R_LEAG, address->v, value->v, value->w);
+      break;
+    }
+    break;
+  case E_GADDR:
+    if (isConstant(value))
+      emitReg(tr, R_STGK, value->v, address->v, address->w);
+    else {
+      rv = toRegister(tr, i + 1);
+      emitReg(tr, R_STG, rv, address->v, address->w);
+    }
+    break;
+  default:
+    ra = toRegister(tr, i);
+    if (isConstant(value))
+      emitReg(tr, R_STIK, ra, DC_VALUE, value->v);
+    else {
+      rv = toRegister(tr, i + 1);
+      emitReg(tr, R_STI, ra, rv, DC_VALUE);
+    }
+    break;
+  }
+  pop(tr, 2);
+  tr->lastDef = -1;
+}
+
+void translateCopy(Translator* tr, WORD size) {
+  int i = tr->height - 2;
+  WORD ra, rb;
+
+  flushLazy(tr, i);
+  ra = toRegister(tr, i);
+  rb = toRegister(tr, i + 1);
+  emitReg(tr, R_COPY, ra, rb, size);
+  pop(tr, 2);
+  tr->lastDef = -1;
+}
+
+void translateFalseJump(Translator* tr, CodeAddress target) {
+  int i = tr->height - 1;
+  Entry* cond = tr->stack + i;
+  RegInstruction* def;
+  WORD r;
+
+  if (isConstant(cond)) {
+    pop(tr, 1);
+    if (cond->v == 0) {
+      flushLazy(tr, tr->height);
+      joinState(tr, target);
+      emitReg(tr, R_J, DC_VALUE, DC_VALUE, target);
+      tr->reachable = 0;
+    }
+    return;
+  }
+
+  if ((tr->lastDef >= 0) && isTemporary(cond, i) && !hasLazy(tr, i)) {
+    def = tr->regCode->code + tr->lastDef;
+    if ((def->a == i) && (def->op >= R_EQ) && (def->op <= R_LEK)) {
+      // Fuses the comparison into the jump
+      def->op = R_FJEQ + (def->op - R_EQ);
+      def->a = def->b;
+      def->b = def->c;
+      def->c = target;
+      pop(tr, 1);
+      joinState(tr, target);
+      tr->lastDef = -1;
+      return;
+    }
+  }
+
+  r = toRegister(tr, i);
+  pop(tr, 1);
+  flushLazy(tr, tr->height);
+  joinState(tr, target);
+  emitReg(tr, R_FJ, r, DC_VALUE, target);
+}
+
+void translateInstruction(Translator* tr, CodeAddress address) {
+  Instruction* inst = tr->codeBlock->code + address;
+  int depth = tr->depths[address];
+  int i = tr->height - 1;
+  WORD r;
+
+  switch (inst->op) {
+  case OP_LA:
+    if (inst->p == 0)
+      push(tr, E_ADDR, inst->q, DC_VALUE);
+    else push(tr, E_GADDR, depth - inst->p, inst->q);
+    break;
+  case OP_LV:
+    if (inst->p == 0)
+      push(tr, E_SLOT, inst->q, DC_VALUE);
+    else push(tr, E_GSLOT, depth - inst->p, inst->q);
+    break;
+  case OP_LC:
+    push(tr, E_CONST, inst->q, DC_VALUE);
+    break;
+  case OP_LI:
+    switch (tr->stack[i].kind) {
+    case E_ADDR:
+      tr->stack[i].kind = E_SLOT;
+      break;
+    case E_GADDR:
+      tr->stack[i].kind = E_GSLOT;
+      break;
+    default:
+      r = toRegister(tr, i);
+      emitDef(tr, R_LDI, i, r, DC_VALUE);
+      break;
+    }
+    break;
+  case OP_INT:
+    // Only a frame is allocated on an empty stack, the program's included
+    if (tr->height == 0)
+      emitReg(tr, R_CHK, inst->q, DC_VALUE, DC_VALUE);
+    for (r = 0; r < inst->q; r ++)
+      push(tr, E_SLOT, tr->height, DC_VALUE);
+    break;
+  case OP_DCT:
+    // Arguments must be in place when the callee starts
+    if ((address + 1 < tr->codeBlock->codeSize) && (tr->codeBlock->code[address + 1].op == OP_CALL))
+      for (r = tr->height - inst->q; r < tr->height; r ++)
+        materialize(tr, r);
+    pop(tr, inst->q);
+    break;
+  case OP_J:
+    flushLazy(tr, tr->height);
+    joinState(tr, inst->q);
+    emitReg(tr, R_J, DC_VALUE, DC_VALUE, inst->q);
+    tr->reachable = 0;
+    break;
+  case OP_FJ:
+    translateFalseJump(tr, inst->q);
+    break;
+  case OP_HL:
+    emitReg(tr, R_HL, DC_VALUE, DC_VALUE, DC_VALUE);
+    tr->reachable = 0;
+    break;
+  case OP_ST:
+    translateStore(tr);
+    break;
+  case OP_CALL:
+    flushLazy(tr, tr->height);
+    emitReg(tr, R_CALL, tr->height, depth - inst->p + 1, inst->q);
+    if (tr->isFunction[inst->q])
+      push(tr, E_SLOT, tr->height, DC_VALUE);
+    break;
+  case OP_EP:
+  case OP_EF:
+    emitReg(tr, R_RET, depth, DC_VALUE, DC_VALUE);
+    tr->reachable = 0;
+    break;
+  case OP_RC:
+    push(tr, E_SLOT, tr->height, DC_VALUE);
+    emitDef(tr, R_RC, tr->height - 1, DC_VALUE, DC_VALUE);
+    break;
+  case OP_RI:
+    push(tr, E_SLOT, tr->height, DC_VALUE);
+    emitDef(tr, R_RI, tr->height - 1, DC_VALUE, DC_VALUE);
+    break;
+  case OP_WRC:
+  case OP_WRI:
+    if (isConstant(tr->stack + i))
+      emitReg(tr, (inst->op == OP_WRC) ? R_WRCK : R_WRIK, DC_VALUE, DC_VALUE, tr->stack[i].v);
+    else {
+      r = toRegister(tr, i);
+      emitReg(tr, (inst->op == OP_WRC) ? R_WRC : R_WRI, r, DC_VALUE, DC_VALUE);
+    }
+    pop(tr, 1);
+    break;
+  case OP_WLN:
+    emitReg(tr, R_WLN, DC_VALUE, DC_VALUE, DC_VALUE);
+    break;
+  case OP_NEG:
+    if (isConstant(tr->stack + i))
+      tr->stack[i].v = (WORD) (- (unsigned int) tr->stack[i].v);
+    else {
+      r = toRegister(tr, i);
+      emitDef(tr, R_NEG, i, r, DC_VALUE);
+    }
+    break;
+  case OP_CV:
+    push(tr, tr->stack[i].kind, tr->stack[i].v, tr->stack[i].w);
+    break;
+  case OP_CK:
+    if (!isConstant(tr->stack + i) || (tr->stack[i].v < 1) || (tr->stack[i].v > inst->q)) {
+      r = toRegister(tr, i);
+      emitReg(tr, R_BOUND, r, DC_VALUE, inst->q);
+    }
+    break;
+  case OP_CP:
+    translateCopy(tr, inst->q);
+    break;
+  case OP_BP:
+    break;
+  default:
+    translateBinary(tr, inst->op);
+    break;
+  }
+}
+
+// Whether the code starting at entry leaves with EF
+int leavesWithValue(CodeBlock* codeBlock, CodeAddress entry, char* visited) {
+  CodeAddress address = entry;
+  Instruction* inst;
+
+  while ((address >= 0) && (address < codeBlock->codeSize) && !visited[address]) {
+    visited[address] = 1;
+    inst = codeBlock->code + address;
+    switch (inst->op) {
+    case OP_EF: return 1;
+    case OP_EP:
+    case OP_HL: return 0;
+    case OP_J:
+      address = inst->q;
+      break;
+    case OP_FJ:
+      if (leavesWithValue(codeBlock, inst->q, visited))
+        return 1;
+      address ++;
+      break;
+    default:
+      address ++;
+      break;
+    }
+  }
+  return 0;
+}
+
+/* Marks jump targets and the entries of the subprograms reachable code
+   calls; a subprogram only unreachable code calls is not translated */
+void findTargets(Translator* tr) {
+  CodeBlock* codeBlock = tr->codeBlock;
+  char* visited = (char*) malloc(codeBlock->codeSize + 1);
+  Instruction* inst;
+  int i;
+
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    if ((inst->op == OP_J) || (inst->op == OP_FJ))
+      tr->isLeader[inst->q] = 1;
+    else if ((inst->op == OP_CALL) && (tr->depths[i] != UNKNOWN_DEPTH) && !tr->isEntry[inst->q]) {
+      tr->isEntry[inst->q] = 1;
+      memset(visited, 0, codeBlock->codeSize + 1);
+      tr->isFunction[inst->q] = leavesWithValue(codeBlock, inst->q, visited);
+    }
+  }
+  tr->isEntry[0] = 1;
+
+  for (i = 0; i < codeBlock->lineCount; i ++)
+    if ((codeBlock->lines[i].address >= 0) && (codeBlock->lines[i].address <= codeBlock->codeSize))
+      tr->lineCounts[codeBlock->lines[i].address] ++;
+  free(visited);
+}
+
+// The line of the last statement started at or before each instruction
+void mapLines(Translator* tr) {
+  CodeBlock* codeBlock = tr->codeBlock;
+  RegCode* regCode = tr->regCode;
+  int* lineOf = (int*) calloc(codeBlock->codeSize + 1, sizeof(int));
+  int line = 0;
+  int i, address;
+
+  regCode->lines = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  for (i = 0; i < codeBlock->lineCount; i ++)
+    if ((codeBlock->lines[i].address >= 0) && (codeBlock->lines[i].address <= codeBlock->codeSize))
+      lineOf[codeBlock->lines[i].address] = codeBlock->lines[i].lineNo;
+
+  address = 0;
+  for (i = 0; i < regCode->codeSize; i ++) {
+    while ((address < codeBlock->codeSize) && (regCode->addressMap[address] <= i)) {
+      if (lineOf[address] > 0) line = lineOf[address];
+      address ++;
+    }
+    regCode->lines[i] = line;
+  }
+  free(lineOf);
+}
+
+int validCode(CodeBlock* codeBlock) {
+  Instruction* inst;
+  int i;
+
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    if (((inst->op == OP_J) || (inst->op == OP_FJ) || (inst->op == OP_CALL)) &&
+        ((inst->q < 0) || (inst->q > codeBlock->codeSize)))
+      return 0;
+    if (((inst->op == OP_INT) || (inst->op == OP_DCT)) && (inst->q < 0))
+      return 0;
+  }
+  return 1;
+}
+
+RegCode* translateCode(CodeBlock* codeBlock) {
+  Translator tr;
+  int size = codeBlock->codeSize + 1;
+  RegInstruction* inst;
+  int address;
+
+  if (!validCode(codeBlock))
+    return NULL;
+
+  tr.depths = (int*) malloc(size * sizeof(int));
+  if (!computeDepths(codeBlock, tr.depths)) {
+    free(tr.depths);
+    return NULL;
+  }
+
+  tr.codeBlock = codeBlock;
+  tr.regCode = (RegCode*) malloc(sizeof(RegCode));
+  tr.regCode->maxSize = size;
+  tr.regCode->codeSize = 0;
+  tr.regCode->code = (RegInstruction*) malloc(size * sizeof(RegInstruction));
+  tr.regCode->statements = (int*) malloc(size * sizeof(int));
+  tr.regCode->depths = (int*) malloc(size * sizeof(int));
+  tr.regCode->lines = NULL;
+  tr.isLeader = (char*) calloc(size, 1);
+  tr.isEntry = (char*) calloc(size, 1);
+  tr.isFunction = (char*) calloc(size, 1);
+  tr.states = (LeaderState**) calloc(size, sizeof(LeaderState*));
+  tr.lineCounts = (int*) calloc(size, sizeof(int));
+  tr.maxHeight = 64;
+  tr.stack = (Entry*) malloc(tr.maxHeight * sizeof(Entry));
+  tr.height = 0;
+  tr.floor = 0;
+  tr.reachable = 0;
+  tr.lastDef = -1;
+  tr.pendingStatements = 0;
+  tr.failed = 0;
+  tr.regCode->addressMap = (int*) malloc(size * sizeof(int));
+  tr.regCode->mapSize = size;
+
+  findTargets(&tr);
+
+  for (address = 0; (address < codeBlock->codeSize) && !tr.failed; address ++) {
+    tr.address = address;
+    if (tr.isEntry[address]) {
+      if (tr.reachable) {
+        // Falls into a subprogram, which the compiler never does
+        tr.failed = 1;
+        break;
+      }
+      tr.height = 0;
+      tr.floor = 0;
+      tr.reachable = 1;
+    } else if (tr.isLeader[address]) {
+      if (tr.reachable) {
+        flushLazy(&tr, tr.height);
+        joinState(&tr, address);
+      } else if (tr.states[address] != NULL) {
+        loadState(&tr, tr.states[address]);
+        tr.reachable = 1;
+      }
+      tr.lastDef = -1;
+    }
+
+    tr.regCode->addressMap[address] = tr.regCode->codeSize;
+    tr.pendingStatements += tr.lineCounts[address];
+    if (tr.reachable && (tr.depths[address] != UNKNOWN_DEPTH))
+      translateInstruction(&tr, address);
+  }
+  tr.address = codeBlock->codeSize;
+  tr.regCode->addressMap[codeBlock->codeSize] = tr.regCode->codeSize;
+  // Falling off the end of the code halts the machine
+  emitReg(&tr, R_HL, DC_VALUE, DC_VALUE, DC_VALUE);
+
+  for (address = 0; address < tr.regCode->codeSize; address ++) {
+    inst = tr.regCode->code + address;
+    if (regOpCodeIsJump(inst->op) || (inst->op == R_CALL))
+      inst->c = tr.regCode->addressMap[inst->c];
+  }
+  if (!tr.failed) mapLines(&tr);
+
+  for (address = 0; address < size; address ++)
+    if (tr.states[address] != NULL)
+      freeState(tr.states[address]);
+  free(tr.states);
+  free(tr.depths);
+  free(tr.isLeader);
+  free(tr.isEntry);
+  free(tr.isFunction);
+  free(tr.lineCounts);
+  free(tr.stack);
+
+  if (tr.failed) {
+    freeRegCode(tr.regCode);
+    return NULL;
+  }
+  return tr.regCode;
+}
+
+/* Splits the code into the program, which starts at 0, and the
+   subprograms, which start where their calls land. owners[i] is the
+   index in entries of the one instruction i belongs to, or -1 when it is
+   never reached. Returns the number of entries. */
+int findProcedures(RegCode* regCode, int* entries, int* owners) {
+  int* work = (int*) malloc((regCode->codeSize + 1) * sizeof(int));
+  RegInstruction* inst;
+  int count = 0, top, i, address;
+
+  for (i = 0; i < regCode->codeSize; i ++)
+    owners[i] = -1;
+
+  entries[count ++] = 0;
+  for (i = 0; i < regCode->codeSize; i ++) {
+    inst = regCode->code + i;
+    if ((inst->op == R_CALL) && (inst->c < regCode->codeSize)) {
+      for (address = 0; address < count; address ++)
+        if (entries[address] == inst->c) break;
+      if (address == count)
+        entries[count ++] = inst->c;
+    }
+  }
+
+  for (i = 0; i < count; i ++) {
+    top = 0;
+    work[top ++] = entries[i];
+    while (top > 0) {
+      address = work[-- top];
+      while ((address < regCode->codeSize) && (owners[address] < 0)) {
+        owners[address] = i;
+        inst = regCode->code + address;
+        if ((inst->op == R_RET) || (inst->op == R_HL))
+          break;
+        if (inst->op == R_J) {
+          address = inst->c;
+          continue;
+        }
+        if (regOpCodeIsJump(inst->op))
+          work[top ++] = inst->c;
+        address ++;
+      }
+    }
+  }
+
+  free(work);
+  return count;
+}
+
+void freeRegCode(RegCode* regCode) {
+  free(regCode->code);
+  free(regCode->statements);
+  free(regCode->depths);
+  free(regCode->lines);
+  free(regCode->addressMap);
+  free(regCode);
+}
+
+int regOpCodeIsJump(enum RegOpCode op) {
+  return (op >= R_J) && (op <= R_FJLEK);
+}
+
+char* regOpCodeToString(enum RegOpCode op) {
+  return regOpCodes[op].name;
+}
+
+void printRegInstruction(RegInstruction* inst) {
+  switch (regOpCodes[inst->op].operands) {
+  case 1:
+    printf("%s %d", regOpCodes[inst->op].name, inst->a);
+    break;
+  case 2:
+    printf("%s %d,%d", regOpCodes[inst->op].name, inst->a, inst->b);
+    break;
+  case 3:
+    printf("%s %d,%d,%d", regOpCodes[inst->op].name, inst->a, inst->b, inst->c);
+    break;
+  case 4:
+    printf("%s %d", regOpCodes[inst->op].name, inst->c);
+    break;
+  case 5:
+    printf("%s %d,%d", regOpCodes[inst->op].name, inst->a, inst->c);
+    break;
+  default:
+    printf("%s", regOpCodes[inst->op].name);
+    break;
+  }
+}
+
+void printRegCode(RegCode* regCode) {
+  int i;
+
+  for (i = 0; i < regCode->codeSize; i ++) {
+    printf("%d:  ", i);
+    printRegInstruction(regCode->code + i);
+    printf("\n");
+  }
+}
@@ -0,0 +1,125 @@
+/* Register code of the KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __REGCODE_H__
+#define __REGCODE_H__
+
+#include "instructions.h"
+
+/* Three-address instructions whose registers are the slots of the current
+   frame: r[x] is s[fp + x]. Temporaries of the stack code get the slot
+   they would have occupied on the stack, so that a call finds its
+   arguments where the callee expects them.
+
+   Binary operations come in pairs: the form on registers, then the form
+   whose right operand is the constant c. */
+enum RegOpCode {
+  R_MOV,    // r[a] := r[b]
+  R_MOVK,   // r[a] := c
+  R_LEA,    // r[a] := fp + c
+  R_LEAG,   // r[a] := display[b] + c
+  R_LDG,    // r[a] := s[display[b] + c]
+  R_STG,    // s[display[b] + c] := r[a]
+  R_STGK,   // s[display[b] + c] := a
+  R_LDI,    // r[a] := s[r[b]]
+  R_STI,    // s[r[a]] := r[b]
+  R_STIK,   // s[r[a]] := c
+  R_COPY,   // the c words from s[r[b]] on to s[r[a]] on
+
+  R_ADD,    // r[a] := r[b] + r[c]
+  R_ADDK,   // r[a] := r[b] + c
+  R_SUB,    // r[a] := r[b] - r[c]
+  R_SUBK,   // r[a] := r[b] - c
+  R_MUL,    // r[a] := r[b] * r[c]
+  R_MULK,   // r[a] := r[b] * c
+  R_DIV,    // r[a] := r[b] / r[c]
+  R_DIVK,   // r[a] := r[b] / c
+  R_KSUB,   // r[a] := c - r[b]
+  R_KDIV,   // r[a] := c / r[b]
+  R_NEG,    // r[a] := - r[b]
+
+  R_EQ,     // r[a] := (r[b] = r[c])
+  R_EQK,    // r[a] := (r[b] = c)
+  R_NE,
+  R_NEK,
+  R_GT,
+  R_GTK,
+  R_LT,
+  R_LTK,
+  R_GE,
+  R_GEK,
+  R_LE,
+  R_LEK,
+
+  R_J,      // pc := c
+  R_FJ,     // if r[a] = 0 then pc := c
+  R_FJEQ,   // if not (r[a] = r[b]) then pc := c
+  R_FJEQK,  // if not (r[a] = b) then pc := c
+  R_FJNE,
+  R_FJNEK,
+  R_FJGT,
+  R_FJGTK,
+  R_FJLT,
+  R_FJLTK,
+  R_FJGE,
+  R_FJGEK,
+  R_FJLE,
+  R_FJLEK,
+
+  R_CALL,   // new frame at fp + a for a scope of depth b; pc := c
+  R_RET,    // leave a scope of depth a
+  R_CHK,    // the stack must have room for a words above fp
+  R_BOUND,  // stop unless 1 <= r[a] <= c
+  R_HL,
+
+  R_RC,     // r[a] := getch
+  R_RI,     // r[a] := integer
+  R_WRC,    // write r[a] as a char
+  R_WRCK,   // write c as a char
+  R_WRI,    // write r[a]
+  R_WRIK,   // write c
+  R_WLN     // new line
+};
+
+#define NUM_OF_REG_OPCODES (R_WLN + 1)
+
+struct RegInstruction_ {
+  enum RegOpCode op;
+  WORD a;
+  WORD b;
+  WORD c;
+};
+
+typedef struct RegInstruction_ RegInstruction;
+
+struct RegCode_ {
+  RegInstruction* code;
+  int codeSize;
+  int maxSize;
+  // Number of statements starting at each instruction
+  int* statements;
+  // Depth of the scope each instruction belongs to
+  int* depths;
+  // Source line of the statement each instruction comes from, or 0
+  int* lines;
+  // The first instruction translated from each stack code instruction
+  int* addressMap;
+  int mapSize;
+};
+
+typedef struct RegCode_ RegCode;
+
+RegCode* translateCode(CodeBlock* codeBlock);
+void freeRegCode(RegCode* regCode);
+
+int findProcedures(RegCode* regCode, int* entries, int* owners);
+
+int regOpCodeIsJump(enum RegOpCode op);
+char* regOpCodeToString(enum RegOpCode op);
+void printRegInstruction(RegInstruction* inst);
+void printRegCode(RegCode* regCode);
+
+#endif
@@ -0,0 +1,260 @@
+/* Instruction bodies of the register machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ *
+ * Included by each dispatcher in regvm.c, which defines OP(op) and NEXT
+ * as for vmops.h. r points to the current frame in the stack s.
+ */
+
+OP(R_MOV)
+  r[inst->a] = r[inst->b];
+  NEXT;
+
+OP(R_MOVK)
+  r[inst->a] = inst->c;
+  NEXT;
+
+OP(R_LEA)
+  r[inst->a] = (r - s) + inst->c;
+  NEXT;
+
+OP(R_LEAG)
+  r[inst->a] = display[inst->b] + inst->c;
+  NEXT;
+
+OP(R_LDG)
+  r[inst->a] = s[display[inst->b] + inst->c];
+  NEXT;
+
+OP(R_STG)
+  s[display[inst->b] + inst->c] = r[inst->a];
+  NEXT;
+
+OP(R_STGK)
+  s[display[inst->b] + inst->c] = inst->a;
+  NEXT;
+
+OP(R_LDI)
+  r[inst->a] = s[r[inst->b]];
+  NEXT;
+
+OP(R_STI)
+  s[r[inst->a]] = r[inst->b];
+  NEXT;
+
+OP(R_STIK)
+  s[r[inst->a]] = inst->c;
+  NEXT;
+
+OP(R_COPY)
+  memmove(s + r[inst->a], s + r[inst->b], inst->c * sizeof(WORD));
+  NEXT;
+
+OP(R_ADD)
+  r[inst->a] = r[inst->b] + r[inst->c];
+  NEXT;
+
+OP(R_ADDK)
+  r[inst->a] = r[inst->b] + inst->c;
+  NEXT;
+
+OP(R_SUB)
+  r[inst->a] = r[inst->b] - r[inst->c];
+  NEXT;
+
+OP(R_SUBK)
+  r[inst->a] = r[inst->b] - inst->c;
+  NEXT;
+
+OP(R_MUL)
+  r[inst->a] = r[inst->b] * r[inst->c];
+  NEXT;
+
+OP(R_MULK)
+  r[inst->a] = r[inst->b] * inst->c;
+  NEXT;
+
+OP(R_DIV)
+  if (r[inst->c] == 0) goto divisionByZero;
+  r[inst->a] = DIVIDE_WORDS(r[inst->b], r[inst->c]);
+  NEXT;
+
+OP(R_DIVK)
+  if (inst->c == 0) goto divisionByZero;
+  r[inst->a] = DIVIDE_WORDS(r[inst->b], inst->c);
+  NEXT;
+
+OP(R_KSUB)
+  r[inst->a] = inst->c - r[inst->b];
+  NEXT;
+
+OP(R_KDIV)
+  if (r[inst->b] == 0) goto divisionByZero;
+  r[inst->a] = DIVIDE_WORDS(inst->c, r[inst->b]);
+  NEXT;
+
+OP(R_NEG)
+  r[inst->a] = - r[inst->b];
+  NEXT;
+
+OP(R_EQ)
+  r[inst->a] = (r[inst->b] == r[inst->c]);
+  NEXT;
+
+OP(R_EQK)
+  r[inst->a] = (r[inst->b] == inst->c);
+  NEXT;
+
+OP(R_NE)
+  r[inst->a] = (r[inst->b] != r[inst->c]);
+  NEXT;
+
+OP(R_NEK)
+  r[inst->a] = (r[inst->b] != inst->c);
+  NEXT;
+
+OP(R_GT)
+  r[inst->a] = (r[inst->b] > r[inst->c]);
+  NEXT;
+
+OP(R_GTK)
+  r[inst->a] = (r[inst->b] > inst->c);
+  NEXT;
+
+OP(R_LT)
+  r[inst->a] = (r[inst->b] < r[inst->c]);
+  NEXT;
+
+OP(R_LTK)
+  r[inst->a] = (r[inst->b] < inst->c);
+  NEXT;
+
+OP(R_GE)
+  r[inst->a] = (r[inst->b] >= r[inst->c]);
+  NEXT;
+
+OP(R_GEK)
+  r[inst->a] = (r[inst->b] >= inst->c);
+  NEXT;
+
+OP(R_LE)
+  r[inst->a] = (r[inst->b] <= r[inst->c]);
+  NEXT;
+
+OP(R_LEK)
+  r[inst->a] = (r[inst->b] <= inst->c);
+  NEXT;
+
+OP(R_J)
+  pc = code + inst->c;
+  NEXT;
+
+OP(R_FJ)
+  if (r[inst->a] == 0) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJEQ)
+  if (!(r[inst->a] == r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJEQK)
+  if (!(r[inst->a] == inst->b)) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJNE)
+  if (!(r[inst->a] != r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJNEK)
+  if (!(r[inst->a] != inst->b)) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJGT)
+  if (!(r[inst->a] > r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJGTK)
+  if (!(r[inst->a] > inst->b)) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJLT)
+  if (!(r[inst->a] < r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJLTK)
+  if (!(r[inst->a] < inst->b)) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJGE)
+  if (!(r[inst->a] >= r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJGEK)
+  if (!(r[inst->a] >= inst->b)) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJLE)
+  if (!(r[inst->a] <= r[inst->b])) pc = code + inst->c;
+  NEXT;
+
+OP(R_FJLEK)
+  if (!(r[inst->a] <= inst->b)) pc = code + inst->c;
+  NEXT;
+
+  // The new frame starts at r[a] and becomes the display entry of depth b
+OP(R_CALL)
+  i = (r - s) + inst->a;
+  if (i >= limit) goto stackOverflow;
+  s[i + DYNAMIC_LINK_OFFSET] = r - s;
+  s[i + RETURN_ADDRESS_OFFSET] = pc - code;
+  s[i + STATIC_LINK_OFFSET] = display[inst->b];
+  display[inst->b] = i;
+  r = s + i;
+  pc = code + inst->c;
+  NEXT;
+
+OP(R_RET)
+  display[inst->a] = r[STATIC_LINK_OFFSET];
+  pc = code + r[RETURN_ADDRESS_OFFSET];
+  r = s + r[DYNAMIC_LINK_OFFSET];
+  NEXT;
+
+OP(R_CHK)
+  if ((r - s) + inst->a >= limit) goto stackOverflow;
+  NEXT;
+
+OP(R_BOUND)
+  if ((r[inst->a] < 1) || (r[inst->a] > inst->c)) goto indexOutOfRange;
+  NEXT;
+
+OP(R_HL)
+  goto halt;
+
+OP(R_RC)
+  r[inst->a] = kplReadc();
+  NEXT;
+
+OP(R_RI)
+  r[inst->a] = kplReadi();
+  NEXT;
+
+OP(R_WRC)
+  kplWritec(r[inst->a]);
+  NEXT;
+
+OP(R_WRCK)
+  kplWritec(inst->c);
+  NEXT;
+
+OP(R_WRI)
+  kplWritei(r[inst->a]);
+  NEXT;
+
+OP(R_WRIK)
+  kplWritei(inst->c);
+  NEXT;
+
+OP(R_WLN)
+  kplWriteln();
+  NEXT;
@@ -0,0 +1,150 @@
+/* Register machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "kplio.h"
+#include "regvm.h"
+
+RegVM* createRegVM(RegCode* regCode, int stackSize) {
+  RegVM* vm = (RegVM*) malloc(sizeof(RegVM));
+  int i;
+
+  vm->codeSize = regCode->codeSize;
+  vm->code = (RegVMInstruction*) malloc(regCode->codeSize * sizeof(RegVMInstruction));
+  vm->ops = (enum RegOpCode*) malloc(regCode->codeSize * sizeof(enum RegOpCode));
+  vm->statements = (int*) malloc(regCode->codeSize * sizeof(int));
+  for (i = 0; i < regCode->codeSize; i ++) {
+    vm->code[i].handler = NULL;
+    vm->code[i].a = regCode->code[i].a;
+    vm->code[i].b = regCode->code[i].b;
+    vm->code[i].c = regCode->code[i].c;
+    vm->ops[i] = regCode->code[i].op;
+    vm->statements[i] = regCode->statements[i];
+  }
+
+  vm->stackSize = stackSize;
+  vm->stack = (WORD*) calloc(stackSize, sizeof(WORD));
+  vm->dispatchCount = 0;
+  vm->statementCount = 0;
+  return vm;
+}
+
+void freeRegVM(RegVM* vm) {
+  free(vm->code);
+  free(vm->ops);
+  free(vm->statements);
+  free(vm->stack);
+  free(vm);
+}
+
+/******************* Dispatchers ******************************/
+
+int runRegThreaded(RegVM* vm) {
+  static const void* labels[NUM_OF_REG_OPCODES] = {
+    &&L_R_MOV, &&L_R_MOVK, &&L_R_LEA, &&L_R_LEAG, &&L_R_LDG,
+    &&L_R_STG, &&L_R_STGK, &&L_R_LDI, &&L_R_STI, &&L_R_STIK,
+    &&L_R_COPY,
+    &&L_R_ADD, &&L_R_ADDK, &&L_R_SUB, &&L_R_SUBK, &&L_R_MUL,
+    &&L_R_MULK, &&L_R_DIV, &&L_R_DIVK, &&L_R_KSUB, &&L_R_KDIV,
+    &&L_R_NEG,
+    &&L_R_EQ, &&L_R_EQK, &&L_R_NE, &&L_R_NEK, &&L_R_GT,
+    &&L_R_GTK, &&L_R_LT, &&L_R_LTK, &&L_R_GE, &&L_R_GEK,
+    &&L_R_LE, &&L_R_LEK,
+    &&L_R_J, &&L_R_FJ,
+    &&L_R_FJEQ, &&L_R_FJEQK, &&L_R_FJNE, &&L_R_FJNEK, &&L_R_FJGT,
+    &&L_R_FJGTK, &&L_R_FJLT, &&L_R_FJLTK, &&L_R_FJGE, &&L_R_FJGEK,
+    &&L_R_FJLE, &&L_R_FJLEK,
+    &&L_R_CALL, &&L_R_RET, &&L_R_CHK, &&L_R_BOUND, &&L_R_HL,
+    &&L_R_RC, &&L_R_RI, &&L_R_WRC, &&L_R_WRCK, &&L_R_WRI,
+    &&L_R_WRIK, &&L_R_WLN
+  };
+  RegVMInstruction* code = vm->code;
+  RegVMInstruction* pc = code;
+  RegVMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* r = s;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int i;
+
+  for (i = 0; i < vm->codeSize; i ++)
+    code[i].handler = labels[vm->ops[i]];
+  display[0] = 0;
+
+#define OP(op) L_##op:
+#define NEXT inst = pc ++; goto *inst->handler
+
+  NEXT;
+
+#include "regops.h"
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+// Counts dispatches and the statements they start
+int runRegCounting(RegVM* vm) {
+  RegVMInstruction* code = vm->code;
+  RegVMInstruction* pc = code;
+  RegVMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* r = s;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int i;
+
+  display[0] = 0;
+
+#define OP(op) case op:
+#define NEXT continue
+
+  for (;;) {
+    inst = pc ++;
+    vm->dispatchCount ++;
+    vm->statementCount += vm->statements[inst - code];
+    switch (vm->ops[inst - code]) {
+#include "regops.h"
+    }
+  }
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+int runRegVM(RegVM* vm, int dispatch) {
+  if (dispatch == DISPATCH_COUNT)
+    return runRegCounting(vm);
+  else return runRegThreaded(vm);
+}
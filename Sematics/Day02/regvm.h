@@ -0,0 +1,40 @@
+/* Register machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __REGVM_H__
+#define __REGVM_H__
+
+#include "regcode.h"
+#include "vm.h"
+
+struct RegVMInstruction_ {
+  const void* handler;
+  WORD a;
+  WORD b;
+  WORD c;
+};
+
+typedef struct RegVMInstruction_ RegVMInstruction;
+
+struct RegVM_ {
+  RegVMInstruction* code;
+  enum RegOpCode* ops;
+  int* statements;
+  int codeSize;
+  WORD* stack;
+  int stackSize;
+  WORD display[MAX_DEPTH];
+  long long dispatchCount;
+  long long statementCount;
+};
+
+typedef struct RegVM_ RegVM;
+
+RegVM* createRegVM(RegCode* regCode, int stackSize);
+void freeRegVM(RegVM* vm);
+int runRegVM(RegVM* vm, int dispatch);
+
+#endif
@@ -101,6 +101,7 @@ Token* readConstChar(void) {
     
   token->string[0] = currentChar;
   token->string[1] = '\0';
+  token->value = currentChar;
 
   readChar();
   if (currentChar == EOF) {
@@ -0,0 +1,310 @@
+/* Sparse conditional constant propagation
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+
+/* Wegman and Zadeck's algorithm: a value is unknown until shown to be a
+   constant, and varying once two constants meet. Only the edges a branch
+   can take are followed, so a condition that is always false keeps the
+   code it guards out of the meet. Arithmetic wraps around as it does in
+   the machine; a division that would stop the machine is left to run. */
+
+#define LATTICE_TOP 0
+#define LATTICE_CONST 1
+#define LATTICE_BOTTOM 2
+
+struct Lattice_ {
+  int state;
+  WORD value;
+};
+
+typedef struct Lattice_ Lattice;
+
+struct SCCP_ {
+  IRFunction* f;
+  Lattice* values;
+  // The users of every value
+  int* userStarts;
+  int* users;
+  char* executable;
+  // Executable incoming edges, by block and predecessor index
+  char** edges;
+  int* flowWork;
+  int flowCount;
+  int maxFlow;
+  int* ssaWork;
+  int ssaCount;
+  int maxSSA;
+};
+
+typedef struct SCCP_ SCCP;
+
+void buildUsers(SCCP* s) {
+  IRFunction* f = s->f;
+  IRInst* inst;
+  int* fill;
+  int i, j, arg;
+
+  s->userStarts = (int*) calloc(f->instCount + 2, sizeof(int));
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    for (j = 0; j < inst->argCount; j ++)
+      s->userStarts[inst->args[j] + 1] ++;
+  }
+  for (i = 0; i < f->instCount; i ++)
+    s->userStarts[i + 1] += s->userStarts[i];
+  s->users = (int*) malloc((s->userStarts[f->instCount] + 1) * sizeof(int));
+  fill = (int*) calloc(f->instCount + 1, sizeof(int));
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    for (j = 0; j < inst->argCount; j ++) {
+      arg = inst->args[j];
+      s->users[s->userStarts[arg] + fill[arg] ++] = i;
+    }
+  }
+  free(fill);
+}
+
+void addFlowEdge(SCCP* s, int from, int to) {
+  if (s->flowCount + 2 > s->maxFlow) {
+    s->maxFlow = 2 * s->maxFlow + 16;
+    s->flowWork = (int*) realloc(s->flowWork, s->maxFlow * sizeof(int));
+  }
+  s->flowWork[s->flowCount ++] = from;
+  s->flowWork[s->flowCount ++] = to;
+}
+
+void setLattice(SCCP* s, int v, int state, WORD value) {
+  Lattice* l = s->values + v;
+
+  if ((l->state == state) && ((state != LATTICE_CONST) || (l->value == value))) return;
+  // Constants that disagree go to the bottom; nothing ever goes back up
+  if ((l->state == LATTICE_CONST) && (state == LATTICE_CONST)) state = LATTICE_BOTTOM;
+  if (l->state > state) return;
+  l->state = state;
+  l->value = value;
+
+  if (s->ssaCount >= s->maxSSA) {
+    s->maxSSA = 2 * s->maxSSA + 16;
+    s->ssaWork = (int*) realloc(s->ssaWork, s->maxSSA * sizeof(int));
+  }
+  s->ssaWork[s->ssaCount ++] = v;
+}
+
+// Folds like the machine does; returns 0 for what it would stop on
+int foldConstants(enum IROpCode op, WORD a, WORD b, WORD* result) {
+  switch (op) {
+  case IR_ADD: *result = (WORD) ((unsigned) a + (unsigned) b); return 1;
+  case IR_SUB: *result = (WORD) ((unsigned) a - (unsigned) b); return 1;
+  case IR_MUL: *result = (WORD) ((unsigned) a * (unsigned) b); return 1;
+  case IR_DIV:
+    if (b == 0) return 0;
+    *result = DIVIDE_WORDS(a, b);
+    return 1;
+  case IR_NEG: *result = (WORD) (0u - (unsigned) a); return 1;
+  case IR_EQ: *result = (a == b); return 1;
+  case IR_NE: *result = (a != b); return 1;
+  case IR_GT: *result = (a > b); return 1;
+  case IR_LT: *result = (a < b); return 1;
+  case IR_GE: *result = (a >= b); return 1;
+  case IR_LE: *result = (a <= b); return 1;
+  default: return 0;
+  }
+}
+
+void visitInstruction(SCCP* s, int v) {
+  IRFunction* f = s->f;
+  IRInst* inst = f->insts + v;
+  IRBlock* b = f->blocks + inst->block;
+  Lattice* l;
+  Lattice* r;
+  WORD result;
+  int i, state;
+
+  switch (inst->op) {
+  case IR_CONST:
+    setLattice(s, v, LATTICE_CONST, inst->value);
+    return;
+
+  case IR_PHI:
+    for (i = 0; i < inst->argCount; i ++) {
+      if (!s->edges[inst->block][i]) continue;
+      l = s->values + inst->args[i];
+      if (l->state != LATTICE_TOP) setLattice(s, v, l->state, l->value);
+    }
+    return;
+
+  case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV: case IR_NEG:
+  case IR_EQ: case IR_NE: case IR_GT: case IR_LT: case IR_GE: case IR_LE:
+    l = s->values + inst->args[0];
+    r = (inst->argCount > 1) ? s->values + inst->args[1] : l;
+    if ((l->state == LATTICE_BOTTOM) || (r->state == LATTICE_BOTTOM))
+      setLattice(s, v, LATTICE_BOTTOM, 0);
+    else if ((l->state == LATTICE_CONST) && (r->state == LATTICE_CONST)) {
+      if (foldConstants(inst->op, l->value, r->value, &result))
+        setLattice(s, v, LATTICE_CONST, result);
+      else setLattice(s, v, LATTICE_BOTTOM, 0);
+    }
+    return;
+
+  case IR_CHECK:
+    l = s->values + inst->args[0];
+    if ((l->state == LATTICE_CONST) && ((l->value < 1) || (l->value > inst->value)))
+      setLattice(s, v, LATTICE_BOTTOM, 0);
+    else if (l->state != LATTICE_TOP)
+      setLattice(s, v, l->state, l->value);
+    return;
+
+  case IR_JUMP:
+    addFlowEdge(s, inst->block, b->succs[0]);
+    return;
+
+  case IR_BRANCH:
+    state = s->values[inst->args[0]].state;
+    if (state == LATTICE_BOTTOM) {
+      addFlowEdge(s, inst->block, b->succs[0]);
+      addFlowEdge(s, inst->block, b->succs[1]);
+    } else if (state == LATTICE_CONST)
+      addFlowEdge(s, inst->block, b->succs[(s->values[inst->args[0]].value != 0) ? 0 : 1]);
+    return;
+
+  default:
+    if (irHasValue(inst)) setLattice(s, v, LATTICE_BOTTOM, 0);
+    return;
+  }
+}
+
+void propagate(SCCP* s) {
+  IRFunction* f = s->f;
+  IRBlock* b;
+  int from, to, i, v, first, newEdge;
+
+  addFlowEdge(s, IR_NONE, 0);
+  while ((s->flowCount > 0) || (s->ssaCount > 0)) {
+    while (s->flowCount > 0) {
+      to = s->flowWork[-- s->flowCount];
+      from = s->flowWork[-- s->flowCount];
+      b = f->blocks + to;
+      first = !s->executable[to];
+      s->executable[to] = 1;
+      newEdge = 0;
+      for (i = 0; (from != IR_NONE) && (i < b->predCount); i ++)
+        if ((b->preds[i] == from) && !s->edges[to][i]) {
+          s->edges[to][i] = 1;
+          newEdge = 1;
+          break;
+        }
+      if (!first && !newEdge) continue;
+      // A new edge only changes the phis, unless the block is new too
+      for (i = 0; i < b->instCount; i ++)
+        if (first || (f->insts[b->insts[i]].op == IR_PHI))
+          visitInstruction(s, b->insts[i]);
+    }
+    while ((s->ssaCount > 0) && (s->flowCount == 0)) {
+      v = s->ssaWork[-- s->ssaCount];
+      for (i = s->userStarts[v]; i < s->userStarts[v + 1]; i ++)
+        if (s->executable[f->insts[s->users[i]].block])
+          visitInstruction(s, s->users[i]);
+    }
+  }
+}
+
+// Puts the constants in, folds the branches and drops what cannot run
+int rewriteConstants(SCCP* s) {
+  IRFunction* f = s->f;
+  // Room for a constant in place of every phi
+  int count = 2 * f->instCount + 1;
+  int* replacements = (int*) malloc(count * sizeof(int));
+  IRBlock* b;
+  IRInst* inst;
+  int changes = 0;
+  int i, j, v, c, phis;
+
+  for (i = 0; i < count; i ++)
+    replacements[i] = IR_NONE;
+
+  for (i = 0; i < f->blockCount; i ++) {
+    if (!s->executable[i]) continue;
+    b = f->blocks + i;
+    for (phis = 0; (phis < b->instCount) && (f->insts[b->insts[phis]].op == IR_PHI); phis ++);
+    for (j = 0; j < b->instCount; j ++) {
+      v = b->insts[j];
+      inst = f->insts + v;
+      if ((inst->op == IR_CONST) || (s->values[v].state != LATTICE_CONST)) continue;
+      changes ++;
+      if (inst->op != IR_PHI) {
+        // Folded in place
+        inst->op = IR_CONST;
+        inst->argCount = 0;
+        inst->value = s->values[v].value;
+        continue;
+      }
+      // A phi is replaced by a constant after the last of them
+      c = newInstruction(f, IR_CONST);
+      inst = f->insts + v;
+      f->insts[c].value = s->values[v].value;
+      f->insts[c].type = inst->type;
+      f->insts[c].lineNo = inst->lineNo;
+      insertInstruction(f, i, phis, c);
+      replacements[v] = c;
+      removeInstruction(f, v);
+    }
+  }
+  replaceUses(f, replacements);
+  free(replacements);
+  compactBlocks(f);
+
+  // A branch on a constant keeps the edge it takes
+  for (i = 0; i < f->blockCount; i ++) {
+    if (!s->executable[i]) continue;
+    v = terminatorOf(f, i);
+    if ((v == IR_NONE) || (f->insts[v].op != IR_BRANCH)) continue;
+    inst = f->insts + v;
+    if (f->insts[inst->args[0]].op != IR_CONST) continue;
+    c = f->blocks[i].succs[(f->insts[inst->args[0]].value != 0) ? 1 : 0];
+    inst->op = IR_JUMP;
+    inst->argCount = 0;
+    removeEdge(f, i, c);
+    changes ++;
+  }
+
+  changes += removeUnreachableBlocks(f);
+  changes += simplifyPhis(f);
+  return changes;
+}
+
+int propagateConstants(IRFunction* f) {
+  SCCP s;
+  int i, changes;
+
+  s.f = f;
+  s.values = (Lattice*) calloc(f->instCount + 1, sizeof(Lattice));
+  s.executable = (char*) calloc(f->blockCount + 1, 1);
+  s.edges = (char**) malloc((f->blockCount + 1) * sizeof(char*));
+  for (i = 0; i < f->blockCount; i ++)
+    s.edges[i] = (char*) calloc(f->blocks[i].predCount + 1, 1);
+  s.flowWork = s.ssaWork = NULL;
+  s.flowCount = s.maxFlow = s.ssaCount = s.maxSSA = 0;
+  buildUsers(&s);
+
+  propagate(&s);
+  changes = rewriteConstants(&s);
+
+  for (i = 0; i < f->blockCount; i ++)
+    free(s.edges[i]);
+  free(s.edges);
+  free(s.values);
+  free(s.executable);
+  free(s.userStarts);
+  free(s.users);
+  free(s.flowWork);
+  free(s.ssaWork);
+  return changes;
+}
@@ -0,0 +1,84 @@
+/* 
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "semantics.h"
+#include "error.h"
+
+extern SymTab* symtab;
+extern Token* currentToken;
+
+Object* checkDeclaredIdent(char *name) {
+  Object* obj = lookupObject(name);
+  if (obj == NULL)
+    error(ERR_UNDECLARED_IDENT, currentToken->lineNo, currentToken->colNo);
+  return obj;
+}
+
+Object* checkDeclaredConstant(char *name) {
+  Object* obj = lookupObject(name);
+  if (obj == NULL)
+    error(ERR_UNDECLARED_CONSTANT, currentToken->lineNo, currentToken->colNo);
+  if (obj->kind != OBJ_CONSTANT)
+    error(ERR_INVALID_CONSTANT, currentToken->lineNo, currentToken->colNo);
+  return obj;
+}
+
+Object* checkDeclaredProcedure(char *name) {
+  Object* obj = lookupObject(name);
+  if (obj == NULL)
+    error(ERR_UNDECLARED_PROCEDURE, currentToken->lineNo, currentToken->colNo);
+  if (obj->kind != OBJ_PROCEDURE)
+    error(ERR_INVALID_PROCEDURE, currentToken->lineNo, currentToken->colNo);
+  return obj;
+}
+
+Object* checkDeclaredLValueIdent(char *name) {
+  Object* obj = lookupObject(name);
+  Scope* scope;
+
+  if (obj == NULL)
+    error(ERR_UNDECLARED_IDENT, currentToken->lineNo, currentToken->colNo);
+
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+  case OBJ_PARAMETER:
+    break;
+  case OBJ_FUNCTION:
+    // A function name is an lvalue only inside the function itself,
+    // where assigning to it sets the return value
+    scope = symtab->currentScope;
+    while ((scope != NULL) && (scope->owner != obj))
+      scope = scope->outer;
+    if (scope == NULL)
+      error(ERR_INVALID_LVALUE, currentToken->lineNo, currentToken->colNo);
+    break;
+  default:
+    error(ERR_INVALID_LVALUE, currentToken->lineNo, currentToken->colNo);
+  }
+  return obj;
+}
+
+void checkIntType(Type* type) {
+  if ((type == NULL) || (type->typeClass != TP_INT))
+    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+}
+
+void checkBasicType(Type* type) {
+  if ((type == NULL) || ((type->typeClass != TP_INT) && (type->typeClass != TP_CHAR)))
+    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+}
+
+void checkArrayType(Type* type) {
+  if ((type == NULL) || (type->typeClass != TP_ARRAY))
+    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+}
+
+void checkTypeEquality(Type* type1, Type* type2) {
+  if (compareType(type1, type2) == 0)
+    error(ERR_TYPE_INCONSISTENCY, currentToken->lineNo, currentToken->colNo);
+}
@@ -0,0 +1,22 @@
+/* 
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __SEMANTICS_H__
+#define __SEMANTICS_H__
+
+#include "symtab.h"
+
+Object* checkDeclaredIdent(char *name);
+Object* checkDeclaredConstant(char *name);
+Object* checkDeclaredProcedure(char *name);
+Object* checkDeclaredLValueIdent(char *name);
+
+void checkIntType(Type* type);
+void checkBasicType(Type* type);
+void checkArrayType(Type* type);
+void checkTypeEquality(Type* type1, Type* type2);
+
+#endif
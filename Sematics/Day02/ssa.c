@@ -0,0 +1,315 @@
+/* Construction of the SSA form
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "passes.h"
+
+/* A slot is promoted to values when it holds a single word and is only
+   ever read or written in place: no subprogram nested in the owner
+   reaches it, and its address goes nowhere else. Every load then takes
+   the value of the last store before it, found by walking back along the
+   predecessors, with a phi where they disagree (Braun et al., "Simple
+   and Efficient Construction of Static Single Assignment Form"). */
+
+struct SSABuilder_ {
+  IRFunction* f;
+  char* promotable;
+  int slotCount;
+  // Column of each promoted slot in the tables below, which only have
+  // columns for those: a frame is mostly arrays, which never are
+  int* columns;
+  int columnCount;
+  // The value of each slot at the end and on entry of each block
+  int* endDefs;
+  int* entryDefs;
+  int* replacements;
+  int maxReplacements;
+  // Phis and entry values made so far, put in their blocks at the end
+  int* created;
+  int* createdBlocks;
+  int createdCount;
+  int maxCreated;
+};
+
+typedef struct SSABuilder_ SSABuilder;
+
+int promotedSlot(SSABuilder* s, int address) {
+  IRInst* inst = s->f->insts + address;
+
+  if ((inst->op == IR_ADDR) && (inst->level == 0) && (inst->value >= 0) &&
+      (inst->value < s->slotCount) && s->promotable[inst->value])
+    return inst->value;
+  return IR_NONE;
+}
+
+void growReplacements(SSABuilder* s) {
+  int i;
+
+  if (s->f->instCount <= s->maxReplacements) return;
+  i = s->maxReplacements;
+  s->maxReplacements = 2 * s->f->instCount;
+  s->replacements = (int*) realloc(s->replacements, s->maxReplacements * sizeof(int));
+  for (; i < s->maxReplacements; i ++)
+    s->replacements[i] = IR_NONE;
+}
+
+int createValue(SSABuilder* s, int block, enum IROpCode op, int slot) {
+  IRFunction* f = s->f;
+  int inst = newInstruction(f, op);
+
+  f->insts[inst].value = slot;
+  f->insts[inst].type = (f->slotTypes[slot] != NULL) ? f->slotTypes[slot] : &irIntType;
+  f->insts[inst].isAddress = f->slotIsReference[slot];
+  growReplacements(s);
+
+  if (s->createdCount >= s->maxCreated) {
+    s->maxCreated = 2 * s->maxCreated + 8;
+    s->created = (int*) realloc(s->created, s->maxCreated * sizeof(int));
+    s->createdBlocks = (int*) realloc(s->createdBlocks, s->maxCreated * sizeof(int));
+  }
+  s->createdBlocks[s->createdCount] = block;
+  s->created[s->createdCount ++] = inst;
+  return inst;
+}
+
+int readAtEntry(SSABuilder* s, int block, int slot);
+
+int readAtEnd(SSABuilder* s, int block, int slot) {
+  int value = s->endDefs[block * s->columnCount + s->columns[slot]];
+
+  return (value != IR_NONE) ? value : readAtEntry(s, block, slot);
+}
+
+int readAtEntry(SSABuilder* s, int block, int slot) {
+  IRBlock* b = s->f->blocks + block;
+  int* def = s->entryDefs + block * s->columnCount + s->columns[slot];
+  int phi, i, value;
+
+  if (*def != IR_NONE) return *def;
+
+  if ((block == 0) || (b->predCount == 0))
+    *def = createValue(s, block, IR_ENTRY, slot);
+  else if (b->predCount == 1)
+    *def = readAtEnd(s, b->preds[0], slot);
+  else {
+    // Recorded first, so that loops find it on their way back
+    phi = createValue(s, block, IR_PHI, slot);
+    *def = phi;
+    for (i = 0; i < b->predCount; i ++) {
+      value = readAtEnd(s, s->f->blocks[block].preds[i], slot);
+      addArgument(s->f, phi, value);
+    }
+  }
+  return *def;
+}
+
+// A phi whose operands are all the same value, or itself, is that value
+int removeTrivialPhis(SSABuilder* s) {
+  IRFunction* f = s->f;
+  IRInst* phi;
+  int removed = 0, changed = 1;
+  int i, j, same, value;
+
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < s->createdCount; i ++) {
+      phi = f->insts + s->created[i];
+      if ((phi->op != IR_PHI) || (s->replacements[s->created[i]] != IR_NONE)) continue;
+      same = IR_NONE;
+      for (j = 0; j < phi->argCount; j ++) {
+        value = resolveValue(s->replacements, phi->args[j]);
+        if ((value == s->created[i]) || (value == same)) continue;
+        if (same != IR_NONE) break;
+        same = value;
+      }
+      if ((j == phi->argCount) && (same != IR_NONE)) {
+        s->replacements[s->created[i]] = same;
+        removed ++;
+        changed = 1;
+      }
+    }
+  }
+  return removed;
+}
+
+// Which slots the subprograms nested in each subprogram reach
+char** findEscapingSlots(IRProgram* program) {
+  char** escaping = (char**) malloc(program->count * sizeof(char*));
+  IRFunction* g;
+  IRFunction* owner;
+  IRInst* inst;
+  int i, j, k, o;
+
+  for (i = 0; i < program->count; i ++)
+    escaping[i] = (char*) calloc(program->functions[i]->slotCount + 1, 1);
+
+  for (i = 0; i < program->count; i ++) {
+    g = program->functions[i];
+    for (j = 0; j < g->instCount; j ++) {
+      inst = g->insts + j;
+      if ((inst->block == IR_NONE) || (inst->op != IR_ADDR) || (inst->level == 0)) continue;
+      o = i;
+      for (k = 0; (k < inst->level) && (o != IR_NONE); k ++)
+        o = program->functions[o]->parent;
+      if (o == IR_NONE) continue;
+      owner = program->functions[o];
+      if ((inst->value >= 0) && (inst->value < owner->slotCount))
+        escaping[o][inst->value] = 1;
+    }
+  }
+  return escaping;
+}
+
+// One round of promotion; returns the number of slots promoted
+// Stops the compiler when a table the promotion needs cannot be had
+void* allocateTable(IRFunction* f, long long count, int size) {
+  void* table = ((count > 0) && (count <= INT_MAX / size)) ? malloc(count * size) : NULL;
+
+  if (table == NULL) {
+    fprintf(stderr, "kplc: not enough memory to promote the variables of %s\n", f->name);
+    exit(EXIT_FAILURE);
+  }
+  return table;
+}
+
+int promoteRound(IRFunction* f, char* escaping) {
+  SSABuilder s;
+  IRBlock* b;
+  IRInst* inst;
+  int* current;
+  char* used;
+  int count = 0;
+  int i, j, k, slot, v;
+
+  s.f = f;
+  s.slotCount = f->slotCount;
+  s.promotable = (char*) malloc(f->slotCount + 1);
+  for (i = 0; i < f->slotCount; i ++)
+    s.promotable[i] = !f->slotIsArray[i] && !escaping[i] &&
+      ((i == RETURN_VALUE_OFFSET) || (i >= RESERVED_WORDS));
+
+  // An address used other than for a load or a store lets the slot escape
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if (inst->block == IR_NONE) continue;
+    for (j = 0; j < inst->argCount; j ++) {
+      slot = promotedSlot(&s, inst->args[j]);
+      if ((slot != IR_NONE) && !((j == 0) && ((inst->op == IR_LOAD) || (inst->op == IR_STORE))))
+        s.promotable[slot] = 0;
+    }
+  }
+  // Only slots that are actually used are worth the work
+  used = (char*) calloc(f->slotCount + 1, 1);
+  for (i = 0; i < f->instCount; i ++) {
+    inst = f->insts + i;
+    if ((inst->block == IR_NONE) || ((inst->op != IR_LOAD) && (inst->op != IR_STORE))) continue;
+    slot = promotedSlot(&s, inst->args[0]);
+    if (slot != IR_NONE) used[slot] = 1;
+  }
+  for (i = 0; i < f->slotCount; i ++) {
+    s.promotable[i] = s.promotable[i] && used[i];
+    count += s.promotable[i];
+  }
+  free(used);
+  if (count == 0) {
+    free(s.promotable);
+    return 0;
+  }
+
+  s.columns = (int*) allocateTable(f, f->slotCount, sizeof(int));
+  s.columnCount = 0;
+  for (i = 0; i < f->slotCount; i ++)
+    s.columns[i] = s.promotable[i] ? s.columnCount ++ : IR_NONE;
+  s.endDefs = (int*) allocateTable(f, (long long) f->blockCount * count, sizeof(int));
+  s.entryDefs = (int*) allocateTable(f, (long long) f->blockCount * count, sizeof(int));
+  for (i = 0; i < f->blockCount * count; i ++)
+    s.endDefs[i] = s.entryDefs[i] = IR_NONE;
+  s.replacements = NULL;
+  s.maxReplacements = 0;
+  growReplacements(&s);
+  s.created = NULL;
+  s.createdBlocks = NULL;
+  s.createdCount = 0;
+  s.maxCreated = 0;
+
+  // The last store of every block
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    for (j = 0; j < b->instCount; j ++) {
+      inst = f->insts + b->insts[j];
+      if (inst->op != IR_STORE) continue;
+      slot = promotedSlot(&s, inst->args[0]);
+      if (slot != IR_NONE) s.endDefs[i * count + s.columns[slot]] = inst->args[1];
+    }
+  }
+
+  // Loads take the value of the store before them
+  current = (int*) allocateTable(f, count, sizeof(int));
+  for (i = 0; i < f->blockCount; i ++) {
+    b = f->blocks + i;
+    for (k = 0; k < count; k ++)
+      current[k] = IR_NONE;
+    for (j = 0; j < b->instCount; j ++) {
+      v = f->blocks[i].insts[j];
+      inst = f->insts + v;
+      if ((inst->op != IR_LOAD) && (inst->op != IR_STORE)) continue;
+      slot = promotedSlot(&s, inst->args[0]);
+      if (slot == IR_NONE) continue;
+      if (inst->op == IR_STORE)
+        current[s.columns[slot]] = inst->args[1];
+      else if (current[s.columns[slot]] != IR_NONE)
+        s.replacements[v] = current[s.columns[slot]];
+      else s.replacements[v] = readAtEntry(&s, i, slot);
+      removeInstruction(f, v);
+    }
+  }
+  free(current);
+
+  removeTrivialPhis(&s);
+  for (i = 0; i < s.createdCount; i ++) {
+    v = s.created[i];
+    if (s.replacements[v] != IR_NONE) continue;
+    insertInstruction(f, s.createdBlocks[i], 0, v);
+  }
+  replaceUses(f, s.replacements);
+
+  // The addresses of the promoted slots are not used any more
+  for (i = 0; i < f->instCount; i ++)
+    if ((f->insts[i].block != IR_NONE) && (promotedSlot(&s, i) != IR_NONE))
+      removeInstruction(f, i);
+  compactBlocks(f);
+
+  free(s.promotable);
+  free(s.columns);
+  free(s.endDefs);
+  free(s.entryDefs);
+  free(s.replacements);
+  free(s.created);
+  free(s.createdBlocks);
+  return count;
+}
+
+int promoteSlots(IRProgram* program) {
+  char** escaping = findEscapingSlots(program);
+  int promoted = 0;
+  int i, count;
+
+  // Promoting the temporaries of a block can bring the address of a
+  // variable straight to its loads, so it goes on until nothing changes
+  for (i = 0; i < program->count; i ++)
+    do {
+      count = promoteRound(program->functions[i], escaping[i]);
+      promoted += count;
+    } while (count > 0);
+
+  for (i = 0; i < program->count; i ++)
+    free(escaping[i]);
+  free(escaping);
+  return promoted;
+}
@@ -0,0 +1,202 @@
+/* Instruction bodies of the superinstructions
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ *
+ * Written by supergen from the profile of the training programs, run
+ * make superops to write it again. Included by each dispatcher of
+ * vm.c after vmops.h, with the same OP and NEXT.
+ */
+
+OP(VM_SUPER_0)
+  // CV
+  s[t + 1] = s[t];
+  t ++;
+  // LI
+  inst = pc ++;
+  s[t] = s[s[t]];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  NEXT;
+
+OP(VM_SUPER_1)
+  // LV
+  s[t + 1] = s[display[inst->p] + inst->q];
+  t ++;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  // LV
+  inst = pc ++;
+  s[t + 1] = s[display[inst->p] + inst->q];
+  t ++;
+  NEXT;
+
+OP(VM_SUPER_2)
+  // AD
+  t --;
+  s[t] += s[t + 1];
+  // LV
+  inst = pc ++;
+  s[t + 1] = s[display[inst->p] + inst->q];
+  t ++;
+  // SB
+  inst = pc ++;
+  t --;
+  s[t] -= s[t + 1];
+  NEXT;
+
+OP(VM_SUPER_3)
+  // AD
+  t --;
+  s[t] += s[t + 1];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  NEXT;
+
+OP(VM_SUPER_4)
+  // CK
+  if ((s[t] < 1) || (s[t] > inst->q)) goto indexOutOfRange;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  NEXT;
+
+OP(VM_SUPER_5)
+  // LV_LOCAL
+  s[t + 1] = s[b + inst->q];
+  t ++;
+  // CK
+  inst = pc ++;
+  if ((s[t] < 1) || (s[t] > inst->q)) goto indexOutOfRange;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  NEXT;
+
+OP(VM_SUPER_6)
+  // LA_LOCAL
+  s[++t] = b + inst->q;
+  // LV_LOCAL
+  inst = pc ++;
+  s[t + 1] = s[b + inst->q];
+  t ++;
+  // CK
+  inst = pc ++;
+  if ((s[t] < 1) || (s[t] > inst->q)) goto indexOutOfRange;
+  NEXT;
+
+OP(VM_SUPER_7)
+  // LC
+  s[++t] = inst->q;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  // ST
+  inst = pc ++;
+  s[s[t - 1]] = s[t];
+  t -= 2;
+  NEXT;
+
+OP(VM_SUPER_8)
+  // AD
+  t --;
+  s[t] += s[t + 1];
+  // ST
+  inst = pc ++;
+  s[s[t - 1]] = s[t];
+  t -= 2;
+  // J
+  inst = pc ++;
+  pc = code + inst->q;
+  BACK_EDGE(inst->q);
+  NEXT;
+
+OP(VM_SUPER_9)
+  // LC
+  s[++t] = inst->q;
+  // LE
+  inst = pc ++;
+  t --;
+  s[t] = (s[t] <= s[t + 1]);
+  // FJ
+  inst = pc ++;
+  if (s[t--] == 0)
+    pc = code + inst->q;
+  NEXT;
+
+OP(VM_SUPER_10)
+  // LI
+  s[t] = s[s[t]];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  // LE
+  inst = pc ++;
+  t --;
+  s[t] = (s[t] <= s[t + 1]);
+  NEXT;
+
+OP(VM_SUPER_11)
+  // LI
+  s[t] = s[s[t]];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  NEXT;
+
+OP(VM_SUPER_12)
+  // CV
+  s[t + 1] = s[t];
+  t ++;
+  // CV
+  inst = pc ++;
+  s[t + 1] = s[t];
+  t ++;
+  // LI
+  inst = pc ++;
+  s[t] = s[s[t]];
+  NEXT;
+
+OP(VM_SUPER_13)
+  // LC
+  s[++t] = inst->q;
+  // AD
+  inst = pc ++;
+  t --;
+  s[t] += s[t + 1];
+  NEXT;
+
+OP(VM_SUPER_14)
+  // CV
+  s[t + 1] = s[t];
+  t ++;
+  // LI
+  inst = pc ++;
+  s[t] = s[s[t]];
+  NEXT;
+
+OP(VM_SUPER_15)
+  // LI
+  s[t] = s[s[t]];
+  // LC
+  inst = pc ++;
+  s[++t] = inst->q;
+  NEXT;
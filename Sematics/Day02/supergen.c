@@ -0,0 +1,273 @@
+/* Generator of the superinstructions of the KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Reads the profile kplvm -profile prints, summed over any number of
+   runs, from the standard input: a count and two or three opcodes to a
+   line. The sequences that would save the most dispatches become
+   superinstructions, whose handlers run the bodies of vmops.h one after
+   the other. Only the last of them may change pc. Writes the table of
+   the sequences and the handlers, included by vm.c:
+     supergen vmops.h superops.h superbodies.h < profile */
+
+#define MAX_SUPER_OPCODES 16
+#define MAX_SUPER_LENGTH 3
+#define MAX_NAME 16
+#define MAX_LINE 256
+#define MAX_BODIES 64
+#define MAX_BODY_LINES 16
+
+struct Sequence_ {
+  char names[MAX_SUPER_LENGTH][MAX_NAME];
+  int length;
+  long long count;
+};
+
+typedef struct Sequence_ Sequence;
+
+// The lines of an instruction body of vmops.h, without its NEXT
+struct Body_ {
+  char name[MAX_NAME + 4];
+  char* lines[MAX_BODY_LINES];
+  int lineCount;
+  // Whether it ends with NEXT, and whether it may jump
+  int next;
+  int jumps;
+};
+
+typedef struct Body_ Body;
+
+Body bodies[MAX_BODIES];
+int bodyCount = 0;
+
+Sequence* sequences = NULL;
+int sequenceCount = 0;
+int maxSequences = 0;
+
+/******************************************************************/
+
+int readBodies(char* fileName) {
+  FILE* f = fopen(fileName, "r");
+  char line[MAX_LINE];
+  char* text;
+  char* end;
+  Body* body = NULL;
+
+  if (f == NULL) return 0;
+  while (fgets(line, MAX_LINE, f) != NULL) {
+    if (strncmp(line, "OP(", 3) == 0) {
+      if (bodyCount == MAX_BODIES) break;
+      body = bodies + bodyCount ++;
+      end = strchr(line, ')');
+      if (end != NULL) *end = '\0';
+      strncpy(body->name, line + 3, sizeof(body->name) - 1);
+      body->name[sizeof(body->name) - 1] = '\0';
+      body->lineCount = 0;
+      body->next = 0;
+      body->jumps = 0;
+      continue;
+    }
+    if ((body == NULL) || body->next) continue;
+    for (text = line; (*text == ' ') || (*text == '\t'); text ++);
+    if (strncmp(text, "NEXT;", 5) == 0) {
+      body->next = 1;
+      continue;
+    }
+    if (body->lineCount == MAX_BODY_LINES) continue;
+    if (strstr(text, "pc =") != NULL) body->jumps = 1;
+    body->lines[body->lineCount ++] = strdup(line);
+  }
+  fclose(f);
+  return 1;
+}
+
+// The body of an opcode as the profile names it, LV or LV_LOCAL say
+Body* findBody(char* name) {
+  char symbol[MAX_NAME + 4];
+  int i;
+
+  sprintf(symbol, "%s_%s", (strstr(name, "_LOCAL") != NULL) ? "VM" : "OP", name);
+  for (i = 0; i < bodyCount; i ++)
+    if (strcmp(bodies[i].name, symbol) == 0) return bodies + i;
+  return NULL;
+}
+
+int isFusable(Sequence* sequence) {
+  Body* body;
+  int i;
+
+  for (i = 0; i < sequence->length; i ++) {
+    body = findBody(sequence->names[i]);
+    if ((body == NULL) || !body->next) return 0;
+    if (body->jumps && (i < sequence->length - 1)) return 0;
+  }
+  return 1;
+}
+
+void addSequence(char names[][MAX_NAME], int length, long long count) {
+  Sequence* sequence;
+  int i, k;
+
+  for (i = 0; i < sequenceCount; i ++) {
+    if (sequences[i].length != length) continue;
+    for (k = 0; (k < length) && (strcmp(sequences[i].names[k], names[k]) == 0); k ++);
+    if (k == length) {
+      sequences[i].count += count;
+      return;
+    }
+  }
+  if (sequenceCount == maxSequences) {
+    maxSequences = (maxSequences == 0) ? 256 : 2 * maxSequences;
+    sequences = (Sequence*) realloc(sequences, maxSequences * sizeof(Sequence));
+  }
+  sequence = sequences + sequenceCount ++;
+  for (k = 0; k < length; k ++)
+    strcpy(sequence->names[k], names[k]);
+  sequence->length = length;
+  sequence->count = count;
+}
+
+void readProfile(FILE* f) {
+  char line[MAX_LINE];
+  char names[MAX_SUPER_LENGTH][MAX_NAME];
+  long long count;
+  int n;
+
+  while (fgets(line, MAX_LINE, f) != NULL) {
+    n = sscanf(line, "%lld %15s %15s %15s", &count, names[0], names[1], names[2]);
+    if (n >= 3) addSequence(names, n - 1, count);
+  }
+}
+
+// Dispatches a sequence saves: all but one of its instructions
+long long savings(Sequence* sequence) {
+  return sequence->count * (sequence->length - 1);
+}
+
+int bySavings(const void* a, const void* b) {
+  long long x = savings((Sequence*) a);
+  long long y = savings((Sequence*) b);
+
+  return (x < y) ? 1 : (x > y) ? -1 : 0;
+}
+
+// The longest first, so that they are tried before their prefixes
+int byLength(const void* a, const void* b) {
+  int d = ((Sequence*) b)->length - ((Sequence*) a)->length;
+
+  return (d != 0) ? d : bySavings(a, b);
+}
+
+/******************************************************************/
+
+void writeHeader(FILE* f, char* title, char* note) {
+  fprintf(f, "/* %s\n", title);
+  fprintf(f, " * @copyright (c) 2008, Hedspi, Hanoi University of Technology\n");
+  fprintf(f, " * @author Huu-Duc Nguyen\n");
+  fprintf(f, " * @version 1.0\n");
+  fprintf(f, " *\n");
+  fprintf(f, " * Written by supergen from the profile of the training programs, run\n");
+  fprintf(f, " * make superops to write it again. %s\n", note);
+  fprintf(f, " */\n\n");
+}
+
+void writeSymbol(FILE* f, char* name) {
+  fprintf(f, "%s_%s", (strstr(name, "_LOCAL") != NULL) ? "VM" : "OP", name);
+}
+
+int writeTable(char* fileName, Sequence* chosen, int count) {
+  FILE* f = fopen(fileName, "w");
+  int i, k;
+
+  if (f == NULL) return 0;
+  writeHeader(f, "Superinstructions of the KPL virtual machine", "Needs NUM_OF_VM_OPCODES.");
+  fprintf(f, "#ifndef __SUPEROPS_H__\n#define __SUPEROPS_H__\n\n");
+  fprintf(f, "#define NUM_OF_SUPER_OPCODES %d\n#define MAX_SUPER_LENGTH %d\n\n", count, MAX_SUPER_LENGTH);
+  for (i = 0; i < count; i ++)
+    fprintf(f, "#define VM_SUPER_%d (NUM_OF_VM_OPCODES + %d)\n", i, i);
+
+  fprintf(f, "\n// Handlers of the threaded dispatchers, after those of the other opcodes\n");
+  fprintf(f, "#define SUPER_LABELS");
+  for (i = 0; i < count; i ++)
+    fprintf(f, " \\\n    , &&L_VM_SUPER_%d", i);
+
+  fprintf(f, "\n\n// The sequence each one runs, with the times it ran in the profile\n");
+  fprintf(f, "#define SUPER_SEQUENCES {");
+  for (i = 0; i < count; i ++) {
+    fprintf(f, " \\\n    {%d, {", chosen[i].length);
+    for (k = 0; k < chosen[i].length; k ++) {
+      if (k > 0) fprintf(f, ", ");
+      writeSymbol(f, chosen[i].names[k]);
+    }
+    fprintf(f, "}}%s  /* %lld */", (i < count - 1) ? "," : "", chosen[i].count);
+  }
+  fprintf(f, " \\\n  }\n\n#endif\n");
+  fclose(f);
+  return 1;
+}
+
+int writeBodies(char* fileName, Sequence* chosen, int count) {
+  FILE* f = fopen(fileName, "w");
+  Body* body;
+  int i, k, j;
+
+  if (f == NULL) return 0;
+  writeHeader(f, "Instruction bodies of the superinstructions",
+              "Included by each dispatcher of\n * vm.c after vmops.h, with the same OP and NEXT.");
+  for (i = 0; i < count; i ++) {
+    fprintf(f, "%sOP(VM_SUPER_%d)\n", (i > 0) ? "\n" : "", i);
+    for (k = 0; k < chosen[i].length; k ++) {
+      body = findBody(chosen[i].names[k]);
+      fprintf(f, "  // %s\n", chosen[i].names[k]);
+      if (k > 0) fprintf(f, "  inst = pc ++;\n");
+      for (j = 0; j < body->lineCount; j ++)
+        fputs(body->lines[j], f);
+    }
+    fprintf(f, "  NEXT;\n");
+  }
+  fclose(f);
+  return 1;
+}
+
+int main(int argc, char* argv[]) {
+  char line[MAX_LINE];
+  int count = 0;
+  int i;
+
+  if (argc != 4) {
+    printf("usage: supergen vmops.h superops.h superbodies.h < profile\n");
+    return -1;
+  }
+  if (!readBodies(argv[1])) {
+    printf("supergen: can\'t read %s!\n", argv[1]);
+    return -1;
+  }
+  readProfile(stdin);
+
+  qsort(sequences, sequenceCount, sizeof(Sequence), bySavings);
+  for (i = 0; (i < sequenceCount) && (count < MAX_SUPER_OPCODES); i ++)
+    if (isFusable(sequences + i))
+      sequences[count ++] = sequences[i];
+  if (count == 0) {
+    printf("supergen: nothing to fuse in the profile!\n");
+    return -1;
+  }
+  qsort(sequences, count, sizeof(Sequence), byLength);
+
+  if (!writeTable(argv[2], sequences, count) || !writeBodies(argv[3], sequences, count)) {
+    printf("supergen: can\'t write the output files!\n");
+    return -1;
+  }
+  for (i = 0; i < count; i ++) {
+    sprintf(line, "%s %s %s", sequences[i].names[0], sequences[i].names[1],
+            (sequences[i].length > 2) ? sequences[i].names[2] : "");
+    printf("VM_SUPER_%-3d %-28s %12lld dispatches saved\n", i, line, savings(sequences + i));
+  }
+  return 0;
+}
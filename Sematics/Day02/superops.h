@@ -0,0 +1,72 @@
+/* Superinstructions of the KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ *
+ * Written by supergen from the profile of the training programs, run
+ * make superops to write it again. Needs NUM_OF_VM_OPCODES.
+ */
+
+#ifndef __SUPEROPS_H__
+#define __SUPEROPS_H__
+
+#define NUM_OF_SUPER_OPCODES 16
+#define MAX_SUPER_LENGTH 3
+
+#define VM_SUPER_0 (NUM_OF_VM_OPCODES + 0)
+#define VM_SUPER_1 (NUM_OF_VM_OPCODES + 1)
+#define VM_SUPER_2 (NUM_OF_VM_OPCODES + 2)
+#define VM_SUPER_3 (NUM_OF_VM_OPCODES + 3)
+#define VM_SUPER_4 (NUM_OF_VM_OPCODES + 4)
+#define VM_SUPER_5 (NUM_OF_VM_OPCODES + 5)
+#define VM_SUPER_6 (NUM_OF_VM_OPCODES + 6)
+#define VM_SUPER_7 (NUM_OF_VM_OPCODES + 7)
+#define VM_SUPER_8 (NUM_OF_VM_OPCODES + 8)
+#define VM_SUPER_9 (NUM_OF_VM_OPCODES + 9)
+#define VM_SUPER_10 (NUM_OF_VM_OPCODES + 10)
+#define VM_SUPER_11 (NUM_OF_VM_OPCODES + 11)
+#define VM_SUPER_12 (NUM_OF_VM_OPCODES + 12)
+#define VM_SUPER_13 (NUM_OF_VM_OPCODES + 13)
+#define VM_SUPER_14 (NUM_OF_VM_OPCODES + 14)
+#define VM_SUPER_15 (NUM_OF_VM_OPCODES + 15)
+
+// Handlers of the threaded dispatchers, after those of the other opcodes
+#define SUPER_LABELS \
+    , &&L_VM_SUPER_0 \
+    , &&L_VM_SUPER_1 \
+    , &&L_VM_SUPER_2 \
+    , &&L_VM_SUPER_3 \
+    , &&L_VM_SUPER_4 \
+    , &&L_VM_SUPER_5 \
+    , &&L_VM_SUPER_6 \
+    , &&L_VM_SUPER_7 \
+    , &&L_VM_SUPER_8 \
+    , &&L_VM_SUPER_9 \
+    , &&L_VM_SUPER_10 \
+    , &&L_VM_SUPER_11 \
+    , &&L_VM_SUPER_12 \
+    , &&L_VM_SUPER_13 \
+    , &&L_VM_SUPER_14 \
+    , &&L_VM_SUPER_15
+
+// The sequence each one runs, with the times it ran in the profile
+#define SUPER_SEQUENCES { \
+    {3, {OP_CV, OP_LI, OP_LC}},  /* 60126387 */ \
+    {3, {OP_LV, OP_AD, OP_LV}},  /* 40000000 */ \
+    {3, {OP_AD, OP_LV, OP_SB}},  /* 40000000 */ \
+    {3, {OP_AD, OP_LC, OP_AD}},  /* 35007295 */ \
+    {3, {OP_CK, OP_AD, OP_LC}},  /* 35007265 */ \
+    {3, {VM_LV_LOCAL, OP_CK, OP_AD}},  /* 35007092 */ \
+    {3, {VM_LA_LOCAL, VM_LV_LOCAL, OP_CK}},  /* 35006063 */ \
+    {3, {OP_LC, OP_AD, OP_ST}},  /* 33008523 */ \
+    {3, {OP_AD, OP_ST, OP_J}},  /* 30905012 */ \
+    {3, {OP_LC, OP_LE, OP_FJ}},  /* 30086917 */ \
+    {3, {OP_LI, OP_LC, OP_LE}},  /* 30083689 */ \
+    {3, {OP_LI, OP_LC, OP_AD}},  /* 30042737 */ \
+    {3, {OP_CV, OP_CV, OP_LI}},  /* 30042698 */ \
+    {2, {OP_LC, OP_AD}},  /* 68225531 */ \
+    {2, {OP_CV, OP_LI}},  /* 60126759 */ \
+    {2, {OP_LI, OP_LC}}  /* 60126485 */ \
+  }
+
+#endif
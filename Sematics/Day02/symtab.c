@@ -61,6 +61,18 @@ int compareType(Type* type1, Type* type2) {
   } else return 0;
 }
 
+// Size in stack words
+int sizeOfType(Type* type) {
+  switch (type->typeClass) {
+  case TP_INT:
+  case TP_CHAR:
+    return 1;
+  case TP_ARRAY:
+    return type->arraySize * sizeOfType(type->elementType);
+  }
+  return 0;
+}
+
 void freeType(Type* type) {
   switch (type->typeClass) {
   case TP_INT:
@@ -69,7 +81,7 @@ void freeType(Type* type) {
     break;
   case TP_ARRAY:
     freeType(type->elementType);
-    freeType(type);
+    free(type);
     break;
   }
 }
@@ -107,6 +119,7 @@ Scope* createScope(Object* owner, Scope* outer) {
   scope->objList = NULL;
   scope->owner = owner;
   scope->outer = outer;
+  scope->frameSize = RESERVED_WORDS;
   return scope;
 }
 
@@ -116,6 +129,7 @@ Object* createProgramObject(char *programName) {
   program->kind = OBJ_PROGRAM;
   program->progAttrs = (ProgramAttributes*) malloc(sizeof(ProgramAttributes));
   program->progAttrs->scope = createScope(program,NULL);
+  program->progAttrs->codeAddress = 0;
   symtab->program = program;
 
   return program;
@@ -152,6 +166,8 @@ Object* createFunctionObject(char *name) {
   obj->kind = OBJ_FUNCTION;
   obj->funcAttrs = (FunctionAttributes*) malloc(sizeof(FunctionAttributes));
   obj->funcAttrs->paramList = NULL;
+  obj->funcAttrs->paramCount = 0;
+  obj->funcAttrs->codeAddress = 0;
   obj->funcAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
@@ -162,6 +178,8 @@ Object* createProcedureObject(char *name) {
   obj->kind = OBJ_PROCEDURE;
   obj->procAttrs = (ProcedureAttributes*) malloc(sizeof(ProcedureAttributes));
   obj->procAttrs->paramList = NULL;
+  obj->procAttrs->paramCount = 0;
+  obj->procAttrs->codeAddress = 0;
   obj->procAttrs->scope = createScope(obj, symtab->currentScope);
   return obj;
 }
@@ -173,6 +191,7 @@ Object* createParameterObject(char *name, enum ParamKind kind, Object* owner) {
   obj->paramAttrs = (ParameterAttributes*) malloc(sizeof(ParameterAttributes));
   obj->paramAttrs->kind = kind;
   obj->paramAttrs->function = owner;
+  obj->paramAttrs->copyOffset = -1;
   return obj;
 }
 
@@ -269,6 +288,7 @@ void initSymTab(void) {
 
   symtab = (SymTab*) malloc(sizeof(SymTab));
   symtab->globalObjectList = NULL;
+  symtab->currentScope = NULL;
   
   obj = createFunctionObject("READC");
   obj->funcAttrs->returnType = makeCharType();
@@ -282,12 +302,14 @@ void initSymTab(void) {
   param = createParameterObject("i", PARAM_VALUE, obj);
   param->paramAttrs->type = makeIntType();
   addObject(&(obj->procAttrs->paramList),param);
+  obj->procAttrs->paramCount = 1;
   addObject(&(symtab->globalObjectList), obj);
 
   obj = createProcedureObject("WRITEC");
   param = createParameterObject("ch", PARAM_VALUE, obj);
   param->paramAttrs->type = makeCharType();
   addObject(&(obj->procAttrs->paramList),param);
+  obj->procAttrs->paramCount = 1;
   addObject(&(symtab->globalObjectList), obj);
 
   obj = createProcedureObject("WRITELN");
@@ -329,21 +351,54 @@ Object* lookupObject(char *name) {
 }
 
 void declareObject(Object* obj) {
-  if (obj->kind == OBJ_PARAMETER) {
-    Object* owner = symtab->currentScope->owner;
+  Object* owner;
+
+  switch (obj->kind) {
+  case OBJ_VARIABLE:
+    obj->varAttrs->localOffset = symtab->currentScope->frameSize;
+    symtab->currentScope->frameSize += sizeOfType(obj->varAttrs->type);
+    break;
+  case OBJ_PARAMETER:
+    // Parameters follow the reserved words, in declaration order
+    obj->paramAttrs->localOffset = symtab->currentScope->frameSize;
+    symtab->currentScope->frameSize ++;
+    owner = symtab->currentScope->owner;
     switch (owner->kind) {
     case OBJ_FUNCTION:
       addObject(&(owner->funcAttrs->paramList), obj);
+      owner->funcAttrs->paramCount ++;
       break;
     case OBJ_PROCEDURE:
       addObject(&(owner->procAttrs->paramList), obj);
+      owner->procAttrs->paramCount ++;
       break;
     default:
       break;
     }
+    break;
+  default:
+    break;
   }
  
   addObject(&(symtab->currentScope->objList), obj);
 }
 
+// The arrays among the value parameters of owner get room for a copy of
+// their own after the parameters, where the subprogram copies them on entry
+void declareParameterCopies(Object* owner) {
+  ObjectNode* node;
+  ParameterAttributes* param;
+
+  if (owner->kind == OBJ_FUNCTION) node = owner->funcAttrs->paramList;
+  else node = owner->procAttrs->paramList;
+
+  for (; node != NULL; node = node->next) {
+    param = node->object->paramAttrs;
+    if ((param->kind == PARAM_VALUE) && (param->type->typeClass == TP_ARRAY)) {
+      param->copyOffset = symtab->currentScope->frameSize;
+      symtab->currentScope->frameSize += sizeOfType(param->type);
+    }
+  }
+}
+
 
@@ -9,6 +9,14 @@
 
 #include "token.h"
 
+/* Every frame starts with four reserved words: the return value of a
+   function, the dynamic link, the return address and the static link */
+#define RESERVED_WORDS 4
+#define RETURN_VALUE_OFFSET 0
+#define DYNAMIC_LINK_OFFSET 1
+#define RETURN_ADDRESS_OFFSET 2
+#define STATIC_LINK_OFFSET 3
+
 enum TypeClass {
   TP_INT,
   TP_CHAR,
@@ -61,6 +69,7 @@ struct ConstantAttributes_ {
 struct VariableAttributes_ {
   Type *type;
   struct Scope_ *scope;
+  int localOffset;
 };
 
 struct TypeAttributes_ {
@@ -70,22 +79,30 @@ struct TypeAttributes_ {
 struct ProcedureAttributes_ {
   struct ObjectNode_ *paramList;
   struct Scope_* scope;
+  int paramCount;
+  int codeAddress;
 };
 
 struct FunctionAttributes_ {
   struct ObjectNode_ *paramList;
   Type* returnType;
   struct Scope_ *scope;
+  int paramCount;
+  int codeAddress;
 };
 
 struct ProgramAttributes_ {
   struct Scope_ *scope;
+  int codeAddress;
 };
 
 struct ParameterAttributes_ {
   enum ParamKind kind;
   Type* type;
   struct Object_ *function;
+  int localOffset;
+  // Where an array passed by value is copied in the frame, or -1
+  int copyOffset;
 };
 
 typedef struct ConstantAttributes_ ConstantAttributes;
@@ -123,6 +140,7 @@ struct Scope_ {
   ObjectNode *objList;
   Object *owner;
   struct Scope_ *outer;
+  int frameSize;
 };
 
 typedef struct Scope_ Scope;
@@ -140,6 +158,7 @@ Type* makeCharType(void);
 Type* makeArrayType(int arraySize, Type* elementType);
 Type* duplicateType(Type* type);
 int compareType(Type* type1, Type* type2);
+int sizeOfType(Type* type);
 void freeType(Type* type);
 
 ConstantValue* makeIntConstant(int i);
@@ -164,5 +183,6 @@ void enterBlock(Scope* scope);
 void exitBlock(void);
 Object* lookupObject(char *name);
 void declareObject(Object* obj);
+void declareParameterCopies(Object* owner);
 
 #endif
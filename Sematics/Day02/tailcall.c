@@ -0,0 +1,290 @@
+/* Tail calls
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "passes.h"
+
+/* A subprogram that calls itself and returns straight away, with the
+   value of the call for a function, has no use for its frame any more:
+   the call becomes a jump back to the start, after the arguments are put
+   in the place of the parameters. The start is a new block after the
+   entry with a phi for each parameter that is a value, and a store
+   does for the parameters still in memory. A call with the address of
+   a variable of its own frame keeps the frame, and so does a subprogram
+   with an array parameter that is a value, copied on entry.
+
+   With accumulators, a function returning x + F(...) or x * F(...)
+   loops as well: what the calls still had to add, or multiply by, is
+   kept in a phi of the start, and every return adds it to, or multiplies
+   it by, the value it returns. Both operators give the same result in
+   any order, wrap around included. */
+
+struct TailCall_ {
+  int block;
+  int call;
+  // The addition or multiplication of the call, or IR_NONE
+  int combine;
+  // The other operand of combine
+  int operand;
+};
+
+typedef struct TailCall_ TailCall;
+
+// Whether the address is in the frame of the subprogram itself
+int addressesOwnFrame(IRFunction* f, int v) {
+  IRInst* inst = f->insts + v;
+
+  while ((inst->op == IR_ADD) && inst->isAddress)
+    inst = f->insts + (f->insts[inst->args[0]].isAddress ? inst->args[0] : inst->args[1]);
+  switch (inst->op) {
+  case IR_ADDR:
+    return inst->level == 0;
+  case IR_ENTRY:
+  case IR_LOAD:
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+// Whether arrays passed by value are copied on entry, which the jump back skips
+int copiesParameters(IRFunction* f) {
+  ObjectNode* node;
+
+  for (node = f->scope->objList; node != NULL; node = node->next)
+    if ((node->object->kind == OBJ_PARAMETER) && (node->object->paramAttrs->copyOffset >= 0))
+      return 1;
+  return 0;
+}
+
+// What the function returns when control goes from pred to block
+int returnedValue(IRFunction* f, int block, int pred) {
+  int ret = terminatorOf(f, block);
+  IRInst* value;
+
+  if (f->insts[ret].argCount == 0) return IR_NONE;
+  value = f->insts + f->insts[ret].args[0];
+  if ((value->op == IR_PHI) && (value->block == block))
+    return value->args[predecessorIndex(f, block, pred)];
+  return f->insts[ret].args[0];
+}
+
+/* Fills the call at the end of pred when it is a tail call of the
+   subprogram self, returning through block. */
+int findTailCall(IRFunction* f, int self, int block, int pred, int accumulate, TailCall* site) {
+  IRBlock* b = f->blocks + pred;
+  IRBlock* r = f->blocks + block;
+  IRInst* inst;
+  IRInst* combine;
+  char* after;
+  int i, j, k, v, position, value;
+
+  if ((b->succCount != 1) || (f->insts[terminatorOf(f, pred)].op != IR_JUMP)) return 0;
+  for (i = 0; (i < r->instCount) && (f->insts[r->insts[i]].op == IR_PHI); i ++);
+  if (i != r->instCount - 1) return 0;
+
+  // The call, then only what could go without it
+  for (position = b->instCount - 2; position >= 0; position --) {
+    inst = f->insts + b->insts[position];
+    if (inst->op == IR_CALL) break;
+    if (!irOpCodeIsPure(inst->op)) return 0;
+  }
+  if (position < 0) return 0;
+  site->block = pred;
+  site->call = b->insts[position];
+  site->combine = site->operand = IR_NONE;
+  inst = f->insts + site->call;
+  if ((inst->callee != self) || (inst->argCount != f->paramCount)) return 0;
+  for (i = 0; i < inst->argCount; i ++)
+    if (f->insts[inst->args[i]].isAddress && addressesOwnFrame(f, inst->args[i])) return 0;
+
+  value = returnedValue(f, block, pred);
+  if ((f->kind == IR_FUNCTION) && (value != site->call)) {
+    combine = f->insts + value;
+    if (!accumulate || (combine->block != pred) ||
+        ((combine->op != IR_ADD) && (combine->op != IR_MUL)) || (combine->argCount != 2))
+      return 0;
+    if (combine->args[0] == site->call) k = 1;
+    else if (combine->args[1] == site->call) k = 0;
+    else return 0;
+    // The other operand has to be known before the call
+    v = combine->args[k];
+    if (f->insts[v].block == pred) {
+      for (j = 0; (j < position) && (b->insts[j] != v); j ++);
+      if (j == position) return 0;
+    }
+    site->combine = value;
+    site->operand = v;
+  }
+
+  // Nothing after the call is needed but for the return
+  after = (char*) calloc(f->instCount + 1, 1);
+  for (i = position; i < b->instCount; i ++)
+    after[b->insts[i]] = 1;
+  for (v = 0; v < f->instCount; v ++) {
+    inst = f->insts + v;
+    if ((inst->block == IR_NONE) || after[v] || (inst->block == block)) continue;
+    for (j = 0; j < inst->argCount; j ++)
+      if (after[inst->args[j]]) break;
+    if (j < inst->argCount) break;
+  }
+  free(after);
+  return v == f->instCount;
+}
+
+int emitCombination(IRFunction* f, int block, int op, int a, int b) {
+  int inst = newInstruction(f, (enum IROpCode) op);
+
+  insertInstruction(f, block, f->blocks[block].instCount - 1, inst);
+  f->insts[inst].type = &irIntType;
+  f->insts[inst].lineNo = f->insts[terminatorOf(f, block)].lineNo;
+  addArgument(f, inst, a);
+  addArgument(f, inst, b);
+  return inst;
+}
+
+int removeTailCalls(IRFunction* f, int self, int accumulate) {
+  TailCall* sites = (TailCall*) malloc((f->blockCount + 1) * sizeof(TailCall));
+  int siteCount = 0;
+  // The operator of the calls that combine, or IR_NONE
+  int op = IR_NONE;
+  int* params;
+  int* replacements;
+  IRBlock* b;
+  IRInst* call;
+  int start, acc, identity, value, address, store;
+  int i, j, k, v;
+
+  if (copiesParameters(f)) {
+    free(sites);
+    return 0;
+  }
+  computeDominators(f);
+  for (i = 0; i < f->blockCount; i ++) {
+    k = terminatorOf(f, i);
+    if ((k == IR_NONE) || (f->insts[k].op != IR_RETURN) || (f->blocks[i].idom == IR_NONE)) continue;
+    for (j = 0; j < f->blocks[i].predCount; j ++)
+      if (findTailCall(f, self, i, f->blocks[i].preds[j], accumulate, sites + siteCount)) {
+        // One operator for all the calls
+        v = sites[siteCount].combine;
+        if (v != IR_NONE) {
+          if ((op != IR_NONE) && (op != f->insts[v].op)) continue;
+          op = f->insts[v].op;
+        }
+        siteCount ++;
+      }
+  }
+  if (siteCount == 0) {
+    free(sites);
+    return 0;
+  }
+
+  // The new start, with the parameters that are values as phis
+  start = splitEdge(f, 0, 0);
+  params = (int*) malloc((f->paramCount + 1) * sizeof(int));
+  replacements = (int*) malloc((f->instCount + f->paramCount + 2) * sizeof(int));
+  for (i = 0; i < f->paramCount; i ++)
+    params[i] = IR_NONE;
+  for (v = 0; v < f->instCount; v ++) {
+    replacements[v] = IR_NONE;
+    k = f->insts[v].value - RESERVED_WORDS;
+    if ((f->insts[v].op != IR_ENTRY) || (f->insts[v].block == IR_NONE) ||
+        (k < 0) || (k >= f->paramCount))
+      continue;
+    params[k] = newInstruction(f, IR_PHI);
+    f->insts[params[k]].type = f->insts[v].type;
+    f->insts[params[k]].isAddress = f->insts[v].isAddress;
+    f->insts[params[k]].value = f->insts[v].value;
+    replacements[v] = params[k];
+  }
+  replaceUses(f, replacements);
+  for (v = 0; v < f->instCount; v ++)
+    if (replacements[v] != IR_NONE) {
+      insertInstruction(f, start, 0, replacements[v]);
+      addArgument(f, replacements[v], v);
+    }
+
+  acc = IR_NONE;
+  if (op != IR_NONE) {
+    identity = newInstruction(f, IR_CONST);
+    f->insts[identity].value = (op == IR_ADD) ? 0 : 1;
+    f->insts[identity].type = &irIntType;
+    insertInstruction(f, 0, f->blocks[0].instCount - 1, identity);
+    acc = newInstruction(f, IR_PHI);
+    f->insts[acc].type = &irIntType;
+    insertInstruction(f, start, 0, acc);
+    addArgument(f, acc, identity);
+  }
+
+  for (i = 0; i < siteCount; i ++) {
+    // The call and what came after it go, and the block jumps to the start
+    b = f->blocks + sites[i].block;
+    for (j = b->instCount - 2; b->insts[j] != sites[i].call; j --)
+      removeInstruction(f, b->insts[j]);
+    removeInstruction(f, sites[i].call);
+    compactBlocks(f);
+
+    call = f->insts + sites[i].call;
+    for (j = 0; j < call->argCount; j ++) {
+      call = f->insts + sites[i].call;
+      if (params[j] != IR_NONE) {
+        addArgument(f, params[j], call->args[j]);
+        continue;
+      }
+      address = newInstruction(f, IR_ADDR);
+      f->insts[address].value = RESERVED_WORDS + j;
+      f->insts[address].isAddress = 1;
+      f->insts[address].type = f->slotTypes[RESERVED_WORDS + j];
+      insertInstruction(f, sites[i].block, f->blocks[sites[i].block].instCount - 1, address);
+      store = newInstruction(f, IR_STORE);
+      insertInstruction(f, sites[i].block, f->blocks[sites[i].block].instCount - 1, store);
+      addArgument(f, store, address);
+      addArgument(f, store, f->insts[sites[i].call].args[j]);
+    }
+    if (acc != IR_NONE) {
+      value = (sites[i].combine == IR_NONE) ? acc :
+        emitCombination(f, sites[i].block, op, acc, resolveValue(replacements, sites[i].operand));
+      addArgument(f, acc, value);
+    }
+
+    removeEdge(f, sites[i].block, f->blocks[sites[i].block].succs[0]);
+    addEdge(f, sites[i].block, start);
+  }
+
+  // Every other return brings what the calls left to do
+  if (acc != IR_NONE)
+    for (i = 0; i < f->blockCount; i ++) {
+      k = terminatorOf(f, i);
+      if ((k == IR_NONE) || (f->insts[k].op != IR_RETURN) || (f->blocks[i].predCount == 0)) continue;
+      value = emitCombination(f, i, op, acc, f->insts[k].args[0]);
+      f->insts[terminatorOf(f, i)].args[0] = value;
+    }
+  removeUnreachableBlocks(f);
+  simplifyPhis(f);
+
+  free(sites);
+  free(params);
+  free(replacements);
+  return siteCount;
+}
+
+int runTailCalls(IRProgram* program, int accumulate) {
+  int changes = 0;
+  int i;
+
+  for (i = 1; i < program->count; i ++)
+    changes += removeTailCalls(program->functions[i], i, accumulate);
+  return changes;
+}
+
+int eliminateTailCalls(IRProgram* program) {
+  return runTailCalls(program, 0);
+}
+
+int introduceAccumulators(IRProgram* program) {
+  return runTailCalls(program, 1);
+}
@@ -0,0 +1,158 @@
+#!/bin/sh
+# Compiles every program of test/ and bench/ with kplc -S, links it with
+# the runtime and compares its output and exit status with kplvm's, and
+# kplvm's with NAME.out when the program has one checked in, then
+# does the same for the code compiled in place by kplc --run --jit, with
+# and without AVX2 vector loops, for tiered execution with a low
+# threshold, so that frames move, for the code of the optimizer, with
+# and without memoization, run by kplvm, for the code of the peephole
+# pass, run in tiers, for the C of kplc --emit-c compiled by gcc -O2 and
+# for the executable written by kplc --elf. A program reads NAME.in when
+# it exists. When NAME.report exists, the decisions kplc -O --memoize
+# --opt-report reports for the program, and for its loops under --jit,
+# must be those. The programs of reject/ must be refused with the
+# message of reject/NAME.err, and kplvm must refuse images with operands
+# out of range. Run from Sematics/Day02:
+#   make test
+
+DIR=`dirname $0`
+KPLC=./kplc
+KPLVM=./kplvm
+TMP=/tmp/kpltest.$$
+passed=0
+failed=0
+
+mkdir -p $TMP
+for src in $DIR/*.kpl $DIR/../bench/*.kpl; do
+  name=`basename $src .kpl`
+  input=`dirname $src`/$name.in
+  [ -f $input ] || input=/dev/null
+
+  if ! $KPLC $src $TMP/$name.kplb > /dev/null ||
+     ! $KPLC $src $TMP/$name.s -S > /dev/null ||
+     ! gcc -o $TMP/$name $TMP/$name.s kplrt.o; then
+    echo "FAIL $name: does not compile"
+    failed=`expr $failed + 1`
+    continue
+  fi
+
+  $KPLVM $TMP/$name.kplb < $input > $TMP/$name.expected
+  expected=$?
+  golden=`dirname $src`/$name.out
+  if [ -f $golden ]; then
+    if cmp -s $golden $TMP/$name.expected; then
+      echo "ok   $name (kplvm)"
+      passed=`expr $passed + 1`
+    else
+      echo "FAIL $name (kplvm): output differs from $name.out"
+      diff $golden $TMP/$name.expected | head -10
+      failed=`expr $failed + 1`
+    fi
+  fi
+  $TMP/$name < $input > $TMP/$name.out
+  status=$?
+
+  if [ $status -eq $expected ] && cmp -s $TMP/$name.expected $TMP/$name.out; then
+    echo "ok   $name"
+    passed=`expr $passed + 1`
+  else
+    echo "FAIL $name: exit status $status, expected $expected"
+    diff $TMP/$name.expected $TMP/$name.out | head -10
+    failed=`expr $failed + 1`
+  fi
+
+  for mode in jit sse2 tiered optimized memoized peephole c elf; do
+    if [ $mode = jit ]; then
+      $KPLC $src --run --jit < $input > $TMP/$name.$mode
+    elif [ $mode = sse2 ]; then
+      $KPLC $src --run --jit --no-avx2 < $input > $TMP/$name.$mode
+    elif [ $mode = tiered ]; then
+      $KPLC $src --run --tiered --threshold 3 < $input > $TMP/$name.$mode
+    elif [ $mode = optimized ]; then
+      $KPLC $src $TMP/$name.opt.kplb -O --verify-ir > /dev/null &&
+        $KPLVM $TMP/$name.opt.kplb < $input > $TMP/$name.$mode
+    elif [ $mode = peephole ]; then
+      $KPLC $src --run --tiered --threshold 3 --peephole < $input > $TMP/$name.$mode
+    elif [ $mode = c ]; then
+      $KPLC $src $TMP/$name.c --emit-c > /dev/null &&
+        gcc -O2 -o $TMP/$name.exe $TMP/$name.c &&
+        $TMP/$name.exe < $input > $TMP/$name.$mode
+    elif [ $mode = elf ]; then
+      $KPLC $src $TMP/$name.bin --elf > /dev/null &&
+        $TMP/$name.bin < $input > $TMP/$name.$mode
+    else
+      $KPLC $src $TMP/$name.opt.kplb --memoize --verify-ir > /dev/null &&
+        $KPLVM $TMP/$name.opt.kplb < $input > $TMP/$name.$mode
+    fi
+    status=$?
+    if [ $status -eq $expected ] && cmp -s $TMP/$name.expected $TMP/$name.$mode; then
+      echo "ok   $name ($mode)"
+      passed=`expr $passed + 1`
+    else
+      echo "FAIL $name ($mode): exit status $status, expected $expected"
+      diff $TMP/$name.expected $TMP/$name.$mode | head -10
+      failed=`expr $failed + 1`
+    fi
+  done
+done
+
+# Inlining, memoization, index check and vectorization decisions, against
+# those of NAME.report
+for report in $DIR/*.report; do
+  [ -f $report ] || continue
+  name=`basename $report .report`
+  input=$DIR/$name.in
+  [ -f $input ] || input=/dev/null
+  $KPLC $DIR/$name.kpl --run --jit -O --memoize --opt-report < $input 2>&1 > /dev/null |
+    grep -E '^(inline |memoize |index checks:|vectorize )' > $TMP/$name.report
+  if cmp -s $report $TMP/$name.report; then
+    echo "ok   $name (report)"
+    passed=`expr $passed + 1`
+  else
+    echo "FAIL $name (report): other decisions"
+    diff $report $TMP/$name.report | head -10
+    failed=`expr $failed + 1`
+  fi
+done
+
+# Programs kplc must refuse, with the message of reject/NAME.err
+for src in $DIR/reject/*.kpl; do
+  name=reject/`basename $src .kpl`
+  rm -f $TMP/rejected.kplb
+  $KPLC $src $TMP/rejected.kplb > $TMP/rejected.err
+  if [ ! -f $TMP/rejected.kplb ] && cmp -s $DIR/$name.err $TMP/rejected.err; then
+    echo "ok   $name"
+    passed=`expr $passed + 1`
+  else
+    echo "FAIL $name: not refused as expected"
+    diff $DIR/$name.err $TMP/rejected.err | head -10
+    failed=`expr $failed + 1`
+  fi
+done
+
+# Images of corrupt/base.kpl with one operand out of range, written over
+# as corrupt/patches says, which kplvm must refuse to load
+$KPLC $DIR/corrupt/base.kpl $TMP/base.kplb > /dev/null
+code=`od -An -t d4 -j 20 -N 4 $TMP/base.kplb`
+grep -v '^#' $DIR/corrupt/patches | while read address field value what; do
+  cp $TMP/base.kplb $TMP/corrupt.kplb
+  word=$(( value & 0xFFFFFFFF ))
+  bytes=""
+  for k in 0 1 2 3; do
+    bytes="$bytes\\`printf %03o $(( word & 255 ))`"
+    word=$(( word >> 8 ))
+  done
+  printf "$bytes" | dd of=$TMP/corrupt.kplb bs=1 seek=$(( code + 12 * address + 4 * field )) conv=notrunc 2> /dev/null
+  if [ "`$KPLVM $TMP/corrupt.kplb 2>&1`" = "kplvm: Invalid code." ]; then
+    echo "ok   corrupt ($what)"
+  else
+    echo "FAIL corrupt ($what): loaded"
+  fi
+done > $TMP/corrupt.out
+cat $TMP/corrupt.out
+passed=`expr $passed + \`grep -c '^ok' $TMP/corrupt.out\``
+failed=`expr $failed + \`grep -c '^FAIL' $TMP/corrupt.out\``
+rm -rf $TMP
+
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
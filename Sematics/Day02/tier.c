@@ -0,0 +1,273 @@
+/* Tiered execution of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tier.h"
+#include "vm.h"
+#include "regcode.h"
+#include "asmgen.h"
+#include "jit.h"
+
+#define PROMOTED_BY_CALL 0
+#define PROMOTED_BY_LOOP 1
+#define PROMOTED_AS_CALLEE 2
+
+struct TierProcedure_ {
+  char* name;
+  // Where the procedure starts and leaves in the stack code
+  int entry;
+  int exit;
+  // Transitions from the interpreter to its machine code
+  long long nativeEntries;
+  long long replacements;
+  int promoted;
+  int promotedBy;
+  int promotedAt;
+  double compileTime;
+};
+
+typedef struct TierProcedure_ TierProcedure;
+
+struct Tier_ {
+  CodeBlock* codeBlock;
+  RegCode* regCode;
+  NativeProgram* program;
+  TierProcedure* procedures;
+};
+
+typedef struct Tier_ Tier;
+
+/******************************************************************/
+
+// The first EP or EF reached from a subprogram entry
+int findExit(CodeBlock* codeBlock, int entry) {
+  char* visited = (char*) calloc(codeBlock->codeSize + 1, 1);
+  int* work = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  Instruction* inst;
+  int top = 0, address, exit = -1;
+
+  work[top ++] = entry;
+  while ((top > 0) && (exit < 0)) {
+    address = work[-- top];
+    while ((address >= 0) && (address < codeBlock->codeSize) && !visited[address]) {
+      visited[address] = 1;
+      inst = codeBlock->code + address;
+      if ((inst->op == OP_EP) || (inst->op == OP_EF)) {
+        exit = address;
+        break;
+      }
+      if (inst->op == OP_HL) break;
+      if (inst->op == OP_J) {
+        address = inst->q;
+        continue;
+      }
+      if (inst->op == OP_FJ)
+        work[top ++] = inst->q;
+      address ++;
+    }
+  }
+
+  free(visited);
+  free(work);
+  return exit;
+}
+
+// Line of the statement an instruction belongs to
+int lineOf(CodeBlock* codeBlock, int address) {
+  int i, lineNo = 0;
+
+  for (i = 0; (i < codeBlock->lineCount) && (codeBlock->lines[i].address <= address); i ++)
+    lineNo = codeBlock->lines[i].lineNo;
+  return lineNo;
+}
+
+Tier* createTier(CodeBlock* codeBlock, SymTab* symtab) {
+  Tier* tier;
+  RegCode* regCode = translateCode(codeBlock);
+  NativeProgram* program;
+  TierProcedure* proc;
+  char** names;
+  int* depths;
+  int i;
+
+  if (regCode == NULL) return NULL;
+  program = createNativeProgram(regCode);
+  if (program == NULL) {
+    freeRegCode(regCode);
+    return NULL;
+  }
+
+  tier = (Tier*) malloc(sizeof(Tier));
+  tier->codeBlock = codeBlock;
+  tier->regCode = regCode;
+  tier->program = program;
+  tier->procedures = (TierProcedure*) calloc(program->count, sizeof(TierProcedure));
+
+  names = (char**) calloc(regCode->codeSize + 1, sizeof(char*));
+  collectNames(symtab->program->progAttrs->scope, names, regCode);
+  for (i = 0; i < program->count; i ++) {
+    proc = tier->procedures + i;
+    proc->name = (i == 0) ? symtab->program->name : names[program->entries[i]];
+    proc->entry = (i == 0) ? 0 : -1;
+    proc->exit = -1;
+    proc->promotedAt = -1;
+  }
+  free(names);
+
+  // Subprograms are only known by their callers, and only reachable
+  // callers, since the others were not translated
+  depths = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  computeDepths(codeBlock, depths);
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    if ((codeBlock->code[i].op == OP_CALL) && (depths[i] != UNKNOWN_DEPTH) &&
+        (codeBlock->code[i].q >= 0) && (codeBlock->code[i].q < regCode->mapSize)) {
+      proc = tier->procedures + program->owners[regCode->addressMap[codeBlock->code[i].q]];
+      if (proc->entry < 0) {
+        proc->entry = codeBlock->code[i].q;
+        proc->exit = findExit(codeBlock, proc->entry);
+      }
+    }
+  free(depths);
+  return tier;
+}
+
+void freeTier(Tier* tier) {
+  freeNativeProgram(tier->program);
+  freeRegCode(tier->regCode);
+  free(tier->procedures);
+  free(tier);
+}
+
+/******************************************************************/
+
+int promote(VM* vm, int address) {
+  Tier* tier = (Tier*) vm->tier;
+  NativeProgram* program = tier->program;
+  TierProcedure* proc;
+  int target, owner, status, i;
+  char* compiled;
+  clock_t start;
+
+  if (address >= tier->regCode->mapSize) return TIER_INTERPRET;
+  target = tier->regCode->addressMap[address];
+  owner = program->owners[target];
+  if (owner < 0) return TIER_INTERPRET;
+  proc = tier->procedures + owner;
+  // The interpreter needs a way back from a subprogram
+  if ((owner > 0) && (proc->exit < 0)) {
+    vm->counters[address] = vm->threshold - (1 << 30);
+    return TIER_INTERPRET;
+  }
+
+  if (!proc->promoted) {
+    compiled = (char*) malloc(program->count);
+    for (i = 0; i < program->count; i ++)
+      compiled[i] = (program->buffers[i] != NULL);
+
+    start = clock();
+    if (!compileProcedure(program, owner)) {
+      free(compiled);
+      vm->counters[address] = vm->threshold - (1 << 30);
+      return TIER_INTERPRET;
+    }
+    proc->compileTime = (double) (clock() - start) / CLOCKS_PER_SEC;
+    proc->promotedBy = (address == proc->entry) ? PROMOTED_BY_CALL : PROMOTED_BY_LOOP;
+    proc->promotedAt = address;
+    for (i = 0; i < program->count; i ++)
+      if (!compiled[i] && (program->buffers[i] != NULL)) {
+        tier->procedures[i].promoted = 1;
+        if (i != owner)
+          tier->procedures[i].promotedBy = PROMOTED_AS_CALLEE;
+      }
+    free(compiled);
+  }
+
+  if (address == proc->entry)
+    proc->nativeEntries ++;
+  else proc->replacements ++;
+
+  // Machine code keeps the display the way the interpreter does
+  status = enterNative(program, vm->stack, vm->stackSize, vm->display, vm->b, target);
+  if (status != VM_OK) return status;
+
+  // The interpreter leaves the frame the way it would have
+  vm->pc = (owner == 0) ? vm->codeSize : proc->exit;
+  return VM_OK;
+}
+
+/******************************************************************/
+
+void printTierStats(Tier* tier, VM* vm, int threshold) {
+  CodeBlock* codeBlock = tier->codeBlock;
+  NativeProgram* program = tier->program;
+  TierProcedure* proc;
+  long long entries = 0, replacements = 0;
+  double compileTime = 0;
+  int i, address;
+
+  fprintf(stderr, "Tiered execution, threshold %d\n", threshold);
+  fprintf(stderr, "  %-16s %10s %12s %8s %8s  %s\n", "subprogram", "calls", "native", "osr", "spilled", "tier");
+  for (i = 0; i < program->count; i ++) {
+    proc = tier->procedures + i;
+    if (proc->entry < 0) continue;
+    entries += proc->nativeEntries;
+    replacements += proc->replacements;
+    compileTime += proc->compileTime;
+
+    fprintf(stderr, "  %-16s ", (proc->name == NULL) ? "?" : proc->name);
+    if (i == 0) fprintf(stderr, "%10s ", "-");
+    else fprintf(stderr, "%10d ", vm->counters[proc->entry]);
+    fprintf(stderr, "%12lld %8lld ", proc->nativeEntries, proc->replacements);
+    if (!proc->promoted) fprintf(stderr, "%8s  ", "-");
+    else fprintf(stderr, "%8d  ", program->spills[i]);
+    if (!proc->promoted)
+      fprintf(stderr, "interpreted\n");
+    else if (proc->promotedBy == PROMOTED_AS_CALLEE)
+      fprintf(stderr, "native, as a callee\n");
+    else if (proc->promotedBy == PROMOTED_BY_CALL)
+      fprintf(stderr, "native, hot entry, %.3f ms compiling\n", 1000 * proc->compileTime);
+    else fprintf(stderr, "native, hot loop at line %d, %.3f ms compiling\n",
+                 lineOf(codeBlock, proc->promotedAt), 1000 * proc->compileTime);
+  }
+
+  fprintf(stderr, "  %-16s %10s\n", "loop", "back edges");
+  for (i = 0; i < codeBlock->codeSize; i ++)
+    if ((codeBlock->code[i].op == OP_J) && (codeBlock->code[i].q <= i)) {
+      address = codeBlock->code[i].q;
+      fprintf(stderr, "  line %-11d %10d\n", lineOf(codeBlock, address), vm->counters[address]);
+    }
+
+  fprintf(stderr, "%lld subprogram entries and %lld on-stack replacements to native code, %.3f ms compiling\n",
+          entries, replacements, 1000 * compileTime);
+}
+
+int runTieredProgram(CodeBlock* codeBlock, SymTab* symtab, int stackSize, int threshold, int stats) {
+  Tier* tier;
+  VM* vm;
+  int status;
+
+  vm = createVM(codeBlock, stackSize);
+  if (vm == NULL) return VM_INVALID_CODE;
+  tier = createTier(codeBlock, symtab);
+  if (tier == NULL) {
+    freeVM(vm);
+    return VM_INVALID_CODE;
+  }
+
+  vm->threshold = (threshold < 1) ? 1 : threshold;
+  vm->promote = promote;
+  vm->tier = tier;
+  status = runVM(vm, DISPATCH_TIERED);
+  if (stats)
+    printTierStats(tier, vm, vm->threshold);
+
+  freeTier(tier);
+  freeVM(vm);
+  return status;
+}
@@ -0,0 +1,22 @@
+/* Tiered execution of KPL programs
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __TIER_H__
+#define __TIER_H__
+
+#include "symtab.h"
+#include "instructions.h"
+
+#define DEFAULT_TIER_THRESHOLD 1000
+
+/* Programs start on the interpreter, which counts the entries of every
+   subprogram and the back edges of every loop. A subprogram whose counter
+   reaches the threshold is compiled to machine code, with everything it
+   may call, and runs natively from then on. A hot loop moves the frame
+   it runs in to machine code at the loop header, without restarting. */
+int runTieredProgram(CodeBlock* codeBlock, SymTab* symtab, int stackSize, int threshold, int stats);
+
+#endif
@@ -0,0 +1,848 @@
+/* Loop vectorization for the native code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "symtab.h"
+#include "regalloc.h"
+#include "vectorize.h"
+
+/* A loop of the register code is a backward jump from end to header. It
+   is vectorized when it is a counted loop, as FOR makes them: its only
+   way out is the test of a slot that grows by 1 against a bound the loop
+   does not change, and its body, which has no other branch, only
+   computes with +, - and * and stores into arrays, at indexes that grow
+   by 1 with the counter.
+
+   The body is evaluated once symbolically, from the header to end. The
+   slots it writes with ADDK x, x, k are its inductions; any other slot it
+   writes must be written before it is read, and when it is a variable
+   rather than a temporary, with a value affine in the iteration, so that
+   its last value is known. Whatever the loop reads without writing it is
+   read once, before the loop.
+
+   Streams of one array a constant distance apart are checked here; other
+   overlaps, and whether the indexes fit their bounds, are only known
+   when the loop runs, so asmgen.c checks them there and keeps the scalar
+   loop when they do not fit. The scalar loop runs the iterations
+   left over after the vector loop too. */
+
+int vectorizeLoops = 1;
+int useAvx2 = 1;
+int reportVectorization = 0;
+
+/* A value as a sum of terms times coefficients, plus a constant, or
+   unknown when termCount is -1. A term is the number of the iteration,
+   fp, display[x], the value r[x] has when the loop is entered, or a node
+   of the body that is none of these nor a sum, a negation or a product
+   by a constant. Two addresses with the same terms are a constant
+   apart. */
+#define MAX_LINEAR_TERMS 8
+#define MAX_VECTOR_STARTS 16
+// Instructions before the header looked at for the starts of the inductions
+#define MAX_START_LENGTH 32
+#define ITERATION_TERM (-1)
+#define FRAME_TERM (-2)
+#define DISPLAY_TERM(x) (-3 - 2 * (x))
+#define SLOT_TERM(x) (-4 - 2 * (x))
+
+struct LinearForm_ {
+  WORD terms[MAX_LINEAR_TERMS];
+  WORD coefficients[MAX_LINEAR_TERMS];
+  int termCount;
+  WORD constant;
+};
+
+typedef struct LinearForm_ LinearForm;
+
+struct VectorAnalysis_ {
+  VectorLoop* loop;
+  RegCode* regCode;
+  int depth;
+  // Slots below are variables, above are temporaries
+  WORD frameSize;
+  // Slots the body writes, how many times, and the node each holds now,
+  // or -1 before the body writes it in the iteration
+  WORD* written;
+  int* writes;
+  int* values;
+  int writtenCount;
+  // Slots the code just before the header writes, and what each holds
+  // when the loop is entered
+  WORD startSlots[MAX_VECTOR_STARTS];
+  LinearForm starts[MAX_VECTOR_STARTS];
+  int startCount;
+};
+
+typedef struct VectorAnalysis_ VectorAnalysis;
+
+void rejectLoop(VectorAnalysis* va, char* reason) {
+  if (va->loop->reason == NULL)
+    va->loop->reason = reason;
+}
+
+int findWritten(VectorAnalysis* va, WORD x) {
+  int k;
+
+  for (k = 0; k < va->writtenCount; k ++)
+    if (va->written[k] == x) return k;
+  return -1;
+}
+
+int findInduction(VectorLoop* loop, WORD x) {
+  int k;
+
+  for (k = 0; k < loop->inductionCount; k ++)
+    if (loop->inductions[k] == x) return k;
+  return -1;
+}
+
+// Whether n is the value c whatever the iteration
+int isConstantNode(VectorLoop* loop, int n, WORD* c) {
+  if (loop->nodes[n].kind != VN_CONST) return 0;
+  *c = loop->nodes[n].c;
+  return 1;
+}
+
+void classifyNode(VectorLoop* loop, VectorNode* node) {
+  VectorNode* a = (node->a >= 0) ? loop->nodes + node->a : NULL;
+  VectorNode* b = (node->b >= 0) ? loop->nodes + node->b : NULL;
+  WORD c;
+
+  node->affine = 1;
+  node->step = 0;
+  switch (node->kind) {
+  case VN_INDUCTION:
+    node->step = node->c;
+    break;
+  case VN_LOAD:
+    node->affine = a->affine && (a->step == 0);
+    break;
+  case VN_STORE:
+    node->affine = 0;
+    break;
+  case VN_ADD:
+  case VN_SUB:
+    node->affine = a->affine && b->affine;
+    node->step = (node->kind == VN_ADD) ? a->step + b->step : a->step - b->step;
+    break;
+  case VN_NEG:
+    node->affine = a->affine;
+    node->step = - a->step;
+    break;
+  case VN_MUL:
+    if (!a->affine || !b->affine)
+      node->affine = 0;
+    else if ((a->step == 0) && (b->step == 0))
+      node->step = 0;
+    else if (isConstantNode(loop, node->a, &c))
+      node->step = b->step * c;
+    else if (isConstantNode(loop, node->b, &c))
+      node->step = a->step * c;
+    else node->affine = 0;
+    break;
+  default:
+    break;
+  }
+  if (!node->affine) node->step = 0;
+}
+
+/* The node of the given operation, shared with an equal one unless it
+   goes through an array, since a store may come between two loads.
+   Returns -1 when there is no room left. */
+int addNode(VectorAnalysis* va, enum VectorNodeKind kind, int a, int b, WORD x, WORD c) {
+  VectorLoop* loop = va->loop;
+  VectorNode* node;
+  int n;
+
+  if ((kind != VN_STORE) &&
+      ((kind != VN_LOAD) || (loop->nodes[a].affine && (loop->nodes[a].step == 0))))
+    for (n = 0; n < loop->nodeCount; n ++) {
+      node = loop->nodes + n;
+      if ((node->kind == kind) && (node->a == a) && (node->b == b) && (node->x == x) && (node->c == c))
+        return n;
+    }
+
+  if (loop->nodeCount >= MAX_VECTOR_NODES) {
+    rejectLoop(va, "its body is too large");
+    return -1;
+  }
+  node = loop->nodes + loop->nodeCount;
+  node->kind = kind;
+  node->a = a;
+  node->b = b;
+  node->x = x;
+  node->c = c;
+  node->stream = -1;
+  node->inVector = 0;
+  classifyNode(loop, node);
+  return loop->nodeCount ++;
+}
+
+// The value of r[x] at this point of the iteration
+int readSlot(VectorAnalysis* va, WORD x) {
+  int k = findWritten(va, x);
+  int frame;
+
+  if ((k >= 0) && (va->values[k] >= 0)) return va->values[k];
+  k = findInduction(va->loop, x);
+  if (k >= 0) return addNode(va, VN_INDUCTION, -1, -1, x, va->loop->steps[k]);
+  if (findWritten(va, x) >= 0) {
+    rejectLoop(va, "a value is carried from one iteration to the next");
+    return -1;
+  }
+  frame = addNode(va, VN_FRAME, -1, -1, 0, x);
+  return (frame < 0) ? -1 : addNode(va, VN_LOAD, frame, -1, 0, 0);
+}
+
+void writeSlot(VectorAnalysis* va, WORD x, int n) {
+  int k = findWritten(va, x);
+
+  if (k >= 0) va->values[k] = n;
+}
+
+int addConstant(VectorAnalysis* va, WORD c) {
+  return addNode(va, VN_CONST, -1, -1, 0, c);
+}
+
+int addBinary(VectorAnalysis* va, enum VectorNodeKind kind, int a, int b) {
+  if ((a < 0) || (b < 0)) return -1;
+  return addNode(va, kind, a, b, 0, 0);
+}
+
+// display[b] + c, which is fp + c in the scope's own frame
+int addGlobalAddress(VectorAnalysis* va, WORD b, WORD c) {
+  if (b >= va->depth) return addNode(va, VN_FRAME, -1, -1, 0, c);
+  return addNode(va, VN_DISPLAY, -1, -1, b, c);
+}
+
+// The stream an array access at the address node goes through, or -1
+int findStream(VectorAnalysis* va, int address, int store) {
+  VectorLoop* loop = va->loop;
+  VectorNode* node = loop->nodes + address;
+  int s;
+
+  if (!node->affine) {
+    rejectLoop(va, "an index does not grow with the loop");
+    return -1;
+  }
+  if ((node->step == 0) && store) {
+    rejectLoop(va, "it stores to the same element in every iteration");
+    return -1;
+  }
+  if (node->step == 0) return -1;
+  if (node->step != 1) {
+    rejectLoop(va, "an index does not grow by 1");
+    return -1;
+  }
+
+  for (s = 0; s < loop->streamCount; s ++)
+    if (loop->streams[s] == address) break;
+  if (s == loop->streamCount) {
+    if (s >= MAX_VECTOR_STREAMS) {
+      rejectLoop(va, "it goes through too many arrays");
+      return -1;
+    }
+    loop->streams[s] = address;
+    loop->storedStreams[s] = 0;
+    loop->streamCount ++;
+  }
+  if (store) loop->storedStreams[s] = 1;
+  return s;
+}
+
+int addAccess(VectorAnalysis* va, enum VectorNodeKind kind, int address, int value) {
+  int n, stream;
+
+  if ((address < 0) || ((kind == VN_STORE) && (value < 0))) return -1;
+  stream = findStream(va, address, kind == VN_STORE);
+  if (va->loop->reason != NULL) return -1;
+  n = addNode(va, kind, address, value, 0, 0);
+  if (n >= 0) va->loop->nodes[n].stream = stream;
+  return n;
+}
+
+// The test of the loop, at address
+void setTest(VectorAnalysis* va, RegInstruction* inst) {
+  VectorLoop* loop = va->loop;
+  int constant = (inst->op == R_FJLEK) || (inst->op == R_FJLTK);
+
+  if ((inst->op != R_FJLE) && (inst->op != R_FJLEK) && (inst->op != R_FJLT) && (inst->op != R_FJLTK)) {
+    rejectLoop(va, "it is not a counted loop");
+    return;
+  }
+  loop->inclusive = (inst->op == R_FJLE) || (inst->op == R_FJLEK);
+  loop->counter = readSlot(va, inst->a);
+  loop->bound = constant ? addConstant(va, inst->b) : readSlot(va, inst->b);
+  if ((loop->counter < 0) || (loop->bound < 0)) return;
+  if (!loop->nodes[loop->counter].affine || (loop->nodes[loop->counter].step != 1) ||
+      !loop->nodes[loop->bound].affine || (loop->nodes[loop->bound].step != 0))
+    rejectLoop(va, "it is not a counted loop");
+}
+
+// Evaluates one instruction of the body
+void evaluateInstruction(VectorAnalysis* va, int address) {
+  VectorLoop* loop = va->loop;
+  RegInstruction* inst = va->regCode->code + address;
+  int n = -1;
+
+  switch (inst->op) {
+  case R_MOV:
+    n = readSlot(va, inst->b);
+    break;
+  case R_MOVK:
+    n = addConstant(va, inst->c);
+    break;
+  case R_LEA:
+    n = addNode(va, VN_FRAME, -1, -1, 0, inst->c);
+    break;
+  case R_LEAG:
+    n = addGlobalAddress(va, inst->b, inst->c);
+    break;
+  case R_LDG:
+    n = addAccess(va, VN_LOAD, addGlobalAddress(va, inst->b, inst->c), -1);
+    break;
+  case R_LDI:
+    n = addAccess(va, VN_LOAD, readSlot(va, inst->b), -1);
+    break;
+  case R_STI:
+    addAccess(va, VN_STORE, readSlot(va, inst->a), readSlot(va, inst->b));
+    return;
+  case R_STIK:
+    addAccess(va, VN_STORE, readSlot(va, inst->a), addConstant(va, inst->c));
+    return;
+
+  case R_ADD:
+    n = addBinary(va, VN_ADD, readSlot(va, inst->b), readSlot(va, inst->c));
+    break;
+  case R_ADDK:
+    n = addBinary(va, VN_ADD, readSlot(va, inst->b), addConstant(va, inst->c));
+    break;
+  case R_SUB:
+    n = addBinary(va, VN_SUB, readSlot(va, inst->b), readSlot(va, inst->c));
+    break;
+  case R_SUBK:
+    n = addBinary(va, VN_SUB, readSlot(va, inst->b), addConstant(va, inst->c));
+    break;
+  case R_KSUB:
+    n = addBinary(va, VN_SUB, addConstant(va, inst->c), readSlot(va, inst->b));
+    break;
+  case R_MUL:
+    n = addBinary(va, VN_MUL, readSlot(va, inst->b), readSlot(va, inst->c));
+    break;
+  case R_MULK:
+    n = addBinary(va, VN_MUL, readSlot(va, inst->b), addConstant(va, inst->c));
+    break;
+  case R_NEG:
+    n = readSlot(va, inst->b);
+    if (n >= 0) n = addNode(va, VN_NEG, n, -1, 0, 0);
+    break;
+
+  case R_BOUND:
+    n = readSlot(va, inst->a);
+    if (n < 0) return;
+    if (!loop->nodes[n].affine)
+      rejectLoop(va, "an index does not grow with the loop");
+    else if (loop->checkCount >= MAX_VECTOR_CHECKS)
+      rejectLoop(va, "its body is too large");
+    else {
+      loop->checks[loop->checkCount].node = n;
+      loop->checks[loop->checkCount].limit = inst->c;
+      loop->checkCount ++;
+    }
+    return;
+
+  case R_DIV: case R_DIVK: case R_KDIV:
+    rejectLoop(va, "it divides");
+    return;
+  case R_EQ: case R_EQK: case R_NE: case R_NEK: case R_GT: case R_GTK:
+  case R_LT: case R_LTK: case R_GE: case R_GEK: case R_LE: case R_LEK:
+    rejectLoop(va, "it compares values");
+    return;
+  case R_STG: case R_STGK:
+    rejectLoop(va, "it assigns a variable");
+    return;
+  case R_COPY:
+    rejectLoop(va, "it copies an array");
+    return;
+  case R_CALL:
+    rejectLoop(va, "it calls a subprogram");
+    return;
+  case R_RC: case R_RI: case R_WRC: case R_WRCK: case R_WRI: case R_WRIK: case R_WLN:
+    rejectLoop(va, "it reads or writes");
+    return;
+  default:
+    rejectLoop(va, "its body has other instructions");
+    return;
+  }
+  if (n >= 0) writeSlot(va, inst->a, n);
+}
+
+/* Finds the slots the body writes, and the inductions among them: those
+   written once, by adding a constant to themselves. Any other slot
+   written is a variable or a temporary, dead once the loop is left. */
+void findInductions(VectorAnalysis* va) {
+  VectorLoop* loop = va->loop;
+  RegInstruction* inst;
+  WORD x;
+  int i, k;
+
+  for (i = loop->header; i < loop->end; i ++) {
+    x = findDefinition(va->regCode->code + i);
+    if (x < 0) continue;
+    k = findWritten(va, x);
+    if (k < 0) {
+      k = va->writtenCount ++;
+      va->written[k] = x;
+      va->writes[k] = 0;
+      va->values[k] = -1;
+    }
+    va->writes[k] ++;
+  }
+
+  for (k = 0; k < va->writtenCount; k ++) {
+    x = va->written[k];
+    for (i = loop->header; (i < loop->end) && (findDefinition(va->regCode->code + i) != x); i ++);
+    inst = va->regCode->code + i;
+    if ((va->writes[k] == 1) && (inst->b == x) && ((inst->op == R_ADDK) || (inst->op == R_SUBK))) {
+      if (loop->inductionCount >= MAX_VECTOR_INDUCTIONS) {
+        rejectLoop(va, "its body is too large");
+        return;
+      }
+      loop->inductions[loop->inductionCount] = x;
+      loop->steps[loop->inductionCount] = (inst->op == R_ADDK) ? inst->c : - inst->c;
+      loop->inductionCount ++;
+    } else if (x < va->frameSize) {
+      if (loop->variableCount >= MAX_VECTOR_INDUCTIONS) {
+        rejectLoop(va, "its body is too large");
+        return;
+      }
+      loop->variables[loop->variableCount ++] = x;
+    }
+  }
+}
+
+// The value each variable has at the end of an iteration
+void findFinalValues(VectorAnalysis* va) {
+  VectorLoop* loop = va->loop;
+  int k, n;
+
+  for (k = 0; k < loop->variableCount; k ++) {
+    n = va->values[findWritten(va, loop->variables[k])];
+    if ((n < 0) || !loop->nodes[n].affine) {
+      rejectLoop(va, "it assigns a variable");
+      return;
+    }
+    loop->finalValues[k] = n;
+  }
+}
+
+void clearForm(LinearForm* form) {
+  form->termCount = 0;
+  form->constant = 0;
+}
+
+// Adds factor * term to the form, or returns 0 when it has too many terms
+int addTerm(LinearForm* form, WORD term, WORD factor) {
+  int k;
+
+  if (form->termCount < 0) return 0;
+  for (k = 0; k < form->termCount; k ++)
+    if (form->terms[k] == term) {
+      form->coefficients[k] += factor;
+      return 1;
+    }
+  if (form->termCount >= MAX_LINEAR_TERMS) return 0;
+  form->terms[form->termCount] = term;
+  form->coefficients[form->termCount] = factor;
+  form->termCount ++;
+  return 1;
+}
+
+int addForm(LinearForm* form, LinearForm* other, WORD factor) {
+  int k;
+
+  if (other->termCount < 0) return 0;
+  form->constant += factor * other->constant;
+  for (k = 0; k < other->termCount; k ++)
+    if (!addTerm(form, other->terms[k], factor * other->coefficients[k])) return 0;
+  return 1;
+}
+
+// Whether the form is the constant c
+int isConstantForm(LinearForm* form, WORD* c) {
+  int k;
+
+  if (form->termCount < 0) return 0;
+  for (k = 0; k < form->termCount; k ++)
+    if (form->coefficients[k] != 0) return 0;
+  *c = form->constant;
+  return 1;
+}
+
+LinearForm* findStart(VectorAnalysis* va, WORD x) {
+  int k;
+
+  for (k = 0; k < va->startCount; k ++)
+    if (va->startSlots[k] == x) return va->starts + k;
+  return NULL;
+}
+
+// Adds factor times the value r[x] has when the loop is entered
+int addSlot(VectorAnalysis* va, LinearForm* form, WORD x, WORD factor) {
+  LinearForm* start = findStart(va, x);
+
+  if (start != NULL) return addForm(form, start, factor);
+  return addTerm(form, SLOT_TERM(x), factor);
+}
+
+// Adds factor times the value of node n to the form
+int addLinear(VectorAnalysis* va, LinearForm* form, int n, WORD factor) {
+  VectorLoop* loop = va->loop;
+  VectorNode* node = loop->nodes + n;
+  WORD c;
+
+  switch (node->kind) {
+  case VN_CONST:
+    form->constant += factor * node->c;
+    return 1;
+  case VN_INDUCTION:
+    return addSlot(va, form, node->x, factor) && addTerm(form, ITERATION_TERM, factor * node->c);
+  case VN_FRAME:
+    form->constant += factor * node->c;
+    return addTerm(form, FRAME_TERM, factor);
+  case VN_DISPLAY:
+    form->constant += factor * node->c;
+    return addTerm(form, DISPLAY_TERM(node->x), factor);
+  case VN_LOAD:
+    // r[x], which the body does not write
+    if (node->affine && (loop->nodes[node->a].kind == VN_FRAME))
+      return addSlot(va, form, loop->nodes[node->a].c, factor);
+    return addTerm(form, n, factor);
+  case VN_ADD:
+    return addLinear(va, form, node->a, factor) && addLinear(va, form, node->b, factor);
+  case VN_SUB:
+    return addLinear(va, form, node->a, factor) && addLinear(va, form, node->b, - factor);
+  case VN_NEG:
+    return addLinear(va, form, node->a, - factor);
+  case VN_MUL:
+    if (isConstantNode(loop, node->a, &c))
+      return addLinear(va, form, node->b, factor * c);
+    if (isConstantNode(loop, node->b, &c))
+      return addLinear(va, form, node->a, factor * c);
+    return addTerm(form, n, factor);
+  default:
+    return addTerm(form, n, factor);
+  }
+}
+
+// Whether the addresses a and b are known to be a constant apart, and how far
+int findDistance(VectorAnalysis* va, int a, int b, WORD* distance) {
+  LinearForm form;
+
+  clearForm(&form);
+  if (!addLinear(va, &form, b, 1) || !addLinear(va, &form, a, -1)) return 0;
+  return isConstantForm(&form, distance);
+}
+
+int isJumpTarget(VectorAnalysis* va, int* owners, int proc, int first, int last, int address) {
+  RegInstruction* inst;
+  int i;
+
+  for (i = first; i <= last; i ++) {
+    inst = va->regCode->code + i;
+    if ((owners[i] == proc) && regOpCodeIsJump(inst->op) && (inst->c == address)) return 1;
+  }
+  return 0;
+}
+
+// Whether the instruction may write slots other than the one it defines, or jumps
+int endsStart(enum RegOpCode op) {
+  switch (op) {
+  case R_STG: case R_STGK: case R_STI: case R_STIK: case R_COPY: case R_CALL:
+    return 1;
+  default:
+    return regOpCodeIsJump(op);
+  }
+}
+
+// What r[inst->a] holds after the instruction, from what the slots held before
+void evaluateStart(VectorAnalysis* va, RegInstruction* inst, LinearForm* form) {
+  LinearForm other;
+  WORD c;
+  int known;
+
+  clearForm(form);
+  switch (inst->op) {
+  case R_MOV:
+    known = addSlot(va, form, inst->b, 1);
+    break;
+  case R_MOVK:
+    form->constant = inst->c;
+    known = 1;
+    break;
+  case R_LEA:
+    form->constant = inst->c;
+    known = addTerm(form, FRAME_TERM, 1);
+    break;
+  case R_LEAG:
+    form->constant = inst->c;
+    known = addTerm(form, (inst->b >= va->depth) ? FRAME_TERM : DISPLAY_TERM(inst->b), 1);
+    break;
+  case R_ADD:
+    known = addSlot(va, form, inst->b, 1) && addSlot(va, form, inst->c, 1);
+    break;
+  case R_SUB:
+    known = addSlot(va, form, inst->b, 1) && addSlot(va, form, inst->c, -1);
+    break;
+  case R_ADDK:
+  case R_SUBK:
+    known = addSlot(va, form, inst->b, 1);
+    form->constant += (inst->op == R_ADDK) ? inst->c : - inst->c;
+    break;
+  case R_KSUB:
+    known = addSlot(va, form, inst->b, -1);
+    form->constant += inst->c;
+    break;
+  case R_MULK:
+    known = addSlot(va, form, inst->b, inst->c);
+    break;
+  case R_MUL:
+    clearForm(&other);
+    known = addSlot(va, &other, inst->c, 1) && isConstantForm(&other, &c) && addSlot(va, form, inst->b, c);
+    break;
+  case R_NEG:
+    known = addSlot(va, form, inst->b, -1);
+    break;
+  default:
+    known = 0;
+    break;
+  }
+  if (!known) form->termCount = -1;
+}
+
+/* Finds what the inductions and the other slots the code just before the
+   header writes hold when the loop is entered, from the straight code
+   that ends at the header. */
+void findStarts(VectorAnalysis* va, int* owners, int proc, int first, int last) {
+  VectorLoop* loop = va->loop;
+  RegInstruction* inst;
+  LinearForm form;
+  LinearForm* start;
+  WORD x;
+  int from = loop->header;
+  int i;
+
+  va->startCount = 0;
+  while ((from > first) && (loop->header - from < MAX_START_LENGTH) && (owners[from - 1] == proc) &&
+         !endsStart(va->regCode->code[from - 1].op) &&
+         ((from == loop->header) || !isJumpTarget(va, owners, proc, first, last, from)))
+    from --;
+
+  for (i = from; i < loop->header; i ++) {
+    inst = va->regCode->code + i;
+    x = findDefinition(inst);
+    if (x < 0) continue;
+    evaluateStart(va, inst, &form);
+    start = findStart(va, x);
+    if (start == NULL) {
+      if (va->startCount >= MAX_VECTOR_STARTS) {
+        // What the code before wrote is no longer known
+        va->startCount = 0;
+        continue;
+      }
+      va->startSlots[va->startCount] = x;
+      start = va->starts + va->startCount ++;
+    }
+    *start = form;
+  }
+}
+
+/* A stream stored to and another one less than the lanes apart carry
+   values from one iteration to the next, which the vector loop would
+   not. Streams less than MIN_VECTOR_LANES apart always do, so the loop
+   stays scalar; when they may be closer than MAX_VECTOR_LANES, the loop
+   is only vectorized when asmgen.c finds them far enough apart. */
+void checkDependences(VectorAnalysis* va) {
+  VectorLoop* loop = va->loop;
+  WORD distance;
+  int s, t;
+
+  loop->guarded = 0;
+  for (s = 0; s < loop->streamCount; s ++) {
+    if (!loop->storedStreams[s]) continue;
+    for (t = 0; t < loop->streamCount; t ++) {
+      if (t == s) continue;
+      if (!findDistance(va, loop->streams[s], loop->streams[t], &distance))
+        loop->guarded = 1;
+      else if ((distance != 0) && (distance > - MIN_VECTOR_LANES) && (distance < MIN_VECTOR_LANES)) {
+        rejectLoop(va, "an iteration uses an element another one stores");
+        return;
+      } else if ((distance != 0) && (distance > - MAX_VECTOR_LANES) && (distance < MAX_VECTOR_LANES))
+        loop->guarded = 1;
+    }
+  }
+}
+
+// Marks the values needed in vector registers, and counts the registers
+void countRegisters(VectorAnalysis* va) {
+  VectorLoop* loop = va->loop;
+  VectorNode* node;
+  int n, stores = 0;
+
+  for (n = 0; n < loop->nodeCount; n ++) {
+    node = loop->nodes + n;
+    if (node->kind == VN_STORE) {
+      loop->nodes[node->b].inVector = 1;
+      stores ++;
+    } else if (!node->affine && (node->kind != VN_LOAD)) {
+      loop->nodes[node->a].inVector = 1;
+      if (node->b >= 0) loop->nodes[node->b].inVector = 1;
+    }
+  }
+
+  loop->registerCount = 0;
+  for (n = 0; n < loop->nodeCount; n ++) {
+    node = loop->nodes + n;
+    if (node->kind == VN_STORE) continue;
+    if (!node->affine)
+      loop->registerCount ++;
+    else if (node->inVector)
+      loop->registerCount += (node->step == 0) ? 1 : 2;
+  }
+
+  if (stores == 0)
+    rejectLoop(va, "it stores nothing");
+  else if (loop->registerCount > VECTOR_REGISTERS)
+    rejectLoop(va, "it needs too many vector registers");
+}
+
+void analyzeLoop(VectorAnalysis* va, int* owners, int proc, int first, int last) {
+  VectorLoop* loop = va->loop;
+  RegInstruction* inst;
+  int tests = 0;
+  int tested = 0;
+  int i;
+
+  // Nothing may come into the body but through the header
+  for (i = first; i <= last; i ++) {
+    inst = va->regCode->code + i;
+    if ((owners[i] == proc) && regOpCodeIsJump(inst->op) && (inst->c > loop->header) &&
+        (inst->c <= loop->end) && ((i < loop->header) || (i > loop->end)))
+      rejectLoop(va, "it is entered in the middle");
+  }
+  for (i = loop->header; i < loop->end; i ++) {
+    if (owners[i] != proc) {
+      rejectLoop(va, "its body has other instructions");
+      return;
+    }
+    inst = va->regCode->code + i;
+    if ((inst->op == R_J) && (inst->c <= i))
+      rejectLoop(va, "it contains another loop");
+  }
+  for (i = loop->header; i < loop->end; i ++) {
+    inst = va->regCode->code + i;
+    if (regOpCodeIsJump(inst->op) && ((tests ++ > 0) || (inst->op == R_J) || (inst->c != loop->end + 1)))
+      rejectLoop(va, "it branches inside its body");
+  }
+  if (loop->reason != NULL) return;
+
+  findInductions(va);
+  for (i = loop->header; (i < loop->end) && (loop->reason == NULL); i ++) {
+    inst = va->regCode->code + i;
+    if (regOpCodeIsJump(inst->op)) {
+      setTest(va, inst);
+      tested = 1;
+    } else evaluateInstruction(va, i);
+  }
+  if (loop->reason != NULL) return;
+  if (!tested) {
+    rejectLoop(va, "it is not a counted loop");
+    return;
+  }
+  findFinalValues(va);
+  findStarts(va, owners, proc, first, last);
+  checkDependences(va);
+  if (loop->reason != NULL) return;
+
+  countRegisters(va);
+}
+
+/* Looks at every loop of the procedure whose instructions lie in
+   first..last, and returns them in the order of their headers. */
+VectorLoop* findVectorLoops(RegCode* regCode, int* owners, int proc, int first, int last, int* count) {
+  VectorAnalysis va;
+  VectorLoop* loops;
+  VectorLoop* loop;
+  RegInstruction* inst;
+  int n = 0;
+  int i, length;
+
+  for (i = first; i <= last; i ++)
+    if ((owners[i] == proc) && (regCode->code[i].op == R_J) && (regCode->code[i].c < i)) n ++;
+  loops = (VectorLoop*) malloc((n + 1) * sizeof(VectorLoop));
+
+  va.regCode = regCode;
+  va.depth = regCode->depths[first];
+  va.frameSize = 0;
+  for (i = first; i <= last; i ++)
+    if ((owners[i] == proc) && (regCode->code[i].op == R_CHK)) {
+      va.frameSize = regCode->code[i].a;
+      break;
+    }
+
+  *count = 0;
+  for (i = first; i <= last; i ++) {
+    inst = regCode->code + i;
+    if ((owners[i] != proc) || (inst->op != R_J) || (inst->c >= i)) continue;
+    loop = loops + (*count) ++;
+    loop->header = inst->c;
+    loop->end = i;
+    loop->line = (regCode->lines == NULL) ? 0 : regCode->lines[inst->c];
+    loop->reason = NULL;
+    loop->nodeCount = 0;
+    loop->counter = loop->bound = -1;
+    loop->inclusive = 1;
+    loop->inductionCount = 0;
+    loop->variableCount = 0;
+    loop->checkCount = 0;
+    loop->streamCount = 0;
+    loop->registerCount = 0;
+
+    length = i - inst->c;
+    va.loop = loop;
+    va.written = (WORD*) malloc((length + 1) * sizeof(WORD));
+    va.writes = (int*) malloc((length + 1) * sizeof(int));
+    va.values = (int*) malloc((length + 1) * sizeof(int));
+    va.writtenCount = 0;
+    analyzeLoop(&va, owners, proc, first, last);
+    free(va.written);
+    free(va.writes);
+    free(va.values);
+  }
+
+  // Backward jumps are found by their source, headers are wanted in order
+  for (i = 1; i < *count; i ++)
+    for (n = i; (n > 0) && (loops[n - 1].header > loops[n].header); n --) {
+      VectorLoop swap = loops[n];
+      loops[n] = loops[n - 1];
+      loops[n - 1] = swap;
+    }
+  return loops;
+}
+
+void reportVectorLoops(FILE* out, VectorLoop* loops, int count) {
+  int i;
+
+  for (i = 0; i < count; i ++) {
+    fprintf(out, "vectorize loop at line %d: ", loops[i].line);
+    if (loops[i].reason == NULL)
+      fprintf(out, "vectorized over %d array%s%s\n", loops[i].streamCount,
+              (loops[i].streamCount == 1) ? "" : "s",
+              loops[i].guarded ? ", guarded against overlap" : "");
+    else fprintf(out, "kept, %s\n", loops[i].reason);
+  }
+}
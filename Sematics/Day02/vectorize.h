@@ -0,0 +1,108 @@
+/* Loop vectorization for the native code
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VECTORIZE_H__
+#define __VECTORIZE_H__
+
+#include <stdio.h>
+#include "regcode.h"
+
+#define MAX_VECTOR_NODES 64
+#define MAX_VECTOR_STREAMS 6
+#define MAX_VECTOR_INDUCTIONS 8
+#define MAX_VECTOR_CHECKS 16
+// %xmm14 and %xmm15 are scratch
+#define VECTOR_REGISTERS 14
+#define MIN_VECTOR_LANES 4
+#define MAX_VECTOR_LANES 8
+
+/* What one iteration of the loop computes, in the order it does. A value
+   is affine when it is the value it has in the first iteration plus step
+   times the number of the iteration; with a step of 0 it does not change
+   in the loop. The others come from the arrays the loop reads. */
+enum VectorNodeKind {
+  VN_CONST,      // c
+  VN_INDUCTION,  // r[x], which the loop adds step to in every iteration
+  VN_FRAME,      // fp + c
+  VN_DISPLAY,    // display[x] + c
+  VN_LOAD,       // s[a]
+  VN_STORE,      // s[a] := b
+  VN_ADD,        // a + b
+  VN_SUB,        // a - b
+  VN_MUL,        // a * b
+  VN_NEG         // - a
+};
+
+struct VectorNode_ {
+  enum VectorNodeKind kind;
+  int a;
+  int b;
+  WORD x;
+  WORD c;
+  int affine;
+  WORD step;
+  // Stream of the array a load or store goes through, or -1
+  int stream;
+  // Whether its values are needed in the lanes of a vector register
+  int inVector;
+};
+
+typedef struct VectorNode_ VectorNode;
+
+struct VectorCheck_ {
+  int node;
+  WORD limit;
+};
+
+typedef struct VectorCheck_ VectorCheck;
+
+struct VectorLoop_ {
+  // The test of the loop is the first instruction jumping out of
+  // header..end; end jumps back to header
+  int header;
+  int end;
+  int line;
+  // Why the loop stays scalar, or NULL
+  char* reason;
+  VectorNode nodes[MAX_VECTOR_NODES];
+  int nodeCount;
+  // The loop goes on while counter <= bound, or counter < bound
+  int counter;
+  int bound;
+  int inclusive;
+  // The slots the loop steps
+  WORD inductions[MAX_VECTOR_INDUCTIONS];
+  WORD steps[MAX_VECTOR_INDUCTIONS];
+  int inductionCount;
+  // The variables it assigns otherwise, and the affine node of the value
+  // each has at the end of an iteration
+  WORD variables[MAX_VECTOR_INDUCTIONS];
+  int finalValues[MAX_VECTOR_INDUCTIONS];
+  int variableCount;
+  // Index nodes, which must be 1 to limit
+  VectorCheck checks[MAX_VECTOR_CHECKS];
+  int checkCount;
+  // Node of the address each stream starts at, and whether it is stored to
+  int streams[MAX_VECTOR_STREAMS];
+  int storedStreams[MAX_VECTOR_STREAMS];
+  int streamCount;
+  // Whether streams may be too close for the vector loop, which asmgen.c
+  // then checks before running it
+  int guarded;
+  // Vector registers the loop needs, both for its values and its steps
+  int registerCount;
+};
+
+typedef struct VectorLoop_ VectorLoop;
+
+extern int vectorizeLoops;
+extern int useAvx2;
+extern int reportVectorization;
+
+VectorLoop* findVectorLoops(RegCode* regCode, int* owners, int proc, int first, int last, int* count);
+void reportVectorLoops(FILE* out, VectorLoop* loops, int count);
+
+#endif
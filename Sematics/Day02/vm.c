@@ -0,0 +1,662 @@
+/* KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "kplio.h"
+#include "vm.h"
+
+// Opcodes that only exist in translated code
+#define VM_LA_LOCAL NUM_OF_OPCODES
+#define VM_LV_LOCAL (NUM_OF_OPCODES + 1)
+#define NUM_OF_VM_OPCODES (NUM_OF_OPCODES + 2)
+
+/* Superinstructions come after them. superops.h and superbodies.h are
+   written by make superops from a profile of the training programs. */
+#include "superops.h"
+
+#define NUM_OF_DISPATCHED_OPCODES (NUM_OF_VM_OPCODES + NUM_OF_SUPER_OPCODES)
+
+struct SuperInstruction_ {
+  int length;
+  int ops[MAX_SUPER_LENGTH];
+};
+
+typedef struct SuperInstruction_ SuperInstruction;
+
+SuperInstruction superInstructions[NUM_OF_SUPER_OPCODES] = SUPER_SEQUENCES;
+
+/* Computes the static depth of the scope every instruction belongs to by
+   following the control flow from the program entry. A CALL p,q made at
+   depth d enters a scope of depth d - p + 1. */
+int computeDepths(CodeBlock* codeBlock, int* depths) {
+  int* work = (int*) malloc(2 * (codeBlock->codeSize + 1) * sizeof(int));
+  int top = 0;
+  int address, depth;
+  Instruction* inst;
+
+  for (address = 0; address < codeBlock->codeSize; address ++)
+    depths[address] = UNKNOWN_DEPTH;
+
+  work[top++] = 0;
+  work[top++] = 0;
+  while (top > 0) {
+    depth = work[--top];
+    address = work[--top];
+
+    while ((address >= 0) && (address < codeBlock->codeSize) && (depths[address] == UNKNOWN_DEPTH)) {
+      depths[address] = depth;
+      inst = codeBlock->code + address;
+
+      if ((inst->op == OP_LA) || (inst->op == OP_LV)) {
+        if ((inst->p < 0) || (inst->p > depth)) break;
+      }
+
+      if (inst->op == OP_J) {
+        address = inst->q;
+        continue;
+      }
+      if ((inst->op == OP_HL) || (inst->op == OP_EP) || (inst->op == OP_EF))
+        break;
+      if (inst->op == OP_FJ) {
+        work[top++] = inst->q;
+        work[top++] = depth;
+      }
+      if (inst->op == OP_CALL) {
+        if ((depth - inst->p + 1 < 0) || (depth - inst->p + 1 >= MAX_DEPTH)) {
+          free(work);
+          return 0;
+        }
+        work[top++] = inst->q;
+        work[top++] = depth - inst->p + 1;
+      }
+      address ++;
+    }
+  }
+
+  free(work);
+  return 1;
+}
+
+// Words of the frame a subprogram starting at entry makes with its INT
+int frameSizeAt(CodeBlock* codeBlock, CodeAddress entry) {
+  CodeAddress start;
+
+  // Only forward jumps are followed, in case of a loop of jumps
+  for (start = entry; (start >= 0) && (start < codeBlock->codeSize) &&
+         (codeBlock->code[start].op == OP_J) && (codeBlock->code[start].q > start); )
+    start = codeBlock->code[start].q;
+  if ((start >= 0) && (start < codeBlock->codeSize) && (codeBlock->code[start].op == OP_INT))
+    return codeBlock->code[start].q;
+  return 0;
+}
+
+/* Fills the frame layouts of the block: one per subprogram called from
+   reachable code and one for the program, in the order of their entries,
+   each frame as large as the INT its code starts with makes it. */
+int computeFrames(CodeBlock* codeBlock) {
+  int* depths = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  char* entries = (char*) calloc(codeBlock->codeSize + 1, 1);
+  FrameLayout* frame;
+  Instruction* inst;
+  int address;
+
+  if (!computeDepths(codeBlock, depths)) {
+    free(depths);
+    free(entries);
+    return 0;
+  }
+
+  if (codeBlock->codeSize > 0) entries[0] = 1;
+  for (address = 0; address < codeBlock->codeSize; address ++) {
+    inst = codeBlock->code + address;
+    if ((inst->op == OP_CALL) && (depths[address] != UNKNOWN_DEPTH) &&
+        (inst->q >= 0) && (inst->q < codeBlock->codeSize))
+      entries[inst->q] = 1;
+  }
+
+  free(codeBlock->frames);
+  codeBlock->frames = (FrameLayout*) malloc((codeBlock->codeSize + 1) * sizeof(FrameLayout));
+  codeBlock->frameCount = 0;
+  for (address = 0; address < codeBlock->codeSize; address ++) {
+    if (!entries[address]) continue;
+    frame = codeBlock->frames + codeBlock->frameCount ++;
+    frame->entry = address;
+    frame->depth = depths[address];
+    frame->size = frameSizeAt(codeBlock, address);
+  }
+
+  free(depths);
+  free(entries);
+  return 1;
+}
+
+/* Whether every reachable instruction stays inside the code, the display
+   and the frames: the targets of jumps and calls are addresses of the
+   code, a level goes no further out than the program, an offset falls in
+   the largest frame of its depth as the INTs of the code make them, and
+   arrays are no larger than a frame. The layouts of an image are not
+   trusted for it. */
+int validOperands(CodeBlock* codeBlock, int* depths) {
+  int sizes[MAX_DEPTH];
+  int largest = 0;
+  Instruction* inst;
+  int address, depth, size;
+
+  for (depth = 0; depth < MAX_DEPTH; depth ++)
+    sizes[depth] = 0;
+  for (address = 0; address < codeBlock->codeSize; address ++) {
+    inst = codeBlock->code + address;
+    if ((address > 0) && ((inst->op != OP_CALL) || (depths[address] == UNKNOWN_DEPTH) ||
+                          (inst->q < 0) || (inst->q >= codeBlock->codeSize)))
+      continue;
+    if (address == 0) {
+      depth = 0;
+      size = frameSizeAt(codeBlock, 0);
+    } else {
+      depth = depths[address] - inst->p + 1;
+      size = frameSizeAt(codeBlock, inst->q);
+    }
+    if (size > sizes[depth]) sizes[depth] = size;
+    if (size > largest) largest = size;
+  }
+
+  for (address = 0; address < codeBlock->codeSize; address ++) {
+    inst = codeBlock->code + address;
+    depth = depths[address];
+    if (depth == UNKNOWN_DEPTH) continue;
+    switch (inst->op) {
+    case OP_LA:
+    case OP_LV:
+      if ((inst->p < 0) || (inst->p > depth) || (inst->q < 0) || (inst->q >= sizes[depth - inst->p]))
+        return 0;
+      break;
+    case OP_J:
+    case OP_FJ:
+    case OP_CALL:
+      if ((inst->q < 0) || (inst->q > codeBlock->codeSize))
+        return 0;
+      break;
+    case OP_INT:
+    case OP_DCT:
+      if (inst->q < 0) return 0;
+      break;
+    case OP_CK:
+    case OP_CP:
+      if ((inst->q < 0) || (inst->q > largest)) return 0;
+      break;
+    default:
+      break;
+    }
+  }
+  return 1;
+}
+
+VM* createVM(CodeBlock* codeBlock, int stackSize) {
+  VM* vm;
+  int* depths;
+  Instruction* inst;
+  VMInstruction* vmInst;
+  int i, depth;
+
+  depths = (int*) malloc((codeBlock->codeSize + 1) * sizeof(int));
+  if (!computeDepths(codeBlock, depths) || !validOperands(codeBlock, depths)) {
+    free(depths);
+    return NULL;
+  }
+
+  vm = (VM*) malloc(sizeof(VM));
+  vm->codeSize = codeBlock->codeSize;
+  vm->code = (VMInstruction*) malloc((codeBlock->codeSize + 1) * sizeof(VMInstruction));
+
+  for (i = 0; i < codeBlock->codeSize; i ++) {
+    inst = codeBlock->code + i;
+    vmInst = vm->code + i;
+    depth = depths[i];
+
+    vmInst->handler = NULL;
+    vmInst->op = inst->op;
+    vmInst->p = inst->p;
+    vmInst->q = inst->q;
+
+    if (depth == UNKNOWN_DEPTH) {
+      // Never reached
+      vmInst->op = OP_HL;
+      continue;
+    }
+
+    switch (inst->op) {
+    case OP_LA:
+      if (inst->p == 0)
+        vmInst->op = VM_LA_LOCAL;
+      else vmInst->p = depth - inst->p;
+      break;
+    case OP_LV:
+      if (inst->p == 0)
+        vmInst->op = VM_LV_LOCAL;
+      else vmInst->p = depth - inst->p;
+      break;
+    case OP_CALL:
+      vmInst->p = depth - inst->p + 1;
+      break;
+    case OP_EP:
+    case OP_EF:
+      vmInst->p = depth;
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Falling off the end of the code halts the machine
+  vm->code[codeBlock->codeSize].handler = NULL;
+  vm->code[codeBlock->codeSize].op = OP_HL;
+  vm->code[codeBlock->codeSize].p = DC_VALUE;
+  vm->code[codeBlock->codeSize].q = DC_VALUE;
+
+  vm->statements = (int*) calloc(codeBlock->codeSize + 1, sizeof(int));
+  for (i = 0; i < codeBlock->lineCount; i ++)
+    if ((codeBlock->lines[i].address >= 0) && (codeBlock->lines[i].address <= codeBlock->codeSize))
+      vm->statements[codeBlock->lines[i].address] ++;
+  vm->dispatchCount = 0;
+  vm->statementCount = 0;
+
+  vm->fuse = 1;
+  vm->fusedCount = 0;
+  vm->pairCounts = NULL;
+  vm->tripleCounts = NULL;
+
+  vm->counters = (int*) calloc(codeBlock->codeSize + 1, sizeof(int));
+  vm->threshold = 0;
+  vm->promote = NULL;
+  vm->tier = NULL;
+  vm->pc = 0;
+  vm->b = 0;
+  vm->t = -1;
+
+  vm->stackSize = stackSize;
+  vm->stack = (WORD*) calloc(stackSize, sizeof(WORD));
+
+  free(depths);
+  return vm;
+}
+
+void freeVM(VM* vm) {
+  free(vm->code);
+  free(vm->statements);
+  free(vm->counters);
+  free(vm->pairCounts);
+  free(vm->tripleCounts);
+  free(vm->stack);
+  free(vm);
+}
+
+/* Gives the instruction at every address where a sequence of a
+   superinstruction starts the handler of the whole sequence, the longest
+   one first. The instructions of the sequence keep their own handlers,
+   for the jumps that land among them, and so does one that starts a
+   statement, so that a superinstruction runs at most one. */
+int fuseSuperinstructions(VM* vm) {
+  SuperInstruction* super;
+  int address, i, k;
+
+  for (address = 0; address < vm->codeSize; address ++)
+    for (i = 0; i < NUM_OF_SUPER_OPCODES; i ++) {
+      super = superInstructions + i;
+      if (address + super->length > vm->codeSize) continue;
+      for (k = 0; k < super->length; k ++)
+        if ((vm->code[address + k].op != super->ops[k]) ||
+            ((k > 0) && (vm->statements[address + k] > 0)))
+          break;
+      if (k == super->length) {
+        vm->code[address].op = NUM_OF_VM_OPCODES + i;
+        vm->fusedCount ++;
+        break;
+      }
+    }
+  return vm->fusedCount;
+}
+
+char* vmOpCodeToString(int op) {
+  if (op < NUM_OF_OPCODES) return opCodeToString((enum OpCode) op);
+  if (op == VM_LA_LOCAL) return "LA_LOCAL";
+  if (op == VM_LV_LOCAL) return "LV_LOCAL";
+  return "SUPER";
+}
+
+/******************* Dispatchers ******************************/
+
+/* Both dispatchers run the same translated code with the same instruction
+   bodies, so that they can be compared on dispatch cost alone. */
+
+// Handlers of the threaded dispatchers, by opcode
+#define THREADED_LABELS {                       \
+    &&L_OP_LA, &&L_OP_LV, &&L_OP_LC, &&L_OP_LI,  \
+    &&L_OP_INT, &&L_OP_DCT, &&L_OP_J, &&L_OP_FJ, \
+    &&L_OP_HL, &&L_OP_ST, &&L_OP_CALL, &&L_OP_EP, \
+    &&L_OP_EF, &&L_OP_RC, &&L_OP_RI, &&L_OP_WRC, \
+    &&L_OP_WRI, &&L_OP_WLN, &&L_OP_AD, &&L_OP_SB, \
+    &&L_OP_ML, &&L_OP_DV, &&L_OP_NEG, &&L_OP_CV, \
+    &&L_OP_EQ, &&L_OP_NE, &&L_OP_GT, &&L_OP_LT,  \
+    &&L_OP_GE, &&L_OP_LE, &&L_OP_CK, &&L_OP_CP,  \
+    &&L_OP_BP,                                   \
+    &&L_VM_LA_LOCAL, &&L_VM_LV_LOCAL             \
+    SUPER_LABELS                                 \
+  }
+
+// Instructions that only the tiered dispatcher watches
+#define ENTER(address)
+#define BACK_EDGE(address)
+
+int runThreaded(VM* vm) {
+  static const void* labels[NUM_OF_DISPATCHED_OPCODES] = THREADED_LABELS;
+  VMInstruction* code = vm->code;
+  VMInstruction* pc = code;
+  VMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int t = -1;
+  int b = 0;
+  int i;
+
+  for (i = 0; i <= vm->codeSize; i ++)
+    code[i].handler = labels[code[i].op];
+  display[0] = 0;
+
+#define OP(op) L_##op:
+#define NEXT inst = pc ++; goto *inst->handler
+
+  NEXT;
+
+#include "vmops.h"
+#include "superbodies.h"
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+/* Threaded dispatch that counts subprogram entries and loop back edges,
+   and hands a frame over to the promotion hook once its counter is hot. */
+int runTiered(VM* vm) {
+  static const void* labels[NUM_OF_DISPATCHED_OPCODES] = THREADED_LABELS;
+  VMInstruction* code = vm->code;
+  VMInstruction* pc = code;
+  VMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* display = vm->display;
+  int* counters = vm->counters;
+  int threshold = vm->threshold;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int t = -1;
+  int b = 0;
+  int i, status;
+
+  for (i = 0; i <= vm->codeSize; i ++)
+    code[i].handler = labels[code[i].op];
+  display[0] = 0;
+
+#define OP(op) L_##op:
+#define NEXT inst = pc ++; goto *inst->handler
+#undef ENTER
+#undef BACK_EDGE
+#define PROMOTE(address)                                \
+  if (++ counters[address] >= threshold) {              \
+    counters[address] = threshold;                      \
+    vm->pc = pc - code;                                 \
+    vm->b = b;                                          \
+    vm->t = t;                                          \
+    status = vm->promote(vm, address);                  \
+    if (status > VM_OK) goto error;                     \
+    if (status == VM_OK) {                              \
+      pc = code + vm->pc;                               \
+      b = vm->b;                                        \
+      t = vm->t;                                        \
+    }                                                   \
+  }
+#define ENTER(address) PROMOTE(address)
+#define BACK_EDGE(address) if (address <= inst - code) PROMOTE(address)
+
+  NEXT;
+
+#include "vmops.h"
+#include "superbodies.h"
+
+#undef OP
+#undef NEXT
+#undef PROMOTE
+#undef ENTER
+#undef BACK_EDGE
+#define ENTER(address)
+#define BACK_EDGE(address)
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+ error:
+  kplFlush();
+  return status;
+}
+
+int runSwitch(VM* vm) {
+  VMInstruction* code = vm->code;
+  VMInstruction* pc = code;
+  VMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int t = -1;
+  int b = 0;
+
+  display[0] = 0;
+
+#define OP(op) case op:
+#define NEXT continue
+
+  for (;;) {
+    inst = pc ++;
+    switch (inst->op) {
+#include "vmops.h"
+#include "superbodies.h"
+    default:
+      goto halt;
+    }
+  }
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+// Counts dispatches and the statements they start
+int runCounting(VM* vm) {
+  VMInstruction* code = vm->code;
+  VMInstruction* pc = code;
+  VMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int t = -1;
+  int b = 0;
+
+  display[0] = 0;
+
+#define OP(op) case op:
+#define NEXT continue
+
+  for (;;) {
+    inst = pc ++;
+    vm->dispatchCount ++;
+    vm->statementCount += vm->statements[inst - code];
+    switch (inst->op) {
+#include "vmops.h"
+#include "superbodies.h"
+    default:
+      goto halt;
+    }
+  }
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+/* Counts the dispatches like runCounting, and how often each pair and
+   each triple of opcodes ran one after the other without a jump between
+   them or a statement starting inside, which are the sequences a
+   superinstruction could take. */
+int runProfiling(VM* vm) {
+  VMInstruction* code = vm->code;
+  VMInstruction* pc = code;
+  VMInstruction* inst;
+  WORD* s = vm->stack;
+  WORD* display = vm->display;
+  int limit = vm->stackSize - STACK_RED_ZONE;
+  int t = -1;
+  int b = 0;
+  int n = NUM_OF_VM_OPCODES;
+  int last = -2, run = 0, first = 0, second = 0;
+  int address;
+
+  if (vm->pairCounts == NULL) {
+    vm->pairCounts = (long long*) calloc(n * n, sizeof(long long));
+    vm->tripleCounts = (long long*) calloc(n * n * n, sizeof(long long));
+  }
+  display[0] = 0;
+
+#define OP(op) case op:
+#define NEXT continue
+
+  for (;;) {
+    inst = pc ++;
+    address = inst - code;
+    vm->dispatchCount ++;
+    vm->statementCount += vm->statements[address];
+    if ((address == last + 1) && (vm->statements[address] == 0)) {
+      vm->pairCounts[second * n + inst->op] ++;
+      if (run >= 2) vm->tripleCounts[(first * n + second) * n + inst->op] ++;
+      run ++;
+    } else run = 1;
+    first = second;
+    second = inst->op;
+    last = address;
+    switch (inst->op) {
+#include "vmops.h"
+    default:
+      goto halt;
+    }
+  }
+
+#undef OP
+#undef NEXT
+
+ halt:
+  kplFlush();
+  return VM_OK;
+ stackOverflow:
+  kplFlush();
+  return VM_STACK_OVERFLOW;
+ divisionByZero:
+  kplFlush();
+  return VM_DIVISION_BY_ZERO;
+ indexOutOfRange:
+  kplFlush();
+  return VM_INDEX_OUT_OF_RANGE;
+}
+
+// One line to a sequence that ran: its count, then its opcodes
+void printProfile(VM* vm, FILE* out) {
+  int n = NUM_OF_VM_OPCODES;
+  int i, j, k;
+
+  if (vm->pairCounts == NULL) return;
+  for (i = 0; i < n; i ++)
+    for (j = 0; j < n; j ++) {
+      if (vm->pairCounts[i * n + j] > 0)
+        fprintf(out, "%lld %s %s\n", vm->pairCounts[i * n + j], vmOpCodeToString(i), vmOpCodeToString(j));
+      for (k = 0; k < n; k ++)
+        if (vm->tripleCounts[(i * n + j) * n + k] > 0)
+          fprintf(out, "%lld %s %s %s\n", vm->tripleCounts[(i * n + j) * n + k],
+                  vmOpCodeToString(i), vmOpCodeToString(j), vmOpCodeToString(k));
+    }
+}
+
+int runVM(VM* vm, int dispatch) {
+  if (dispatch == DISPATCH_PROFILE)
+    return runProfiling(vm);
+  if (vm->fuse) fuseSuperinstructions(vm);
+  switch (dispatch) {
+  case DISPATCH_SWITCH:
+    return runSwitch(vm);
+  case DISPATCH_COUNT:
+    return runCounting(vm);
+  case DISPATCH_TIERED:
+    if (vm->promote != NULL)
+      return runTiered(vm);
+    return runThreaded(vm);
+  default:
+    return runThreaded(vm);
+  }
+}
+
+char* vmErrorToString(int status) {
+  switch (status) {
+  case VM_OK: return "OK";
+  case VM_STACK_OVERFLOW: return "Stack overflow.";
+  case VM_DIVISION_BY_ZERO: return "Division by zero.";
+  case VM_INVALID_CODE: return "Invalid code.";
+  case VM_INDEX_OUT_OF_RANGE: return "Index out of range.";
+  default: return "Unknown error.";
+  }
+}
@@ -0,0 +1,94 @@
+/* KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <stdio.h>
+#include "instructions.h"
+
+#define STACK_SIZE (1 << 20)
+#define STACK_RED_ZONE 1024
+#define MAX_DEPTH 256
+#define UNKNOWN_DEPTH -1
+
+#define VM_OK 0
+#define VM_STACK_OVERFLOW 1
+#define VM_DIVISION_BY_ZERO 2
+#define VM_INVALID_CODE 3
+#define VM_INDEX_OUT_OF_RANGE 4
+
+#define DISPATCH_THREADED 0
+#define DISPATCH_SWITCH 1
+#define DISPATCH_COUNT 2
+#define DISPATCH_TIERED 3
+#define DISPATCH_PROFILE 4
+
+// Returned by a promotion hook that leaves the frame to the interpreter
+#define TIER_INTERPRET -1
+
+/* Bytecode is translated once before running: accesses through a static
+   link become accesses through the display, at the absolute depth of the
+   scope, and accesses to the current frame get their own opcodes. */
+struct VMInstruction_ {
+  const void* handler;
+  int op;
+  WORD p;
+  WORD q;
+};
+
+typedef struct VMInstruction_ VMInstruction;
+
+/* Called by the tiered dispatcher when the counter of address reaches the
+   threshold, address being a subprogram entry just called or the target
+   of a loop back edge just taken. The hook either returns TIER_INTERPRET,
+   or runs the frame elsewhere and returns the status of the run, leaving
+   the registers of the machine where the interpreter has to resume. */
+typedef struct VM_ VM;
+typedef int (*TierHook)(VM* vm, int address);
+
+struct VM_ {
+  VMInstruction* code;
+  int codeSize;
+  WORD* stack;
+  int stackSize;
+  // display[d] is the frame of the innermost active scope at depth d
+  WORD display[MAX_DEPTH];
+  // Number of statements starting at each instruction
+  int* statements;
+  long long dispatchCount;
+  long long statementCount;
+  // Tiered execution: one counter per instruction, bumped on entries
+  // and back edges
+  int* counters;
+  int threshold;
+  TierHook promote;
+  void* tier;
+  // Whether runVM fuses the sequences of superops.h first, and how many
+  // instructions it fused
+  int fuse;
+  int fusedCount;
+  // Profiling: how many times each pair and each triple of opcodes ran
+  // in a row, indexed by the opcodes from the first one
+  long long* pairCounts;
+  long long* tripleCounts;
+  // Registers, as seen by the promotion hook
+  int pc;
+  int b;
+  int t;
+};
+
+int computeDepths(CodeBlock* codeBlock, int* depths);
+int computeFrames(CodeBlock* codeBlock);
+VM* createVM(CodeBlock* codeBlock, int stackSize);
+void freeVM(VM* vm);
+int fuseSuperinstructions(VM* vm);
+int runVM(VM* vm, int dispatch);
+void printProfile(VM* vm, FILE* out);
+char* vmOpCodeToString(int op);
+char* vmErrorToString(int status);
+
+#endif
@@ -0,0 +1,186 @@
+/* Instruction bodies of the KPL virtual machine
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ *
+ * Included once by each dispatcher in vm.c, which defines OP(op) as the
+ * entry point of an instruction and NEXT as the dispatch of the next one.
+ * Registers: pc points to the next instruction, inst to the current one,
+ * t is the top of the stack s and b the base of the current frame.
+ * ENTER(address) and BACK_EDGE(address) mark where control reaches a
+ * subprogram entry or, maybe, a loop header.
+ */
+
+OP(OP_LA)
+  s[++t] = display[inst->p] + inst->q;
+  NEXT;
+
+OP(VM_LA_LOCAL)
+  s[++t] = b + inst->q;
+  NEXT;
+
+OP(OP_LV)
+  s[t + 1] = s[display[inst->p] + inst->q];
+  t ++;
+  NEXT;
+
+OP(VM_LV_LOCAL)
+  s[t + 1] = s[b + inst->q];
+  t ++;
+  NEXT;
+
+OP(OP_LC)
+  s[++t] = inst->q;
+  NEXT;
+
+OP(OP_LI)
+  s[t] = s[s[t]];
+  NEXT;
+
+OP(OP_INT)
+  t += inst->q;
+  if (t >= limit) goto stackOverflow;
+  NEXT;
+
+OP(OP_DCT)
+  t -= inst->q;
+  NEXT;
+
+OP(OP_J)
+  pc = code + inst->q;
+  BACK_EDGE(inst->q);
+  NEXT;
+
+OP(OP_FJ)
+  if (s[t--] == 0)
+    pc = code + inst->q;
+  NEXT;
+
+OP(OP_HL)
+  goto halt;
+
+OP(OP_ST)
+  s[s[t - 1]] = s[t];
+  t -= 2;
+  NEXT;
+
+  // p is the depth of the callee; its slot in the display is saved in
+  // the static link word of the new frame
+OP(OP_CALL)
+  if (t >= limit) goto stackOverflow;
+  s[t + 1 + DYNAMIC_LINK_OFFSET] = b;
+  s[t + 1 + RETURN_ADDRESS_OFFSET] = pc - code;
+  s[t + 1 + STATIC_LINK_OFFSET] = display[inst->p];
+  b = t + 1;
+  display[inst->p] = b;
+  pc = code + inst->q;
+  ENTER(inst->q);
+  NEXT;
+
+OP(OP_EP)
+  display[inst->p] = s[b + STATIC_LINK_OFFSET];
+  t = b - 1;
+  pc = code + s[b + RETURN_ADDRESS_OFFSET];
+  b = s[b + DYNAMIC_LINK_OFFSET];
+  NEXT;
+
+OP(OP_EF)
+  display[inst->p] = s[b + STATIC_LINK_OFFSET];
+  t = b;
+  pc = code + s[b + RETURN_ADDRESS_OFFSET];
+  b = s[b + DYNAMIC_LINK_OFFSET];
+  NEXT;
+
+OP(OP_RC)
+  s[++t] = kplReadc();
+  NEXT;
+
+OP(OP_RI)
+  s[++t] = kplReadi();
+  NEXT;
+
+OP(OP_WRC)
+  kplWritec(s[t--]);
+  NEXT;
+
+OP(OP_WRI)
+  kplWritei(s[t--]);
+  NEXT;
+
+OP(OP_WLN)
+  kplWriteln();
+  NEXT;
+
+OP(OP_AD)
+  t --;
+  s[t] += s[t + 1];
+  NEXT;
+
+OP(OP_SB)
+  t --;
+  s[t] -= s[t + 1];
+  NEXT;
+
+OP(OP_ML)
+  t --;
+  s[t] *= s[t + 1];
+  NEXT;
+
+OP(OP_DV)
+  t --;
+  if (s[t + 1] == 0) goto divisionByZero;
+  s[t] = DIVIDE_WORDS(s[t], s[t + 1]);
+  NEXT;
+
+OP(OP_NEG)
+  s[t] = - s[t];
+  NEXT;
+
+OP(OP_CV)
+  s[t + 1] = s[t];
+  t ++;
+  NEXT;
+
+OP(OP_EQ)
+  t --;
+  s[t] = (s[t] == s[t + 1]);
+  NEXT;
+
+OP(OP_NE)
+  t --;
+  s[t] = (s[t] != s[t + 1]);
+  NEXT;
+
+OP(OP_GT)
+  t --;
+  s[t] = (s[t] > s[t + 1]);
+  NEXT;
+
+OP(OP_LT)
+  t --;
+  s[t] = (s[t] < s[t + 1]);
+  NEXT;
+
+OP(OP_GE)
+  t --;
+  s[t] = (s[t] >= s[t + 1]);
+  NEXT;
+
+OP(OP_LE)
+  t --;
+  s[t] = (s[t] <= s[t + 1]);
+  NEXT;
+
+OP(OP_CK)
+  if ((s[t] < 1) || (s[t] > inst->q)) goto indexOutOfRange;
+  NEXT;
+
+  // A whole array at once; an array assigned to itself is the one case
+  // where the two overlap
+OP(OP_CP)
+  memmove(s + s[t - 1], s + s[t], inst->q * sizeof(WORD));
+  t -= 2;
+  NEXT;
+
+OP(OP_BP)
+  NEXT;
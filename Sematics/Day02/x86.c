@@ -0,0 +1,777 @@
+/* x86-64 instruction emitter
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "x86.h"
+
+char* registers64[16] = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+char* registers32[16] = {
+  "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+
+char* registers8[16] = {
+  "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+char* conditionNames[16] = {
+  "o", "no", "b", "ae", "e", "ne", "be", "a",
+  "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+// Opcodes of ADD, SUB, CMP and the /digit of their immediate forms
+unsigned char aluOpcodes[3] = {0x03, 0x2B, 0x3B};
+int aluDigits[3] = {0, 5, 7};
+char* aluNames[4] = {"add", "sub", "cmp", "imul"};
+
+X86* createEmitter(int mode) {
+  X86* x = (X86*) malloc(sizeof(X86));
+
+  x->mode = mode;
+  x->file = NULL;
+  x->code = NULL;
+  x->size = 0;
+  x->maxSize = 0;
+  x->labels = NULL;
+  x->labelCount = 0;
+  x->maxLabels = 0;
+  x->fixups = NULL;
+  x->fixupCount = 0;
+  x->maxFixups = 0;
+  x->prefix = 0;
+  return x;
+}
+
+X86* createTextEmitter(FILE* file) {
+  X86* x = createEmitter(X86_TEXT);
+  x->file = file;
+  return x;
+}
+
+X86* createBinaryEmitter(void) {
+  X86* x = createEmitter(X86_BINARY);
+  x->maxSize = 256;
+  x->code = (unsigned char*) malloc(x->maxSize);
+  return x;
+}
+
+void freeEmitter(X86* x) {
+  free(x->code);
+  free(x->labels);
+  free(x->fixups);
+  free(x);
+}
+
+// Patches the jumps to labels; fails when a label was never bound
+int finishEmitter(X86* x) {
+  X86Fixup* fixup;
+  int i, rel;
+
+  if (x->mode == X86_TEXT) return 1;
+  for (i = 0; i < x->fixupCount; i ++) {
+    fixup = x->fixups + i;
+    if (x->labels[fixup->label] < 0) return 0;
+    rel = x->labels[fixup->label] - (fixup->position + 4);
+    memcpy(x->code + fixup->position, &rel, 4);
+  }
+  return 1;
+}
+
+X86Memory x86Mem(int base, int disp) {
+  return x86MemIndex(base, X_NONE, 1, disp);
+}
+
+X86Memory x86MemIndex(int base, int index, int scale, int disp) {
+  X86Memory mem;
+
+  mem.base = base;
+  mem.index = index;
+  mem.scale = scale;
+  mem.disp = disp;
+  return mem;
+}
+
+/******************* Encoding ******************************/
+
+void byte(X86* x, int b) {
+  if (x->size >= x->maxSize) {
+    x->maxSize *= 2;
+    x->code = (unsigned char*) realloc(x->code, x->maxSize);
+  }
+  x->code[x->size ++] = (unsigned char) b;
+}
+
+void dword(X86* x, int d) {
+  unsigned int u = (unsigned int) d;
+
+  byte(x, u & 0xFF);
+  byte(x, (u >> 8) & 0xFF);
+  byte(x, (u >> 16) & 0xFF);
+  byte(x, (u >> 24) & 0xFF);
+}
+
+void rex(X86* x, int w, int reg, int index, int base) {
+  int r = 0x40 | (w << 3);
+
+  if ((reg != X_NONE) && (reg & 8)) r |= 4;
+  if ((index != X_NONE) && (index & 8)) r |= 2;
+  if ((base != X_NONE) && (base & 8)) r |= 1;
+  if (r != 0x40) byte(x, r);
+}
+
+// ModRM, SIB and displacement of a memory operand
+void modrmMemory(X86* x, int reg, X86Memory mem) {
+  int mod, scale;
+  int needsSib = (mem.index != X_NONE) || ((mem.base & 7) == X_RSP);
+
+  if ((mem.disp == 0) && ((mem.base & 7) != X_RBP)) mod = 0;
+  else if ((mem.disp >= -128) && (mem.disp <= 127)) mod = 1;
+  else mod = 2;
+
+  byte(x, (mod << 6) | ((reg & 7) << 3) | (needsSib ? 4 : (mem.base & 7)));
+  if (needsSib) {
+    scale = (mem.scale == 8) ? 3 : (mem.scale == 4) ? 2 : (mem.scale == 2) ? 1 : 0;
+    byte(x, (scale << 6) | (((mem.index == X_NONE) ? 4 : mem.index) & 7) << 3 | (mem.base & 7));
+  }
+  if (mod == 1) byte(x, mem.disp);
+  else if (mod == 2) dword(x, mem.disp);
+}
+
+void modrmRegister(X86* x, int reg, int rm) {
+  byte(x, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// An instruction with a register and a memory operand
+void encodeRM(X86* x, int w, int opcode, int reg, X86Memory mem) {
+  rex(x, w, reg, mem.index, mem.base);
+  if (opcode > 0xFF) byte(x, opcode >> 8);
+  byte(x, opcode & 0xFF);
+  modrmMemory(x, reg, mem);
+}
+
+// An instruction with two register operands
+void encodeRR(X86* x, int w, int opcode, int reg, int rm) {
+  rex(x, w, reg, X_NONE, rm);
+  if (opcode > 0xFF) byte(x, opcode >> 8);
+  byte(x, opcode & 0xFF);
+  modrmRegister(x, reg, rm);
+}
+
+int fitsByte(int imm) {
+  return (imm >= -128) && (imm <= 127);
+}
+
+void fixup(X86* x, int label) {
+  if (x->fixupCount >= x->maxFixups) {
+    x->maxFixups = (x->maxFixups == 0) ? 64 : 2 * x->maxFixups;
+    x->fixups = (X86Fixup*) realloc(x->fixups, x->maxFixups * sizeof(X86Fixup));
+  }
+  x->fixups[x->fixupCount].position = x->size;
+  x->fixups[x->fixupCount].label = label;
+  x->fixupCount ++;
+  dword(x, 0);
+}
+
+/******************* Text ******************************/
+
+void printMemory(X86* x, X86Memory mem) {
+  if (mem.disp != 0) fprintf(x->file, "%d", mem.disp);
+  if (mem.index == X_NONE)
+    fprintf(x->file, "(%%%s)", registers64[mem.base]);
+  else fprintf(x->file, "(%%%s,%%%s,%d)", registers64[mem.base], registers64[mem.index], mem.scale);
+}
+
+void printLabel(X86* x, int label) {
+  fprintf(x->file, ".L%d_%d", x->prefix, label);
+}
+
+/******************* Instructions ******************************/
+
+int x86NewLabel(X86* x) {
+  if (x->labelCount >= x->maxLabels) {
+    x->maxLabels = (x->maxLabels == 0) ? 64 : 2 * x->maxLabels;
+    x->labels = (int*) realloc(x->labels, x->maxLabels * sizeof(int));
+  }
+  x->labels[x->labelCount] = -1;
+  return x->labelCount ++;
+}
+
+void x86Bind(X86* x, int label) {
+  if (x->mode == X86_TEXT) {
+    printLabel(x, label);
+    fprintf(x->file, ":\n");
+  } else x->labels[label] = x->size;
+}
+
+void x86Comment(X86* x, char* comment) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "# %s\n", comment);
+}
+
+// Names the current position in text
+void x86Symbol(X86* x, char* name, int global) {
+  if (x->mode != X86_TEXT) return;
+  if (global) {
+    fprintf(x->file, "\t.globl %s\n", name);
+    fprintf(x->file, "\t.type %s, @function\n", name);
+  }
+  fprintf(x->file, "%s:\n", name);
+}
+
+void x86MovRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovl ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers32[reg]);
+  } else encodeRM(x, 0, 0x8B, reg, mem);
+}
+
+void x86MovMR(X86* x, X86Memory mem, int reg) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovl %%%s, ", registers32[reg]);
+    printMemory(x, mem);
+    fprintf(x->file, "\n");
+  } else encodeRM(x, 0, 0x89, reg, mem);
+}
+
+void x86MovMI(X86* x, X86Memory mem, int imm) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovl $%d, ", imm);
+    printMemory(x, mem);
+    fprintf(x->file, "\n");
+  } else {
+    encodeRM(x, 0, 0xC7, 0, mem);
+    dword(x, imm);
+  }
+}
+
+void x86MovRI(X86* x, int reg, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovl $%d, %%%s\n", imm, registers32[reg]);
+  else {
+    rex(x, 0, X_NONE, X_NONE, reg);
+    byte(x, 0xB8 + (reg & 7));
+    dword(x, imm);
+  }
+}
+
+void x86MovRR(X86* x, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovl %%%s, %%%s\n", registers32[src], registers32[dst]);
+  else encodeRR(x, 0, 0x89, src, dst);
+}
+
+void x86MovqRR(X86* x, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovq %%%s, %%%s\n", registers64[src], registers64[dst]);
+  else encodeRR(x, 1, 0x89, src, dst);
+}
+
+void x86MovqRI(X86* x, int reg, long long imm) {
+  int i;
+
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovabsq $%lld, %%%s\n", imm, registers64[reg]);
+  else {
+    rex(x, 1, X_NONE, X_NONE, reg);
+    byte(x, 0xB8 + (reg & 7));
+    for (i = 0; i < 8; i ++)
+      byte(x, (int) ((((unsigned long long) imm) >> (8 * i)) & 0xFF));
+  }
+}
+
+void x86MovqRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovq ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers64[reg]);
+  } else encodeRM(x, 1, 0x8B, reg, mem);
+}
+
+void x86MovsxdRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovslq ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers64[reg]);
+  } else encodeRM(x, 1, 0x63, reg, mem);
+}
+
+void x86MovsxdRR(X86* x, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovslq %%%s, %%%s\n", registers32[src], registers64[dst]);
+  else encodeRR(x, 1, 0x63, dst, src);
+}
+
+void x86LeaqRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tleaq ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers64[reg]);
+  } else encodeRM(x, 1, 0x8D, reg, mem);
+}
+
+void x86LealRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tleal ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers32[reg]);
+  } else encodeRM(x, 0, 0x8D, reg, mem);
+}
+
+void x86AluRM(X86* x, enum X86Operation op, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%sl ", aluNames[op]);
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers32[reg]);
+  } else if (op == X86_IMUL)
+    encodeRM(x, 0, 0x0FAF, reg, mem);
+  else encodeRM(x, 0, aluOpcodes[op], reg, mem);
+}
+
+void x86AluRI(X86* x, enum X86Operation op, int reg, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\t%sl $%d, %%%s\n", aluNames[op], imm, registers32[reg]);
+  else if (op == X86_IMUL) {
+    encodeRR(x, 0, fitsByte(imm) ? 0x6B : 0x69, reg, reg);
+    if (fitsByte(imm)) byte(x, imm);
+    else dword(x, imm);
+  } else {
+    encodeRR(x, 0, fitsByte(imm) ? 0x83 : 0x81, aluDigits[op], reg);
+    if (fitsByte(imm)) byte(x, imm);
+    else dword(x, imm);
+  }
+}
+
+void x86AluRR(X86* x, enum X86Operation op, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\t%sl %%%s, %%%s\n", aluNames[op], registers32[src], registers32[dst]);
+  else if (op == X86_IMUL)
+    encodeRR(x, 0, 0x0FAF, dst, src);
+  else encodeRR(x, 0, aluOpcodes[op], dst, src);
+}
+
+void x86AluMI(X86* x, enum X86Operation op, X86Memory mem, int imm) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%sl $%d, ", aluNames[op], imm);
+    printMemory(x, mem);
+    fprintf(x->file, "\n");
+  } else {
+    encodeRM(x, 0, fitsByte(imm) ? 0x83 : 0x81, aluDigits[op], mem);
+    if (fitsByte(imm)) byte(x, imm);
+    else dword(x, imm);
+  }
+}
+
+void x86AluqRR(X86* x, enum X86Operation op, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\t%sq %%%s, %%%s\n", aluNames[op], registers64[src], registers64[dst]);
+  else encodeRR(x, 1, aluOpcodes[op], dst, src);
+}
+
+void x86AluqRI(X86* x, enum X86Operation op, int reg, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\t%sq $%d, %%%s\n", aluNames[op], imm, registers64[reg]);
+  else {
+    encodeRR(x, 1, fitsByte(imm) ? 0x83 : 0x81, aluDigits[op], reg);
+    if (fitsByte(imm)) byte(x, imm);
+    else dword(x, imm);
+  }
+}
+
+void x86SarqRI(X86* x, int reg, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tsarq $%d, %%%s\n", imm, registers64[reg]);
+  else {
+    encodeRR(x, 1, 0xC1, 7, reg);
+    byte(x, imm);
+  }
+}
+
+void x86Setcc(X86* x, enum X86Condition cc, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tset%s %%%s\n", conditionNames[cc], registers8[reg]);
+  else {
+    if (reg >= 4) byte(x, 0x40 | ((reg & 8) ? 1 : 0));
+    byte(x, 0x0F);
+    byte(x, 0x90 + cc);
+    modrmRegister(x, 0, reg);
+  }
+}
+
+void x86Movzbl(X86* x, int dst, int src) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tmovzbl %%%s, %%%s\n", registers8[src], registers32[dst]);
+  else {
+    if ((dst >= 8) || (src >= 4)) byte(x, 0x40 | ((dst & 8) ? 4 : 0) | ((src & 8) ? 1 : 0));
+    byte(x, 0x0F);
+    byte(x, 0xB6);
+    modrmRegister(x, dst, src);
+  }
+}
+
+void x86MovzblRM(X86* x, int reg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovzbl ");
+    printMemory(x, mem);
+    fprintf(x->file, ", %%%s\n", registers32[reg]);
+  } else encodeRM(x, 0, 0x0FB6, reg, mem);
+}
+
+void x86MovbMR(X86* x, X86Memory mem, int reg) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tmovb %%%s, ", registers8[reg]);
+    printMemory(x, mem);
+    fprintf(x->file, "\n");
+  } else {
+    // Without a REX prefix, 4 to 7 would be %ah, %ch, %dh and %bh
+    if ((reg >= 4) && (reg < 8) && !(mem.base & 8) && ((mem.index == X_NONE) || !(mem.index & 8)))
+      byte(x, 0x40);
+    encodeRM(x, 0, 0x88, reg, mem);
+  }
+}
+
+void x86Cltd(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tcltd\n");
+  else byte(x, 0x99);
+}
+
+void x86Idiv(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tidivl %%%s\n", registers32[reg]);
+  else encodeRR(x, 0, 0xF7, 7, reg);
+}
+
+void x86Div(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tdivl %%%s\n", registers32[reg]);
+  else encodeRR(x, 0, 0xF7, 6, reg);
+}
+
+void x86Neg(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tnegl %%%s\n", registers32[reg]);
+  else encodeRR(x, 0, 0xF7, 3, reg);
+}
+
+void x86Test(X86* x, int reg1, int reg2) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\ttestl %%%s, %%%s\n", registers32[reg2], registers32[reg1]);
+  else encodeRR(x, 0, 0x85, reg2, reg1);
+}
+
+void x86Jcc(X86* x, enum X86Condition cc, int label) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tj%s ", conditionNames[cc]);
+    printLabel(x, label);
+    fprintf(x->file, "\n");
+  } else {
+    byte(x, 0x0F);
+    byte(x, 0x80 + cc);
+    fixup(x, label);
+  }
+}
+
+void x86Jmp(X86* x, int label) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tjmp ");
+    printLabel(x, label);
+    fprintf(x->file, "\n");
+  } else {
+    byte(x, 0xE9);
+    fixup(x, label);
+  }
+}
+
+void x86CallLabel(X86* x, int label) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tcall ");
+    printLabel(x, label);
+    fprintf(x->file, "\n");
+  } else {
+    byte(x, 0xE8);
+    fixup(x, label);
+  }
+}
+
+// Calls a function of the runtime by name in text, by address in code
+void x86CallRegister(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tcall *%%%s\n", registers64[reg]);
+  else encodeRR(x, 0, 0xFF, 2, reg);
+}
+
+void x86CallAbsolute(X86* x, char* name, void* address) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tcall %s\n", name);
+  else {
+    x86MovqRI(x, X_RAX, (long long) address);
+    x86CallRegister(x, X_RAX);
+  }
+}
+
+/* A call whose target is only known once all code is placed. Returns the
+   position of the 64-bit address to patch in the code. */
+int x86CallPatchable(X86* x, char* name) {
+  int position;
+
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\tcall %s\n", name);
+    return -1;
+  }
+  x86MovqRI(x, X_RAX, 0);
+  position = x->size - 8;
+  encodeRR(x, 0, 0xFF, 2, X_RAX);
+  return position;
+}
+
+void x86PatchAbsolute(unsigned char* code, int position, void* address) {
+  long long a = (long long) address;
+  memcpy(code + position, &a, 8);
+}
+
+void x86Push(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tpushq %%%s\n", registers64[reg]);
+  else {
+    rex(x, 0, X_NONE, X_NONE, reg);
+    byte(x, 0x50 + (reg & 7));
+  }
+}
+
+void x86Pop(X86* x, int reg) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tpopq %%%s\n", registers64[reg]);
+  else {
+    rex(x, 0, X_NONE, X_NONE, reg);
+    byte(x, 0x58 + (reg & 7));
+  }
+}
+
+void x86Ret(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tret\n");
+  else byte(x, 0xC3);
+}
+
+// %rcx bytes from (%rsi) to (%rdi)
+void x86RepMovsb(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\trep movsb\n");
+  else {
+    byte(x, 0xF3);
+    byte(x, 0xA4);
+  }
+}
+
+void x86Syscall(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tsyscall\n");
+  else {
+    byte(x, 0x0F);
+    byte(x, 0x05);
+  }
+}
+
+// Bytes placed among the instructions
+void x86Data(X86* x, char* data, int size) {
+  int i;
+
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t.byte ");
+    for (i = 0; i < size; i ++)
+      fprintf(x->file, "%s%d", (i > 0) ? ", " : "", (unsigned char) data[i]);
+    fprintf(x->file, "\n");
+  } else
+    for (i = 0; i < size; i ++)
+      byte(x, data[i]);
+}
+
+void x86Cpuid(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tcpuid\n");
+  else {
+    byte(x, 0x0F);
+    byte(x, 0xA2);
+  }
+}
+
+// %edx:%eax := the extended control register %ecx
+void x86Xgetbv(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\txgetbv\n");
+  else {
+    byte(x, 0x0F);
+    byte(x, 0x01);
+    byte(x, 0xD0);
+  }
+}
+
+// The carry flag := the given bit of reg
+void x86BtRI(X86* x, int reg, int bit) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tbtl $%d, %%%s\n", bit, registers32[reg]);
+  else {
+    encodeRR(x, 0, 0x0FBA, 4, reg);
+    byte(x, bit);
+  }
+}
+
+/******************* Vector instructions ******************************/
+
+char* vectorNames[6] = {"paddd", "psubd", "pmulld", "pmuludq", "punpckldq", "pxor"};
+// Opcodes in the 0F map, but for PMULLD, which is in 0F38
+unsigned char vectorOpcodes[6] = {0xFE, 0xFA, 0x40, 0xF4, 0x62, 0xEF};
+
+void printVector(X86* x, int wide, int vreg) {
+  fprintf(x->file, "%%%cmm%d", wide ? 'y' : 'x', vreg);
+}
+
+/* The three byte VEX prefix, for the map 0F (1) or 0F38 (2) and the
+   implied prefix 66 (1) or F3 (2), with the second source in vvvv. */
+void vex(X86* x, int reg, int index, int base, int map, int vvvv, int wide, int pp) {
+  int b1 = map;
+
+  if ((reg == X_NONE) || !(reg & 8)) b1 |= 0x80;
+  if ((index == X_NONE) || !(index & 8)) b1 |= 0x40;
+  if ((base == X_NONE) || !(base & 8)) b1 |= 0x20;
+  byte(x, 0xC4);
+  byte(x, b1);
+  byte(x, ((~vvvv & 15) << 3) | (wide ? 4 : 0) | pp);
+}
+
+// movdqu, unaligned
+void x86VecLoad(X86* x, int wide, int vreg, X86Memory mem) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%s ", wide ? "vmovdqu" : "movdqu");
+    printMemory(x, mem);
+    fprintf(x->file, ", ");
+    printVector(x, wide, vreg);
+    fprintf(x->file, "\n");
+  } else if (wide) {
+    vex(x, vreg, mem.index, mem.base, 1, 0, 1, 2);
+    byte(x, 0x6F);
+    modrmMemory(x, vreg, mem);
+  } else {
+    byte(x, 0xF3);
+    encodeRM(x, 0, 0x0F6F, vreg, mem);
+  }
+}
+
+void x86VecStore(X86* x, int wide, X86Memory mem, int vreg) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%s ", wide ? "vmovdqu" : "movdqu");
+    printVector(x, wide, vreg);
+    fprintf(x->file, ", ");
+    printMemory(x, mem);
+    fprintf(x->file, "\n");
+  } else if (wide) {
+    vex(x, vreg, mem.index, mem.base, 1, 0, 1, 2);
+    byte(x, 0x7F);
+    modrmMemory(x, vreg, mem);
+  } else {
+    byte(x, 0xF3);
+    encodeRM(x, 0, 0x0F7F, vreg, mem);
+  }
+}
+
+void x86VecMov(X86* x, int wide, int dst, int src) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%s ", wide ? "vmovdqa" : "movdqa");
+    printVector(x, wide, src);
+    fprintf(x->file, ", ");
+    printVector(x, wide, dst);
+    fprintf(x->file, "\n");
+  } else if (wide) {
+    vex(x, dst, X_NONE, src, 1, 0, 1, 1);
+    byte(x, 0x6F);
+    modrmRegister(x, dst, src);
+  } else {
+    byte(x, 0x66);
+    encodeRR(x, 0, 0x0F6F, dst, src);
+  }
+}
+
+// Every lane of vreg := the 32-bit reg
+void x86VecBroadcast(X86* x, int wide, int vreg, int reg) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%s %%%s, %%xmm%d\n", wide ? "vmovd" : "movd", registers32[reg], vreg);
+    if (wide)
+      fprintf(x->file, "\tvpbroadcastd %%xmm%d, %%ymm%d\n", vreg, vreg);
+    else fprintf(x->file, "\tpshufd $0, %%xmm%d, %%xmm%d\n", vreg, vreg);
+  } else if (wide) {
+    vex(x, vreg, X_NONE, reg, 1, 0, 0, 1);
+    byte(x, 0x6E);
+    modrmRegister(x, vreg, reg);
+    vex(x, vreg, X_NONE, vreg, 2, 0, 1, 1);
+    byte(x, 0x58);
+    modrmRegister(x, vreg, vreg);
+  } else {
+    byte(x, 0x66);
+    encodeRR(x, 0, 0x0F6E, vreg, reg);
+    x86Pshufd(x, vreg, vreg, 0);
+  }
+}
+
+void x86VecOp(X86* x, int wide, enum X86VectorOperation op, int dst, int src1, int src2) {
+  if (x->mode == X86_TEXT) {
+    fprintf(x->file, "\t%s%s ", wide ? "v" : "", vectorNames[op]);
+    printVector(x, wide, src2);
+    fprintf(x->file, ", ");
+    if (wide) {
+      printVector(x, wide, src1);
+      fprintf(x->file, ", ");
+    }
+    printVector(x, wide, dst);
+    fprintf(x->file, "\n");
+  } else if (wide) {
+    vex(x, dst, X_NONE, src2, (op == X86_PMULLD) ? 2 : 1, src1, 1, 1);
+    byte(x, vectorOpcodes[op]);
+    modrmRegister(x, dst, src2);
+  } else {
+    byte(x, 0x66);
+    encodeRR(x, 0, 0x0F00 | vectorOpcodes[op], dst, src2);
+  }
+}
+
+void x86Pshufd(X86* x, int dst, int src, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tpshufd $%d, %%xmm%d, %%xmm%d\n", imm, src, dst);
+  else {
+    byte(x, 0x66);
+    encodeRR(x, 0, 0x0F70, dst, src);
+    byte(x, imm);
+  }
+}
+
+// Shifts both 64-bit halves of vreg right
+void x86Psrlq(X86* x, int vreg, int imm) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tpsrlq $%d, %%xmm%d\n", imm, vreg);
+  else {
+    byte(x, 0x66);
+    encodeRR(x, 0, 0x0F73, 2, vreg);
+    byte(x, imm);
+  }
+}
+
+// Clears the upper halves of the %ymm registers, before SSE code runs again
+void x86Vzeroupper(X86* x) {
+  if (x->mode == X86_TEXT)
+    fprintf(x->file, "\tvzeroupper\n");
+  else {
+    byte(x, 0xC5);
+    byte(x, 0xF8);
+    byte(x, 0x77);
+  }
+}
@@ -0,0 +1,168 @@
+/* x86-64 instruction emitter
+ * @copyright (c) 2008, Hedspi, Hanoi University of Technology
+ * @author Huu-Duc Nguyen
+ * @version 1.0
+ */
+
+#ifndef __X86_H__
+#define __X86_H__
+
+#include <stdio.h>
+
+/* Instructions are either written as GNU assembly text or encoded into a
+   buffer of machine code. Jumps go to labels, which are resolved when the
+   buffer is finished. */
+
+#define X86_TEXT 0
+#define X86_BINARY 1
+
+enum X86Register {
+  X_RAX, X_RCX, X_RDX, X_RBX, X_RSP, X_RBP, X_RSI, X_RDI,
+  X_R8, X_R9, X_R10, X_R11, X_R12, X_R13, X_R14, X_R15
+};
+
+#define X_NONE -1
+
+// Condition codes, as encoded in Jcc and SETcc
+enum X86Condition {
+  CC_B = 0x2,
+  CC_AE = 0x3,
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_BE = 0x6,
+  CC_A = 0x7,
+  CC_L = 0xC,
+  CC_GE = 0xD,
+  CC_LE = 0xE,
+  CC_G = 0xF
+};
+
+enum X86Operation {
+  X86_ADD,
+  X86_SUB,
+  X86_CMP,
+  X86_IMUL
+};
+
+// Operations on the 32-bit lanes of %xmm or %ymm registers
+enum X86VectorOperation {
+  X86_PADDD,
+  X86_PSUBD,
+  X86_PMULLD,     // with AVX2 only
+  X86_PMULUDQ,
+  X86_PUNPCKLDQ,
+  X86_PXOR
+};
+
+// base + index * scale + disp
+struct X86Memory_ {
+  int base;
+  int index;
+  int scale;
+  int disp;
+};
+
+typedef struct X86Memory_ X86Memory;
+
+struct X86Fixup_ {
+  int position;  // the rel32 to patch
+  int label;
+};
+
+typedef struct X86Fixup_ X86Fixup;
+
+struct X86_ {
+  int mode;
+  FILE* file;
+  unsigned char* code;
+  int size;
+  int maxSize;
+  // Position of each label, or -1 before it is bound
+  int* labels;
+  int labelCount;
+  int maxLabels;
+  X86Fixup* fixups;
+  int fixupCount;
+  int maxFixups;
+  // Labels are named .L<prefix>_<label> in text
+  int prefix;
+};
+
+typedef struct X86_ X86;
+
+X86* createTextEmitter(FILE* file);
+X86* createBinaryEmitter(void);
+void freeEmitter(X86* x);
+int finishEmitter(X86* x);
+
+X86Memory x86Mem(int base, int disp);
+X86Memory x86MemIndex(int base, int index, int scale, int disp);
+
+int x86NewLabel(X86* x);
+void x86Bind(X86* x, int label);
+void x86Comment(X86* x, char* comment);
+void x86Symbol(X86* x, char* name, int global);
+
+void x86MovRM(X86* x, int reg, X86Memory mem);
+void x86MovMR(X86* x, X86Memory mem, int reg);
+void x86MovMI(X86* x, X86Memory mem, int imm);
+void x86MovRI(X86* x, int reg, int imm);
+void x86MovRR(X86* x, int dst, int src);
+void x86MovqRR(X86* x, int dst, int src);
+void x86MovqRI(X86* x, int reg, long long imm);
+void x86MovqRM(X86* x, int reg, X86Memory mem);
+void x86MovsxdRM(X86* x, int reg, X86Memory mem);
+void x86MovsxdRR(X86* x, int dst, int src);
+void x86LeaqRM(X86* x, int reg, X86Memory mem);
+void x86LealRM(X86* x, int reg, X86Memory mem);
+
+void x86AluRM(X86* x, enum X86Operation op, int reg, X86Memory mem);
+void x86AluRI(X86* x, enum X86Operation op, int reg, int imm);
+void x86AluRR(X86* x, enum X86Operation op, int dst, int src);
+void x86AluMI(X86* x, enum X86Operation op, X86Memory mem, int imm);
+void x86AluqRR(X86* x, enum X86Operation op, int dst, int src);
+void x86AluqRI(X86* x, enum X86Operation op, int reg, int imm);
+void x86SarqRI(X86* x, int reg, int imm);
+
+void x86Setcc(X86* x, enum X86Condition cc, int reg);
+void x86Movzbl(X86* x, int dst, int src);
+void x86MovzblRM(X86* x, int reg, X86Memory mem);
+void x86MovbMR(X86* x, X86Memory mem, int reg);
+void x86Cltd(X86* x);
+void x86Idiv(X86* x, int reg);
+void x86Div(X86* x, int reg);
+void x86Neg(X86* x, int reg);
+void x86Test(X86* x, int reg1, int reg2);
+
+void x86Jcc(X86* x, enum X86Condition cc, int label);
+void x86Jmp(X86* x, int label);
+void x86CallLabel(X86* x, int label);
+void x86CallRegister(X86* x, int reg);
+void x86CallAbsolute(X86* x, char* name, void* address);
+int x86CallPatchable(X86* x, char* name);
+void x86Push(X86* x, int reg);
+void x86Pop(X86* x, int reg);
+void x86Ret(X86* x);
+void x86RepMovsb(X86* x);
+void x86Syscall(X86* x);
+void x86Data(X86* x, char* data, int size);
+
+void x86Cpuid(X86* x);
+void x86Xgetbv(X86* x);
+void x86BtRI(X86* x, int reg, int bit);
+
+/* Vector instructions take wide = 0 for the SSE2 forms on %xmm, which
+   change their first operand, and wide = 1 for the AVX2 forms on %ymm,
+   which write dst from src1 and src2. */
+void x86VecLoad(X86* x, int wide, int vreg, X86Memory mem);
+void x86VecStore(X86* x, int wide, X86Memory mem, int vreg);
+void x86VecMov(X86* x, int wide, int dst, int src);
+void x86VecBroadcast(X86* x, int wide, int vreg, int reg);
+void x86VecOp(X86* x, int wide, enum X86VectorOperation op, int dst, int src1, int src2);
+void x86Pshufd(X86* x, int dst, int src, int imm);
+void x86Psrlq(X86* x, int vreg, int imm);
+void x86Vzeroupper(X86* x);
+
+void x86PatchAbsolute(unsigned char* code, int position, void* address);
+
+#endif